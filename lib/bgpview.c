@@ -25,7 +25,9 @@
  */
 
 #include <assert.h>
+#include <pthread.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "config.h"
 
@@ -41,6 +43,7 @@
 
 #include "bgpstream_utils_pfx.h"
 #include "bgpview.h"
+#include "bgpview_slab.h"
 
 /** Information about a prefix as seen from a peer */
 typedef struct bwv_pfx_peerinfo {
@@ -81,14 +84,49 @@ KHASH_INIT(bwv_peerid_pfx_peerinfo_ext, uint16_t, bwv_pfx_peerinfo_ext_t, 1,
 	   kh_int_hash_func, kh_int_hash_equal)
 typedef khash_t(bwv_peerid_pfx_peerinfo_ext) bwv_peerid_pfx_peerinfo_ext_t;
 
+/** Sorted array of pfx-peer cells
+ *
+ * Used in place of the per-prefix peer hash when the view uses the
+ * BGPVIEW_CELL_LAYOUT_SORTED layout. A single allocation holds this header,
+ * followed by `alloc` peer IDs (sorted, only the first `cnt` are in use),
+ * followed by `alloc` peerinfo records (either bwv_pfx_peerinfo_t or
+ * bwv_pfx_peerinfo_ext_t depending on view->disable_extended).
+ */
+typedef struct bwv_pfx_peer_vec {
+
+  /** Number of cells in use */
+  uint16_t cnt;
+
+  /** Number of cells allocated */
+  uint16_t alloc;
+
+} bwv_pfx_peer_vec_t;
+
+/** Initial number of cells allocated for a sorted cell array */
+#define BWV_PFX_PEER_VEC_INIT_SIZE 4
+
+/** Number of size classes of sorted cell arrays. Each class doubles the
+    number of cells of the previous one (capped at UINT16_MAX) */
+#define BWV_PFX_PEER_VEC_CLASS_CNT 15
+
+/** Minimum size (in bytes) of the slabs used to allocate prefix info
+    structures and sorted cell arrays */
+#define BWV_SLAB_SIZE (256 * 1024)
+
 #define BWV_PFX_PEERINFO_SIZE(view)                                            \
   (((view)->disable_extended) ? sizeof(bwv_pfx_peerinfo_t)                     \
                               : sizeof(bwv_pfx_peerinfo_ext_t))
 
-#define BWV_PFX_GET_PEER_PTR(view, pfxinfo, k)                                 \
-  (((view)->disable_extended)                                                  \
-     ? &BWV_PFX_GET_PEER(pfxinfo, k)                                           \
-     : (bwv_pfx_peerinfo_t *)&BWV_PFX_GET_PEER_EXT(pfxinfo, k))
+#define BWV_VEC_IDS(vec) ((bgpstream_peer_id_t *)((vec) + 1))
+
+#define BWV_VEC_REC(view, vec, i)                                              \
+  ((bwv_pfx_peerinfo_t *)((uint8_t *)(BWV_VEC_IDS(vec) + (vec)->alloc) +       \
+                          ((i) * BWV_PFX_PEERINFO_SIZE(view))))
+
+#define BWV_PFX_GET_PEER_PTR(view, pfxinfo, k) (bwv_cell_ptr(view, pfxinfo, k))
+
+#define BWV_PFX_GET_PEER_EXT_PTR(view, pfxinfo, k)                             \
+  ((bwv_pfx_peerinfo_ext_t *)BWV_PFX_GET_PEER_PTR(view, pfxinfo, k))
 
 #define BWV_PFX_GET_PEER(pfxinfo, k)                                           \
   kh_val(pfxinfo->peers_min, k)
@@ -110,12 +148,14 @@ typedef struct bwv_peerid_pfxinfo {
   /** Table of peers
    *
    * must select either peers_min or peers_ext
-   * depending on view->disable_extended
+   * depending on view->disable_extended, or peers_vec if
+   * view->cell_layout is BGPVIEW_CELL_LAYOUT_SORTED
    */
   union {
     void *peers_generic;
     bwv_peerid_pfx_peerinfo_t *peers_min;
     bwv_peerid_pfx_peerinfo_ext_t *peers_ext;
+    bwv_pfx_peer_vec_t *peers_vec;
   };
 
   /** The number of peers in the peers list that currently observe this
@@ -131,8 +171,134 @@ typedef struct bwv_peerid_pfxinfo {
   /** Generic pointer to store per-pfx information on consumers */
   void *user;
 
+  /** Snapshot generation in which this prefix was created or last preserved
+   *  (see snapshot_preserve_pfx) */
+  uint32_t gen;
+
+  /** Is this prefix in the GC dirty list? */
+  uint8_t gc_dirty;
+
+  /** Is this prefix in the change journal? */
+  uint8_t journal_dirty;
+
 } __attribute__((packed)) bwv_peerid_pfxinfo_t;
 
+/************ cell access ************/
+
+/** Cell layout and pfx-peer record type of a view, combined so that cell
+    accesses only need to dispatch on a single value (see view->cell_kind) */
+typedef enum {
+
+  /** Per-prefix hash of bwv_pfx_peerinfo_ext_t */
+  BWV_CELLS_TAB_EXT = 0,
+
+  /** Per-prefix hash of bwv_pfx_peerinfo_t */
+  BWV_CELLS_TAB_MIN = 1,
+
+  /** Sorted cell array of bwv_pfx_peerinfo_ext_t */
+  BWV_CELLS_VEC_EXT = 2,
+
+  /** Sorted cell array of bwv_pfx_peerinfo_t */
+  BWV_CELLS_VEC_MIN = 3,
+
+} bwv_cell_kind_t;
+
+/* Generate the cell accessors of a cell kind that uses a per-prefix hash.
+   Each kind gets its own copy of the accessors (and of everything built on
+   top of them, see BWV_CELLS_ITER_INIT), so that the code that walks the
+   cells of a prefix only tests the kind once, not for every cell. */
+#define BWV_CELLS_TAB_INIT(kind, tabtype, field)                               \
+  static inline bwv_pfx_peerinfo_t *cell_ptr_##kind(bwv_peerid_pfxinfo_t *v,   \
+                                                    khiter_t k)                \
+  {                                                                            \
+    return (bwv_pfx_peerinfo_t *)&kh_val(v->field, k);                         \
+  }                                                                            \
+  static inline khiter_t cells_end_##kind(bwv_peerid_pfxinfo_t *v)             \
+  {                                                                            \
+    return kh_end(v->field);                                                   \
+  }                                                                            \
+  static inline int cell_exists_##kind(bwv_peerid_pfxinfo_t *v, khiter_t k)    \
+  {                                                                            \
+    return kh_exist(v->field, k);                                              \
+  }                                                                            \
+  static inline bgpstream_peer_id_t cell_peer_##kind(bwv_peerid_pfxinfo_t *v,  \
+                                                     khiter_t k)               \
+  {                                                                            \
+    return kh_key(v->field, k);                                                \
+  }                                                                            \
+  static inline khiter_t cell_get_##kind(bwv_peerid_pfxinfo_t *v,              \
+                                         bgpstream_peer_id_t peerid)           \
+  {                                                                            \
+    return kh_get(tabtype, v->field, peerid);                                  \
+  }
+
+/* Generate the cell accessors of a cell kind that uses sorted cell arrays.
+   The record size is a constant here, unlike in BWV_VEC_REC. */
+#define BWV_CELLS_VEC_INIT(kind, rec_t)                                        \
+  static inline bwv_pfx_peerinfo_t *cell_ptr_##kind(bwv_peerid_pfxinfo_t *v,   \
+                                                    khiter_t k)                \
+  {                                                                            \
+    return (bwv_pfx_peerinfo_t *)((rec_t *)(BWV_VEC_IDS(v->peers_vec) +        \
+                                            v->peers_vec->alloc) +             \
+                                  k);                                          \
+  }                                                                            \
+  static inline khiter_t cells_end_##kind(bwv_peerid_pfxinfo_t *v)             \
+  {                                                                            \
+    return v->peers_vec->cnt;                                                  \
+  }                                                                            \
+  static inline int cell_exists_##kind(bwv_peerid_pfxinfo_t *v, khiter_t k)    \
+  {                                                                            \
+    return 1;                                                                  \
+  }                                                                            \
+  static inline bgpstream_peer_id_t cell_peer_##kind(bwv_peerid_pfxinfo_t *v,  \
+                                                     khiter_t k)               \
+  {                                                                            \
+    return BWV_VEC_IDS(v->peers_vec)[k];                                       \
+  }                                                                            \
+  static inline khiter_t cell_get_##kind(bwv_peerid_pfxinfo_t *v,              \
+                                         bgpstream_peer_id_t peerid)           \
+  {                                                                            \
+    return pfx_peer_vec_get(v->peers_vec, peerid);                             \
+  }
+
+/* call the fn_<kind> variant of a function for the cell kind of the view */
+#define BWV_CELLS_DISPATCH(view, fn, ...)                                      \
+  do {                                                                         \
+    switch ((bwv_cell_kind_t)(view)->cell_kind) {                              \
+    case BWV_CELLS_TAB_EXT:                                                    \
+      fn##_tab_ext(__VA_ARGS__);                                               \
+      break;                                                                   \
+    case BWV_CELLS_TAB_MIN:                                                    \
+      fn##_tab_min(__VA_ARGS__);                                               \
+      break;                                                                   \
+    case BWV_CELLS_VEC_EXT:                                                    \
+      fn##_vec_ext(__VA_ARGS__);                                               \
+      break;                                                                   \
+    case BWV_CELLS_VEC_MIN:                                                    \
+      fn##_vec_min(__VA_ARGS__);                                               \
+      break;                                                                   \
+    }                                                                          \
+  } while (0)
+
+/* same as BWV_CELLS_DISPATCH, but store the return value in ret */
+#define BWV_CELLS_DISPATCH_RET(view, ret, fn, ...)                             \
+  do {                                                                         \
+    switch ((bwv_cell_kind_t)(view)->cell_kind) {                              \
+    case BWV_CELLS_TAB_EXT:                                                    \
+      ret = fn##_tab_ext(__VA_ARGS__);                                         \
+      break;                                                                   \
+    case BWV_CELLS_TAB_MIN:                                                    \
+      ret = fn##_tab_min(__VA_ARGS__);                                         \
+      break;                                                                   \
+    case BWV_CELLS_VEC_EXT:                                                    \
+      ret = fn##_vec_ext(__VA_ARGS__);                                         \
+      break;                                                                   \
+    case BWV_CELLS_VEC_MIN:                                                    \
+      ret = fn##_vec_min(__VA_ARGS__);                                         \
+      break;                                                                   \
+    }                                                                          \
+  } while (0)
+
 /** @todo: add documentation ? */
 
 /************ map from prefix -> peers [-> prefix info] ************/
@@ -147,6 +313,16 @@ KHASH_INIT(bwv_v6pfx_peerid_pfxinfo, bgpstream_ipv6_pfx_t,
            bgpstream_ipv6_pfx_equal_val)
 typedef khash_t(bwv_v6pfx_peerid_pfxinfo) bwv_v6pfx_peerid_pfxinfo_t;
 
+/***** set of prefixes (per-peer prefix index) *****/
+
+KHASH_INIT(bwv_v4pfx_set, bgpstream_ipv4_pfx_t, char, 0,
+           bgpstream_ipv4_pfx_hash_val, bgpstream_ipv4_pfx_equal_val)
+typedef khash_t(bwv_v4pfx_set) bwv_v4pfx_set_t;
+
+KHASH_INIT(bwv_v6pfx_set, bgpstream_ipv6_pfx_t, char, 0,
+           bgpstream_ipv6_pfx_hash_val, bgpstream_ipv6_pfx_equal_val)
+typedef khash_t(bwv_v6pfx_set) bwv_v6pfx_set_t;
+
 /***** map from peerid to peerinfo *****/
 
 /** Additional per-peer info */
@@ -164,10 +340,258 @@ typedef struct bwv_peerinfo {
   /** Generic pointer to store information related to the peer */
   void *user;
 
+  /** v4 prefixes that this peer has a (valid) pfx-peer for (only if
+      view->peer_pfx_index is set) */
+  bwv_v4pfx_set_t *v4pfxs_idx;
+
+  /** v6 prefixes that this peer has a (valid) pfx-peer for (only if
+      view->peer_pfx_index is set) */
+  bwv_v6pfx_set_t *v6pfxs_idx;
+
+  /** Position of the peer in the ids list of the peer table (only
+      meaningful if the peer is in the table, see bwv_peer_table_t) */
+  uint32_t ids_pos;
+
 } bwv_peerinfo_t;
 
-KHASH_INIT(bwv_peerid_peerinfo, bgpstream_peer_id_t, bwv_peerinfo_t, 1,
-           kh_int_hash_func, kh_int_hash_equal)
+/** Table of peer info, indexed directly by peer ID
+ *
+ * Peer IDs are assigned densely by the peer signature map, so the peer info
+ * is stored in an array indexed by peer ID, and the IDs of the peers in the
+ * table are kept in a separate list, used for iteration. A peer is in the
+ * table iff infos[id].ids_pos < cnt and ids[infos[id].ids_pos] == id, so
+ * entries never need to be cleared.
+ */
+typedef struct bwv_peer_table {
+
+  /** Peer info, indexed by peer ID */
+  bwv_peerinfo_t *infos;
+
+  /** Number of entries allocated in infos */
+  uint32_t infos_alloc_cnt;
+
+  /** IDs of the peers in the table (in no particular order) */
+  bgpstream_peer_id_t *ids;
+
+  /** Number of peers in the table */
+  uint32_t cnt;
+
+  /** Number of IDs allocated in ids */
+  uint32_t ids_alloc_cnt;
+
+} bwv_peer_table_t;
+
+/** Value of a peer iterator that does not point at a peer */
+#define BWV_PEER_IT_END ((khiter_t)UINT32_MAX)
+
+/** Get the peer info of the given peer (which must be in the table) */
+#define BWV_PEER_INFO(view, peerid) ((view)->peerinfo.infos[(peerid)])
+
+static inline int peertab_exists(bwv_peer_table_t *t,
+                                 bgpstream_peer_id_t peerid)
+{
+  return peerid < t->infos_alloc_cnt && t->infos[peerid].ids_pos < t->cnt &&
+         t->ids[t->infos[peerid].ids_pos] == peerid;
+}
+
+/* returns the peer ID (i.e., the iterator value) if the peer is in the
+   table, BWV_PEER_IT_END otherwise */
+static inline khiter_t peertab_get(bwv_peer_table_t *t,
+                                   bgpstream_peer_id_t peerid)
+{
+  return peertab_exists(t, peerid) ? peerid : BWV_PEER_IT_END;
+}
+
+/* add a peer to the table, with zeroed peer info. returns -1 if memory could
+   not be allocated */
+static int peertab_put(bwv_peer_table_t *t, bgpstream_peer_id_t peerid)
+{
+  bwv_peerinfo_t *infos;
+  bgpstream_peer_id_t *ids;
+  uint32_t alloc_cnt;
+
+  assert(!peertab_exists(t, peerid));
+
+  if (peerid >= t->infos_alloc_cnt) {
+    alloc_cnt = (t->infos_alloc_cnt == 0) ? 64 : t->infos_alloc_cnt;
+    while (alloc_cnt <= peerid) {
+      alloc_cnt *= 2;
+    }
+    if ((infos = realloc(t->infos, sizeof(bwv_peerinfo_t) * alloc_cnt)) ==
+        NULL) {
+      return -1;
+    }
+    memset(&infos[t->infos_alloc_cnt], 0,
+           sizeof(bwv_peerinfo_t) * (alloc_cnt - t->infos_alloc_cnt));
+    t->infos = infos;
+    t->infos_alloc_cnt = alloc_cnt;
+  }
+
+  if (t->cnt == t->ids_alloc_cnt) {
+    alloc_cnt = (t->ids_alloc_cnt == 0) ? 64 : t->ids_alloc_cnt * 2;
+    if ((ids = realloc(t->ids, sizeof(bgpstream_peer_id_t) * alloc_cnt)) ==
+        NULL) {
+      return -1;
+    }
+    t->ids = ids;
+    t->ids_alloc_cnt = alloc_cnt;
+  }
+
+  memset(&t->infos[peerid], 0, sizeof(bwv_peerinfo_t));
+  t->infos[peerid].ids_pos = t->cnt;
+  t->ids[t->cnt++] = peerid;
+  return 0;
+}
+
+/* remove a peer from the table. the last peer of the ids list takes its
+   place, so when deleting while walking the list, walk it backwards */
+static void peertab_del(bwv_peer_table_t *t, bgpstream_peer_id_t peerid)
+{
+  uint32_t pos = t->infos[peerid].ids_pos;
+  bgpstream_peer_id_t last = t->ids[--t->cnt];
+
+  t->ids[pos] = last;
+  t->infos[last].ids_pos = pos;
+}
+
+/* make dst a copy of src, reusing the memory of dst */
+static int peertab_copy(bwv_peer_table_t *dst, bwv_peer_table_t *src)
+{
+  bwv_peerinfo_t *infos;
+  bgpstream_peer_id_t *ids;
+
+  if (dst->infos_alloc_cnt < src->infos_alloc_cnt) {
+    if ((infos = realloc(dst->infos, sizeof(bwv_peerinfo_t) *
+                                       src->infos_alloc_cnt)) == NULL) {
+      return -1;
+    }
+    dst->infos = infos;
+    dst->infos_alloc_cnt = src->infos_alloc_cnt;
+  }
+  if (dst->ids_alloc_cnt < src->cnt) {
+    if ((ids = realloc(dst->ids, sizeof(bgpstream_peer_id_t) *
+                                   src->ids_alloc_cnt)) == NULL) {
+      return -1;
+    }
+    dst->ids = ids;
+    dst->ids_alloc_cnt = src->ids_alloc_cnt;
+  }
+
+  /* entries of dst past the end of src are stale, but they are not in the
+     ids list */
+  if (src->infos_alloc_cnt > 0) {
+    memcpy(dst->infos, src->infos,
+           sizeof(bwv_peerinfo_t) * src->infos_alloc_cnt);
+  }
+  if (src->cnt > 0) {
+    memcpy(dst->ids, src->ids, sizeof(bgpstream_peer_id_t) * src->cnt);
+  }
+  dst->cnt = src->cnt;
+  return 0;
+}
+
+static void peertab_destroy(bwv_peer_table_t *t)
+{
+  free(t->infos);
+  free(t->ids);
+  memset(t, 0, sizeof(bwv_peer_table_t));
+}
+
+/************ concurrent writers ************/
+
+/** Locks used when several threads write to the same view (see
+    bgpview_enable_concurrent_writers) */
+typedef struct bwv_writers {
+
+  /** Guards the structure of the prefix and peer tables. Held shared while a
+      prefix row is updated, and exclusively while keys are inserted (which
+      may resize a table) or while a peer is changed */
+  pthread_rwlock_t tables;
+
+  /** One lock per prefix shard, held while a prefix row is updated */
+  pthread_mutex_t *shards;
+
+  /** Number of prefix shards */
+  int shards_cnt;
+
+  /** Guards the allocators and the other view-wide structures that are
+      touched by prefix row updates (snapshots, gc list, per-peer index) */
+  pthread_mutex_t misc;
+
+  /** Guards the AS Path Store */
+  pthread_mutex_t pathstore;
+
+  /** Number of prefix rows locked (updated atomically) */
+  uint64_t locked_cnt;
+
+  /** Number of prefixes inserted while locking their row (updated with
+      exclusive access to the tables) */
+  uint64_t inserted_cnt;
+
+  /** Time spent waiting for exclusive access to the tables to insert
+      prefixes, in microseconds (updated with exclusive access) */
+  uint64_t insert_wait_usec;
+
+} bwv_writers_t;
+
+/************ path origins ************/
+
+/** Origin information of an AS Path Store path */
+typedef struct bwv_path_origin {
+
+  /** Borrowed pointer to the origin segment (owned by the path store) */
+  bgpstream_as_path_seg_t *origin_seg;
+
+  /** Origin ASN (0 if the origin segment is not a simple ASN) */
+  uint32_t origin_asn;
+
+  /** Number of segments in the path (only computed if asked for) */
+  uint16_t path_len;
+
+} bwv_path_origin_t;
+
+/************ prefixes sorted by address ************/
+
+/** Record used to sort the prefixes of a view by address (see
+    bgpview_freeze and bgpview_iter_first_pfx_ordered) */
+typedef struct bwv_sorted_pfx {
+
+  /** The prefix */
+  bgpstream_pfx_t pfx;
+
+  /** Position of the prefix in the view's v4pfxs or v6pfxs table */
+  khiter_t k;
+
+} bwv_sorted_pfx_t;
+
+/************ snapshots ************/
+
+/** Prefix info removed from a view by bgpview_clear while it may still be
+    shared with snapshots of the view */
+typedef struct bwv_retired_pfxinfo {
+
+  /** The prefix info (allocated by the view) */
+  bwv_peerid_pfxinfo_t *pfxinfo;
+
+  /** Snapshot generation of the view when the prefix info was removed */
+  uint32_t gen;
+
+} bwv_retired_pfxinfo_t;
+
+/** Peer signatures and AS Path Store of a destroyed view, kept alive for its
+    snapshots and destroyed with the last of them */
+typedef struct bwv_snap_tables {
+
+  /** Peer signatures (NULL if they were not owned by the view) */
+  bgpstream_peer_sig_map_t *peersigns;
+
+  /** AS Path Store (NULL if it was not owned by the view) */
+  bgpstream_as_path_store_t *pathstore;
+
+  /** Number of snapshots that still use the tables */
+  int refcnt;
+
+} bwv_snap_tables_t;
 
 /************ bgpview ************/
 
@@ -205,8 +629,7 @@ struct bgpview {
   int pathstore_shared;
 
   /** Table of peerid -> peerinfo */
-  /** todo*/
-  kh_bwv_peerid_peerinfo_t *peerinfo;
+  bwv_peer_table_t peerinfo;
 
   /** The number of active peers */
   uint32_t peerinfo_cnt[BGPVIEW_FIELD_ALL_VALID];
@@ -238,9 +661,149 @@ struct bgpview {
    */
   int disable_extended;
 
+  /** How the pfx-peer cells of each prefix are stored */
+  bgpview_cell_layout_t cell_layout;
+
+  /** Combination of cell_layout and disable_extended (a bwv_cell_kind_t
+      value, see update_cell_kind) */
+  uint8_t cell_kind;
+
+  /** Slab allocator for bwv_peerid_pfxinfo_t structures */
+  bgpview_slab_t *pfxinfo_slab;
+
+  /** Slab allocators for sorted cell arrays, one per size class (created on
+      demand) */
+  bgpview_slab_t *cells_slab[BWV_PFX_PEER_VEC_CLASS_CNT];
+
+  /** Are the slabs and prefix tables backed by huge pages? (see
+      bgpview_enable_huge_pages) */
+  uint8_t huge_pages;
+
+  /** Number of buckets of the v4 and v6 prefix tables when they were last
+      advised to use huge pages */
+  khint_t v4pfxs_advised;
+  khint_t v6pfxs_advised;
+
+  /** Has a pfx or pfx-peer user pointer ever been set in this view? */
+  uint8_t pfx_user_used;
+
+  /** Is the per-peer prefix index maintained? */
+  uint8_t peer_pfx_index;
+
+  /** Copy-on-write snapshots of this view */
+  bgpview_t **snapshots;
+
+  /** Number of snapshots of this view */
+  int snapshots_cnt;
+
+  /** Current snapshot generation (bumped whenever a snapshot is updated).
+      Prefixes whose gen differs from this may be shared with a snapshot and
+      must be preserved before being changed */
+  uint32_t snap_gen;
+
+  /** Is this view a snapshot? */
+  uint8_t is_snapshot;
+
+  /** View this snapshot was taken from (NULL if it has been destroyed) */
+  bgpview_t *snapshot_src;
+
+  /** Prefix infos owned by this snapshot (i.e. copies of prefixes that have
+      since changed in the source view) */
+  bwv_peerid_pfxinfo_t **snap_copies;
+
+  /** Number of prefix infos in snap_copies */
+  uint32_t snap_copies_cnt;
+
+  /** Number of prefix infos allocated in snap_copies */
+  uint32_t snap_copies_alloc_cnt;
+
+  /** Snapshot generation of the source view at the last update of this
+      snapshot */
+  uint32_t snap_update_gen;
+
+  /** Prefix infos removed by bgpview_clear that snapshots may still share */
+  bwv_retired_pfxinfo_t *retired;
+
+  /** Number of prefix infos in retired */
+  uint32_t retired_cnt;
+
+  /** Number of prefix infos allocated in retired */
+  uint32_t retired_alloc_cnt;
+
+  /** Tables inherited from the destroyed source view of this snapshot */
+  bwv_snap_tables_t *snap_tables;
+
   uint8_t need_gc_v4pfxs;
   uint8_t need_gc_v6pfxs;
   uint8_t need_gc_peerinfo;
+
+  /** Prefixes that have been removed, or have had pfx-peers removed, since
+      they were last garbage collected (see bgpview_gc_step) */
+  bgpstream_pfx_t *gc_dirty;
+
+  /** Number of prefixes in gc_dirty */
+  uint32_t gc_dirty_cnt;
+
+  /** Number of prefixes allocated in gc_dirty */
+  uint32_t gc_dirty_alloc_cnt;
+
+  /** Could a prefix not be added to gc_dirty? If so, the next garbage
+      collection visits every prefix (see bgpview_gc) */
+  uint8_t gc_dirty_lost;
+
+  /** Is the change journal maintained? (see bgpview_enable_journal) */
+  uint8_t journal_enabled;
+
+  /** Does the journal hold every change since the last checkpoint? (0 until
+      the first checkpoint, and after changes could not be recorded) */
+  uint8_t journal_complete;
+
+  /** Time of the view when the journal was last checkpointed */
+  uint32_t journal_time;
+
+  /** Prefixes whose pfx-peers changed since the last checkpoint (see
+      bgpview_journal_checkpoint) */
+  bgpstream_pfx_t *journal;
+
+  /** Number of prefixes in journal */
+  uint32_t journal_cnt;
+
+  /** Number of prefixes allocated in journal */
+  uint32_t journal_alloc_cnt;
+
+  /** Prefixes of the view sorted by address, which is kept across ordered
+      iterations and diffs, and brought up to date before each (see
+      pfx_index_update) */
+  bwv_sorted_pfx_t *pfx_index;
+
+  /** Number of prefixes in pfx_index */
+  uint32_t pfx_index_cnt;
+
+  /** Number of IPv4 prefixes in pfx_index (which come first) */
+  uint32_t pfx_index_v4_cnt;
+
+  /** Number of prefixes allocated in pfx_index */
+  uint32_t pfx_index_alloc_cnt;
+
+  /** Prefixes that are not in pfx_index yet (only used while updating) */
+  bwv_sorted_pfx_t *pfx_index_new;
+
+  /** Number of prefixes allocated in pfx_index_new */
+  uint32_t pfx_index_new_alloc_cnt;
+
+  /** Buckets of the v4pfxs and v6pfxs tables that pfx_index points at (only
+      used while updating) */
+  uint64_t *pfx_index_marks;
+
+  /** Number of 64-bit words allocated in pfx_index_marks */
+  uint32_t pfx_index_marks_alloc_cnt;
+
+  /** Guards the update of pfx_index (concurrent readers may all start an
+      ordered iteration) */
+  pthread_mutex_t pfx_index_lock;
+
+  /** Concurrent writer locks (NULL unless concurrent writers are enabled) */
+  bwv_writers_t *writers;
 };
 
 struct bgpview_iter {
@@ -275,1913 +838,6087 @@ struct bgpview_iter {
   khiter_t peer_it;
   /** State mask used for peer iteration */
   uint8_t peer_state_mask;
+
+  /** Peer whose prefixes are iterated by the peer-pfx iterator */
+  bgpstream_peer_id_t peer_pfx_peerid;
+  /** IP version filter of the peer-pfx iterator (0 for all versions) */
+  int peer_pfx_version_filter;
+  /** Current position in the prefix index of the peer */
+  khiter_t peer_pfx_it;
+  /** Is the peer-pfx iterator valid? */
+  int peer_pfx_it_valid;
+
+  /** Index of the partition of the prefix tables that is iterated */
+  int part_idx;
+  /** Number of partitions the prefix tables are divided into (1 if the
+      iterator is not partitioned) */
+  int part_cnt;
+
+  /** Prefix shard locked by this iterator (-1 if none) */
+  int locked_shard;
+
+  /** Prefixes visited by the ordered prefix iterator, sorted by address
+      (borrowed from the prefix index of the view, or dirty_pfxs) */
+  bwv_sorted_pfx_t *ord_pfxs;
+  /** Number of prefixes in ord_pfxs */
+  uint32_t ord_pfxs_cnt;
+  /** Index of the current prefix of the ordered prefix iterator */
+  uint32_t ord_idx;
+  /** Dirty prefixes visited by the dirty prefix iterator */
+  bwv_sorted_pfx_t *dirty_pfxs;
+  /** Number of prefixes allocated in dirty_pfxs */
+  uint32_t dirty_pfxs_alloc_cnt;
 };
 
-/* ========== PRIVATE FUNCTIONS ========== */
+/************ frozen view ************/
 
-static void peerinfo_reset(bwv_peerinfo_t *v)
-{
-  v->state = BGPVIEW_FIELD_INVALID;
-  v->v4_pfx_cnt[BGPVIEW_FIELD_INACTIVE] = 0;
-  v->v4_pfx_cnt[BGPVIEW_FIELD_ACTIVE] = 0;
-  v->v6_pfx_cnt[BGPVIEW_FIELD_INACTIVE] = 0;
-  v->v6_pfx_cnt[BGPVIEW_FIELD_ACTIVE] = 0;
-}
+struct bgpview_frozen {
 
-static void peerinfo_destroy_user(bgpview_t *view)
-{
-  khiter_t k;
-  if (view->peer_user_destructor == NULL) {
-    return;
-  }
-  for (k = kh_begin(view->peerinfo); k != kh_end(view->peerinfo); ++k) {
-    if (!kh_exist(view->peerinfo, k) ||
-        (kh_value(view->peerinfo, k).user == NULL)) {
-      continue;
-    }
-    view->peer_user_destructor(kh_value(view->peerinfo, k).user);
-    kh_value(view->peerinfo, k).user = NULL;
-  }
-}
+  /** BGP Time of the view that was frozen */
+  uint32_t time;
 
-static bwv_peerid_pfxinfo_t *peerid_pfxinfo_create(void)
-{
-  bwv_peerid_pfxinfo_t *v;
+  /** AS Path Store of the view that was frozen */
+  bgpstream_as_path_store_t *pathstore;
 
-  if ((v = malloc_zero(sizeof(bwv_peerid_pfxinfo_t))) == NULL) {
-    return NULL;
-  }
-  v->state = BGPVIEW_FIELD_INVALID;
+  /** Number of (active) prefixes */
+  uint32_t pfxs_cnt;
 
-  /* all other fields are memset to 0 */
+  /** Prefixes, sorted by address (v4 first) */
+  bgpstream_pfx_t *pfxs;
 
-  return v;
-}
+  /** Index of the first cell of each prefix (pfxs_cnt+1 entries, so that the
+      cells of prefix i are in [cell_offsets[i], cell_offsets[i+1]) ) */
+  uint32_t *cell_offsets;
 
-static int peerid_pfxinfo_insert(bgpview_iter_t *iter,
-                                 bwv_peerid_pfxinfo_t *v,
-                                 bgpstream_peer_id_t peerid,
-                                 bgpstream_as_path_store_path_id_t path_id)
-{
-  bwv_pfx_peerinfo_t *peerinfo = NULL;
-  int khret;
-  khiter_t k;
+  /** Number of (active) pfx-peer cells */
+  uint32_t cells_cnt;
 
-  if (!v->peers_generic) {
-    if (iter->view->disable_extended) {
-      v->peers_min = kh_init(bwv_peerid_pfx_peerinfo);
-    } else {
-      v->peers_ext = kh_init(bwv_peerid_pfx_peerinfo_ext);
-    }
-  }
+  /** Peer ID of each cell */
+  bgpstream_peer_id_t *peer_ids;
 
-  if (iter->view->disable_extended) {
-    k = kh_put(bwv_peerid_pfx_peerinfo, v->peers_min, peerid, &khret);
-    if (khret > 0) {
-      // peer didn't exist; initialize it
-      kh_val(v->peers_min, k).state = BGPVIEW_FIELD_INVALID;
-    }
-    peerinfo = &kh_val(v->peers_min, k);
-  } else {
-    k = kh_put(bwv_peerid_pfx_peerinfo_ext, v->peers_ext, peerid, &khret);
-    if (khret > 0) {
-      // peer didn't exist; initialize it
-      kh_val(v->peers_ext, k).state = BGPVIEW_FIELD_INVALID;
-      kh_val(v->peers_ext, k).user = NULL;
-    }
-    peerinfo = (bwv_pfx_peerinfo_t*)&kh_val(v->peers_ext, k);
-  }
+  /** AS Path Store ID of each cell */
+  bgpstream_as_path_store_path_id_t *path_ids;
 
-  peerinfo->as_path_id = path_id;
+  /** Origin ASN of each cell (0 if the origin is not a simple ASN) */
+  uint32_t *origin_asns;
 
-  if (peerinfo->state == BGPVIEW_FIELD_INVALID) {
-    // did not already exist or was invalid
-    peerinfo->state = BGPVIEW_FIELD_INACTIVE;
+  /** Peer signatures, indexed by peer ID (unused IDs are zeroed) */
+  bgpstream_peer_sig_t *peersigs;
 
-    /** peerinfo->user remains untouched */
+  /** Number of entries in peersigs */
+  uint32_t peersigs_cnt;
 
-    /* and count this as a new inactive peer for this prefix */
-    v->peers_cnt[BGPVIEW_FIELD_INACTIVE]++;
+  /* the following are only set for views mapped from an image, which
+     reference their paths by index rather than by AS Path Store ID */
 
-    /* also count this as an inactive pfx for the peer */
-    switch (iter->version_ptr) {
-    case BGPSTREAM_ADDR_VERSION_IPV4:
-      kh_value(iter->view->peerinfo, iter->peer_it)
-	.v4_pfx_cnt[BGPVIEW_FIELD_INACTIVE]++;
-      break;
-    case BGPSTREAM_ADDR_VERSION_IPV6:
-      kh_value(iter->view->peerinfo, iter->peer_it)
-	.v6_pfx_cnt[BGPVIEW_FIELD_INACTIVE]++;
-      break;
-    default:
-      return -1;
-    }
-  }
+  /** Index of the path of each cell */
+  uint32_t *path_idxs;
 
-  /* now seek the iterator to this pfx/peer */
-  iter->pfx_peer_it = k;
-  iter->pfx_peer_it_valid = 1;
-  iter->pfx_peer_state_mask = BGPVIEW_FIELD_ALL_VALID;
+  /** Number of paths */
+  uint32_t paths_cnt;
 
-  return 0;
-}
+  /** Offset of each path in path_data (paths_cnt+1 entries) */
+  uint32_t *path_offsets;
 
-static inline void pfx_peer_info_destroy(bgpview_t *view, bwv_pfx_peerinfo_t *v)
-{
-  return;
-}
+  /** Whether each path is a core path (i.e. without the peer ASN) */
+  uint8_t *path_cores;
 
-static inline void pfx_peer_info_ext_destroy(bgpview_t *view,
-                                             bwv_pfx_peerinfo_ext_t *v)
-{
-  ASSERT_BWV_PFX_PEERINFO_EXT(view);
-  if (v->user != NULL && view->pfx_peer_user_destructor != NULL) {
-    view->pfx_peer_user_destructor(v->user);
-  }
-  v->user = NULL;
-}
+  /** Path data, as used by the AS Path Store */
+  uint8_t *path_data;
 
-static void peerid_pfxinfo_destroy(bgpview_t *view, bwv_peerid_pfxinfo_t *v)
-{
-  if (v == NULL) {
-    return;
-  }
-  khiter_t k;
-  if (v->peers_generic != NULL) {
-    if (view->disable_extended == 0) {
-      for (k = kh_begin(v->peers_ext); k != kh_end(v->peers_ext); ++k) {
-        if (!kh_exist(v->peers_ext, k)) continue;
-        pfx_peer_info_ext_destroy(view, &kh_val(v->peers_ext, k));
-      }
-      kh_destroy(bwv_peerid_pfx_peerinfo_ext, v->peers_ext);
-    } else {
-      // loop calling empty inline function can be optimized away
-      for (k = kh_begin(v->peers_min); k != kh_end(v->peers_min); ++k) {
-        if (!kh_exist(v->peers_min, k)) continue;
-        pfx_peer_info_destroy(view, &kh_val(v->peers_min, k));
-      }
-      kh_destroy(bwv_peerid_pfx_peerinfo, v->peers_min);
-    }
-  }
-  v->peers_generic = NULL;
-  v->state = BGPVIEW_FIELD_INVALID;
-  if (view->pfx_user_destructor != NULL && v->user != NULL) {
-    view->pfx_user_destructor(v->user);
-  }
-  v->user = NULL;
-  free(v);
-}
+  /** Do the arrays point into an image (rather than being owned by us)? */
+  int mapped;
 
-#define __pfx_peerinfos(iter)                                                  \
-  (((iter)->version_ptr == BGPSTREAM_ADDR_VERSION_IPV4)                        \
-     ? (kh_val((iter)->view->v4pfxs, (iter)->pfx_it))                          \
-     : ((iter)->version_ptr == BGPSTREAM_ADDR_VERSION_IPV6)                    \
-         ? (kh_val((iter)->view->v6pfxs, (iter)->pfx_it))                      \
-         : NULL)
+  /** Image owned by the view (only set for published versions) */
+  void *image;
+};
 
-static int add_v4pfx(bgpview_iter_t *iter, bgpstream_ipv4_pfx_t *pfx)
-{
-  bwv_peerid_pfxinfo_t *new_pfxpeerinfo;
-  khiter_t k;
-  int khret;
+/** Header of the image of a frozen view (see bgpview_frozen_write)
+ *
+ * All offsets are relative to the start of the header, and all sections are
+ * aligned to BWV_FROZEN_IMAGE_ALIGN bytes.
+ */
+typedef struct bwv_frozen_image_hdr {
 
-  k = kh_put(bwv_v4pfx_peerid_pfxinfo, iter->view->v4pfxs, *pfx, &khret);
-  if (khret > 0) {
-    /* pfx didn't exist */
-    if ((new_pfxpeerinfo = peerid_pfxinfo_create()) == NULL) {
-      return -1;
-    }
-    kh_value(iter->view->v4pfxs, k) = new_pfxpeerinfo;
+  /** BWV_FROZEN_IMAGE_MAGIC */
+  uint32_t magic;
 
-    /* pfx is invalid at this point */
-  }
+  /** BWV_FROZEN_IMAGE_VERSION */
+  uint32_t version;
 
-  /* seek the iterator to this prefix */
-  iter->pfx_it = k;
-  iter->version_ptr = BGPSTREAM_ADDR_VERSION_IPV4;
-  iter->pfx_peer_it_valid = 0; // moving pfx_it invalidates pfx_peer_it
+  /** BWV_FROZEN_IMAGE_BOM, as written by the host that wrote the image */
+  uint32_t bom;
 
-  if (kh_value(iter->view->v4pfxs, k)->state != BGPVIEW_FIELD_INVALID) {
-    /* it was already there and active/inactive */
-    return 0;
-  }
+  /** BGP time of the view */
+  uint32_t time;
 
-  kh_value(iter->view->v4pfxs, k)->state = BGPVIEW_FIELD_INACTIVE;
-  iter->view->v4pfxs_cnt[BGPVIEW_FIELD_INACTIVE]++;
+  /** Size of a peer signature record */
+  uint32_t peersig_size;
 
-  return 0;
-}
+  /** Size of a prefix record */
+  uint32_t pfx_size;
 
-static int add_v6pfx(bgpview_iter_t *iter, bgpstream_ipv6_pfx_t *pfx)
-{
-  bwv_peerid_pfxinfo_t *new_pfxpeerinfo;
-  khiter_t k;
-  int khret;
+  /** Number of peer signatures */
+  uint32_t peersigs_cnt;
 
-  k = kh_put(bwv_v6pfx_peerid_pfxinfo, iter->view->v6pfxs, *pfx, &khret);
-  if (khret > 0) {
-    /* pfx didn't exist */
-    if ((new_pfxpeerinfo = peerid_pfxinfo_create()) == NULL) {
-      return -1;
-    }
-    kh_value(iter->view->v6pfxs, k) = new_pfxpeerinfo;
+  /** Number of prefixes */
+  uint32_t pfxs_cnt;
 
-    /* pfx is invalid at this point */
-  }
+  /** Number of cells */
+  uint32_t cells_cnt;
 
-  /* seek the iterator to this prefix */
-  iter->pfx_it = k;
-  iter->version_ptr = BGPSTREAM_ADDR_VERSION_IPV6;
-  iter->pfx_peer_it_valid = 0; // moving pfx_it invalidates pfx_peer_it
+  /** Number of paths */
+  uint32_t paths_cnt;
 
-  if (kh_value(iter->view->v6pfxs, k)->state != BGPVIEW_FIELD_INVALID) {
-    /* it was already there and active/inactive */
-    return 0;
-  }
+  /** Total length of the image (including padding) */
+  uint64_t len;
 
-  kh_value(iter->view->v6pfxs, k)->state = BGPVIEW_FIELD_INACTIVE;
-  iter->view->v6pfxs_cnt[BGPVIEW_FIELD_INACTIVE]++;
+  /** Length of the path data */
+  uint64_t path_data_len;
 
-  return 0;
-}
+  /** Section offsets */
+  uint64_t peersigs_off;
+  uint64_t pfxs_off;
+  uint64_t cell_offsets_off;
+  uint64_t peer_ids_off;
+  uint64_t path_idxs_off;
+  uint64_t origin_asns_off;
+  uint64_t path_offsets_off;
+  uint64_t path_cores_off;
+  uint64_t path_data_off;
 
-static int add_pfx(bgpview_iter_t *iter, bgpstream_pfx_t *pfx)
-{
-  if (pfx->address.version == BGPSTREAM_ADDR_VERSION_IPV4) {
-    return add_v4pfx(iter, &pfx->bs_ipv4);
-  } else if (pfx->address.version == BGPSTREAM_ADDR_VERSION_IPV6) {
-    return add_v6pfx(iter, &pfx->bs_ipv6);
-  }
+} bwv_frozen_image_hdr_t;
 
-  return -1;
-}
+#define BWV_FROZEN_IMAGE_MAGIC 0x42475646 /* BGVF */
+#define BWV_FROZEN_IMAGE_VERSION 1
+#define BWV_FROZEN_IMAGE_BOM 0x01020304
+#define BWV_FROZEN_IMAGE_ALIGN 8
 
-/* ==================== ITERATOR FUNCTIONS ==================== */
+#define BWV_FROZEN_IMAGE_PAD(len)                                              \
+  (((len) + BWV_FROZEN_IMAGE_ALIGN - 1) &                                      \
+   ~((uint64_t)BWV_FROZEN_IMAGE_ALIGN - 1))
 
-bgpview_iter_t *bgpview_iter_create(bgpview_t *view)
-{
-  bgpview_iter_t *iter;
+struct bgpview_frozen_iter {
 
-  /* DEBUG REMOVE ME */
-  fprintf(stderr, "AS Path Store size: %d\n",
-          bgpstream_as_path_store_get_size(view->pathstore));
+  /** Pointer to the frozen view we are iterating over */
+  bgpview_frozen_t *frozen;
 
-  if ((iter = malloc_zero(sizeof(bgpview_iter_t))) == NULL) {
-    return NULL;
-  }
+  /** Index of the current prefix */
+  uint32_t pfx_idx;
 
-  iter->view = view;
+  /** Index of the current cell */
+  uint32_t cell_idx;
+};
 
-  iter->version_ptr = BGPSTREAM_ADDR_VERSION_IPV4;
-  iter->version_filter = 0; // default: all prefix versions
+/** Phases of a freeze */
+typedef enum {
 
-  iter->pfx_it = 0;
+  /** Collecting the active prefixes of the view */
+  BWV_FREEZE_COLLECT,
 
-  iter->peer_it = kh_end(iter->view->peerinfo);
+  /** Filling in the cells of the sorted prefixes */
+  BWV_FREEZE_FILL,
 
-  iter->pfx_peer_it_valid = 0;
+  /** The frozen view is complete */
+  BWV_FREEZE_DONE,
 
-  // default: all valid fields are iterated
-  iter->pfx_state_mask = BGPVIEW_FIELD_ALL_VALID;
-  iter->peer_state_mask = BGPVIEW_FIELD_ALL_VALID;
-  iter->pfx_peer_state_mask = BGPVIEW_FIELD_ALL_VALID;
+} bwv_freeze_phase_t;
 
-  return iter;
-}
+/** A freeze in progress, which can be done in several steps (see
+    bgpview_pub_publish_step). The view must not change between steps. */
+typedef struct bwv_freeze {
 
-void bgpview_iter_destroy(bgpview_iter_t *iter)
-{
-  free(iter);
-}
+  /** Iterator over the view being frozen */
+  bgpview_iter_t *it;
 
-/* ==================== ITER GETTER/SETTERS ==================== */
+  /** Frozen view being built */
+  bgpview_frozen_t *frozen;
 
-#define __cnt_by_mask(counter, mask)                                           \
-  (((mask) == BGPVIEW_FIELD_ACTIVE || (mask) == BGPVIEW_FIELD_INACTIVE)        \
-     ? ((counter)[(mask)])                                                     \
-     : ((counter)[BGPVIEW_FIELD_ACTIVE] + (counter)[BGPVIEW_FIELD_INACTIVE]))
+  /** Active prefixes of the view (sorted by address once collected) */
+  bwv_sorted_pfx_t *sorted;
 
-#define __pfx_field(iter, field) (__pfx_peerinfos((iter))->field)
+  /** Number of prefixes collected (or filled in) so far */
+  uint32_t pfx_idx;
 
-#define __iter_get_view(iter) ((iter)->view)
+  /** Number of cells filled in so far */
+  uint32_t cell_idx;
 
-bgpview_t *bgpview_iter_get_view(bgpview_iter_t *iter)
-{
-  if (iter != NULL) {
-    return __iter_get_view(iter);
-  }
-  return NULL;
-}
+  /** Current phase */
+  bwv_freeze_phase_t phase;
 
-#define __iter_pfx_get_pfx(iter)                                               \
-  (((iter)->version_ptr == BGPSTREAM_ADDR_VERSION_IPV4)                        \
-     ? ((bgpstream_pfx_t *)&kh_key(iter->view->v4pfxs, iter->pfx_it))          \
-     : ((iter)->version_ptr == BGPSTREAM_ADDR_VERSION_IPV6)                    \
-         ? ((bgpstream_pfx_t *)&kh_key(iter->view->v6pfxs, iter->pfx_it))      \
-         : NULL)
+  /** Does the frozen view get its own copy of the paths of its cells (laid
+      out as in an image), so that it can be written without looking up the
+      AS Path Store? */
+  int own_paths;
 
-bgpstream_pfx_t *bgpview_iter_pfx_get_pfx(bgpview_iter_t *iter)
-{
-  return __iter_pfx_get_pfx(iter);
-}
+  /** Index of each AS Path Store path in the frozen view (UINT32_MAX if
+      the path is not used), indexed by store index */
+  uint32_t *idx_map;
 
-#define __iter_pfx_get_peer_cnt(iter, state_mask)                              \
-  (__cnt_by_mask(__pfx_field(iter, peers_cnt), state_mask))
+  /** Number of entries in idx_map */
+  uint32_t idx_map_cnt;
 
-int bgpview_iter_pfx_get_peer_cnt(bgpview_iter_t *iter, uint8_t state_mask)
-{
-  return __iter_pfx_get_peer_cnt(iter, state_mask);
-}
+  /** Number of entries allocated in the path arrays of the frozen view */
+  uint32_t paths_alloc_cnt;
 
-#define __iter_pfx_get_state(iter) (__pfx_field(iter, state))
+  /** Number of bytes used in the path data of the frozen view */
+  uint64_t path_data_len;
 
-bgpview_field_state_t bgpview_iter_pfx_get_state(bgpview_iter_t *iter)
-{
-  return __iter_pfx_get_state(iter);
-}
+  /** Number of bytes allocated for the path data of the frozen view */
+  uint64_t path_data_alloc;
 
-#define __iter_pfx_get_user(iter) (__pfx_field(iter, user))
+} bwv_freeze_t;
 
-void *bgpview_iter_pfx_get_user(bgpview_iter_t *iter)
-{
-  return __iter_pfx_get_user(iter);
-}
+/************ publication ************/
 
-int bgpview_iter_pfx_set_user(bgpview_iter_t *iter, void *user)
-{
-  bwv_peerid_pfxinfo_t *pfxinfo = __pfx_peerinfos(iter);
+/** A version that has been replaced, but may still be used by readers */
+typedef struct bwv_pub_retired {
 
-  if (pfxinfo->user == user) {
-    return 0;
-  }
+  /** The replaced version */
+  bgpview_frozen_t *frozen;
 
-  if (pfxinfo->user != NULL && iter->view->pfx_user_destructor != NULL) {
-    iter->view->pfx_user_destructor(pfxinfo->user);
-  }
-  pfxinfo->user = user;
-  return 1;
-}
+  /** Value of the global epoch right after the version was replaced */
+  uint64_t epoch;
 
-#define __iter_peer_get_peer_id(iter)                                          \
-  (kh_key(iter->view->peerinfo, iter->peer_it))
+  /** Next retired version (older versions come last) */
+  struct bwv_pub_retired *next;
+} bwv_pub_retired_t;
 
-bgpstream_peer_id_t bgpview_iter_peer_get_peer_id(bgpview_iter_t *iter)
-{
-  return __iter_peer_get_peer_id(iter);
-}
+struct bgpview_pub_reader {
 
-#define __iter_peer_get_sig(iter)                                              \
-  (bgpstream_peer_sig_map_get_sig((iter)->view->peersigns,                     \
-                                  __iter_peer_get_peer_id(iter)))
+  /** Publisher the reader is registered with */
+  bgpview_pub_t *pub;
 
-bgpstream_peer_sig_t *bgpview_iter_peer_get_sig(bgpview_iter_t *iter)
-{
-  return __iter_peer_get_sig(iter);
-}
+  /** Global epoch observed when the current version was acquired (0 if the
+      reader does not hold a version) */
+  volatile uint64_t epoch;
 
-#define __peer_get_pfx_cnt(iter, state_mask, field)                            \
-  (__cnt_by_mask(kh_value(iter->view->peerinfo, iter->peer_it).field,          \
-                 state_mask))
+  /** Next registered reader */
+  struct bgpview_pub_reader *next;
+};
 
-#define __iter_peer_get_pfx_cnt(iter, version, state_mask)                     \
-  (((version) == BGPSTREAM_ADDR_VERSION_IPV4)                                  \
-     ? (__peer_get_pfx_cnt(iter, state_mask, v4_pfx_cnt))                      \
-     : ((version) == BGPSTREAM_ADDR_VERSION_IPV6)                              \
-         ? (__peer_get_pfx_cnt(iter, state_mask, v6_pfx_cnt))                  \
-         : (__peer_get_pfx_cnt(iter, state_mask, v4_pfx_cnt) +                 \
-            __peer_get_pfx_cnt(iter, state_mask, v6_pfx_cnt)))
+struct bgpview_pub {
 
-int bgpview_iter_peer_get_pfx_cnt(bgpview_iter_t *iter, int version,
-                                  uint8_t state_mask)
-{
-  return __iter_peer_get_pfx_cnt(iter, version, state_mask);
-}
+  /** Most recently published version */
+  bgpview_frozen_t *volatile current;
 
-#define __peer_field(iter, field)                                              \
-  (kh_val((iter)->view->peerinfo, (iter)->peer_it).field)
+  /** Global epoch, advanced each time a version is published */
+  volatile uint64_t epoch;
 
-#define __iter_peer_get_state(iter) (__peer_field(iter, state))
+  /** Versions waiting to be reclaimed */
+  bwv_pub_retired_t *retired;
 
-bgpview_field_state_t bgpview_iter_peer_get_state(bgpview_iter_t *iter)
-{
-  return __iter_peer_get_state(iter);
-}
+  /** Registered readers */
+  bgpview_pub_reader_t *readers;
 
-#define __iter_peer_get_user(iter) (__peer_field(iter, user))
+  /** Protects the list of readers (but not their epochs) */
+  pthread_mutex_t readers_lock;
 
-void *bgpview_iter_peer_get_user(bgpview_iter_t *iter)
-{
-  return __iter_peer_get_user(iter);
-}
+  /** Snapshot of the view that versions are built from in steps (NULL until
+      bgpview_pub_publish_start is first called) */
+  bgpview_t *snap;
 
-int bgpview_iter_peer_set_user(bgpview_iter_t *iter, void *user)
+  /** Version being built in steps */
+  bwv_freeze_t freeze;
+
+  /** Is a version being built? */
+  int building;
+};
+
+/* ========== PRIVATE FUNCTIONS ========== */
+
+/* order prefixes by version (v4 first), then address, then mask length */
+static int pfx_cmp(const bgpstream_pfx_t *pa, const bgpstream_pfx_t *pb)
 {
-  void *cur_user = __peer_field(iter, user);
+  int ret;
 
-  if (cur_user == user) {
-    return 0;
+  if (pa->address.version != pb->address.version) {
+    return (pa->address.version == BGPSTREAM_ADDR_VERSION_IPV4) ? -1 : 1;
   }
 
-  if (cur_user != NULL && iter->view->peer_user_destructor != NULL) {
-    iter->view->peer_user_destructor(cur_user);
+  if (pa->address.version == BGPSTREAM_ADDR_VERSION_IPV4) {
+    ret = memcmp(&pa->bs_ipv4.address.addr, &pb->bs_ipv4.address.addr,
+                 sizeof(pa->bs_ipv4.address.addr));
+  } else {
+    ret = memcmp(&pa->bs_ipv6.address.addr, &pb->bs_ipv6.address.addr,
+                 sizeof(pa->bs_ipv6.address.addr));
+  }
+  if (ret != 0) {
+    return ret;
   }
 
-  kh_val(iter->view->peerinfo, iter->peer_it).user = user;
-  return 1;
+  return (int)pa->mask_len - (int)pb->mask_len;
 }
 
-#define __pfx_peer_field(iter, field)                                          \
-  (BWV_PFX_GET_PEER_PTR((iter)->view, __pfx_peerinfos(iter),                   \
-                        (iter)->pfx_peer_it)                                   \
-     ->field)
-
-#define __iter_pfx_peer_get_as_path_store_path(iter)                           \
-  (bgpstream_as_path_store_get_store_path((iter)->view->pathstore,             \
-                                          __pfx_peer_field(iter, as_path_id)))
-
-bgpstream_as_path_store_path_t *
-bgpview_iter_pfx_peer_get_as_path_store_path(bgpview_iter_t *iter)
+static int sorted_pfx_cmp(const void *a, const void *b)
 {
-  return __iter_pfx_peer_get_as_path_store_path(iter);
+  return pfx_cmp(&((const bwv_sorted_pfx_t *)a)->pfx,
+                 &((const bwv_sorted_pfx_t *)b)->pfx);
 }
 
-#define __iter_pfx_peer_get_as_path_store_path_id(iter)                        \
-  (__pfx_peer_field(iter, as_path_id))
-
-bgpstream_as_path_store_path_id_t
-bgpview_iter_pfx_peer_get_as_path_store_path_id(bgpview_iter_t *iter)
+static int journal_pfx_cmp(const void *a, const void *b)
 {
-  return __iter_pfx_peer_get_as_path_store_path_id(iter);
+  return pfx_cmp((const bgpstream_pfx_t *)a, (const bgpstream_pfx_t *)b);
 }
 
-#define __iter_pfx_peer_get_as_path(iter)                                      \
-  (bgpstream_as_path_store_path_get_path(                                      \
-    __iter_pfx_peer_get_as_path_store_path(iter),                              \
-    (__iter_peer_get_sig(iter))->peer_asnumber))
-
-bgpstream_as_path_t *bgpview_iter_pfx_peer_get_as_path(bgpview_iter_t *iter)
+/* make room for size prefixes in the given buffer of sorted prefixes */
+static int sorted_pfxs_reserve(bwv_sorted_pfx_t **pfxs, uint32_t *alloc_cnt,
+                               uint32_t size)
 {
-  return __iter_pfx_peer_get_as_path(iter);
-}
+  bwv_sorted_pfx_t *tmp;
 
-#define __iter_pfx_peer_get_origin_seg(iter)                                   \
-  (bgpstream_as_path_store_path_get_origin_seg(                                \
-    __iter_pfx_peer_get_as_path_store_path(iter)))
+  if (size > *alloc_cnt) {
+    /* leave room for the view to grow a little before the next update */
+    size += size / 8 + 1024;
+    if ((tmp = realloc(*pfxs, sizeof(bwv_sorted_pfx_t) * size)) == NULL) {
+      return -1;
+    }
+    *pfxs = tmp;
+    *alloc_cnt = size;
+  }
+  return 0;
+}
 
-bgpstream_as_path_seg_t *
-bgpview_iter_pfx_peer_get_origin_seg(bgpview_iter_t *iter)
+/* does the entry of the prefix index still point at a bucket that holds its
+   prefix? */
+static int pfx_index_entry_valid(bgpview_t *view, bwv_sorted_pfx_t *e)
 {
-  return __iter_pfx_peer_get_origin_seg(iter);
+  if (e->pfx.address.version == BGPSTREAM_ADDR_VERSION_IPV4) {
+    return e->k < kh_end(view->v4pfxs) && kh_exist(view->v4pfxs, e->k) &&
+           pfx_cmp(&e->pfx, (bgpstream_pfx_t *)&kh_key(view->v4pfxs, e->k)) ==
+             0;
+  }
+  return e->k < kh_end(view->v6pfxs) && kh_exist(view->v6pfxs, e->k) &&
+         pfx_cmp(&e->pfx, (bgpstream_pfx_t *)&kh_key(view->v6pfxs, e->k)) == 0;
 }
 
-#define __iter_pfx_peer_as_path_seg_iter_reset(iter)                           \
-  (bgpstream_as_path_store_path_iter_reset(                                    \
-    __iter_pfx_peer_get_as_path_store_path(iter), &(iter)->pfx_peer_path_it,   \
-    __iter_peer_get_sig(iter)->peer_asnumber))
-
-void bgpview_iter_pfx_peer_as_path_seg_iter_reset(bgpview_iter_t *iter)
-{
-  __iter_pfx_peer_as_path_seg_iter_reset(iter);
-}
-
-#define __iter_pfx_peer_as_path_seg_next(iter)                                 \
-  (bgpstream_as_path_store_path_get_next_seg(&iter->pfx_peer_path_it))
+/* mark (or check) a bucket of a prefix table as pointed at by the index */
+#define PFX_INDEX_MARK(marks, k)                                               \
+  ((marks)[(k) / 64] |= (UINT64_C(1) << ((k) % 64)))
+#define PFX_INDEX_MARKED(marks, k) (((marks)[(k) / 64] >> ((k) % 64)) & 1)
 
-bgpstream_as_path_seg_t *
-bgpview_iter_pfx_peer_as_path_seg_next(bgpview_iter_t *iter)
-{
-  return __iter_pfx_peer_as_path_seg_next(iter);
-}
+/* append the prefixes of a table that the index does not point at to
+   pfx_index_new */
+#define PFX_INDEX_COLLECT(view, table, marks, cnt)                             \
+  do {                                                                         \
+    khiter_t __k;                                                              \
+    for (__k = kh_begin(table); __k != kh_end(table); ++__k) {                 \
+      if (!kh_exist(table, __k) || PFX_INDEX_MARKED(marks, __k)) {             \
+        continue;                                                              \
+      }                                                                        \
+      bgpstream_pfx_copy(&(view)->pfx_index_new[(cnt)].pfx,                    \
+                         (bgpstream_pfx_t *)&kh_key(table, __k));              \
+      (view)->pfx_index_new[(cnt)++].k = __k;                                  \
+    }                                                                          \
+  } while (0)
 
-int bgpview_iter_pfx_peer_set_as_path(bgpview_iter_t *iter,
-                                      bgpstream_as_path_t *as_path)
+/* bring the prefix index of the view up to date. Entries whose bucket no
+   longer holds their prefix (removed prefixes, or all of them after the table
+   was resized or cleared) are dropped, and the prefixes that the index does
+   not point at are found with one pass over the buckets, sorted, and merged
+   in. Only the new prefixes are sorted, and nothing is written if the index
+   is already up to date */
+static int pfx_index_update(bgpview_t *view)
 {
-  bgpstream_as_path_store_path_id_t *id = &(__pfx_peer_field(iter, as_path_id));
+  uint32_t tables_cnt = kh_size(view->v4pfxs) + kh_size(view->v6pfxs);
+  uint32_t v4_words = (kh_end(view->v4pfxs) + 63) / 64;
+  uint32_t words = v4_words + (kh_end(view->v6pfxs) + 63) / 64;
+  uint64_t *marks;
+  bwv_sorted_pfx_t *e;
+  uint32_t kept = 0;
+  uint32_t v4_cnt = 0;
+  uint32_t new_cnt = 0;
+  uint32_t i, j, w;
+
+  for (i = 0; i < view->pfx_index_cnt; i++) {
+    kept += pfx_index_entry_valid(view, &view->pfx_index[i]);
+  }
+  if (kept == view->pfx_index_cnt && kept == tables_cnt) {
+    return 0;
+  }
 
-  bgpstream_peer_sig_t *ps = __iter_peer_get_sig(iter);
+  if (words > view->pfx_index_marks_alloc_cnt) {
+    if ((marks = realloc(view->pfx_index_marks, sizeof(uint64_t) * words)) ==
+        NULL) {
+      return -1;
+    }
+    view->pfx_index_marks = marks;
+    view->pfx_index_marks_alloc_cnt = words;
+  }
+  marks = view->pfx_index_marks;
+  memset(marks, 0, sizeof(uint64_t) * words);
+
+  /* drop the stale entries (which keeps the others sorted) */
+  kept = 0;
+  for (i = 0; i < view->pfx_index_cnt; i++) {
+    e = &view->pfx_index[i];
+    if (!pfx_index_entry_valid(view, e)) {
+      continue;
+    }
+    if (e->pfx.address.version == BGPSTREAM_ADDR_VERSION_IPV4) {
+      PFX_INDEX_MARK(marks, e->k);
+      v4_cnt++;
+    } else {
+      PFX_INDEX_MARK(marks + v4_words, e->k);
+    }
+    view->pfx_index[kept++] = *e;
+  }
 
-  if (bgpstream_as_path_store_get_path_id(iter->view->pathstore, as_path,
-                                          ps->peer_asnumber, id) != 0) {
-    fprintf(stderr, "ERROR: Failed to get AS Path ID from store\n");
+  /* collect and sort the prefixes that are missing */
+  if (sorted_pfxs_reserve(&view->pfx_index_new,
+                          &view->pfx_index_new_alloc_cnt,
+                          tables_cnt - kept) != 0 ||
+      sorted_pfxs_reserve(&view->pfx_index, &view->pfx_index_alloc_cnt,
+                          tables_cnt) != 0) {
+    view->pfx_index_cnt = kept;
+    view->pfx_index_v4_cnt = v4_cnt;
     return -1;
   }
+  PFX_INDEX_COLLECT(view, view->v4pfxs, marks, new_cnt);
+  v4_cnt += new_cnt;
+  PFX_INDEX_COLLECT(view, view->v6pfxs, marks + v4_words, new_cnt);
+  assert(kept + new_cnt == tables_cnt);
+  if (new_cnt > 1) {
+    qsort(view->pfx_index_new, new_cnt, sizeof(bwv_sorted_pfx_t),
+          sorted_pfx_cmp);
+  }
+
+  /* merge them in from the end, so that no entry is overwritten before it
+     is moved */
+  i = kept;
+  j = new_cnt;
+  w = kept + new_cnt;
+  while (j > 0) {
+    if (i > 0 && sorted_pfx_cmp(&view->pfx_index[i - 1],
+                                &view->pfx_index_new[j - 1]) > 0) {
+      view->pfx_index[--w] = view->pfx_index[--i];
+    } else {
+      view->pfx_index[--w] = view->pfx_index_new[--j];
+    }
+  }
 
+  view->pfx_index_cnt = tables_cnt;
+  view->pfx_index_v4_cnt = v4_cnt;
   return 0;
 }
 
-int bgpview_iter_pfx_peer_set_as_path_by_id(
-  bgpview_iter_t *iter, bgpstream_as_path_store_path_id_t path_id)
+/* lock the view-wide structures that concurrent writers share */
+#define WRITERS_MISC_LOCK(view)                                                \
+  do {                                                                         \
+    if ((view)->writers != NULL) {                                             \
+      pthread_mutex_lock(&(view)->writers->misc);                              \
+    }                                                                          \
+  } while (0)
+
+#define WRITERS_MISC_UNLOCK(view)                                              \
+  do {                                                                         \
+    if ((view)->writers != NULL) {                                             \
+      pthread_mutex_unlock(&(view)->writers->misc);                            \
+    }                                                                          \
+  } while (0)
+
+/* get exclusive access to the tables of the view (i.e. wait for all prefix
+   row updates to finish) */
+#define WRITERS_TABLES_LOCK(view)                                              \
+  do {                                                                         \
+    if ((view)->writers != NULL) {                                             \
+      pthread_rwlock_wrlock(&(view)->writers->tables);                         \
+    }                                                                          \
+  } while (0)
+
+#define WRITERS_TABLES_UNLOCK(view)                                            \
+  do {                                                                         \
+    if ((view)->writers != NULL) {                                             \
+      pthread_rwlock_unlock(&(view)->writers->tables);                         \
+    }                                                                          \
+  } while (0)
+
+/* update a view or peer counter, which (unlike prefix counters) may be
+   updated by several concurrent writers at once */
+#define SHARED_CNT_ADD(view, cnt, val)                                         \
+  do {                                                                         \
+    if ((view)->writers != NULL) {                                             \
+      __sync_fetch_and_add(&(cnt), (val));                                     \
+    } else {                                                                   \
+      (cnt) += (val);                                                          \
+    }                                                                          \
+  } while (0)
+
+static void writers_destroy(bwv_writers_t *writers)
 {
-  (__pfx_peer_field(iter, as_path_id)) = path_id;
-  return 0;
+  int i;
+
+  if (writers == NULL) {
+    return;
+  }
+  for (i = 0; i < writers->shards_cnt; i++) {
+    pthread_mutex_destroy(&writers->shards[i]);
+  }
+  free(writers->shards);
+  pthread_rwlock_destroy(&writers->tables);
+  pthread_mutex_destroy(&writers->misc);
+  pthread_mutex_destroy(&writers->pathstore);
+  free(writers);
 }
 
-#define __iter_pfx_peer_get_state(iter)                                        \
-  (BWV_PFX_GET_PEER_STATE(iter->view, __pfx_peerinfos(iter), iter->pfx_peer_it))
+/* copy a khash table into another of the same type, reusing the bucket
+   layout of the source so that nothing needs to be rehashed */
+#define BWV_KH_COPY_INIT(name, khkey_t, khval_t)                               \
+  static int kh_copy_##name(kh_##name##_t *dst, kh_##name##_t *src)            \
+  {                                                                            \
+    khint32_t *flags;                                                          \
+    khkey_t *keys;                                                             \
+    khval_t *vals;                                                             \
+    if (src->n_buckets == 0) {                                                 \
+      kh_clear(name, dst);                                                     \
+      return 0;                                                                \
+    }                                                                          \
+    if (dst->n_buckets != src->n_buckets) {                                    \
+      if ((flags = realloc(dst->flags, __ac_fsize(src->n_buckets) *            \
+                                         sizeof(khint32_t))) == NULL) {        \
+        return -1;                                                             \
+      }                                                                        \
+      dst->flags = flags;                                                      \
+      if ((keys = realloc(dst->keys, src->n_buckets * sizeof(khkey_t))) ==     \
+          NULL) {                                                              \
+        return -1;                                                             \
+      }                                                                        \
+      dst->keys = keys;                                                        \
+      if ((vals = realloc(dst->vals, src->n_buckets * sizeof(khval_t))) ==     \
+          NULL) {                                                              \
+        return -1;                                                             \
+      }                                                                        \
+      dst->vals = vals;                                                        \
+      dst->n_buckets = src->n_buckets;                                         \
+    }                                                                          \
+    memcpy(dst->flags, src->flags,                                             \
+           __ac_fsize(src->n_buckets) * sizeof(khint32_t));                    \
+    memcpy(dst->keys, src->keys, src->n_buckets * sizeof(khkey_t));            \
+    memcpy(dst->vals, src->vals, src->n_buckets * sizeof(khval_t));            \
+    dst->size = src->size;                                                     \
+    dst->n_occupied = src->n_occupied;                                         \
+    dst->upper_bound = src->upper_bound;                                       \
+    return 0;                                                                  \
+  }
 
-bgpview_field_state_t bgpview_iter_pfx_peer_get_state(bgpview_iter_t *iter)
+BWV_KH_COPY_INIT(bwv_v4pfx_peerid_pfxinfo, bgpstream_ipv4_pfx_t,
+                 bwv_peerid_pfxinfo_t *)
+BWV_KH_COPY_INIT(bwv_v6pfx_peerid_pfxinfo, bgpstream_ipv6_pfx_t,
+                 bwv_peerid_pfxinfo_t *)
+BWV_KH_COPY_INIT(bwv_peerid_pfx_peerinfo, uint16_t, bwv_pfx_peerinfo_t)
+BWV_KH_COPY_INIT(bwv_peerid_pfx_peerinfo_ext, uint16_t, bwv_pfx_peerinfo_ext_t)
+
+static void peerinfo_reset(bwv_peerinfo_t *v)
 {
-  return __iter_pfx_peer_get_state(iter);
+  v->state = BGPVIEW_FIELD_INVALID;
+  v->v4_pfx_cnt[BGPVIEW_FIELD_INACTIVE] = 0;
+  v->v4_pfx_cnt[BGPVIEW_FIELD_ACTIVE] = 0;
+  v->v6_pfx_cnt[BGPVIEW_FIELD_INACTIVE] = 0;
+  v->v6_pfx_cnt[BGPVIEW_FIELD_ACTIVE] = 0;
+  if (v->v4pfxs_idx != NULL) {
+    kh_clear(bwv_v4pfx_set, v->v4pfxs_idx);
+  }
+  if (v->v6pfxs_idx != NULL) {
+    kh_clear(bwv_v6pfx_set, v->v6pfxs_idx);
+  }
 }
 
-#define __iter_pfx_peer_get_user(iter)                                         \
-  (BWV_PFX_GET_PEER_EXT(__pfx_peerinfos(iter), iter->pfx_peer_it).user)
-
-void *bgpview_iter_pfx_peer_get_user(bgpview_iter_t *iter)
+static void peerinfo_destroy_idx(bwv_peerinfo_t *v)
 {
-  ASSERT_BWV_PFX_PEERINFO_EXT(iter->view);
-  return __iter_pfx_peer_get_user(iter);
+  if (v->v4pfxs_idx != NULL) {
+    kh_destroy(bwv_v4pfx_set, v->v4pfxs_idx);
+    v->v4pfxs_idx = NULL;
+  }
+  if (v->v6pfxs_idx != NULL) {
+    kh_destroy(bwv_v6pfx_set, v->v6pfxs_idx);
+    v->v6pfxs_idx = NULL;
+  }
 }
 
-int bgpview_iter_pfx_peer_set_user(bgpview_iter_t *iter, void *user)
+/* add the current prefix of the iterator to the index of the current peer */
+static int peerinfo_idx_add(bgpview_iter_t *iter)
 {
-  ASSERT_BWV_PFX_PEERINFO_EXT(iter->view);
+  bwv_peerinfo_t *peerinfo = &BWV_PEER_INFO(iter->view, iter->peer_it);
+  int khret;
 
-  void *cur_user = __iter_pfx_peer_get_user(iter);
+  switch (iter->version_ptr) {
+  case BGPSTREAM_ADDR_VERSION_IPV4:
+    if (peerinfo->v4pfxs_idx == NULL &&
+        (peerinfo->v4pfxs_idx = kh_init(bwv_v4pfx_set)) == NULL) {
+      return -1;
+    }
+    kh_put(bwv_v4pfx_set, peerinfo->v4pfxs_idx,
+           kh_key(iter->view->v4pfxs, iter->pfx_it), &khret);
+    break;
 
-  if (cur_user == user) {
-    return 0;
-  }
+  case BGPSTREAM_ADDR_VERSION_IPV6:
+    if (peerinfo->v6pfxs_idx == NULL &&
+        (peerinfo->v6pfxs_idx = kh_init(bwv_v6pfx_set)) == NULL) {
+      return -1;
+    }
+    kh_put(bwv_v6pfx_set, peerinfo->v6pfxs_idx,
+           kh_key(iter->view->v6pfxs, iter->pfx_it), &khret);
+    break;
 
-  if (cur_user != NULL && iter->view->pfx_peer_user_destructor != NULL) {
-    iter->view->pfx_peer_user_destructor(cur_user);
+  default:
+    return -1;
   }
 
-  BWV_PFX_GET_PEER_EXT(__pfx_peerinfos(iter), iter->pfx_peer_it).user = user;
-  return 1;
+  return (khret < 0) ? -1 : 0;
 }
 
-/* ==================== PEER ITERATORS ==================== */
+/* remove the current prefix of the iterator from the index of the current
+   peer */
+static void peerinfo_idx_del(bgpview_iter_t *iter)
+{
+  bwv_peerinfo_t *peerinfo = &BWV_PEER_INFO(iter->view, iter->peer_it);
+  khiter_t k;
 
-/* internal macros, optimized for performance */
+  switch (iter->version_ptr) {
+  case BGPSTREAM_ADDR_VERSION_IPV4:
+    if (peerinfo->v4pfxs_idx != NULL &&
+        (k = kh_get(bwv_v4pfx_set, peerinfo->v4pfxs_idx,
+                    kh_key(iter->view->v4pfxs, iter->pfx_it))) !=
+          kh_end(peerinfo->v4pfxs_idx)) {
+      kh_del(bwv_v4pfx_set, peerinfo->v4pfxs_idx, k);
+    }
+    break;
 
-#define WHILE_NOT_MATCHED_PEER(iter)                                           \
-  while (iter->peer_it != kh_end(iter->view->peerinfo) &&                      \
-         (!kh_exist(iter->view->peerinfo, iter->peer_it) ||                    \
-          !(iter->peer_state_mask &                                            \
-            kh_val(iter->view->peerinfo, iter->peer_it).state)))
+  case BGPSTREAM_ADDR_VERSION_IPV6:
+    if (peerinfo->v6pfxs_idx != NULL &&
+        (k = kh_get(bwv_v6pfx_set, peerinfo->v6pfxs_idx,
+                    kh_key(iter->view->v6pfxs, iter->pfx_it))) !=
+          kh_end(peerinfo->v6pfxs_idx)) {
+      kh_del(bwv_v6pfx_set, peerinfo->v6pfxs_idx, k);
+    }
+    break;
 
-#define __iter_first_peer(iter, state_mask)                                    \
-  do {                                                                         \
-    iter->peer_it = kh_begin(iter->view->peerinfo);                            \
-    iter->peer_state_mask = state_mask;                                        \
-    iter->pfx_peer_it_valid = 0;                                               \
-    /* keep searching if this does not exist */                                \
-    WHILE_NOT_MATCHED_PEER(iter)                                               \
-    {                                                                          \
-      iter->peer_it++;                                                         \
-    }                                                                          \
-  } while (0)
+  default:
+    break;
+  }
+}
 
-#define __iter_next_peer(iter)                                                 \
-  do {                                                                         \
-    do {                                                                       \
-      iter->peer_it++;                                                         \
-    }                                                                          \
-    WHILE_NOT_MATCHED_PEER(iter);                                              \
-  } while (0)
+static void peerinfo_destroy_user(bgpview_t *view)
+{
+  bwv_peerinfo_t *pi;
+  uint32_t i;
 
-#define __iter_has_more_peer(iter)                                             \
-  (iter->peer_it != kh_end(iter->view->peerinfo))
+  if (view->peer_user_destructor == NULL) {
+    return;
+  }
+  for (i = 0; i < view->peerinfo.cnt; i++) {
+    pi = &BWV_PEER_INFO(view, view->peerinfo.ids[i]);
+    if (pi->user == NULL) {
+      continue;
+    }
+    view->peer_user_destructor(pi->user);
+    pi->user = NULL;
+  }
+}
 
-#define __iter_seek_peer(iter, peerid, state_mask)                             \
-  do {                                                                         \
-    iter->peer_state_mask = state_mask;                                        \
-    iter->peer_it = kh_get(bwv_peerid_peerinfo, iter->view->peerinfo, peerid); \
-  } while (0)
+static bwv_peerid_pfxinfo_t *peerid_pfxinfo_create(bgpview_t *view)
+{
+  bwv_peerid_pfxinfo_t *v;
 
-/* external functions */
+  if ((v = bgpview_slab_alloc(view->pfxinfo_slab)) == NULL) {
+    return NULL;
+  }
+  memset(v, 0, sizeof(bwv_peerid_pfxinfo_t));
+  v->state = BGPVIEW_FIELD_INVALID;
+  v->gen = view->snap_gen;
 
-int bgpview_iter_first_peer(bgpview_iter_t *iter, uint8_t state_mask)
-{
-  __iter_first_peer(iter, state_mask);
-  return __iter_has_more_peer(iter);
+  /* all other fields are memset to 0 */
+
+  return v;
 }
 
-int bgpview_iter_next_peer(bgpview_iter_t *iter)
+/* find the index of the given peer in a sorted cell array, or the index at
+   which it should be inserted if it is not present */
+static int pfx_peer_vec_lower_bound(bwv_pfx_peer_vec_t *vec,
+                                    bgpstream_peer_id_t peerid)
 {
-  __iter_next_peer(iter);
-  return __iter_has_more_peer(iter);
+  bgpstream_peer_id_t *ids = BWV_VEC_IDS(vec);
+  int lo = 0;
+  int hi = vec->cnt;
+  int mid;
+
+  while (lo < hi) {
+    mid = (lo + hi) / 2;
+    if (ids[mid] < peerid) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
 }
 
-int bgpview_iter_has_more_peer(bgpview_iter_t *iter)
+/* returns the index of the cell for the given peer, or vec->cnt if the peer
+   is not present */
+static khiter_t pfx_peer_vec_get(bwv_pfx_peer_vec_t *vec,
+                                 bgpstream_peer_id_t peerid)
 {
-  return __iter_has_more_peer(iter);
+  int i = pfx_peer_vec_lower_bound(vec, peerid);
+  if (i < vec->cnt && BWV_VEC_IDS(vec)[i] == peerid) {
+    return i;
+  }
+  return vec->cnt;
 }
 
-int bgpview_iter_seek_peer(bgpview_iter_t *iter, bgpstream_peer_id_t peerid,
-                           uint8_t state_mask)
+BWV_CELLS_TAB_INIT(tab_ext, bwv_peerid_pfx_peerinfo_ext, peers_ext)
+BWV_CELLS_TAB_INIT(tab_min, bwv_peerid_pfx_peerinfo, peers_min)
+BWV_CELLS_VEC_INIT(vec_ext, bwv_pfx_peerinfo_ext_t)
+BWV_CELLS_VEC_INIT(vec_min, bwv_pfx_peerinfo_t)
+
+static inline bwv_pfx_peerinfo_t *
+bwv_cell_ptr(bgpview_t *view, bwv_peerid_pfxinfo_t *v, khiter_t k)
 {
-  iter->pfx_peer_it_valid = 0; // moving peer_it invalidates pfx_peer_it
-  __iter_seek_peer(iter, peerid, state_mask);
-  if (iter->peer_it == kh_end(iter->view->peerinfo)) {
-    return 0;
-  }
-  if (iter->peer_state_mask &
-      kh_val(iter->view->peerinfo, iter->peer_it).state) {
-    return 1;
+  switch ((bwv_cell_kind_t)view->cell_kind) {
+  case BWV_CELLS_TAB_MIN:
+    return cell_ptr_tab_min(v, k);
+  case BWV_CELLS_VEC_EXT:
+    return cell_ptr_vec_ext(v, k);
+  case BWV_CELLS_VEC_MIN:
+    return cell_ptr_vec_min(v, k);
+  case BWV_CELLS_TAB_EXT:
+  default:
+    return cell_ptr_tab_ext(v, k);
   }
-  iter->peer_it = kh_end(iter->view->peerinfo);
-  return 0;
 }
 
-/* ==================== PFX ITERATORS ==================== */
-
-#define WHILE_NOT_MATCHED_PFX(iter, table)                                     \
-  while ((iter)->pfx_it != kh_end((table)) &&   /* each hash item */           \
-         (!kh_exist((table), (iter)->pfx_it) || /* in hash? */                 \
-          !((iter)->pfx_state_mask &            /* correct state? */           \
-            kh_val((table), (iter)->pfx_it)->state)))
+static void update_cell_kind(bgpview_t *view)
+{
+  if (view->cell_layout == BGPVIEW_CELL_LAYOUT_SORTED) {
+    view->cell_kind =
+      view->disable_extended ? BWV_CELLS_VEC_MIN : BWV_CELLS_VEC_EXT;
+  } else {
+    view->cell_kind =
+      view->disable_extended ? BWV_CELLS_TAB_MIN : BWV_CELLS_TAB_EXT;
+  }
+}
 
-#define __pfx_valid(iter, table) ((iter)->pfx_it != kh_end((table)))
+#define BWV_PFX_PEER_VEC_CLASS_ALLOC(cls)                                      \
+  (((BWV_PFX_PEER_VEC_INIT_SIZE << (cls)) > UINT16_MAX)                        \
+     ? UINT16_MAX                                                              \
+     : (BWV_PFX_PEER_VEC_INIT_SIZE << (cls)))
 
-#define RETURN_IF_PFX_VALID(iter, table)                                       \
-  do {                                                                         \
-    if (__pfx_valid(iter, table)) {                                            \
-      return 1;                                                                \
-    }                                                                          \
-  } while (0)
+static int pfx_peer_vec_class(bwv_pfx_peer_vec_t *vec)
+{
+  int cls = 0;
+  while (BWV_PFX_PEER_VEC_CLASS_ALLOC(cls) < vec->alloc) {
+    cls++;
+  }
+  return cls;
+}
 
-int bgpview_iter_first_pfx(bgpview_iter_t *iter, int version,
-                           uint8_t state_mask)
+static void pfx_peer_vec_free(bgpview_t *view, bwv_pfx_peer_vec_t *vec)
 {
-  // set the version we iterate through
-  iter->version_filter = version;
+  if (vec == NULL) {
+    return;
+  }
+  WRITERS_MISC_LOCK(view);
+  bgpview_slab_free(view->cells_slab[pfx_peer_vec_class(vec)], vec);
+  WRITERS_MISC_UNLOCK(view);
+}
 
-  // set the version we start iterating through
-  if (iter->version_filter == BGPSTREAM_ADDR_VERSION_IPV4 ||
-      iter->version_filter == 0) {
-    iter->version_ptr = BGPSTREAM_ADDR_VERSION_IPV4;
-  } else {
-    iter->version_ptr = BGPSTREAM_ADDR_VERSION_IPV6;
+/* allocate an array of the given size class, copying the cells of (and then
+   freeing) vec if it is not NULL */
+static bwv_pfx_peer_vec_t *pfx_peer_vec_alloc(bgpview_t *view,
+                                              bwv_pfx_peer_vec_t *vec, int cls)
+{
+  size_t recsize = BWV_PFX_PEERINFO_SIZE(view);
+  int alloc = BWV_PFX_PEER_VEC_CLASS_ALLOC(cls);
+  bwv_pfx_peer_vec_t *new_vec;
+
+  WRITERS_MISC_LOCK(view);
+  if (view->cells_slab[cls] == NULL) {
+    if ((view->cells_slab[cls] = bgpview_slab_create(
+           sizeof(bwv_pfx_peer_vec_t) +
+             alloc * (sizeof(bgpstream_peer_id_t) + recsize),
+           BWV_SLAB_SIZE)) == NULL) {
+      WRITERS_MISC_UNLOCK(view);
+      return NULL;
+    }
+    if (view->huge_pages != 0) {
+      bgpview_slab_enable_huge_pages(view->cells_slab[cls]);
+    }
   }
+  new_vec = bgpview_slab_alloc(view->cells_slab[cls]);
+  WRITERS_MISC_UNLOCK(view);
 
-  // set the pfx mask
-  iter->pfx_state_mask = state_mask;
+  if (new_vec == NULL) {
+    return NULL;
+  }
+  new_vec->alloc = alloc;
+  new_vec->cnt = 0;
+
+  if (vec != NULL) {
+    new_vec->cnt = vec->cnt;
+    memcpy(BWV_VEC_IDS(new_vec), BWV_VEC_IDS(vec),
+           sizeof(bgpstream_peer_id_t) * vec->cnt);
+    memcpy(BWV_VEC_REC(view, new_vec, 0), BWV_VEC_REC(view, vec, 0),
+           recsize * vec->cnt);
+    pfx_peer_vec_free(view, vec);
+  }
 
-  // moving pfx_it invalidates pfx_peer_it
-  iter->pfx_peer_it_valid = 0;
+  return new_vec;
+}
 
-  if (iter->version_ptr == BGPSTREAM_ADDR_VERSION_IPV4) {
-    iter->pfx_it = kh_begin(iter->view->v4pfxs);
-    /* keep searching if this does not exist */
-    WHILE_NOT_MATCHED_PFX(iter, iter->view->v4pfxs)
-    {
-      iter->pfx_it++;
-    }
-    RETURN_IF_PFX_VALID(iter, iter->view->v4pfxs);
+/* returns the index of the (possibly new) cell for the given peer, or -1 if
+   the array could not be grown */
+static int pfx_peer_vec_put(bgpview_t *view, bwv_peerid_pfxinfo_t *v,
+                            bgpstream_peer_id_t peerid)
+{
+  bwv_pfx_peer_vec_t *vec = v->peers_vec;
+  size_t recsize = BWV_PFX_PEERINFO_SIZE(view);
+  bgpstream_peer_id_t *ids;
+  bwv_pfx_peerinfo_t *rec;
+  int cls;
+  int i;
+
+  i = pfx_peer_vec_lower_bound(vec, peerid);
+  if (i < vec->cnt && BWV_VEC_IDS(vec)[i] == peerid) {
+    return i;
+  }
 
-    // no ipv4 prefix was found, we don't look for other versions
-    // unless version_filter is zero
-    if (iter->version_filter) {
-      return 0;
+  if (vec->cnt == vec->alloc) {
+    // grow geometrically by moving to the next size class
+    cls = pfx_peer_vec_class(vec) + 1;
+    if (cls == BWV_PFX_PEER_VEC_CLASS_CNT ||
+        (vec = pfx_peer_vec_alloc(view, vec, cls)) == NULL) {
+      return -1;
     }
-
-    // continue to the next IP version
-    iter->version_ptr = BGPSTREAM_ADDR_VERSION_IPV6;
+    v->peers_vec = vec;
   }
 
-  if (iter->version_ptr == BGPSTREAM_ADDR_VERSION_IPV6) {
-    iter->pfx_it = kh_begin(iter->view->v6pfxs);
-    /* keep searching if this does not exist */
-    WHILE_NOT_MATCHED_PFX(iter, iter->view->v6pfxs)
-    {
-      iter->pfx_it++;
-    }
-    RETURN_IF_PFX_VALID(iter, iter->view->v6pfxs);
+  // shift the following cells up by one to make room
+  ids = BWV_VEC_IDS(vec);
+  rec = BWV_VEC_REC(view, vec, i);
+  memmove(&ids[i + 1], &ids[i], sizeof(bgpstream_peer_id_t) * (vec->cnt - i));
+  memmove((uint8_t *)rec + recsize, rec, recsize * (vec->cnt - i));
+  vec->cnt++;
+
+  ids[i] = peerid;
+  rec->state = BGPVIEW_FIELD_INVALID;
+  if (view->disable_extended == 0) {
+    ((bwv_pfx_peerinfo_ext_t *)rec)->user = NULL;
   }
 
-  return 0;
+  return i;
 }
 
-#define __iter_next_pfx_v4(iter)                                               \
+/* make room for cnt more cells in the given prefix, so that a row of cells
+   can be inserted without growing the cell table one step at a time */
+static int pfx_peer_cells_reserve(bgpview_t *view, bwv_peerid_pfxinfo_t *v,
+                                  int cnt)
+{
+  int need;
+  int cls = 0;
+
+  if (view->cell_layout == BGPVIEW_CELL_LAYOUT_SORTED) {
+    need = (v->peers_vec == NULL) ? cnt : v->peers_vec->cnt + cnt;
+    if (v->peers_vec != NULL && v->peers_vec->alloc >= need) {
+      return 0;
+    }
+    while (cls + 1 < BWV_PFX_PEER_VEC_CLASS_CNT &&
+           BWV_PFX_PEER_VEC_CLASS_ALLOC(cls) < need) {
+      cls++;
+    }
+    if (v->peers_vec != NULL &&
+        BWV_PFX_PEER_VEC_CLASS_ALLOC(cls) <= v->peers_vec->alloc) {
+      /* already as large as it can be */
+      return 0;
+    }
+    if ((v->peers_vec = pfx_peer_vec_alloc(view, v->peers_vec, cls)) ==
+        NULL) {
+      return -1;
+    }
+    return 0;
+  }
+
+  if (!v->peers_generic) {
+    if (view->disable_extended) {
+      v->peers_min = kh_init(bwv_peerid_pfx_peerinfo);
+    } else {
+      v->peers_ext = kh_init(bwv_peerid_pfx_peerinfo_ext);
+    }
+    if (v->peers_generic == NULL) {
+      return -1;
+    }
+  }
+
+  /* only ever grow the table (kh_resize also shrinks) */
+  if (view->disable_extended) {
+    need = kh_size(v->peers_min) + cnt;
+    if (need >= kh_n_buckets(v->peers_min) * __ac_HASH_UPPER) {
+      kh_resize(bwv_peerid_pfx_peerinfo, v->peers_min,
+                need / __ac_HASH_UPPER + 1);
+    }
+  } else {
+    need = kh_size(v->peers_ext) + cnt;
+    if (need >= kh_n_buckets(v->peers_ext) * __ac_HASH_UPPER) {
+      kh_resize(bwv_peerid_pfx_peerinfo_ext, v->peers_ext,
+                need / __ac_HASH_UPPER + 1);
+    }
+  }
+
+  return 0;
+}
+
+/* find (or create, in the invalid state) the cell of the given peer in the
+   given prefix. returns NULL if the cell table could not be grown */
+static bwv_pfx_peerinfo_t *pfx_peer_cell_put(bgpview_t *view,
+                                             bwv_peerid_pfxinfo_t *v,
+                                             bgpstream_peer_id_t peerid,
+                                             khiter_t *k)
+{
+  int khret;
+  int idx;
+
+  if (view->cell_layout == BGPVIEW_CELL_LAYOUT_SORTED) {
+    if (v->peers_vec == NULL &&
+        (v->peers_vec = pfx_peer_vec_alloc(view, NULL, 0)) == NULL) {
+      return NULL;
+    }
+    if ((idx = pfx_peer_vec_put(view, v, peerid)) < 0) {
+      return NULL;
+    }
+    *k = idx;
+    return BWV_VEC_REC(view, v->peers_vec, idx);
+  }
+
+  if (!v->peers_generic) {
+    if (view->disable_extended) {
+      v->peers_min = kh_init(bwv_peerid_pfx_peerinfo);
+    } else {
+      v->peers_ext = kh_init(bwv_peerid_pfx_peerinfo_ext);
+    }
+  }
+
+  if (view->disable_extended) {
+    *k = kh_put(bwv_peerid_pfx_peerinfo, v->peers_min, peerid, &khret);
+    if (khret > 0) {
+      // peer didn't exist; initialize it
+      kh_val(v->peers_min, *k).state = BGPVIEW_FIELD_INVALID;
+    }
+    return &kh_val(v->peers_min, *k);
+  }
+
+  *k = kh_put(bwv_peerid_pfx_peerinfo_ext, v->peers_ext, peerid, &khret);
+  if (khret > 0) {
+    // peer didn't exist; initialize it
+    kh_val(v->peers_ext, *k).state = BGPVIEW_FIELD_INVALID;
+    kh_val(v->peers_ext, *k).user = NULL;
+  }
+  return (bwv_pfx_peerinfo_t *)&kh_val(v->peers_ext, *k);
+}
+
+static int peerid_pfxinfo_insert(bgpview_iter_t *iter,
+                                 bwv_peerid_pfxinfo_t *v,
+                                 bgpstream_peer_id_t peerid,
+                                 bgpstream_as_path_store_path_id_t path_id)
+{
+  bwv_pfx_peerinfo_t *peerinfo = NULL;
+  khiter_t k;
+  int rc;
+
+  if ((peerinfo = pfx_peer_cell_put(iter->view, v, peerid, &k)) == NULL) {
+    return -1;
+  }
+
+  peerinfo->as_path_id = path_id;
+
+  if (peerinfo->state == BGPVIEW_FIELD_INVALID) {
+    // did not already exist or was invalid
+    peerinfo->state = BGPVIEW_FIELD_INACTIVE;
+
+    /** peerinfo->user remains untouched */
+
+    /* and count this as a new inactive peer for this prefix */
+    v->peers_cnt[BGPVIEW_FIELD_INACTIVE]++;
+
+    /* also count this as an inactive pfx for the peer */
+    switch (iter->version_ptr) {
+    case BGPSTREAM_ADDR_VERSION_IPV4:
+      SHARED_CNT_ADD(iter->view,
+                     BWV_PEER_INFO(iter->view, iter->peer_it)
+                       .v4_pfx_cnt[BGPVIEW_FIELD_INACTIVE],
+                     1);
+      break;
+    case BGPSTREAM_ADDR_VERSION_IPV6:
+      SHARED_CNT_ADD(iter->view,
+                     BWV_PEER_INFO(iter->view, iter->peer_it)
+                       .v6_pfx_cnt[BGPVIEW_FIELD_INACTIVE],
+                     1);
+      break;
+    default:
+      return -1;
+    }
+
+    if (iter->view->peer_pfx_index) {
+      WRITERS_MISC_LOCK(iter->view);
+      rc = peerinfo_idx_add(iter);
+      WRITERS_MISC_UNLOCK(iter->view);
+      if (rc != 0) {
+        return -1;
+      }
+    }
+  }
+
+  /* now seek the iterator to this pfx/peer */
+  iter->pfx_peer_it = k;
+  iter->pfx_peer_it_valid = 1;
+  iter->pfx_peer_state_mask = BGPVIEW_FIELD_ALL_VALID;
+
+  return 0;
+}
+
+static inline void pfx_peer_info_destroy(bgpview_t *view, bwv_pfx_peerinfo_t *v)
+{
+  return;
+}
+
+static inline void pfx_peer_info_ext_destroy(bgpview_t *view,
+                                             bwv_pfx_peerinfo_ext_t *v)
+{
+  ASSERT_BWV_PFX_PEERINFO_EXT(view);
+  if (v->user != NULL && view->pfx_peer_user_destructor != NULL) {
+    view->pfx_peer_user_destructor(v->user);
+  }
+  v->user = NULL;
+}
+
+static void peerid_pfxinfo_destroy(bgpview_t *view, bwv_peerid_pfxinfo_t *v)
+{
+  if (v == NULL) {
+    return;
+  }
+  khiter_t k;
+  if (v->peers_generic != NULL &&
+      view->cell_layout == BGPVIEW_CELL_LAYOUT_SORTED) {
+    if (view->disable_extended == 0) {
+      for (k = 0; k < v->peers_vec->cnt; k++) {
+        pfx_peer_info_ext_destroy(view,
+                                  BWV_PFX_GET_PEER_EXT_PTR(view, v, k));
+      }
+    }
+    pfx_peer_vec_free(view, v->peers_vec);
+  } else if (v->peers_generic != NULL) {
+    if (view->disable_extended == 0) {
+      for (k = kh_begin(v->peers_ext); k != kh_end(v->peers_ext); ++k) {
+        if (!kh_exist(v->peers_ext, k)) continue;
+        pfx_peer_info_ext_destroy(view, &kh_val(v->peers_ext, k));
+      }
+      kh_destroy(bwv_peerid_pfx_peerinfo_ext, v->peers_ext);
+    } else {
+      // loop calling empty inline function can be optimized away
+      for (k = kh_begin(v->peers_min); k != kh_end(v->peers_min); ++k) {
+        if (!kh_exist(v->peers_min, k)) continue;
+        pfx_peer_info_destroy(view, &kh_val(v->peers_min, k));
+      }
+      kh_destroy(bwv_peerid_pfx_peerinfo, v->peers_min);
+    }
+  }
+  v->peers_generic = NULL;
+  v->state = BGPVIEW_FIELD_INVALID;
+  if (view->pfx_user_destructor != NULL && v->user != NULL) {
+    view->pfx_user_destructor(v->user);
+  }
+  v->user = NULL;
+  bgpview_slab_free(view->pfxinfo_slab, v);
+}
+
+/* free the invalid pfx-peers of a (valid) prefix, and shrink its cell table
+   if it is now mostly empty */
+static int peerid_pfxinfo_compact(bgpview_t *view, bwv_peerid_pfxinfo_t *v)
+{
+  bwv_pfx_peer_vec_t *vec;
+  bwv_pfx_peer_vec_t *new_vec;
+  khiter_t k;
+  int i, j, cls;
+
+  if (v->peers_generic == NULL) {
+    return 0;
+  }
+
+  if (view->cell_layout == BGPVIEW_CELL_LAYOUT_SORTED) {
+    vec = v->peers_vec;
+    for (i = 0, j = 0; i < vec->cnt; i++) {
+      if (BWV_VEC_REC(view, vec, i)->state == BGPVIEW_FIELD_INVALID) {
+        if (view->disable_extended == 0) {
+          pfx_peer_info_ext_destroy(view, BWV_PFX_GET_PEER_EXT_PTR(view, v, i));
+        }
+        continue;
+      }
+      if (i != j) {
+        BWV_VEC_IDS(vec)[j] = BWV_VEC_IDS(vec)[i];
+        memcpy(BWV_VEC_REC(view, vec, j), BWV_VEC_REC(view, vec, i),
+               BWV_PFX_PEERINFO_SIZE(view));
+      }
+      j++;
+    }
+    vec->cnt = j;
+
+    /* only shrink if less than a quarter of the array is in use, so that a
+       prefix that flaps does not keep being reallocated */
+    cls = 0;
+    while (BWV_PFX_PEER_VEC_CLASS_ALLOC(cls) < j) {
+      cls++;
+    }
+    if (cls + 2 <= pfx_peer_vec_class(vec)) {
+      if ((new_vec = pfx_peer_vec_alloc(view, vec, cls)) == NULL) {
+        return -1;
+      }
+      v->peers_vec = new_vec;
+    }
+  } else if (view->disable_extended) {
+    for (k = kh_begin(v->peers_min); k != kh_end(v->peers_min); ++k) {
+      if (kh_exist(v->peers_min, k) &&
+          kh_val(v->peers_min, k).state == BGPVIEW_FIELD_INVALID) {
+        pfx_peer_info_destroy(view, &kh_val(v->peers_min, k));
+        kh_del(bwv_peerid_pfx_peerinfo, v->peers_min, k);
+      }
+    }
+    if (kh_size(v->peers_min) * 4 < kh_n_buckets(v->peers_min) &&
+        kh_resize(bwv_peerid_pfx_peerinfo, v->peers_min,
+                  kh_size(v->peers_min) * 2) < 0) {
+      return -1;
+    }
+  } else {
+    for (k = kh_begin(v->peers_ext); k != kh_end(v->peers_ext); ++k) {
+      if (kh_exist(v->peers_ext, k) &&
+          kh_val(v->peers_ext, k).state == BGPVIEW_FIELD_INVALID) {
+        pfx_peer_info_ext_destroy(view, &kh_val(v->peers_ext, k));
+        kh_del(bwv_peerid_pfx_peerinfo_ext, v->peers_ext, k);
+      }
+    }
+    if (kh_size(v->peers_ext) * 4 < kh_n_buckets(v->peers_ext) &&
+        kh_resize(bwv_peerid_pfx_peerinfo_ext, v->peers_ext,
+                  kh_size(v->peers_ext) * 2) < 0) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+#define __pfx_peerinfos(iter)                                                  \
+  (((iter)->version_ptr == BGPSTREAM_ADDR_VERSION_IPV4)                        \
+     ? (kh_val((iter)->view->v4pfxs, (iter)->pfx_it))                          \
+     : ((iter)->version_ptr == BGPSTREAM_ADDR_VERSION_IPV6)                    \
+         ? (kh_val((iter)->view->v6pfxs, (iter)->pfx_it))                      \
+         : NULL)
+
+/* ========== SNAPSHOT FUNCTIONS ========== */
+
+/* make a copy of the given prefix info (owned by the snapshot) */
+static bwv_peerid_pfxinfo_t *snapshot_copy_pfxinfo(bgpview_t *snap,
+                                                   bwv_peerid_pfxinfo_t *v)
+{
+  bwv_peerid_pfxinfo_t *copy;
+  bwv_peerid_pfxinfo_t **tmp;
+  khiter_t k;
+
+  if (snap->snap_copies_cnt == snap->snap_copies_alloc_cnt) {
+    if ((tmp = realloc(snap->snap_copies,
+                       sizeof(bwv_peerid_pfxinfo_t *) *
+                         (snap->snap_copies_alloc_cnt + 1024))) == NULL) {
+      return NULL;
+    }
+    snap->snap_copies = tmp;
+    snap->snap_copies_alloc_cnt += 1024;
+  }
+
+  if ((copy = peerid_pfxinfo_create(snap)) == NULL) {
+    return NULL;
+  }
+  copy->peers_cnt[BGPVIEW_FIELD_INACTIVE] =
+    v->peers_cnt[BGPVIEW_FIELD_INACTIVE];
+  copy->peers_cnt[BGPVIEW_FIELD_ACTIVE] = v->peers_cnt[BGPVIEW_FIELD_ACTIVE];
+  copy->state = v->state;
+  /* user pointers are not preserved in snapshots */
+
+  if (v->peers_generic == NULL) {
+    goto done;
+  }
+
+  if (snap->cell_layout == BGPVIEW_CELL_LAYOUT_SORTED) {
+    if ((copy->peers_vec = pfx_peer_vec_alloc(
+           snap, NULL, pfx_peer_vec_class(v->peers_vec))) == NULL) {
+      goto err;
+    }
+    copy->peers_vec->cnt = v->peers_vec->cnt;
+    memcpy(BWV_VEC_IDS(copy->peers_vec), BWV_VEC_IDS(v->peers_vec),
+           sizeof(bgpstream_peer_id_t) * v->peers_vec->cnt);
+    memcpy(BWV_VEC_REC(snap, copy->peers_vec, 0),
+           BWV_VEC_REC(snap, v->peers_vec, 0),
+           BWV_PFX_PEERINFO_SIZE(snap) * v->peers_vec->cnt);
+    if (snap->disable_extended == 0) {
+      for (k = 0; k < copy->peers_vec->cnt; k++) {
+        BWV_PFX_GET_PEER_EXT_PTR(snap, copy, k)->user = NULL;
+      }
+    }
+  } else if (snap->disable_extended) {
+    if ((copy->peers_min = kh_init(bwv_peerid_pfx_peerinfo)) == NULL ||
+        kh_copy_bwv_peerid_pfx_peerinfo(copy->peers_min, v->peers_min) != 0) {
+      goto err;
+    }
+  } else {
+    if ((copy->peers_ext = kh_init(bwv_peerid_pfx_peerinfo_ext)) == NULL ||
+        kh_copy_bwv_peerid_pfx_peerinfo_ext(copy->peers_ext, v->peers_ext) !=
+          0) {
+      goto err;
+    }
+    for (k = kh_begin(copy->peers_ext); k != kh_end(copy->peers_ext); ++k) {
+      kh_val(copy->peers_ext, k).user = NULL;
+    }
+  }
+
+done:
+  snap->snap_copies[snap->snap_copies_cnt++] = copy;
+  return copy;
+
+err:
+  peerid_pfxinfo_destroy(snap, copy);
+  return NULL;
+}
+
+/* called before a prefix of a view that has snapshots is changed (or freed):
+   give every snapshot that still shares the prefix info with the view its own
+   copy of the current contents */
+static int snapshot_preserve_pfx_locked(bgpview_t *view, int version,
+                                        khiter_t pfx_k)
+{
+  bgpview_t *snap;
+  bwv_peerid_pfxinfo_t *v;
+  bwv_peerid_pfxinfo_t *copy = NULL;
+  khiter_t k;
+  int i;
+
+  switch (version) {
+  case BGPSTREAM_ADDR_VERSION_IPV4:
+    v = kh_val(view->v4pfxs, pfx_k);
+    break;
+  case BGPSTREAM_ADDR_VERSION_IPV6:
+    v = kh_val(view->v6pfxs, pfx_k);
+    break;
+  default:
+    return -1;
+  }
+
+  for (i = 0; i < view->snapshots_cnt; i++) {
+    snap = view->snapshots[i];
+
+    if (version == BGPSTREAM_ADDR_VERSION_IPV4) {
+      k = kh_get(bwv_v4pfx_peerid_pfxinfo, snap->v4pfxs,
+                 kh_key(view->v4pfxs, pfx_k));
+      if (k == kh_end(snap->v4pfxs) || kh_val(snap->v4pfxs, k) != v) {
+        continue;
+      }
+      if (v->state == BGPVIEW_FIELD_INVALID) {
+        /* invalid in the snapshot too, so just forget about it */
+        kh_del(bwv_v4pfx_peerid_pfxinfo, snap->v4pfxs, k);
+        continue;
+      }
+      if ((copy = snapshot_copy_pfxinfo(snap, v)) == NULL) {
+        goto err;
+      }
+      kh_val(snap->v4pfxs, k) = copy;
+    } else {
+      k = kh_get(bwv_v6pfx_peerid_pfxinfo, snap->v6pfxs,
+                 kh_key(view->v6pfxs, pfx_k));
+      if (k == kh_end(snap->v6pfxs) || kh_val(snap->v6pfxs, k) != v) {
+        continue;
+      }
+      if (v->state == BGPVIEW_FIELD_INVALID) {
+        kh_del(bwv_v6pfx_peerid_pfxinfo, snap->v6pfxs, k);
+        continue;
+      }
+      if ((copy = snapshot_copy_pfxinfo(snap, v)) == NULL) {
+        goto err;
+      }
+      kh_val(snap->v6pfxs, k) = copy;
+    }
+  }
+
+  /* no snapshot shares this prefix info any longer */
+  v->gen = view->snap_gen;
+  return 0;
+
+err:
+  /* snapshots that already got their copy are skipped on the next attempt */
+  fprintf(stderr, "ERROR: Could not preserve prefix in view snapshot\n");
+  return -1;
+}
+
+static int snapshot_preserve_pfx(bgpview_t *view, int version, khiter_t pfx_k)
+{
+  int rc;
+
+  /* the snapshots are shared by all concurrent writers */
+  WRITERS_MISC_LOCK(view);
+  rc = snapshot_preserve_pfx_locked(view, version, pfx_k);
+  WRITERS_MISC_UNLOCK(view);
+  return rc;
+}
+
+/* preserve the current prefix of the iterator (if needed) */
+#define SNAPSHOT_PRESERVE_PFX(iter)                                            \
   do {                                                                         \
-    /* skip to the next v4 pfx */                                              \
-    do {                                                                       \
-      (iter)->pfx_it++;                                                        \
-    }                                                                          \
-    WHILE_NOT_MATCHED_PFX(iter, (iter)->view->v4pfxs);                         \
-    /* if no v4 pfx, but considering all versions... */                        \
-    if (__pfx_valid(iter, (iter)->view->v4pfxs) == 0 &&                        \
-        (iter)->version_filter == 0) {                                         \
-      /* skip to the first v6 pfx */                                           \
-      bgpview_iter_first_pfx((iter), BGPSTREAM_ADDR_VERSION_IPV6,              \
-                             (iter)->pfx_state_mask);                          \
+    assert((iter)->view->is_snapshot == 0);                                    \
+    if ((iter)->view->snapshots_cnt != 0 &&                                    \
+        __pfx_peerinfos(iter)->gen != (iter)->view->snap_gen &&                \
+        snapshot_preserve_pfx((iter)->view, (iter)->version_ptr,               \
+                              (iter)->pfx_it) != 0) {                          \
+      return -1;                                                               \
     }                                                                          \
-    /* here: valid v4, valid v6, or invalid */                                 \
   } while (0)
 
-#define __iter_next_pfx_v6(iter)                                               \
+/* forget about a snapshot that is being destroyed */
+static void snapshot_detach(bgpview_t *view, bgpview_t *snap)
+{
+  int i;
+  for (i = 0; i < view->snapshots_cnt; i++) {
+    if (view->snapshots[i] == snap) {
+      view->snapshots[i] = view->snapshots[--view->snapshots_cnt];
+      return;
+    }
+  }
+}
+
+/* free all the prefix infos owned by a snapshot */
+static void snapshot_release_copies(bgpview_t *snap)
+{
+  uint32_t i;
+  for (i = 0; i < snap->snap_copies_cnt; i++) {
+    peerid_pfxinfo_destroy(snap, snap->snap_copies[i]);
+  }
+  snap->snap_copies_cnt = 0;
+}
+
+/* called when the view is cleared with snapshots: rather than copying every
+   prefix info that may be shared with a snapshot, remove it from the view and
+   leave it to the snapshots until they no longer use it */
+static int snapshot_retire_pfxs(bgpview_t *view)
+{
+  bwv_retired_pfxinfo_t *tmp;
+  uint32_t need;
+  khiter_t k;
+
+  need = view->retired_cnt + kh_size(view->v4pfxs) + kh_size(view->v6pfxs);
+  if (need > view->retired_alloc_cnt) {
+    if ((tmp = realloc(view->retired, sizeof(bwv_retired_pfxinfo_t) * need)) ==
+        NULL) {
+      return -1;
+    }
+    view->retired = tmp;
+    view->retired_alloc_cnt = need;
+  }
+
+#define RETIRE_PFXS(tabletype, table)                                          \
   do {                                                                         \
-    do {                                                                       \
-      iter->pfx_it++;                                                          \
+    for (k = kh_begin(table); k != kh_end(table); ++k) {                       \
+      if (!kh_exist(table, k) || kh_val(table, k)->gen == view->snap_gen) {    \
+        continue;                                                              \
+      }                                                                        \
+      view->retired[view->retired_cnt].pfxinfo = kh_val(table, k);             \
+      view->retired[view->retired_cnt].gen = view->snap_gen;                   \
+      view->retired_cnt++;                                                     \
+      kh_del(tabletype, table, k);                                             \
     }                                                                          \
-    WHILE_NOT_MATCHED_PFX(iter, iter->view->v6pfxs);                           \
   } while (0)
 
-#define __iter_next_pfx(iter)                                                  \
+  RETIRE_PFXS(bwv_v4pfx_peerid_pfxinfo, view->v4pfxs);
+  RETIRE_PFXS(bwv_v6pfx_peerid_pfxinfo, view->v6pfxs);
+#undef RETIRE_PFXS
+
+  return 0;
+}
+
+/* free the retired prefix infos that no snapshot uses any longer (i.e. every
+   snapshot has been updated since they were retired) */
+static void snapshot_sweep_retired(bgpview_t *view)
+{
+  uint32_t i, j;
+  int s;
+
+  for (i = 0, j = 0; i < view->retired_cnt; i++) {
+    for (s = 0; s < view->snapshots_cnt; s++) {
+      if (view->snapshots[s]->snap_update_gen <= view->retired[i].gen) {
+        break;
+      }
+    }
+    if (s < view->snapshots_cnt) {
+      view->retired[j++] = view->retired[i];
+    } else {
+      peerid_pfxinfo_destroy(view, view->retired[i].pfxinfo);
+    }
+  }
+  view->retired_cnt = j;
+}
+
+/* ========== JOURNAL FUNCTIONS ========== */
+
+/* record the current prefix of the iterator in the change journal */
+static void journal_mark_pfx(bgpview_iter_t *iter)
+{
+  bgpview_t *view = iter->view;
+  bgpstream_pfx_t *tmp;
+
+  WRITERS_MISC_LOCK(view);
+  if (view->journal_cnt == view->journal_alloc_cnt) {
+    if ((tmp = realloc(view->journal,
+                       sizeof(bgpstream_pfx_t) *
+                         (view->journal_alloc_cnt + 1024))) == NULL) {
+      /* the change is lost, so the journal can't be trusted until the next
+         checkpoint */
+      view->journal_complete = 0;
+      WRITERS_MISC_UNLOCK(view);
+      return;
+    }
+    view->journal = tmp;
+    view->journal_alloc_cnt += 1024;
+  }
+
+  if (iter->version_ptr == BGPSTREAM_ADDR_VERSION_IPV4) {
+    bgpstream_pfx_copy(&view->journal[view->journal_cnt++],
+                       (bgpstream_pfx_t *)&kh_key(view->v4pfxs, iter->pfx_it));
+  } else {
+    bgpstream_pfx_copy(&view->journal[view->journal_cnt++],
+                       (bgpstream_pfx_t *)&kh_key(view->v6pfxs, iter->pfx_it));
+  }
+  WRITERS_MISC_UNLOCK(view);
+  __pfx_peerinfos(iter)->journal_dirty = 1;
+}
+
+/* record that the pfx-peers of the current prefix of the iterator changed
+   (if the journal is enabled) */
+#define JOURNAL_MARK_PFX(iter)                                                 \
   do {                                                                         \
-    (iter)->pfx_peer_it_valid = 0;                                             \
-    if ((iter)->version_ptr == BGPSTREAM_ADDR_VERSION_IPV4) {                  \
-      __iter_next_pfx_v4(iter);                                                \
-    } else {                                                                   \
-      __iter_next_pfx_v6(iter);                                                \
+    if ((iter)->view->journal_enabled &&                                       \
+        __pfx_peerinfos(iter)->journal_dirty == 0) {                           \
+      journal_mark_pfx(iter);                                                  \
     }                                                                          \
   } while (0)
 
-#define __iter_has_more_pfx_v(iter, table) ((iter)->pfx_it != kh_end((table)))
+/* sort the journal and drop duplicates (a prefix that is garbage collected
+   and then re-added is recorded again) */
+static void journal_sort(bgpview_t *view)
+{
+  uint32_t i, j;
+
+  if (view->journal_cnt < 2) {
+    return;
+  }
+  qsort(view->journal, view->journal_cnt, sizeof(bgpstream_pfx_t),
+        journal_pfx_cmp);
+  for (i = 1, j = 1; i < view->journal_cnt; i++) {
+    if (pfx_cmp(&view->journal[i], &view->journal[j - 1]) != 0) {
+      view->journal[j++] = view->journal[i];
+    }
+  }
+  view->journal_cnt = j;
+}
+
+/* find the prefix info of a prefix (NULL if the view has no such prefix) */
+static bwv_peerid_pfxinfo_t *journal_get_pfxinfo(bgpview_t *view,
+                                                 bgpstream_pfx_t *pfx)
+{
+  khiter_t k;
+
+  if (pfx->address.version == BGPSTREAM_ADDR_VERSION_IPV4) {
+    k = kh_get(bwv_v4pfx_peerid_pfxinfo, view->v4pfxs, pfx->bs_ipv4);
+    return (k == kh_end(view->v4pfxs)) ? NULL : kh_val(view->v4pfxs, k);
+  } else if (pfx->address.version == BGPSTREAM_ADDR_VERSION_IPV6) {
+    k = kh_get(bwv_v6pfx_peerid_pfxinfo, view->v6pfxs, pfx->bs_ipv6);
+    return (k == kh_end(view->v6pfxs)) ? NULL : kh_val(view->v6pfxs, k);
+  }
+  return NULL;
+}
+
+/* the bucket arrays of the prefix tables are reallocated as the tables
+   grow, so advise them again whenever they are resized */
+static void advise_pfx_tables(bgpview_t *view)
+{
+  if (view->v4pfxs->n_buckets != view->v4pfxs_advised) {
+    bgpview_slab_advise_huge_pages(view->v4pfxs->keys,
+                                   sizeof(*view->v4pfxs->keys) *
+                                     view->v4pfxs->n_buckets);
+    bgpview_slab_advise_huge_pages(view->v4pfxs->vals,
+                                   sizeof(*view->v4pfxs->vals) *
+                                     view->v4pfxs->n_buckets);
+    view->v4pfxs_advised = view->v4pfxs->n_buckets;
+  }
+  if (view->v6pfxs->n_buckets != view->v6pfxs_advised) {
+    bgpview_slab_advise_huge_pages(view->v6pfxs->keys,
+                                   sizeof(*view->v6pfxs->keys) *
+                                     view->v6pfxs->n_buckets);
+    bgpview_slab_advise_huge_pages(view->v6pfxs->vals,
+                                   sizeof(*view->v6pfxs->vals) *
+                                     view->v6pfxs->n_buckets);
+    view->v6pfxs_advised = view->v6pfxs->n_buckets;
+  }
+}
+
+static int add_v4pfx(bgpview_iter_t *iter, bgpstream_ipv4_pfx_t *pfx)
+{
+  bwv_peerid_pfxinfo_t *new_pfxpeerinfo;
+  khiter_t k;
+  int khret;
+
+  if (iter->view->writers != NULL) {
+    /* the prefix was inserted by bgpview_iter_lock_pfx (the table must not
+       be modified while other writers may be using it) */
+    k = kh_get(bwv_v4pfx_peerid_pfxinfo, iter->view->v4pfxs, *pfx);
+    if (k == kh_end(iter->view->v4pfxs)) {
+      /* the prefix was not locked */
+      return -1;
+    }
+    khret = 0;
+  } else {
+    k = kh_put(bwv_v4pfx_peerid_pfxinfo, iter->view->v4pfxs, *pfx, &khret);
+  }
+  if (khret > 0) {
+    /* pfx didn't exist */
+    if (iter->view->huge_pages != 0) {
+      advise_pfx_tables(iter->view);
+    }
+    if ((new_pfxpeerinfo = peerid_pfxinfo_create(iter->view)) == NULL) {
+      return -1;
+    }
+    kh_value(iter->view->v4pfxs, k) = new_pfxpeerinfo;
+
+    /* pfx is invalid at this point */
+  }
+
+  /* seek the iterator to this prefix */
+  iter->pfx_it = k;
+  iter->version_ptr = BGPSTREAM_ADDR_VERSION_IPV4;
+  iter->pfx_peer_it_valid = 0; // moving pfx_it invalidates pfx_peer_it
+
+  if (kh_value(iter->view->v4pfxs, k)->state != BGPVIEW_FIELD_INVALID) {
+    /* it was already there and active/inactive */
+    return 0;
+  }
+
+  SNAPSHOT_PRESERVE_PFX(iter);
+
+  kh_value(iter->view->v4pfxs, k)->state = BGPVIEW_FIELD_INACTIVE;
+  SHARED_CNT_ADD(iter->view, iter->view->v4pfxs_cnt[BGPVIEW_FIELD_INACTIVE],
+                 1);
+
+  return 0;
+}
+
+static int add_v6pfx(bgpview_iter_t *iter, bgpstream_ipv6_pfx_t *pfx)
+{
+  bwv_peerid_pfxinfo_t *new_pfxpeerinfo;
+  khiter_t k;
+  int khret;
+
+  if (iter->view->writers != NULL) {
+    /* the prefix was inserted by bgpview_iter_lock_pfx (the table must not
+       be modified while other writers may be using it) */
+    k = kh_get(bwv_v6pfx_peerid_pfxinfo, iter->view->v6pfxs, *pfx);
+    if (k == kh_end(iter->view->v6pfxs)) {
+      /* the prefix was not locked */
+      return -1;
+    }
+    khret = 0;
+  } else {
+    k = kh_put(bwv_v6pfx_peerid_pfxinfo, iter->view->v6pfxs, *pfx, &khret);
+  }
+  if (khret > 0) {
+    /* pfx didn't exist */
+    if (iter->view->huge_pages != 0) {
+      advise_pfx_tables(iter->view);
+    }
+    if ((new_pfxpeerinfo = peerid_pfxinfo_create(iter->view)) == NULL) {
+      return -1;
+    }
+    kh_value(iter->view->v6pfxs, k) = new_pfxpeerinfo;
+
+    /* pfx is invalid at this point */
+  }
+
+  /* seek the iterator to this prefix */
+  iter->pfx_it = k;
+  iter->version_ptr = BGPSTREAM_ADDR_VERSION_IPV6;
+  iter->pfx_peer_it_valid = 0; // moving pfx_it invalidates pfx_peer_it
+
+  if (kh_value(iter->view->v6pfxs, k)->state != BGPVIEW_FIELD_INVALID) {
+    /* it was already there and active/inactive */
+    return 0;
+  }
+
+  SNAPSHOT_PRESERVE_PFX(iter);
+
+  kh_value(iter->view->v6pfxs, k)->state = BGPVIEW_FIELD_INACTIVE;
+  SHARED_CNT_ADD(iter->view, iter->view->v6pfxs_cnt[BGPVIEW_FIELD_INACTIVE],
+                 1);
+
+  return 0;
+}
+
+static int add_pfx(bgpview_iter_t *iter, bgpstream_pfx_t *pfx)
+{
+  if (pfx->address.version == BGPSTREAM_ADDR_VERSION_IPV4) {
+    return add_v4pfx(iter, &pfx->bs_ipv4);
+  } else if (pfx->address.version == BGPSTREAM_ADDR_VERSION_IPV6) {
+    return add_v6pfx(iter, &pfx->bs_ipv6);
+  }
+
+  return -1;
+}
+
+/* insert a prefix key (in the invalid state) if it is not already in the
+   view. used by concurrent writers, with exclusive access to the tables.
+   returns 1 if the key was inserted, 0 if it was already there, -1 on
+   error */
+static int reserve_pfx(bgpview_t *view, bgpstream_pfx_t *pfx)
+{
+  bwv_peerid_pfxinfo_t *v;
+  khiter_t k;
+  int khret;
+
+  if (pfx->address.version == BGPSTREAM_ADDR_VERSION_IPV4) {
+    k = kh_put(bwv_v4pfx_peerid_pfxinfo, view->v4pfxs, pfx->bs_ipv4, &khret);
+    if (khret <= 0) {
+      return khret;
+    }
+    if ((v = peerid_pfxinfo_create(view)) == NULL) {
+      kh_del(bwv_v4pfx_peerid_pfxinfo, view->v4pfxs, k);
+      return -1;
+    }
+    kh_val(view->v4pfxs, k) = v;
+    /* if no pfx-peer is ever added, this is reclaimed by bgpview_gc */
+    view->need_gc_v4pfxs = 1;
+  } else if (pfx->address.version == BGPSTREAM_ADDR_VERSION_IPV6) {
+    k = kh_put(bwv_v6pfx_peerid_pfxinfo, view->v6pfxs, pfx->bs_ipv6, &khret);
+    if (khret <= 0) {
+      return khret;
+    }
+    if ((v = peerid_pfxinfo_create(view)) == NULL) {
+      kh_del(bwv_v6pfx_peerid_pfxinfo, view->v6pfxs, k);
+      return -1;
+    }
+    kh_val(view->v6pfxs, k) = v;
+    view->need_gc_v6pfxs = 1;
+  } else {
+    return -1;
+  }
+
+  if (view->huge_pages != 0) {
+    advise_pfx_tables(view);
+  }
+
+  return 1;
+}
+
+/* does the view have a key (possibly invalid) for the given prefix? */
+static int has_pfx_key(bgpview_t *view, bgpstream_pfx_t *pfx)
+{
+  if (pfx->address.version == BGPSTREAM_ADDR_VERSION_IPV4) {
+    return kh_get(bwv_v4pfx_peerid_pfxinfo, view->v4pfxs, pfx->bs_ipv4) !=
+           kh_end(view->v4pfxs);
+  } else if (pfx->address.version == BGPSTREAM_ADDR_VERSION_IPV6) {
+    return kh_get(bwv_v6pfx_peerid_pfxinfo, view->v6pfxs, pfx->bs_ipv6) !=
+           kh_end(view->v6pfxs);
+  }
+  return 0;
+}
+
+static int pfx_shard(bwv_writers_t *writers, bgpstream_pfx_t *pfx)
+{
+  uint32_t h;
+
+  if (pfx->address.version == BGPSTREAM_ADDR_VERSION_IPV4) {
+    h = bgpstream_ipv4_pfx_hash_val(pfx->bs_ipv4);
+  } else {
+    h = bgpstream_ipv6_pfx_hash_val(pfx->bs_ipv6);
+  }
+  return h % writers->shards_cnt;
+}
+
+/* ==================== ITERATOR FUNCTIONS ==================== */
+
+bgpview_iter_t *bgpview_iter_create(bgpview_t *view)
+{
+  bgpview_iter_t *iter;
+
+  /* DEBUG REMOVE ME */
+  fprintf(stderr, "AS Path Store size: %d\n",
+          bgpstream_as_path_store_get_size(view->pathstore));
+
+  if ((iter = malloc_zero(sizeof(bgpview_iter_t))) == NULL) {
+    return NULL;
+  }
+
+  iter->view = view;
+
+  iter->version_ptr = BGPSTREAM_ADDR_VERSION_IPV4;
+  iter->version_filter = 0; // default: all prefix versions
+
+  iter->pfx_it = 0;
+
+  iter->peer_it = BWV_PEER_IT_END;
+
+  iter->pfx_peer_it_valid = 0;
+
+  // default: all valid fields are iterated
+  iter->pfx_state_mask = BGPVIEW_FIELD_ALL_VALID;
+  iter->peer_state_mask = BGPVIEW_FIELD_ALL_VALID;
+  iter->pfx_peer_state_mask = BGPVIEW_FIELD_ALL_VALID;
+
+  // default: the whole prefix tables are iterated
+  iter->part_idx = 0;
+  iter->part_cnt = 1;
+
+  iter->locked_shard = -1;
+
+  return iter;
+}
+
+bgpview_iter_t *bgpview_iter_create_partition(bgpview_t *view, int part_idx,
+                                              int part_cnt)
+{
+  bgpview_iter_t *iter;
+
+  if (part_cnt < 1 || part_idx < 0 || part_idx >= part_cnt) {
+    fprintf(stderr, "ERROR: Invalid iterator partition %d/%d\n", part_idx,
+            part_cnt);
+    return NULL;
+  }
+
+  if ((iter = bgpview_iter_create(view)) == NULL) {
+    return NULL;
+  }
+
+  iter->part_idx = part_idx;
+  iter->part_cnt = part_cnt;
+
+  return iter;
+}
+
+void bgpview_iter_destroy(bgpview_iter_t *iter)
+{
+  if (iter == NULL) {
+    return;
+  }
+  bgpview_iter_unlock_pfx(iter);
+  free(iter->dirty_pfxs);
+  free(iter);
+}
+
+int bgpview_iter_lock_pfx(bgpview_iter_t *iter, bgpstream_pfx_t *pfx)
+{
+  bwv_writers_t *writers = iter->view->writers;
+  struct timeval wait_start, wait_end;
+  int rc;
+
+  if (writers == NULL) {
+    return 0;
+  }
+  assert(iter->locked_shard == -1);
+
+  pthread_rwlock_rdlock(&writers->tables);
+  if (has_pfx_key(iter->view, pfx) == 0) {
+    /* inserting the key may resize the prefix table, so we need exclusive
+       access (the key cannot disappear once inserted, since only the garbage
+       collector removes keys). This waits for every row update in progress,
+       so it is where concurrent writers contend */
+    pthread_rwlock_unlock(&writers->tables);
+    gettimeofday(&wait_start, NULL);
+    pthread_rwlock_wrlock(&writers->tables);
+    gettimeofday(&wait_end, NULL);
+    writers->insert_wait_usec +=
+      (uint64_t)(wait_end.tv_sec - wait_start.tv_sec) * 1000000 +
+      wait_end.tv_usec - wait_start.tv_usec;
+    rc = reserve_pfx(iter->view, pfx);
+    if (rc > 0) {
+      writers->inserted_cnt++;
+    }
+    pthread_rwlock_unlock(&writers->tables);
+    if (rc < 0) {
+      fprintf(stderr, "ERROR: Could not insert prefix\n");
+      return -1;
+    }
+    pthread_rwlock_rdlock(&writers->tables);
+  }
+
+  iter->locked_shard = pfx_shard(writers, pfx);
+  pthread_mutex_lock(&writers->shards[iter->locked_shard]);
+  __sync_fetch_and_add(&writers->locked_cnt, 1);
+
+  return 0;
+}
+
+void bgpview_iter_unlock_pfx(bgpview_iter_t *iter)
+{
+  bwv_writers_t *writers = iter->view->writers;
+
+  if (writers == NULL || iter->locked_shard == -1) {
+    return;
+  }
+
+  pthread_mutex_unlock(&writers->shards[iter->locked_shard]);
+  pthread_rwlock_unlock(&writers->tables);
+  iter->locked_shard = -1;
+}
+
+/* ==================== ITER GETTER/SETTERS ==================== */
+
+#define __cnt_by_mask(counter, mask)                                           \
+  (((mask) == BGPVIEW_FIELD_ACTIVE || (mask) == BGPVIEW_FIELD_INACTIVE)        \
+     ? ((counter)[(mask)])                                                     \
+     : ((counter)[BGPVIEW_FIELD_ACTIVE] + (counter)[BGPVIEW_FIELD_INACTIVE]))
+
+#define __pfx_field(iter, field) (__pfx_peerinfos((iter))->field)
+
+#define __iter_get_view(iter) ((iter)->view)
+
+bgpview_t *bgpview_iter_get_view(bgpview_iter_t *iter)
+{
+  if (iter != NULL) {
+    return __iter_get_view(iter);
+  }
+  return NULL;
+}
+
+#define __iter_pfx_get_pfx(iter)                                               \
+  (((iter)->version_ptr == BGPSTREAM_ADDR_VERSION_IPV4)                        \
+     ? ((bgpstream_pfx_t *)&kh_key(iter->view->v4pfxs, iter->pfx_it))          \
+     : ((iter)->version_ptr == BGPSTREAM_ADDR_VERSION_IPV6)                    \
+         ? ((bgpstream_pfx_t *)&kh_key(iter->view->v6pfxs, iter->pfx_it))      \
+         : NULL)
+
+bgpstream_pfx_t *bgpview_iter_pfx_get_pfx(bgpview_iter_t *iter)
+{
+  return __iter_pfx_get_pfx(iter);
+}
+
+#define __iter_pfx_get_peer_cnt(iter, state_mask)                              \
+  (__cnt_by_mask(__pfx_field(iter, peers_cnt), state_mask))
+
+int bgpview_iter_pfx_get_peer_cnt(bgpview_iter_t *iter, uint8_t state_mask)
+{
+  return __iter_pfx_get_peer_cnt(iter, state_mask);
+}
+
+#define __iter_pfx_get_state(iter) (__pfx_field(iter, state))
+
+bgpview_field_state_t bgpview_iter_pfx_get_state(bgpview_iter_t *iter)
+{
+  return __iter_pfx_get_state(iter);
+}
+
+#define __iter_pfx_get_user(iter) (__pfx_field(iter, user))
+
+void *bgpview_iter_pfx_get_user(bgpview_iter_t *iter)
+{
+  return __iter_pfx_get_user(iter);
+}
+
+int bgpview_iter_pfx_set_user(bgpview_iter_t *iter, void *user)
+{
+  bwv_peerid_pfxinfo_t *pfxinfo = __pfx_peerinfos(iter);
+
+  if (pfxinfo->user == user) {
+    return 0;
+  }
+
+  if (pfxinfo->user != NULL && iter->view->pfx_user_destructor != NULL) {
+    iter->view->pfx_user_destructor(pfxinfo->user);
+  }
+  pfxinfo->user = user;
+  if (user != NULL) {
+    iter->view->pfx_user_used = 1;
+  }
+  return 1;
+}
+
+#define __iter_peer_get_peer_id(iter)                                          \
+  ((bgpstream_peer_id_t)(iter)->peer_it)
+
+bgpstream_peer_id_t bgpview_iter_peer_get_peer_id(bgpview_iter_t *iter)
+{
+  return __iter_peer_get_peer_id(iter);
+}
+
+#define __iter_peer_get_sig(iter)                                              \
+  (bgpstream_peer_sig_map_get_sig((iter)->view->peersigns,                     \
+                                  __iter_peer_get_peer_id(iter)))
+
+bgpstream_peer_sig_t *bgpview_iter_peer_get_sig(bgpview_iter_t *iter)
+{
+  return __iter_peer_get_sig(iter);
+}
+
+#define __peer_get_pfx_cnt(iter, state_mask, field)                            \
+  (__cnt_by_mask(BWV_PEER_INFO(iter->view, iter->peer_it).field, state_mask))
+
+#define __iter_peer_get_pfx_cnt(iter, version, state_mask)                     \
+  (((version) == BGPSTREAM_ADDR_VERSION_IPV4)                                  \
+     ? (__peer_get_pfx_cnt(iter, state_mask, v4_pfx_cnt))                      \
+     : ((version) == BGPSTREAM_ADDR_VERSION_IPV6)                              \
+         ? (__peer_get_pfx_cnt(iter, state_mask, v6_pfx_cnt))                  \
+         : (__peer_get_pfx_cnt(iter, state_mask, v4_pfx_cnt) +                 \
+            __peer_get_pfx_cnt(iter, state_mask, v6_pfx_cnt)))
+
+int bgpview_iter_peer_get_pfx_cnt(bgpview_iter_t *iter, int version,
+                                  uint8_t state_mask)
+{
+  return __iter_peer_get_pfx_cnt(iter, version, state_mask);
+}
+
+#define __peer_field(iter, field)                                              \
+  (BWV_PEER_INFO((iter)->view, (iter)->peer_it).field)
+
+#define __iter_peer_get_state(iter) (__peer_field(iter, state))
+
+bgpview_field_state_t bgpview_iter_peer_get_state(bgpview_iter_t *iter)
+{
+  return __iter_peer_get_state(iter);
+}
+
+#define __iter_peer_get_user(iter) (__peer_field(iter, user))
+
+void *bgpview_iter_peer_get_user(bgpview_iter_t *iter)
+{
+  return __iter_peer_get_user(iter);
+}
+
+int bgpview_iter_peer_set_user(bgpview_iter_t *iter, void *user)
+{
+  void *cur_user = __peer_field(iter, user);
+
+  if (cur_user == user) {
+    return 0;
+  }
+
+  if (cur_user != NULL && iter->view->peer_user_destructor != NULL) {
+    iter->view->peer_user_destructor(cur_user);
+  }
+
+  BWV_PEER_INFO(iter->view, iter->peer_it).user = user;
+  return 1;
+}
+
+#define __pfx_peer_field(iter, field)                                          \
+  (BWV_PFX_GET_PEER_PTR((iter)->view, __pfx_peerinfos(iter),                   \
+                        (iter)->pfx_peer_it)                                   \
+     ->field)
+
+#define __iter_pfx_peer_get_as_path_store_path(iter)                           \
+  (bgpstream_as_path_store_get_store_path((iter)->view->pathstore,             \
+                                          __pfx_peer_field(iter, as_path_id)))
+
+bgpstream_as_path_store_path_t *
+bgpview_iter_pfx_peer_get_as_path_store_path(bgpview_iter_t *iter)
+{
+  return __iter_pfx_peer_get_as_path_store_path(iter);
+}
+
+#define __iter_pfx_peer_get_as_path_store_path_id(iter)                        \
+  (__pfx_peer_field(iter, as_path_id))
+
+bgpstream_as_path_store_path_id_t
+bgpview_iter_pfx_peer_get_as_path_store_path_id(bgpview_iter_t *iter)
+{
+  return __iter_pfx_peer_get_as_path_store_path_id(iter);
+}
+
+#define __iter_pfx_peer_get_as_path(iter)                                      \
+  (bgpstream_as_path_store_path_get_path(                                      \
+    __iter_pfx_peer_get_as_path_store_path(iter),                              \
+    (__iter_peer_get_sig(iter))->peer_asnumber))
+
+bgpstream_as_path_t *bgpview_iter_pfx_peer_get_as_path(bgpview_iter_t *iter)
+{
+  return __iter_pfx_peer_get_as_path(iter);
+}
+
+#define __iter_pfx_peer_get_origin_seg(iter)                                   \
+  (bgpstream_as_path_store_path_get_origin_seg(                                \
+    __iter_pfx_peer_get_as_path_store_path(iter)))
+
+static void path_origin_compute(bgpview_t *view,
+                                bgpstream_as_path_store_path_id_t id,
+                                bwv_path_origin_t *po, int with_len)
+{
+  bgpstream_as_path_store_path_t *spath =
+    bgpstream_as_path_store_get_store_path(view->pathstore, id);
+  bgpstream_as_path_store_path_iter_t it;
+
+  memset(po, 0, sizeof(*po));
+  if (spath == NULL) {
+    return;
+  }
+
+  po->origin_seg = bgpstream_as_path_store_path_get_origin_seg(spath);
+  if (po->origin_seg != NULL &&
+      po->origin_seg->type == BGPSTREAM_AS_PATH_SEG_ASN) {
+    po->origin_asn = ((bgpstream_as_path_seg_asn_t *)po->origin_seg)->asn;
+  }
+
+  /* the origin is found without walking the path, so only count the
+     segments when the length is needed */
+  if (!with_len) {
+    return;
+  }
+
+  /* core paths have the peer ASN prepended whatever the peer, so any ASN
+     gives the right length */
+  bgpstream_as_path_store_path_iter_reset(spath, &it, 0);
+  while (bgpstream_as_path_store_path_get_next_seg(&it) != NULL) {
+    po->path_len++;
+  }
+}
+
+bgpstream_as_path_seg_t *
+bgpview_iter_pfx_peer_get_origin_seg(bgpview_iter_t *iter)
+{
+  return __iter_pfx_peer_get_origin_seg(iter);
+}
+
+uint32_t bgpview_iter_pfx_peer_get_origin_asn(bgpview_iter_t *iter)
+{
+  bwv_path_origin_t po;
+
+  path_origin_compute(iter->view, __pfx_peer_field(iter, as_path_id), &po, 0);
+  return po.origin_asn;
+}
+
+int bgpview_iter_pfx_peer_get_as_path_len(bgpview_iter_t *iter)
+{
+  bwv_path_origin_t po;
+
+  path_origin_compute(iter->view, __pfx_peer_field(iter, as_path_id), &po, 1);
+  return po.path_len;
+}
+
+#define __iter_pfx_peer_as_path_seg_iter_reset(iter)                           \
+  (bgpstream_as_path_store_path_iter_reset(                                    \
+    __iter_pfx_peer_get_as_path_store_path(iter), &(iter)->pfx_peer_path_it,   \
+    __iter_peer_get_sig(iter)->peer_asnumber))
+
+void bgpview_iter_pfx_peer_as_path_seg_iter_reset(bgpview_iter_t *iter)
+{
+  __iter_pfx_peer_as_path_seg_iter_reset(iter);
+}
+
+#define __iter_pfx_peer_as_path_seg_next(iter)                                 \
+  (bgpstream_as_path_store_path_get_next_seg(&iter->pfx_peer_path_it))
+
+bgpstream_as_path_seg_t *
+bgpview_iter_pfx_peer_as_path_seg_next(bgpview_iter_t *iter)
+{
+  return __iter_pfx_peer_as_path_seg_next(iter);
+}
+
+int bgpview_iter_pfx_peer_set_as_path(bgpview_iter_t *iter,
+                                      bgpstream_as_path_t *as_path)
+{
+  bgpstream_as_path_store_path_id_t id;
+  bgpstream_peer_sig_t *ps;
+
+  ps = __iter_peer_get_sig(iter);
+
+  if (bgpstream_as_path_store_get_path_id(iter->view->pathstore, as_path,
+                                          ps->peer_asnumber, &id) != 0) {
+    fprintf(stderr, "ERROR: Failed to get AS Path ID from store\n");
+    return -1;
+  }
+
+  return bgpview_iter_pfx_peer_set_as_path_by_id(iter, id);
+}
+
+int bgpview_iter_pfx_peer_set_as_path_by_id(
+  bgpview_iter_t *iter, bgpstream_as_path_store_path_id_t path_id)
+{
+  SNAPSHOT_PRESERVE_PFX(iter);
+  if (iter->view->journal_enabled &&
+      memcmp(&(__pfx_peer_field(iter, as_path_id)), &path_id,
+             sizeof(bgpstream_as_path_store_path_id_t)) != 0) {
+    JOURNAL_MARK_PFX(iter);
+  }
+  (__pfx_peer_field(iter, as_path_id)) = path_id;
+  return 0;
+}
+
+#define __iter_pfx_peer_get_state(iter)                                        \
+  (BWV_PFX_GET_PEER_STATE(iter->view, __pfx_peerinfos(iter), iter->pfx_peer_it))
+
+bgpview_field_state_t bgpview_iter_pfx_peer_get_state(bgpview_iter_t *iter)
+{
+  return __iter_pfx_peer_get_state(iter);
+}
+
+#define __iter_pfx_peer_get_user(iter)                                         \
+  (BWV_PFX_GET_PEER_EXT_PTR((iter)->view, __pfx_peerinfos(iter),               \
+                            (iter)->pfx_peer_it)                               \
+     ->user)
+
+void *bgpview_iter_pfx_peer_get_user(bgpview_iter_t *iter)
+{
+  ASSERT_BWV_PFX_PEERINFO_EXT(iter->view);
+  return __iter_pfx_peer_get_user(iter);
+}
+
+int bgpview_iter_pfx_peer_set_user(bgpview_iter_t *iter, void *user)
+{
+  ASSERT_BWV_PFX_PEERINFO_EXT(iter->view);
+
+  void *cur_user = __iter_pfx_peer_get_user(iter);
+
+  if (cur_user == user) {
+    return 0;
+  }
+
+  if (cur_user != NULL && iter->view->pfx_peer_user_destructor != NULL) {
+    iter->view->pfx_peer_user_destructor(cur_user);
+  }
+
+  __iter_pfx_peer_get_user(iter) = user;
+  if (user != NULL) {
+    iter->view->pfx_user_used = 1;
+  }
+  return 1;
+}
+
+/* ==================== PEER ITERATORS ==================== */
+
+/* internal macros, optimized for performance */
+
+/* move the peer iterator to the first matching peer at or after the given
+   position of the ids list */
+static inline void iter_scan_peers(bgpview_iter_t *iter, uint32_t pos)
+{
+  bwv_peer_table_t *t = &iter->view->peerinfo;
+
+  for (; pos < t->cnt; pos++) {
+    if (iter->peer_state_mask & t->infos[t->ids[pos]].state) {
+      iter->peer_it = t->ids[pos];
+      return;
+    }
+  }
+  iter->peer_it = BWV_PEER_IT_END;
+}
+
+#define __iter_first_peer(iter, state_mask)                                    \
+  do {                                                                         \
+    iter->peer_state_mask = state_mask;                                        \
+    iter->pfx_peer_it_valid = 0;                                               \
+    iter_scan_peers(iter, 0);                                                  \
+  } while (0)
+
+#define __iter_next_peer(iter)                                                 \
+  iter_scan_peers(iter, BWV_PEER_INFO(iter->view, iter->peer_it).ids_pos + 1)
+
+#define __iter_has_more_peer(iter)                                             \
+  (iter->peer_it != BWV_PEER_IT_END)
+
+#define __iter_seek_peer(iter, peerid, state_mask)                             \
+  do {                                                                         \
+    iter->peer_state_mask = state_mask;                                        \
+    iter->peer_it = peertab_get(&iter->view->peerinfo, peerid);                \
+  } while (0)
+
+/* external functions */
+
+int bgpview_iter_first_peer(bgpview_iter_t *iter, uint8_t state_mask)
+{
+  __iter_first_peer(iter, state_mask);
+  return __iter_has_more_peer(iter);
+}
+
+int bgpview_iter_next_peer(bgpview_iter_t *iter)
+{
+  __iter_next_peer(iter);
+  return __iter_has_more_peer(iter);
+}
+
+int bgpview_iter_has_more_peer(bgpview_iter_t *iter)
+{
+  return __iter_has_more_peer(iter);
+}
+
+int bgpview_iter_seek_peer(bgpview_iter_t *iter, bgpstream_peer_id_t peerid,
+                           uint8_t state_mask)
+{
+  iter->pfx_peer_it_valid = 0; // moving peer_it invalidates pfx_peer_it
+  __iter_seek_peer(iter, peerid, state_mask);
+  if (iter->peer_it == BWV_PEER_IT_END) {
+    return 0;
+  }
+  if (iter->peer_state_mask & BWV_PEER_INFO(iter->view, iter->peer_it).state) {
+    return 1;
+  }
+  iter->peer_it = BWV_PEER_IT_END;
+  return 0;
+}
+
+/* ==================== PFX ITERATORS ==================== */
+
+/* first and last (excluded) bucket of the partition of a prefix table that
+   the iterator walks. partitions are computed from the number of buckets, so
+   they are only disjoint as long as the table is not resized */
+#define __pfx_part_begin(iter, table)                                          \
+  ((khiter_t)(((uint64_t)kh_end((table)) * (iter)->part_idx) /                 \
+              (iter)->part_cnt))
+
+#define __pfx_part_end(iter, table)                                            \
+  (((iter)->part_cnt == 1)                                                     \
+     ? kh_end((table))                                                         \
+     : (khiter_t)(((uint64_t)kh_end((table)) * ((iter)->part_idx + 1)) /       \
+                  (iter)->part_cnt))
+
+#define WHILE_NOT_MATCHED_PFX(iter, table)                                     \
+  while ((iter)->pfx_it < __pfx_part_end(iter, table) && /* each hash item */  \
+         (!kh_exist((table), (iter)->pfx_it) || /* in hash? */                 \
+          !((iter)->pfx_state_mask &            /* correct state? */           \
+            kh_val((table), (iter)->pfx_it)->state)))
+
+/* if the end of the partition was reached, move to the end of the table */
+#define PFX_PART_CLAMP(iter, table)                                            \
+  do {                                                                         \
+    if ((iter)->pfx_it >= __pfx_part_end(iter, table)) {                       \
+      (iter)->pfx_it = kh_end((table));                                        \
+    }                                                                          \
+  } while (0)
+
+#define __pfx_valid(iter, table) ((iter)->pfx_it != kh_end((table)))
+
+#define RETURN_IF_PFX_VALID(iter, table)                                       \
+  do {                                                                         \
+    if (__pfx_valid(iter, table)) {                                            \
+      return 1;                                                                \
+    }                                                                          \
+  } while (0)
+
+int bgpview_iter_first_pfx(bgpview_iter_t *iter, int version,
+                           uint8_t state_mask)
+{
+  // set the version we iterate through
+  iter->version_filter = version;
+
+  // set the version we start iterating through
+  if (iter->version_filter == BGPSTREAM_ADDR_VERSION_IPV4 ||
+      iter->version_filter == 0) {
+    iter->version_ptr = BGPSTREAM_ADDR_VERSION_IPV4;
+  } else {
+    iter->version_ptr = BGPSTREAM_ADDR_VERSION_IPV6;
+  }
+
+  // set the pfx mask
+  iter->pfx_state_mask = state_mask;
+
+  // moving pfx_it invalidates pfx_peer_it
+  iter->pfx_peer_it_valid = 0;
+
+  if (iter->version_ptr == BGPSTREAM_ADDR_VERSION_IPV4) {
+    iter->pfx_it = __pfx_part_begin(iter, iter->view->v4pfxs);
+    /* keep searching if this does not exist */
+    WHILE_NOT_MATCHED_PFX(iter, iter->view->v4pfxs)
+    {
+      iter->pfx_it++;
+    }
+    PFX_PART_CLAMP(iter, iter->view->v4pfxs);
+    RETURN_IF_PFX_VALID(iter, iter->view->v4pfxs);
+
+    // no ipv4 prefix was found, we don't look for other versions
+    // unless version_filter is zero
+    if (iter->version_filter) {
+      return 0;
+    }
+
+    // continue to the next IP version
+    iter->version_ptr = BGPSTREAM_ADDR_VERSION_IPV6;
+  }
+
+  if (iter->version_ptr == BGPSTREAM_ADDR_VERSION_IPV6) {
+    iter->pfx_it = __pfx_part_begin(iter, iter->view->v6pfxs);
+    /* keep searching if this does not exist */
+    WHILE_NOT_MATCHED_PFX(iter, iter->view->v6pfxs)
+    {
+      iter->pfx_it++;
+    }
+    PFX_PART_CLAMP(iter, iter->view->v6pfxs);
+    RETURN_IF_PFX_VALID(iter, iter->view->v6pfxs);
+  }
+
+  return 0;
+}
+
+#define __iter_next_pfx_v4(iter)                                               \
+  do {                                                                         \
+    /* skip to the next v4 pfx */                                              \
+    do {                                                                       \
+      (iter)->pfx_it++;                                                        \
+    }                                                                          \
+    WHILE_NOT_MATCHED_PFX(iter, (iter)->view->v4pfxs);                         \
+    PFX_PART_CLAMP(iter, (iter)->view->v4pfxs);                                \
+    /* if no v4 pfx, but considering all versions... */                        \
+    if (__pfx_valid(iter, (iter)->view->v4pfxs) == 0 &&                        \
+        (iter)->version_filter == 0) {                                         \
+      /* skip to the first v6 pfx */                                           \
+      bgpview_iter_first_pfx((iter), BGPSTREAM_ADDR_VERSION_IPV6,              \
+                             (iter)->pfx_state_mask);                          \
+    }                                                                          \
+    /* here: valid v4, valid v6, or invalid */                                 \
+  } while (0)
+
+#define __iter_next_pfx_v6(iter)                                               \
+  do {                                                                         \
+    do {                                                                       \
+      iter->pfx_it++;                                                          \
+    }                                                                          \
+    WHILE_NOT_MATCHED_PFX(iter, iter->view->v6pfxs);                           \
+    PFX_PART_CLAMP(iter, iter->view->v6pfxs);                                  \
+  } while (0)
+
+#define __iter_next_pfx(iter)                                                  \
+  do {                                                                         \
+    (iter)->pfx_peer_it_valid = 0;                                             \
+    if ((iter)->version_ptr == BGPSTREAM_ADDR_VERSION_IPV4) {                  \
+      __iter_next_pfx_v4(iter);                                                \
+    } else {                                                                   \
+      __iter_next_pfx_v6(iter);                                                \
+    }                                                                          \
+  } while (0)
+
+#define __iter_has_more_pfx_v(iter, table) ((iter)->pfx_it != kh_end((table)))
+
+#define __iter_has_more_pfx(iter)                                              \
+  (((iter)->version_ptr == BGPSTREAM_ADDR_VERSION_IPV4)                        \
+     ? (__iter_has_more_pfx_v((iter), iter->view->v4pfxs))                     \
+     : ((iter)->version_ptr == BGPSTREAM_ADDR_VERSION_IPV6)                    \
+         ? (__iter_has_more_pfx_v((iter), iter->view->v6pfxs))                 \
+         : 0)
+
+int bgpview_iter_next_pfx(bgpview_iter_t *iter)
+{
+  __iter_next_pfx(iter);
+  return __iter_has_more_pfx(iter);
+}
+
+int bgpview_iter_has_more_pfx(bgpview_iter_t *iter)
+{
+  return __iter_has_more_pfx(iter);
+}
+
+int bgpview_iter_seek_pfx(bgpview_iter_t *iter, bgpstream_pfx_t *pfx,
+                          uint8_t state_mask)
+{
+  iter->version_filter = pfx->address.version;
+  iter->version_ptr = pfx->address.version;
+  iter->pfx_state_mask = state_mask;
+  iter->pfx_peer_it_valid = 0;
+  iter->pfx_peer_it = 0;
+
+  switch (pfx->address.version) {
+  case BGPSTREAM_ADDR_VERSION_IPV4:
+    iter->pfx_it = kh_get(bwv_v4pfx_peerid_pfxinfo, iter->view->v4pfxs,
+                          pfx->bs_ipv4);
+    if (iter->pfx_it == kh_end(iter->view->v4pfxs)) {
+      return 0;
+    }
+    if (iter->pfx_state_mask &
+        kh_val(iter->view->v4pfxs, iter->pfx_it)->state) {
+      return 1;
+    }
+    // if the mask does not match, than set the iterator to the end
+    iter->pfx_it = kh_end(iter->view->v4pfxs);
+    return 0;
+
+  case BGPSTREAM_ADDR_VERSION_IPV6:
+    iter->pfx_it = kh_get(bwv_v6pfx_peerid_pfxinfo, iter->view->v6pfxs,
+                          pfx->bs_ipv6);
+    if (iter->pfx_it == kh_end(iter->view->v6pfxs)) {
+      return 0;
+    }
+    if (iter->pfx_state_mask &
+        kh_val(iter->view->v6pfxs, iter->pfx_it)->state) {
+      return 1;
+    }
+    // if the mask does not match, than set the iterator to the end
+    iter->pfx_it = kh_end(iter->view->v6pfxs);
+    return 0;
+  default:
+    /* programming error */
+    assert(0);
+  }
+  return 0;
+}
+
+/* point the ordered prefix iterator at the prefixes of the index of the view
+   that it visits */
+static int ord_pfxs_build(bgpview_iter_t *iter, int version,
+                          uint8_t state_mask)
+{
+  bgpview_t *view = iter->view;
+  int ret;
+
+  iter->version_filter = version;
+  iter->pfx_state_mask = state_mask;
+  iter->ord_pfxs = NULL;
+  iter->ord_pfxs_cnt = 0;
+  iter->ord_idx = 0;
+
+  pthread_mutex_lock(&view->pfx_index_lock);
+  ret = pfx_index_update(view);
+  pthread_mutex_unlock(&view->pfx_index_lock);
+  if (ret != 0) {
+    return -1;
+  }
+
+  /* IPv4 prefixes are sorted first */
+  iter->ord_pfxs = view->pfx_index;
+  iter->ord_pfxs_cnt = view->pfx_index_cnt;
+  if (version == BGPSTREAM_ADDR_VERSION_IPV4) {
+    iter->ord_pfxs_cnt = view->pfx_index_v4_cnt;
+  } else if (version == BGPSTREAM_ADDR_VERSION_IPV6) {
+    iter->ord_pfxs += view->pfx_index_v4_cnt;
+    iter->ord_pfxs_cnt -= view->pfx_index_v4_cnt;
+  }
+
+  return 0;
+}
+
+/* move the ordered prefix iterator to the first prefix (starting from the
+   current one) that still matches the state mask */
+static int ord_pfxs_scan(bgpview_iter_t *iter)
+{
+  for (; iter->ord_idx < iter->ord_pfxs_cnt; iter->ord_idx++) {
+    iter->version_ptr = iter->ord_pfxs[iter->ord_idx].pfx.address.version;
+    iter->pfx_it = iter->ord_pfxs[iter->ord_idx].k;
+    iter->pfx_peer_it_valid = 0;
+    if (__pfx_peerinfos(iter)->state & iter->pfx_state_mask) {
+      return 1;
+    }
+  }
+  /* no more prefixes: make bgpview_iter_has_more_pfx fail too */
+  iter->version_ptr = BGPSTREAM_ADDR_VERSION_UNKNOWN;
+  return 0;
+}
+
+int bgpview_iter_first_pfx_ordered(bgpview_iter_t *iter, int version,
+                                   uint8_t state_mask)
+{
+  if (ord_pfxs_build(iter, version, state_mask) != 0) {
+    fprintf(stderr, "ERROR: Could not sort the prefixes of the view\n");
+    iter->ord_pfxs_cnt = 0;
+    return 0;
+  }
+
+  return ord_pfxs_scan(iter);
+}
+
+int bgpview_iter_next_pfx_ordered(bgpview_iter_t *iter)
+{
+  if (iter->ord_idx < iter->ord_pfxs_cnt) {
+    iter->ord_idx++;
+  }
+  return ord_pfxs_scan(iter);
+}
+
+int bgpview_iter_has_more_pfx_ordered(bgpview_iter_t *iter)
+{
+  return iter->ord_idx < iter->ord_pfxs_cnt;
+}
+
+int bgpview_iter_first_dirty_pfx(bgpview_iter_t *iter, int version,
+                                 uint8_t state_mask)
+{
+  bgpview_t *view = iter->view;
+  bgpstream_pfx_t *pfx;
+  khiter_t k;
+  uint32_t i;
+
+  iter->version_filter = version;
+  iter->pfx_state_mask = state_mask;
+  iter->ord_pfxs = iter->dirty_pfxs;
+  iter->ord_pfxs_cnt = 0;
+  iter->ord_idx = 0;
+
+  journal_sort(view);
+  if (sorted_pfxs_reserve(&iter->dirty_pfxs, &iter->dirty_pfxs_alloc_cnt,
+                          view->journal_cnt) != 0) {
+    fprintf(stderr, "ERROR: Could not collect the dirty prefixes\n");
+    return 0;
+  }
+  iter->ord_pfxs = iter->dirty_pfxs;
+
+  /* the journal is sorted, so the prefixes are visited in address order */
+  for (i = 0; i < view->journal_cnt; i++) {
+    pfx = &view->journal[i];
+    if (version != 0 && pfx->address.version != version) {
+      continue;
+    }
+    if (pfx->address.version == BGPSTREAM_ADDR_VERSION_IPV4) {
+      k = kh_get(bwv_v4pfx_peerid_pfxinfo, view->v4pfxs, pfx->bs_ipv4);
+      if (k == kh_end(view->v4pfxs)) {
+        continue;
+      }
+    } else {
+      k = kh_get(bwv_v6pfx_peerid_pfxinfo, view->v6pfxs, pfx->bs_ipv6);
+      if (k == kh_end(view->v6pfxs)) {
+        continue;
+      }
+    }
+    bgpstream_pfx_copy(&iter->ord_pfxs[iter->ord_pfxs_cnt].pfx, pfx);
+    iter->ord_pfxs[iter->ord_pfxs_cnt++].k = k;
+  }
+
+  return ord_pfxs_scan(iter);
+}
+
+int bgpview_iter_next_dirty_pfx(bgpview_iter_t *iter)
+{
+  return bgpview_iter_next_pfx_ordered(iter);
+}
+
+int bgpview_iter_has_more_dirty_pfx(bgpview_iter_t *iter)
+{
+  return bgpview_iter_has_more_pfx_ordered(iter);
+}
+
+/* ==================== PFX-PEER ITERATORS ==================== */
+
+/* optimized macros. be careful when using these */
+
+/* Generate the pfx-peer iteration functions of a cell kind (see
+   BWV_CELLS_TAB_INIT). iter_scan_cells_<kind> moves the iterator to the
+   first matching cell at or after iter->pfx_peer_it, and
+   iter_seek_cell_<kind> moves it to the cell of the given peer. */
+#define BWV_CELLS_ITER_INIT(kind)                                              \
+  static inline void iter_scan_cells_##kind(bgpview_iter_t *iter,              \
+                                            bwv_peerid_pfxinfo_t *v)           \
+  {                                                                            \
+    khiter_t end = cells_end_##kind(v);                                        \
+    for (; iter->pfx_peer_it < end; iter->pfx_peer_it++) {                     \
+      if (cell_exists_##kind(v, iter->pfx_peer_it) &&                          \
+          (iter->pfx_peer_state_mask &                                         \
+           cell_ptr_##kind(v, iter->pfx_peer_it)->state)) {                    \
+        __iter_seek_peer(iter, cell_peer_##kind(v, iter->pfx_peer_it),         \
+                         iter->pfx_peer_state_mask);                           \
+        iter->pfx_peer_it_valid = 1;                                           \
+        return;                                                                \
+      }                                                                        \
+    }                                                                          \
+  }                                                                            \
+  static inline void iter_seek_cell_##kind(bgpview_iter_t *iter,               \
+                                           bwv_peerid_pfxinfo_t *v,            \
+                                           bgpstream_peer_id_t peerid)         \
+  {                                                                            \
+    khiter_t k = cell_get_##kind(v, peerid);                                   \
+    if (k != cells_end_##kind(v) &&                                            \
+        (iter->pfx_peer_state_mask & cell_ptr_##kind(v, k)->state)) {          \
+      iter->pfx_peer_it_valid = 1;                                             \
+      iter->pfx_peer_it = k;                                                   \
+      __iter_seek_peer(iter, peerid, iter->pfx_peer_state_mask);               \
+    }                                                                          \
+  }                                                                            \
+  static inline int cells_get_##kind(                                          \
+    bwv_peerid_pfxinfo_t *v, uint8_t state_mask,                               \
+    bgpstream_peer_id_t *peer_ids,                                             \
+    bgpstream_as_path_store_path_id_t *path_ids, int max)                      \
+  {                                                                            \
+    khiter_t k, end = cells_end_##kind(v);                                     \
+    int cnt = 0;                                                               \
+    for (k = 0; k < end; k++) {                                                \
+      if (!cell_exists_##kind(v, k) ||                                         \
+          (state_mask & cell_ptr_##kind(v, k)->state) == 0) {                  \
+        continue;                                                              \
+      }                                                                        \
+      if (cnt == max) {                                                        \
+        return -1;                                                             \
+      }                                                                        \
+      peer_ids[cnt] = cell_peer_##kind(v, k);                                  \
+      if (path_ids != NULL) {                                                  \
+        path_ids[cnt] = cell_ptr_##kind(v, k)->as_path_id;                     \
+      }                                                                        \
+      cnt++;                                                                   \
+    }                                                                          \
+    return cnt;                                                                \
+  }
+
+BWV_CELLS_ITER_INIT(tab_ext)
+BWV_CELLS_ITER_INIT(tab_min)
+BWV_CELLS_ITER_INIT(vec_ext)
+BWV_CELLS_ITER_INIT(vec_min)
+
+#define __iter_pfx_first_peer(iter, state_mask)                                \
+  do {                                                                         \
+    bwv_peerid_pfxinfo_t *__infos = __pfx_peerinfos((iter));                   \
+    (iter)->pfx_peer_state_mask = state_mask;                                  \
+    (iter)->pfx_peer_it = 0;                                                   \
+    (iter)->pfx_peer_it_valid = 0;                                             \
+    if (__infos->peers_generic == NULL) {                                      \
+      break;                                                                   \
+    }                                                                          \
+    BWV_CELLS_DISPATCH((iter)->view, iter_scan_cells, iter, __infos);          \
+  } while (0)
+
+#define __iter_pfx_next_peer(iter)                                             \
+  do {                                                                         \
+    bwv_peerid_pfxinfo_t *__infos = __pfx_peerinfos((iter));                   \
+    (iter)->pfx_peer_it_valid = 0;                                             \
+    (iter)->pfx_peer_it++;                                                     \
+    BWV_CELLS_DISPATCH((iter)->view, iter_scan_cells, iter, __infos);          \
+  } while (0)
+
+#define __iter_pfx_has_more_peer(iter)                                         \
+  ((iter)->pfx_peer_it_valid)
+
+#define __iter_pfx_seek_peer(iter, peerid, state_mask)                         \
+  do {                                                                         \
+    bwv_peerid_pfxinfo_t *__infos = __pfx_peerinfos((iter));                   \
+    (iter)->pfx_peer_state_mask = state_mask;                                  \
+    (iter)->pfx_peer_it_valid = 0;                                             \
+    if (__infos->peers_generic == NULL) {                                      \
+      break;                                                                   \
+    }                                                                          \
+    BWV_CELLS_DISPATCH((iter)->view, iter_seek_cell, iter, __infos, peerid);   \
+  } while (0)
+
+/* public accessor functions */
+
+int bgpview_iter_pfx_first_peer(bgpview_iter_t *iter, uint8_t state_mask)
+{
+  __iter_pfx_first_peer(iter, state_mask);
+  assert(iter->pfx_peer_it_valid == 0 || __iter_has_more_peer(iter));
+  return (iter->pfx_peer_it_valid);
+}
+
+int bgpview_iter_pfx_next_peer(bgpview_iter_t *iter)
+{
+  __iter_pfx_next_peer(iter);
+  assert(iter->pfx_peer_it_valid == 0 || __iter_has_more_peer(iter));
+  return (iter->pfx_peer_it_valid);
+}
+
+int bgpview_iter_pfx_has_more_peer(bgpview_iter_t *iter)
+{
+  return __iter_pfx_has_more_peer(iter);
+}
+
+int bgpview_iter_pfx_seek_peer(bgpview_iter_t *iter, bgpstream_peer_id_t peerid,
+                               uint8_t state_mask)
+{
+  __iter_pfx_seek_peer(iter, peerid, state_mask);
+  return (iter->pfx_peer_it_valid);
+}
+
+/* number of buckets to look ahead for the next prefix to prefetch */
+#define PFX_PREFETCH_SCAN 8
+
+#define PREFETCH_NEXT_PFXINFO(iter, table)                                     \
+  do {                                                                         \
+    khiter_t pk;                                                               \
+    for (pk = (iter)->pfx_it + 1;                                              \
+         pk < kh_end(table) && pk <= (iter)->pfx_it + PFX_PREFETCH_SCAN;       \
+         pk++) {                                                               \
+      if (kh_exist(table, pk)) {                                               \
+        __builtin_prefetch(kh_val(table, pk));                                 \
+        break;                                                                 \
+      }                                                                        \
+    }                                                                          \
+  } while (0)
+
+int bgpview_iter_pfx_get_cells(bgpview_iter_t *iter, uint8_t state_mask,
+                               bgpstream_peer_id_t *peer_ids,
+                               bgpstream_as_path_store_path_id_t *path_ids,
+                               int max)
+{
+  bgpview_t *view = iter->view;
+  bwv_peerid_pfxinfo_t *infos = __pfx_peerinfos(iter);
+  int cnt = 0;
+
+  /* the caller is most likely going to ask for the next prefix next */
+  if (iter->version_ptr == BGPSTREAM_ADDR_VERSION_IPV4) {
+    PREFETCH_NEXT_PFXINFO(iter, view->v4pfxs);
+  } else {
+    PREFETCH_NEXT_PFXINFO(iter, view->v6pfxs);
+  }
+
+  if (infos->peers_generic == NULL) {
+    return 0;
+  }
+
+  BWV_CELLS_DISPATCH_RET(view, cnt, cells_get, infos, state_mask, peer_ids,
+                         path_ids, max);
+  return cnt;
+}
+
+/* =================== ALL-PFX-PEER ITERATORS ==================== */
+
+int bgpview_iter_first_pfx_peer(bgpview_iter_t *iter, int version,
+                                uint8_t pfx_mask, uint8_t peer_mask)
+{
+  // set the version(s) we iterate through
+  iter->version_filter = version;
+
+  // set the version we start iterating through
+  iter->version_ptr = (iter->version_filter == BGPSTREAM_ADDR_VERSION_IPV6)
+                        ? BGPSTREAM_ADDR_VERSION_IPV6
+                        : BGPSTREAM_ADDR_VERSION_IPV4;
+
+  // masks are going to be set by each first function
+  iter->pfx_state_mask = 0;
+  iter->pfx_peer_state_mask = 0;
+
+  // start from the first matching prefix
+  bgpview_iter_first_pfx(iter, version, pfx_mask);
+  while (__iter_has_more_pfx(iter)) {
+    // look for the first matching peer within the prefix
+    if (bgpview_iter_pfx_first_peer(iter, peer_mask)) {
+      return 1;
+    }
+    __iter_next_pfx(iter);
+  }
+  return 0;
+}
+
+#define __iter_has_more_pfx_peer(iter)                                         \
+  (__iter_has_more_pfx(iter) && __iter_pfx_has_more_peer(iter))
+
+#define __iter_next_pfx_peer(iter)                                             \
+  do {                                                                         \
+    while (__iter_has_more_pfx(iter)) {                                        \
+      /* look for the next matching peer within the prefix */                  \
+      __iter_pfx_next_peer(iter);                                              \
+      if (__iter_pfx_has_more_peer(iter))                                      \
+        break;                                                                 \
+      /* no more peers, go to the next prefix */                               \
+      __iter_next_pfx(iter);                                                   \
+      if (__iter_has_more_pfx(iter)) {                                         \
+        /* go to the first peer */                                             \
+        __iter_pfx_first_peer(iter, iter->pfx_peer_state_mask);                \
+        break;                                                                 \
+      }                                                                        \
+    }                                                                          \
+  } while (0)
+
+int bgpview_iter_next_pfx_peer(bgpview_iter_t *iter)
+{
+  __iter_next_pfx_peer(iter);
+  return __iter_has_more_pfx_peer(iter);
+}
+
+int bgpview_iter_has_more_pfx_peer(bgpview_iter_t *iter)
+{
+  return bgpview_iter_has_more_pfx(iter) &&
+         bgpview_iter_pfx_has_more_peer(iter);
+}
+
+int bgpview_iter_seek_pfx_peer(bgpview_iter_t *iter, bgpstream_pfx_t *pfx,
+                               bgpstream_peer_id_t peerid, uint8_t pfx_mask,
+                               uint8_t peer_mask)
+{
+  if (bgpview_iter_seek_pfx(iter, pfx, pfx_mask) &&
+      bgpview_iter_pfx_seek_peer(iter, peerid, peer_mask)) {
+    return 1;
+  }
+
+  // if the peer is not found we reset the iterators
+  iter->version_ptr = BGPSTREAM_ADDR_VERSION_IPV4;
+  iter->pfx_it = kh_end(iter->view->v4pfxs);
+  iter->pfx_peer_it_valid = 0;
+  iter->pfx_peer_it = 0;
+
+  return 0;
+}
+
+/* ==================== PEER-PFX ITERATORS ==================== */
+
+/* scan the prefix index of a peer (starting from the current position) for
+   the first prefix and pfx-peer that match the state masks */
+#define SCAN_FOR_MATCHING_PEER_PFX(iter, pfxtype, pfxtable, idx)              \
+  do {                                                                         \
+    for (; (iter)->peer_pfx_it != kh_end(idx); ++(iter)->peer_pfx_it) {        \
+      if (!kh_exist(idx, (iter)->peer_pfx_it)) {                               \
+        continue;                                                              \
+      }                                                                        \
+      (iter)->pfx_it =                                                         \
+        kh_get(pfxtype, pfxtable, kh_key(idx, (iter)->peer_pfx_it));           \
+      assert((iter)->pfx_it != kh_end(pfxtable));                              \
+      if (!((iter)->pfx_state_mask &                                           \
+            kh_val(pfxtable, (iter)->pfx_it)->state)) {                        \
+        continue;                                                              \
+      }                                                                        \
+      __iter_pfx_seek_peer((iter), (iter)->peer_pfx_peerid,                    \
+                           (iter)->pfx_peer_state_mask);                       \
+      if ((iter)->pfx_peer_it_valid) {                                         \
+        (iter)->peer_pfx_it_valid = 1;                                         \
+        break;                                                                 \
+      }                                                                        \
+    }                                                                          \
+  } while (0)
+
+/* move the peer-pfx iterator to the first match at or after the current
+   position */
+static void peer_pfx_scan(bgpview_iter_t *iter)
+{
+  bwv_peerinfo_t *peerinfo;
+  khiter_t k;
+
+  iter->peer_pfx_it_valid = 0;
+
+  if (iter->view->peer_pfx_index == 0) {
+    /* no index, so look for the peer in every prefix */
+    while (__iter_has_more_pfx(iter)) {
+      __iter_pfx_seek_peer(iter, iter->peer_pfx_peerid,
+                           iter->pfx_peer_state_mask);
+      if (iter->pfx_peer_it_valid) {
+        iter->peer_pfx_it_valid = 1;
+        return;
+      }
+      __iter_next_pfx(iter);
+    }
+    return;
+  }
+
+  k = peertab_get(&iter->view->peerinfo, iter->peer_pfx_peerid);
+  if (k == BWV_PEER_IT_END) {
+    return;
+  }
+  peerinfo = &BWV_PEER_INFO(iter->view, k);
+
+  if (iter->version_ptr == BGPSTREAM_ADDR_VERSION_IPV4) {
+    if (peerinfo->v4pfxs_idx != NULL) {
+      SCAN_FOR_MATCHING_PEER_PFX(iter, bwv_v4pfx_peerid_pfxinfo,
+                                 iter->view->v4pfxs, peerinfo->v4pfxs_idx);
+      if (iter->peer_pfx_it_valid) {
+        return;
+      }
+    }
+    if (iter->peer_pfx_version_filter != 0) {
+      iter->pfx_peer_it_valid = 0;
+      return;
+    }
+    // continue to the next IP version
+    iter->version_ptr = BGPSTREAM_ADDR_VERSION_IPV6;
+    iter->peer_pfx_it = 0;
+  }
+
+  if (peerinfo->v6pfxs_idx != NULL) {
+    SCAN_FOR_MATCHING_PEER_PFX(iter, bwv_v6pfx_peerid_pfxinfo,
+                               iter->view->v6pfxs, peerinfo->v6pfxs_idx);
+    if (iter->peer_pfx_it_valid) {
+      return;
+    }
+  }
+  iter->pfx_peer_it_valid = 0;
+}
+
+int bgpview_iter_peer_first_pfx(bgpview_iter_t *iter, int version,
+                                uint8_t pfx_mask, uint8_t pfx_peer_mask)
+{
+  assert(__iter_has_more_peer(iter));
+
+  iter->peer_pfx_peerid = __iter_peer_get_peer_id(iter);
+  iter->peer_pfx_version_filter = version;
+  iter->pfx_peer_state_mask = pfx_peer_mask;
+
+  if (iter->view->peer_pfx_index == 0) {
+    bgpview_iter_first_pfx(iter, version, pfx_mask);
+  } else {
+    iter->version_filter = version;
+    if (version == BGPSTREAM_ADDR_VERSION_IPV4 || version == 0) {
+      iter->version_ptr = BGPSTREAM_ADDR_VERSION_IPV4;
+    } else {
+      iter->version_ptr = BGPSTREAM_ADDR_VERSION_IPV6;
+    }
+    iter->pfx_state_mask = pfx_mask;
+    iter->pfx_peer_it_valid = 0;
+    iter->peer_pfx_it = 0;
+  }
+
+  peer_pfx_scan(iter);
+  return iter->peer_pfx_it_valid;
+}
+
+int bgpview_iter_peer_next_pfx(bgpview_iter_t *iter)
+{
+  if (iter->peer_pfx_it_valid == 0) {
+    return 0;
+  }
+
+  if (iter->view->peer_pfx_index == 0) {
+    __iter_next_pfx(iter);
+  } else {
+    iter->peer_pfx_it++;
+  }
+
+  peer_pfx_scan(iter);
+  return iter->peer_pfx_it_valid;
+}
+
+int bgpview_iter_peer_has_more_pfx(bgpview_iter_t *iter)
+{
+  return iter->peer_pfx_it_valid;
+}
+
+/* ==================== CREATION FUNCS ==================== */
+
+static bgpstream_peer_id_t add_peer(bgpview_iter_t *iter,
+                                    const char *collector_str,
+                                    bgpstream_ip_addr_t *peer_address,
+                                    uint32_t peer_asnumber)
+{
+  bgpstream_peer_id_t peer_id;
+  khiter_t k;
+
+  /* add peer to signatures' map */
+  if ((peer_id =
+         bgpstream_peer_sig_map_get_id(iter->view->peersigns, collector_str,
+                                       peer_address, peer_asnumber)) == 0) {
+    fprintf(stderr, "Could not add peer to peersigns\n");
+    fprintf(stderr, "Consider making bgpstream_peer_sig_map_set more robust\n");
+    return 0;
+  }
+
+  /* populate peer information in peerinfo */
+
+  if ((k = peertab_get(&iter->view->peerinfo, peer_id)) == BWV_PEER_IT_END) {
+    /* new peer!  */
+    if (peertab_put(&iter->view->peerinfo, peer_id) != 0) {
+      fprintf(stderr, "Could not add peer to peerinfo\n");
+      return 0;
+    }
+    k = peer_id;
+    /* peer is invalid */
+  }
+
+  /* seek the iterator */
+  iter->peer_it = k;
+  iter->peer_state_mask = BGPVIEW_FIELD_ALL_VALID;
+  iter->pfx_peer_it_valid = 0; // moving peer_it invalidates pfx_peer_it
+
+  /* here iter->peer_it points to a peer, it could be invalid, inactive,
+     active */
+  if (BWV_PEER_INFO(iter->view, k).state != BGPVIEW_FIELD_INVALID) {
+    /* it was already here, and it was inactive/active, just return */
+    return peer_id;
+  }
+
+  /* by here, it was invalid */
+  BWV_PEER_INFO(iter->view, k).state = BGPVIEW_FIELD_INACTIVE;
+
+  /* and count one more inactive peer */
+  iter->view->peerinfo_cnt[BGPVIEW_FIELD_INACTIVE]++;
+
+  return peer_id;
+}
+
+bgpstream_peer_id_t bgpview_iter_add_peer(bgpview_iter_t *iter,
+                                          const char *collector_str,
+                                          bgpstream_ip_addr_t *peer_address,
+                                          uint32_t peer_asnumber)
+{
+  bgpstream_peer_id_t peer_id;
+
+  /* inserting into the peer table may resize it */
+  WRITERS_TABLES_LOCK(iter->view);
+  peer_id = add_peer(iter, collector_str, peer_address, peer_asnumber);
+  WRITERS_TABLES_UNLOCK(iter->view);
+
+  return peer_id;
+}
+
+int bgpview_iter_remove_peer(bgpview_iter_t *iter)
+{
+  bgpview_iter_t *lit;
+  /* we have to have a valid peer */
+  assert(__iter_has_more_peer(iter));
+
+  /* if the peer is active, then we deactivate it first */
+  if (bgpview_iter_peer_get_state(iter) == BGPVIEW_FIELD_ACTIVE) {
+    bgpview_iter_deactivate_peer(iter);
+  }
+  assert(bgpview_iter_peer_get_state(iter) == BGPVIEW_FIELD_INACTIVE);
+
+  /* if the peer had prefixes, then we need to remove all pfx-peers for this
+     peer */
+  if (bgpview_iter_peer_get_pfx_cnt(iter, 0, BGPVIEW_FIELD_ALL_VALID) > 0) {
+    lit = bgpview_iter_create(iter->view);
+    assert(lit != NULL);
+    bgpview_iter_seek_peer(lit, bgpview_iter_peer_get_peer_id(iter),
+                           BGPVIEW_FIELD_ALL_VALID);
+    // remove all the peer-pfx associated with the peer
+    for (bgpview_iter_peer_first_pfx(lit, 0, BGPVIEW_FIELD_ALL_VALID,
+                                     BGPVIEW_FIELD_ALL_VALID);
+         bgpview_iter_peer_has_more_pfx(lit); bgpview_iter_peer_next_pfx(lit)) {
+      bgpview_iter_pfx_remove_peer(lit);
+    }
+    bgpview_iter_destroy(lit);
+  }
+
+  /* set the state to invalid and reset the counters */
+  peerinfo_reset(&BWV_PEER_INFO(iter->view, iter->peer_it));
+  iter->view->need_gc_peerinfo = 1;
+  iter->view->peerinfo_cnt[BGPVIEW_FIELD_INACTIVE]--;
+
+  return 0;
+}
+
+int bgpview_iter_add_pfx_peer(bgpview_iter_t *iter,
+                                   bgpstream_pfx_t *pfx,
+                                   bgpstream_peer_id_t peer_id,
+                                   bgpstream_as_path_t *as_path)
+{
+  bgpstream_as_path_store_path_id_t path_id;
+  bgpstream_peer_sig_t *ps;
+
+  /* first seek to the prefix */
+  if (bgpview_iter_seek_pfx(iter, pfx, BGPVIEW_FIELD_ALL_VALID) == 0) {
+    /* we have to first create (or un-invalid) the prefix */
+    if (add_pfx(iter, pfx) != 0) {
+      return -1;
+    }
+  }
+
+  /* the peer must already exist */
+  __iter_seek_peer(iter, peer_id, BGPVIEW_FIELD_ALL_VALID);
+  iter->pfx_peer_it_valid = 0; // moving peer_it invalidates pfx_peer_it
+  if (iter->peer_it == BWV_PEER_IT_END) {
+    return -1;
+  }
+  /* get the peer ASN */
+  ps = bgpview_iter_peer_get_sig(iter);
+
+  if (bgpstream_as_path_store_get_path_id(iter->view->pathstore, as_path,
+                                          ps->peer_asnumber, &path_id) != 0) {
+    fprintf(stderr, "ERROR: Failed to get AS Path ID from store\n");
+    return -1;
+  }
+
+  /* now insert the prefix-peer info */
+  return bgpview_iter_pfx_add_peer_by_id(iter, peer_id, path_id);
+}
+
+int bgpview_iter_add_pfx_peer_by_id(bgpview_iter_t *iter, bgpstream_pfx_t *pfx,
+                                    bgpstream_peer_id_t peer_id,
+                                    bgpstream_as_path_store_path_id_t path_id)
+{
+  /* the peer must already exist */
+  if (bgpview_iter_seek_peer(iter, peer_id, BGPVIEW_FIELD_ALL_VALID) == 0) {
+    return -1;
+  }
+
+  /* now seek to the prefix */
+  if (bgpview_iter_seek_pfx(iter, pfx, BGPVIEW_FIELD_ALL_VALID) == 0) {
+    /* we have to first create (or un-invalid) the prefix */
+    if (add_pfx(iter, pfx) != 0) {
+      return -1;
+    }
+  }
+
+  /* now insert the prefix-peer info */
+  return bgpview_iter_pfx_add_peer_by_id(iter, peer_id, path_id);
+}
+
+/* remember that the current prefix has something to garbage collect */
+static int gc_mark_dirty(bgpview_iter_t *iter)
+{
+  bgpview_t *view = iter->view;
+  bwv_peerid_pfxinfo_t *pfxinfo = __pfx_peerinfos(iter);
+  bgpstream_pfx_t *tmp;
+
+  if (pfxinfo->gc_dirty) {
+    return 0;
+  }
+
+  WRITERS_MISC_LOCK(view);
+  if (view->gc_dirty_cnt == view->gc_dirty_alloc_cnt) {
+    if ((tmp = realloc(view->gc_dirty,
+                       sizeof(bgpstream_pfx_t) *
+                         (view->gc_dirty_alloc_cnt + 1024))) == NULL) {
+      view->gc_dirty_lost = 1;
+      WRITERS_MISC_UNLOCK(view);
+      return -1;
+    }
+    view->gc_dirty = tmp;
+    view->gc_dirty_alloc_cnt += 1024;
+  }
+
+  bgpstream_pfx_copy(&view->gc_dirty[view->gc_dirty_cnt++],
+                     __iter_pfx_get_pfx(iter));
+  WRITERS_MISC_UNLOCK(view);
+  pfxinfo->gc_dirty = 1;
+  return 0;
+}
+
+int bgpview_iter_remove_pfx(bgpview_iter_t *iter)
+{
+  bwv_peerid_pfxinfo_t *pfxinfo = __pfx_peerinfos(iter);
+  bgpview_iter_t ti;
+
+  SNAPSHOT_PRESERVE_PFX(iter);
+  JOURNAL_MARK_PFX(iter);
+
+  /* if the pfx is active, then we deactivate it first */
+  if (bgpview_iter_pfx_get_state(iter) == BGPVIEW_FIELD_ACTIVE) {
+    bgpview_iter_deactivate_pfx(iter);
+  }
+
+  assert(pfxinfo->state == BGPVIEW_FIELD_INACTIVE);
+
+  pfxinfo->state = BGPVIEW_FIELD_INVALID;
+
+  /* if there are any active or inactive pfx-peers, we remove them now */
+  if (bgpview_iter_pfx_get_peer_cnt(iter, BGPVIEW_FIELD_ALL_VALID) > 0) {
+    ti = *iter;
+    /* iterate over all pfx-peers for this pfx */
+    __iter_pfx_first_peer(&ti, BGPVIEW_FIELD_ALL_VALID);
+    while (bgpview_iter_pfx_has_more_peer(&ti)) {
+      bgpview_iter_pfx_remove_peer(&ti);
+      __iter_pfx_next_peer(&ti);
+    }
+  }
+
+  assert(pfxinfo->peers_cnt[BGPVIEW_FIELD_INACTIVE] == 0 &&
+         pfxinfo->peers_cnt[BGPVIEW_FIELD_ACTIVE] == 0);
+
+  /* a failure here is remembered, and makes the next bgpview_gc_step fall
+     back to a full bgpview_gc */
+  gc_mark_dirty(iter);
+
+  /* set the state to invalid and update counters */
+
+  switch (iter->version_ptr) {
+  case BGPSTREAM_ADDR_VERSION_IPV4:
+    SHARED_CNT_ADD(iter->view,
+                   iter->view->v4pfxs_cnt[BGPVIEW_FIELD_INACTIVE], -1);
+    iter->view->need_gc_v4pfxs = 1;
+    break;
+
+  case BGPSTREAM_ADDR_VERSION_IPV6:
+    SHARED_CNT_ADD(iter->view,
+                   iter->view->v6pfxs_cnt[BGPVIEW_FIELD_INACTIVE], -1);
+    iter->view->need_gc_v6pfxs = 1;
+    break;
+
+  default:
+    return -1;
+  }
+
+  return 0;
+}
+
+int bgpview_iter_pfx_add_peer(bgpview_iter_t *iter, bgpstream_peer_id_t peer_id,
+                              bgpstream_as_path_t *as_path)
+{
+  bgpstream_as_path_store_path_id_t path_id;
+
+  /* get the peer ASN */
+  if (bgpstream_as_path_store_get_path_id(
+        iter->view->pathstore, as_path,
+        __iter_peer_get_sig(iter)->peer_asnumber, &path_id) != 0) {
+    fprintf(stderr, "ERROR: Failed to get AS Path ID from store\n");
+    return -1;
+  }
+
+  __iter_seek_peer(iter, peer_id, BGPVIEW_FIELD_ALL_VALID);
+
+  SNAPSHOT_PRESERVE_PFX(iter);
+  JOURNAL_MARK_PFX(iter);
+
+  return peerid_pfxinfo_insert(iter, __pfx_peerinfos(iter), peer_id, path_id);
+}
+
+int bgpview_iter_pfx_add_peer_by_id(bgpview_iter_t *iter,
+                                    bgpstream_peer_id_t peer_id,
+                                    bgpstream_as_path_store_path_id_t path_id)
+{
+  /* this code is mostly a duplicate of the above func, for efficiency */
+  __iter_seek_peer(iter, peer_id, BGPVIEW_FIELD_ALL_VALID);
+
+  SNAPSHOT_PRESERVE_PFX(iter);
+  JOURNAL_MARK_PFX(iter);
+
+  return peerid_pfxinfo_insert(iter, __pfx_peerinfos(iter), peer_id, path_id);
+}
+
+int bgpview_iter_pfx_remove_peer(bgpview_iter_t *iter)
+{
+  bwv_peerid_pfxinfo_t *pfxinfo = __pfx_peerinfos(iter);
+
+  SNAPSHOT_PRESERVE_PFX(iter);
+  JOURNAL_MARK_PFX(iter);
+
+  /* if the pfx-peer is active, then we deactivate it first */
+  if (__iter_pfx_peer_get_state(iter) == BGPVIEW_FIELD_ACTIVE) {
+    bgpview_iter_pfx_deactivate_peer(iter);
+  }
+
+  assert(BWV_PFX_GET_PEER_STATE(iter->view, pfxinfo, iter->pfx_peer_it) ==
+         BGPVIEW_FIELD_INACTIVE);
+
+  /* now, simply set the state to invalid and reset the pfx counters (the cell
+     itself will be freed by the garbage collector) */
+  if (gc_mark_dirty(iter) != 0) {
+    return -1;
+  }
+  BWV_PFX_SET_PEER_STATE(iter->view, pfxinfo, iter->pfx_peer_it,
+      BGPVIEW_FIELD_INVALID);
+  pfxinfo->peers_cnt[BGPVIEW_FIELD_INACTIVE]--;
+
+  assert(__iter_has_more_peer(iter));
+  switch (iter->version_ptr) {
+  case BGPSTREAM_ADDR_VERSION_IPV4:
+    SHARED_CNT_ADD(iter->view,
+                   BWV_PEER_INFO(iter->view, iter->peer_it)
+                     .v4_pfx_cnt[BGPVIEW_FIELD_INACTIVE],
+                   -1);
+    break;
+
+  case BGPSTREAM_ADDR_VERSION_IPV6:
+    SHARED_CNT_ADD(iter->view,
+                   BWV_PEER_INFO(iter->view, iter->peer_it)
+                     .v6_pfx_cnt[BGPVIEW_FIELD_INACTIVE],
+                   -1);
+    break;
+
+  default:
+    return -1;
+  }
+
+  if (iter->view->peer_pfx_index) {
+    WRITERS_MISC_LOCK(iter->view);
+    peerinfo_idx_del(iter);
+    WRITERS_MISC_UNLOCK(iter->view);
+  }
+
+  /* if there are no peers left in this pfx, the pfx should be removed */
+  if (pfxinfo->state != BGPVIEW_FIELD_INVALID &&
+      pfxinfo->peers_cnt[BGPVIEW_FIELD_INACTIVE] == 0 &&
+      pfxinfo->peers_cnt[BGPVIEW_FIELD_ACTIVE] == 0) {
+    return bgpview_iter_remove_pfx(iter);
+  }
+
+  return 0;
+}
+
+/* ==================== ACTIVATE/DEACTIVATE ==================== */
+
+#define ACTIVATE_FIELD_CNT(field)                                              \
+  do {                                                                         \
+    field[BGPVIEW_FIELD_INACTIVE]--;                                           \
+    field[BGPVIEW_FIELD_ACTIVE]++;                                             \
+  } while (0);
+
+#define DEACTIVATE_FIELD_CNT(field)                                            \
+  do {                                                                         \
+    field[BGPVIEW_FIELD_INACTIVE]++;                                           \
+    field[BGPVIEW_FIELD_ACTIVE]--;                                             \
+  } while (0)
+
+#define ACTIVATE_SHARED_CNT(view, field)                                       \
+  do {                                                                         \
+    SHARED_CNT_ADD(view, field[BGPVIEW_FIELD_INACTIVE], -1);                   \
+    SHARED_CNT_ADD(view, field[BGPVIEW_FIELD_ACTIVE], 1);                      \
+  } while (0)
+
+#define DEACTIVATE_SHARED_CNT(view, field)                                     \
+  do {                                                                         \
+    SHARED_CNT_ADD(view, field[BGPVIEW_FIELD_INACTIVE], 1);                    \
+    SHARED_CNT_ADD(view, field[BGPVIEW_FIELD_ACTIVE], -1);                     \
+  } while (0)
+
+static int activate_peer(bgpview_iter_t *iter)
+{
+  assert(__iter_has_more_peer(iter));
+  assert(__iter_peer_get_state(iter) > 0);
+
+  if (__iter_peer_get_state(iter) != BGPVIEW_FIELD_INACTIVE) {
+    return 0;
+  }
+
+  BWV_PEER_INFO(iter->view, iter->peer_it).state = BGPVIEW_FIELD_ACTIVE;
+  ACTIVATE_FIELD_CNT(iter->view->peerinfo_cnt);
+  return 1;
+}
+
+int bgpview_iter_activate_peer(bgpview_iter_t *iter)
+{
+  int rc;
+
+  WRITERS_TABLES_LOCK(iter->view);
+  rc = activate_peer(iter);
+  WRITERS_TABLES_UNLOCK(iter->view);
+
+  return rc;
+}
+
+static int deactivate_peer(bgpview_iter_t *iter)
+{
+  assert(__iter_has_more_peer(iter));
+  assert(__iter_peer_get_state(iter) > 0);
+
+  bgpview_iter_t *lit;
+  bgpstream_peer_id_t current_id;
+
+  if (__iter_peer_get_state(iter) != BGPVIEW_FIELD_ACTIVE) {
+    return 0;
+  }
+
+  /* only do the massive work of deactivating all pfx-peers if this peer has any
+     active pfxs */
+  if (__iter_peer_get_pfx_cnt(iter, 0, BGPVIEW_FIELD_ACTIVE) > 0) {
+    lit = bgpview_iter_create(iter->view);
+    assert(lit != NULL);
+    current_id = __iter_peer_get_peer_id(iter);
+    bgpview_iter_seek_peer(lit, current_id, BGPVIEW_FIELD_ALL_VALID);
+
+    // deactivate all the peer-pfx associated with the peer
+    for (bgpview_iter_peer_first_pfx(lit, 0, BGPVIEW_FIELD_ACTIVE,
+                                     BGPVIEW_FIELD_ACTIVE);
+         bgpview_iter_peer_has_more_pfx(lit); bgpview_iter_peer_next_pfx(lit)) {
+      bgpview_iter_pfx_deactivate_peer(lit);
+    }
+    bgpview_iter_destroy(lit);
+  }
+
+  /* mark as inactive */
+  BWV_PEER_INFO(iter->view, iter->peer_it).state = BGPVIEW_FIELD_INACTIVE;
+
+  /* update the counters */
+  DEACTIVATE_FIELD_CNT(iter->view->peerinfo_cnt);
+
+  return 1;
+}
+
+int bgpview_iter_deactivate_peer(bgpview_iter_t *iter)
+{
+  int rc;
+
+  /* all the prefixes of the peer are updated, so no other writer may be
+     updating a prefix row */
+  WRITERS_TABLES_LOCK(iter->view);
+  rc = deactivate_peer(iter);
+  WRITERS_TABLES_UNLOCK(iter->view);
+
+  return rc;
+}
+
+static inline int activate_pfx(bgpview_iter_t *iter)
+{
+  bwv_peerid_pfxinfo_t *pfxinfo = __pfx_peerinfos(iter);
+
+  assert(pfxinfo->state > 0);
+  if (pfxinfo->state != BGPVIEW_FIELD_INACTIVE) {
+    return 0;
+  }
+
+  SNAPSHOT_PRESERVE_PFX(iter);
+
+  pfxinfo->state = BGPVIEW_FIELD_ACTIVE;
+
+  switch (iter->version_ptr) {
+  case BGPSTREAM_ADDR_VERSION_IPV4:
+    ACTIVATE_SHARED_CNT(iter->view, iter->view->v4pfxs_cnt);
+    break;
+
+  case BGPSTREAM_ADDR_VERSION_IPV6:
+    ACTIVATE_SHARED_CNT(iter->view, iter->view->v6pfxs_cnt);
+    break;
+
+  default:
+    return -1;
+  }
+
+  return 1;
+}
+
+int bgpview_iter_deactivate_pfx(bgpview_iter_t *iter)
+{
+  bwv_peerid_pfxinfo_t *pfxinfo = __pfx_peerinfos(iter);
+  bgpview_iter_t ti = *iter;
+
+  assert(pfxinfo->state > 0);
+  if (pfxinfo->state != BGPVIEW_FIELD_ACTIVE) {
+    return 0;
+  }
+
+  SNAPSHOT_PRESERVE_PFX(iter);
+
+  /* now mark the pfx as inactive */
+  pfxinfo->state = BGPVIEW_FIELD_INACTIVE;
+
+  /* deactivate all pfx-peers for this prefix */
+  __iter_pfx_first_peer(&ti, BGPVIEW_FIELD_ACTIVE);
+  while (__iter_pfx_has_more_peer(&ti)) {
+    bgpview_iter_pfx_deactivate_peer(&ti);
+    __iter_pfx_next_peer(&ti);
+  }
+
+  /* now update the counters */
+  switch (iter->version_ptr) {
+  case BGPSTREAM_ADDR_VERSION_IPV4:
+    DEACTIVATE_SHARED_CNT(iter->view, iter->view->v4pfxs_cnt);
+    break;
+
+  case BGPSTREAM_ADDR_VERSION_IPV6:
+    DEACTIVATE_SHARED_CNT(iter->view, iter->view->v6pfxs_cnt);
+    break;
+
+  default:
+    return -1;
+  }
+
+  return 1;
+}
+
+int bgpview_iter_pfx_activate_peer(bgpview_iter_t *iter)
+{
+  bwv_peerid_pfxinfo_t *pfxinfo = __pfx_peerinfos(iter);
+
+  assert(__iter_pfx_has_more_peer(iter));
+
+  assert(BWV_PFX_GET_PEER_STATE(iter->view, pfxinfo, iter->pfx_peer_it) > 0);
+  if (BWV_PFX_GET_PEER_STATE(iter->view, pfxinfo, iter->pfx_peer_it) !=
+      BGPVIEW_FIELD_INACTIVE) {
+    return 0;
+  }
+
+  SNAPSHOT_PRESERVE_PFX(iter);
+  JOURNAL_MARK_PFX(iter);
+
+  /* update the number of peers that observe this pfx */
+  ACTIVATE_FIELD_CNT(pfxinfo->peers_cnt);
+
+  /* this is the first active peer, so pfx must be activated */
+  if (pfxinfo->peers_cnt[BGPVIEW_FIELD_ACTIVE] == 1) {
+    activate_pfx(iter);
+  }
+
+  /* the peer MUST be active */
+  assert(__iter_peer_get_state(iter) == BGPVIEW_FIELD_ACTIVE);
+
+  // increment the number of prefixes observed by the peer
+  switch (iter->version_ptr) {
+  case BGPSTREAM_ADDR_VERSION_IPV4:
+    ACTIVATE_SHARED_CNT(
+      iter->view, BWV_PEER_INFO(iter->view, iter->peer_it).v4_pfx_cnt);
+    break;
+  case BGPSTREAM_ADDR_VERSION_IPV6:
+    ACTIVATE_SHARED_CNT(
+      iter->view, BWV_PEER_INFO(iter->view, iter->peer_it).v6_pfx_cnt);
+    break;
+  default:
+    return -1;
+  }
+
+  BWV_PFX_SET_PEER_STATE(iter->view, pfxinfo, iter->pfx_peer_it,
+      BGPVIEW_FIELD_ACTIVE);
+
+  return 1;
+}
+
+int bgpview_iter_pfx_deactivate_peer(bgpview_iter_t *iter)
+{
+  bwv_peerid_pfxinfo_t *pfxinfo = __pfx_peerinfos(iter);
+
+  assert(__iter_pfx_has_more_peer(iter));
+
+  assert(BWV_PFX_GET_PEER_STATE(iter->view, pfxinfo, iter->pfx_peer_it) > 0);
+  if (BWV_PFX_GET_PEER_STATE(iter->view, pfxinfo, iter->pfx_peer_it) !=
+      BGPVIEW_FIELD_ACTIVE) {
+    return 0;
+  }
+
+  SNAPSHOT_PRESERVE_PFX(iter);
+  JOURNAL_MARK_PFX(iter);
+
+  /* set the state to inactive */
+  BWV_PFX_SET_PEER_STATE(iter->view, pfxinfo, iter->pfx_peer_it,
+      BGPVIEW_FIELD_INACTIVE);
+
+  /* update the number of peers that observe the pfx */
+  DEACTIVATE_FIELD_CNT(pfxinfo->peers_cnt);
+  if (pfxinfo->peers_cnt[BGPVIEW_FIELD_ACTIVE] == 0) {
+    bgpview_iter_deactivate_pfx(iter);
+  }
+
+  // decrement the number of pfxs observed by the peer
+  switch (iter->version_ptr) {
+  case BGPSTREAM_ADDR_VERSION_IPV4:
+    DEACTIVATE_SHARED_CNT(
+      iter->view, BWV_PEER_INFO(iter->view, iter->peer_it).v4_pfx_cnt);
+    break;
+  case BGPSTREAM_ADDR_VERSION_IPV6:
+    DEACTIVATE_SHARED_CNT(
+      iter->view, BWV_PEER_INFO(iter->view, iter->peer_it).v6_pfx_cnt);
+    break;
+  default:
+    return -1;
+  }
+
+  return 1;
+}
+
+int bgpview_iter_add_pfx_row(bgpview_iter_t *iter, bgpstream_pfx_t *pfx,
+                             bgpstream_peer_id_t *peer_ids,
+                             bgpstream_as_path_store_path_id_t *path_ids,
+                             int peers_cnt, bgpview_field_state_t state)
+{
+  bwv_peerid_pfxinfo_t *pfxinfo;
+  bwv_peerinfo_t *peerinfo;
+  bwv_pfx_peerinfo_t *cell;
+  uint32_t *pfx_cnt;
+  int cnt[BGPVIEW_FIELD_ALL_VALID] = {0, 0, 0};
+  khiter_t k;
+  int i;
+  int rc;
+  int ret = 0;
+
+  assert(state == BGPVIEW_FIELD_ACTIVE || state == BGPVIEW_FIELD_INACTIVE);
+
+  if (peers_cnt == 0) {
+    return 0;
+  }
+
+  /* seek to (or create) the prefix */
+  if (bgpview_iter_seek_pfx(iter, pfx, BGPVIEW_FIELD_ALL_VALID) == 0 &&
+      add_pfx(iter, pfx) != 0) {
+    return -1;
+  }
+
+  SNAPSHOT_PRESERVE_PFX(iter);
+  JOURNAL_MARK_PFX(iter);
+
+  pfxinfo = __pfx_peerinfos(iter);
+  if (pfx_peer_cells_reserve(iter->view, pfxinfo, peers_cnt) != 0) {
+    return -1;
+  }
+
+  for (i = 0; i < peers_cnt; i++) {
+    /* the peer must already exist */
+    __iter_seek_peer(iter, peer_ids[i], BGPVIEW_FIELD_ALL_VALID);
+    if (iter->peer_it == BWV_PEER_IT_END) {
+      ret = -1;
+      break;
+    }
+    peerinfo = &BWV_PEER_INFO(iter->view, iter->peer_it);
+    pfx_cnt = (iter->version_ptr == BGPSTREAM_ADDR_VERSION_IPV4)
+                ? peerinfo->v4_pfx_cnt
+                : peerinfo->v6_pfx_cnt;
+
+    if ((cell = pfx_peer_cell_put(iter->view, pfxinfo, peer_ids[i], &k)) ==
+        NULL) {
+      ret = -1;
+      break;
+    }
+    cell->as_path_id = path_ids[i];
+
+    if (cell->state == BGPVIEW_FIELD_INVALID) {
+      /* new cell, goes straight to the requested state */
+      assert(state != BGPVIEW_FIELD_ACTIVE ||
+             peerinfo->state == BGPVIEW_FIELD_ACTIVE);
+      cell->state = state;
+      cnt[state]++;
+      SHARED_CNT_ADD(iter->view, pfx_cnt[state], 1);
+
+      if (iter->view->peer_pfx_index) {
+        WRITERS_MISC_LOCK(iter->view);
+        rc = peerinfo_idx_add(iter);
+        WRITERS_MISC_UNLOCK(iter->view);
+        if (rc != 0) {
+          ret = -1;
+          break;
+        }
+      }
+    } else if (cell->state == BGPVIEW_FIELD_INACTIVE &&
+               state == BGPVIEW_FIELD_ACTIVE) {
+      assert(peerinfo->state == BGPVIEW_FIELD_ACTIVE);
+      cell->state = BGPVIEW_FIELD_ACTIVE;
+      cnt[BGPVIEW_FIELD_INACTIVE]--;
+      cnt[BGPVIEW_FIELD_ACTIVE]++;
+      ACTIVATE_SHARED_CNT(iter->view, pfx_cnt);
+    }
+  }
+
+  /* update the prefix counters once for the whole row (even after an error,
+     so that they match the cells inserted so far) */
+  pfxinfo->peers_cnt[BGPVIEW_FIELD_INACTIVE] += cnt[BGPVIEW_FIELD_INACTIVE];
+  pfxinfo->peers_cnt[BGPVIEW_FIELD_ACTIVE] += cnt[BGPVIEW_FIELD_ACTIVE];
+  if (pfxinfo->peers_cnt[BGPVIEW_FIELD_ACTIVE] > 0) {
+    activate_pfx(iter);
+  }
+
+  /* the cells of the row may have moved, so don't point at any of them */
+  iter->pfx_peer_it_valid = 0;
+
+  return ret;
+}
+
+/* ========== PUBLIC FUNCTIONS ========== */
+
+bgpview_t *
+bgpview_create_shared(bgpstream_peer_sig_map_t *peersigns,
+                      bgpstream_as_path_store_t *pathstore,
+                      bgpview_destroy_user_t *bwv_user_destructor,
+                      bgpview_destroy_user_t *bwv_peer_user_destructor,
+                      bgpview_destroy_user_t *bwv_pfx_user_destructor,
+                      bgpview_destroy_user_t *bwv_pfx_peer_user_destructor)
+{
+  bgpview_t *view;
+  struct timeval time_created;
+
+  if ((view = malloc_zero(sizeof(bgpview_t))) == NULL) {
+    return NULL;
+  }
+  pthread_mutex_init(&view->pfx_index_lock, NULL);
+
+  if ((view->v4pfxs = kh_init(bwv_v4pfx_peerid_pfxinfo)) == NULL) {
+    goto err;
+  }
+
+  if ((view->v6pfxs = kh_init(bwv_v6pfx_peerid_pfxinfo)) == NULL) {
+    goto err;
+  }
+
+  if ((view->pfxinfo_slab = bgpview_slab_create(sizeof(bwv_peerid_pfxinfo_t),
+                                                BWV_SLAB_SIZE)) == NULL) {
+    goto err;
+  }
+
+  if (peersigns != NULL) {
+    view->peersigns_shared = 1;
+    view->peersigns = peersigns;
+  } else {
+    if ((view->peersigns = bgpstream_peer_sig_map_create()) == NULL) {
+      fprintf(stderr, "Failed to create peersigns table\n");
+      goto err;
+    }
+    view->peersigns_shared = 0;
+  }
+
+  if (pathstore != NULL) {
+    view->pathstore_shared = 1;
+    view->pathstore = pathstore;
+  } else {
+    if ((view->pathstore = bgpstream_as_path_store_create()) == NULL) {
+      fprintf(stderr, "Failed to create AS Path Store\n");
+      goto err;
+    }
+    view->pathstore_shared = 0;
+  }
+
+  gettimeofday(&time_created, NULL);
+  view->time_created = time_created.tv_sec;
 
-#define __iter_has_more_pfx(iter)                                              \
-  (((iter)->version_ptr == BGPSTREAM_ADDR_VERSION_IPV4)                        \
-     ? (__iter_has_more_pfx_v((iter), iter->view->v4pfxs))                     \
-     : ((iter)->version_ptr == BGPSTREAM_ADDR_VERSION_IPV6)                    \
-         ? (__iter_has_more_pfx_v((iter), iter->view->v6pfxs))                 \
-         : 0)
+  view->user_destructor = bwv_user_destructor;
+  view->peer_user_destructor = bwv_peer_user_destructor;
+  view->pfx_user_destructor = bwv_pfx_user_destructor;
+  view->pfx_peer_user_destructor = bwv_pfx_peer_user_destructor;
 
-int bgpview_iter_next_pfx(bgpview_iter_t *iter)
-{
-  __iter_next_pfx(iter);
-  return __iter_has_more_pfx(iter);
+  /* all other fields are memset to 0 */
+
+  return view;
+
+err:
+  fprintf(stderr, "Failed to create BGPView\n");
+  bgpview_destroy(view);
+  return NULL;
 }
 
-int bgpview_iter_has_more_pfx(bgpview_iter_t *iter)
+bgpview_t *bgpview_create(bgpview_destroy_user_t *bwv_user_destructor,
+                          bgpview_destroy_user_t *bwv_peer_user_destructor,
+                          bgpview_destroy_user_t *bwv_pfx_user_destructor,
+                          bgpview_destroy_user_t *bwv_pfx_peer_user_destructor)
 {
-  return __iter_has_more_pfx(iter);
+  return bgpview_create_shared(
+    NULL, NULL, bwv_user_destructor, bwv_peer_user_destructor,
+    bwv_pfx_user_destructor, bwv_pfx_peer_user_destructor);
 }
 
-int bgpview_iter_seek_pfx(bgpview_iter_t *iter, bgpstream_pfx_t *pfx,
-                          uint8_t state_mask)
+void bgpview_destroy(bgpview_t *view)
 {
-  iter->version_filter = pfx->address.version;
-  iter->version_ptr = pfx->address.version;
-  iter->pfx_state_mask = state_mask;
-  iter->pfx_peer_it_valid = 0;
-  iter->pfx_peer_it = 0;
+  if (view == NULL) {
+    return;
+  }
 
-  switch (pfx->address.version) {
-  case BGPSTREAM_ADDR_VERSION_IPV4:
-    iter->pfx_it = kh_get(bwv_v4pfx_peerid_pfxinfo, iter->view->v4pfxs,
-                          pfx->bs_ipv4);
-    if (iter->pfx_it == kh_end(iter->view->v4pfxs)) {
-      return 0;
+  khiter_t k;
+  int i;
+  int destroy_pfxs;
+  bwv_snap_tables_t *tables = NULL;
+
+  if (view->is_snapshot) {
+    /* a snapshot only owns its copies, the rest of the prefix infos belong to
+       the source view */
+    snapshot_release_copies(view);
+    free(view->snap_copies);
+    view->snap_copies = NULL;
+    if (view->snapshot_src != NULL) {
+      snapshot_detach(view->snapshot_src, view);
+      snapshot_sweep_retired(view->snapshot_src);
     }
-    if (iter->pfx_state_mask &
-        kh_val(iter->view->v4pfxs, iter->pfx_it)->state) {
-      return 1;
+    if (view->v4pfxs != NULL) {
+      kh_clear(bwv_v4pfx_peerid_pfxinfo, view->v4pfxs);
     }
-    // if the mask does not match, than set the iterator to the end
-    iter->pfx_it = kh_end(iter->view->v4pfxs);
-    return 0;
+    if (view->v6pfxs != NULL) {
+      kh_clear(bwv_v6pfx_peerid_pfxinfo, view->v6pfxs);
+    }
+  }
 
-  case BGPSTREAM_ADDR_VERSION_IPV6:
-    iter->pfx_it = kh_get(bwv_v6pfx_peerid_pfxinfo, iter->view->v6pfxs,
-                          pfx->bs_ipv6);
-    if (iter->pfx_it == kh_end(iter->view->v6pfxs)) {
-      return 0;
+  /* the snapshots outlive us, and they share our prefixes (and most likely
+     our path store), so leave them empty, but with the tables they use */
+  if (view->snapshots_cnt != 0 &&
+      (view->peersigns_shared == 0 || view->pathstore_shared == 0)) {
+    if ((tables = malloc_zero(sizeof(bwv_snap_tables_t))) == NULL) {
+      /* better leaked than dangling */
+      fprintf(stderr, "WARN: Could not hand view tables over to snapshots\n");
+    } else {
+      tables->peersigns = view->peersigns_shared ? NULL : view->peersigns;
+      tables->pathstore = view->pathstore_shared ? NULL : view->pathstore;
+      tables->refcnt = view->snapshots_cnt;
     }
-    if (iter->pfx_state_mask &
-        kh_val(iter->view->v6pfxs, iter->pfx_it)->state) {
-      return 1;
+    view->peersigns_shared = 1;
+    view->pathstore_shared = 1;
+  }
+  for (i = 0; i < view->snapshots_cnt; i++) {
+    view->snapshots[i]->snap_tables = tables;
+    snapshot_release_copies(view->snapshots[i]);
+    kh_clear(bwv_v4pfx_peerid_pfxinfo, view->snapshots[i]->v4pfxs);
+    kh_clear(bwv_v6pfx_peerid_pfxinfo, view->snapshots[i]->v6pfxs);
+    memset(view->snapshots[i]->v4pfxs_cnt, 0,
+           sizeof(view->snapshots[i]->v4pfxs_cnt));
+    memset(view->snapshots[i]->v6pfxs_cnt, 0,
+           sizeof(view->snapshots[i]->v6pfxs_cnt));
+    view->snapshots[i]->snapshot_src = NULL;
+  }
+  free(view->snapshots);
+  view->snapshots = NULL;
+  view->snapshots_cnt = 0;
+  snapshot_sweep_retired(view);
+  free(view->retired);
+  view->retired = NULL;
+
+  /* if there is no per-prefix state to destroy, all prefixes are released
+     at once when the slabs are destroyed */
+  destroy_pfxs = !(view->cell_layout == BGPVIEW_CELL_LAYOUT_SORTED &&
+                   view->pfx_user_used == 0);
+
+  if (view->v4pfxs != NULL) {
+    for (k = kh_begin(view->v4pfxs);
+         destroy_pfxs && k != kh_end(view->v4pfxs); ++k) {
+      if (kh_exist(view->v4pfxs, k)) {
+        peerid_pfxinfo_destroy(view, kh_value(view->v4pfxs, k));
+      }
     }
-    // if the mask does not match, than set the iterator to the end
-    iter->pfx_it = kh_end(iter->view->v6pfxs);
-    return 0;
-  default:
-    /* programming error */
-    assert(0);
+    kh_destroy(bwv_v4pfx_peerid_pfxinfo, view->v4pfxs);
+    view->v4pfxs = NULL;
   }
-  return 0;
+
+  if (view->v6pfxs != NULL) {
+    for (k = kh_begin(view->v6pfxs);
+         destroy_pfxs && k != kh_end(view->v6pfxs); ++k) {
+      if (kh_exist(view->v6pfxs, k)) {
+        peerid_pfxinfo_destroy(view, kh_value(view->v6pfxs, k));
+      }
+    }
+    kh_destroy(bwv_v6pfx_peerid_pfxinfo, view->v6pfxs);
+    view->v6pfxs = NULL;
+  }
+
+  bgpview_slab_destroy(view->pfxinfo_slab);
+  view->pfxinfo_slab = NULL;
+
+  free(view->gc_dirty);
+  view->gc_dirty = NULL;
+  view->gc_dirty_cnt = 0;
+  free(view->journal);
+  view->journal = NULL;
+  view->journal_cnt = 0;
+  free(view->pfx_index);
+  view->pfx_index = NULL;
+  view->pfx_index_cnt = 0;
+  free(view->pfx_index_new);
+  view->pfx_index_new = NULL;
+  free(view->pfx_index_marks);
+  view->pfx_index_marks = NULL;
+  pthread_mutex_destroy(&view->pfx_index_lock);
+  for (i = 0; i < BWV_PFX_PEER_VEC_CLASS_CNT; i++) {
+    bgpview_slab_destroy(view->cells_slab[i]);
+    view->cells_slab[i] = NULL;
+  }
+
+  if (view->peersigns_shared == 0 && view->peersigns != NULL) {
+    bgpstream_peer_sig_map_destroy(view->peersigns);
+    view->peersigns = NULL;
+  }
+
+  if (view->pathstore_shared == 0 && view->pathstore != NULL) {
+    bgpstream_as_path_store_destroy(view->pathstore);
+    view->pathstore = NULL;
+  }
+
+  if (view->snap_tables != NULL && --view->snap_tables->refcnt == 0) {
+    if (view->snap_tables->peersigns != NULL) {
+      bgpstream_peer_sig_map_destroy(view->snap_tables->peersigns);
+    }
+    if (view->snap_tables->pathstore != NULL) {
+      bgpstream_as_path_store_destroy(view->snap_tables->pathstore);
+    }
+    free(view->snap_tables);
+  }
+  view->snap_tables = NULL;
+
+  peerinfo_destroy_user(view);
+  for (i = 0; i < (int)view->peerinfo.cnt; i++) {
+    peerinfo_destroy_idx(&BWV_PEER_INFO(view, view->peerinfo.ids[i]));
+  }
+  peertab_destroy(&view->peerinfo);
+
+  if (view->user != NULL) {
+    if (view->user_destructor != NULL) {
+      view->user_destructor(view->user);
+    }
+    view->user = NULL;
+  }
+
+  writers_destroy(view->writers);
+  view->writers = NULL;
+
+  free(view);
 }
 
-/* ==================== PFX-PEER ITERATORS ==================== */
+void bgpview_clear(bgpview_t *view)
+{
+  struct timeval time_created;
+  bwv_peerid_pfxinfo_t *pfxinfo;
+  int i;
+  bgpview_iter_t *lit = bgpview_iter_create(view);
+  assert(lit != NULL);
 
-/* optimized macros. be careful when using these */
+  view->time = 0;
+
+  gettimeofday(&time_created, NULL);
+  view->time_created = time_created.tv_sec;
+
+  assert(view->is_snapshot == 0);
+
+  /* prefixes shared with snapshots are handed over to them rather than
+     copied (if that fails, they are copied when they are marked invalid) */
+  if (view->snapshots_cnt != 0 && snapshot_retire_pfxs(view) != 0) {
+    fprintf(stderr, "WARN: Could not hand prefixes over to view snapshots\n");
+  }
+
+  if (view->cell_layout == BGPVIEW_CELL_LAYOUT_SORTED &&
+      view->pfx_user_used == 0 && view->snapshots_cnt == 0 &&
+      view->retired_cnt == 0) {
+    /* there is no per-prefix state worth keeping, so rather than marking
+       each prefix as invalid, release them all at once and recycle the
+       slabs for the next view */
+    kh_clear(bwv_v4pfx_peerid_pfxinfo, view->v4pfxs);
+    kh_clear(bwv_v6pfx_peerid_pfxinfo, view->v6pfxs);
+    view->gc_dirty_cnt = 0;
+    bgpview_slab_reset(view->pfxinfo_slab);
+    for (i = 0; i < BWV_PFX_PEER_VEC_CLASS_CNT; i++) {
+      if (view->cells_slab[i] != NULL) {
+        bgpview_slab_reset(view->cells_slab[i]);
+      }
+    }
+  }
+
+  /* mark all prefixes as invalid */
+  bgpview_iter_first_pfx(lit, 0, BGPVIEW_FIELD_ALL_VALID);
+  while (__iter_has_more_pfx(lit)) {
+    pfxinfo = __pfx_peerinfos(lit);
+    if (view->snapshots_cnt != 0 && pfxinfo->gen != view->snap_gen &&
+        snapshot_preserve_pfx(view, lit->version_ptr, lit->pfx_it) != 0) {
+      fprintf(stderr, "WARN: Failed to preserve prefix in view snapshot\n");
+    }
+    pfxinfo->peers_cnt[BGPVIEW_FIELD_INACTIVE] = 0;
+    pfxinfo->peers_cnt[BGPVIEW_FIELD_ACTIVE] = 0;
+    pfxinfo->state = BGPVIEW_FIELD_INVALID;
+    pfxinfo->journal_dirty = 0;
+    if (view->cell_layout == BGPVIEW_CELL_LAYOUT_SORTED) {
+      if (pfxinfo->peers_vec != NULL) {
+        pfxinfo->peers_vec->cnt = 0;
+      }
+    } else if (view->disable_extended) {
+      kh_clear(bwv_peerid_pfx_peerinfo, pfxinfo->peers_min);
+    } else {
+      kh_clear(bwv_peerid_pfx_peerinfo_ext, pfxinfo->peers_ext);
+    }
+    __iter_next_pfx(lit);
+  }
+  view->need_gc_v4pfxs = (kh_size(view->v4pfxs) > 0);
+  view->need_gc_v6pfxs = (kh_size(view->v6pfxs) > 0);
+  view->v4pfxs_cnt[BGPVIEW_FIELD_INACTIVE] = 0;
+  view->v4pfxs_cnt[BGPVIEW_FIELD_ACTIVE] = 0;
+  view->v6pfxs_cnt[BGPVIEW_FIELD_INACTIVE] = 0;
+  view->v6pfxs_cnt[BGPVIEW_FIELD_ACTIVE] = 0;
+
+  /* clear out the peerinfo table */
+  __iter_first_peer(lit, BGPVIEW_FIELD_ALL_VALID);
+  while (__iter_has_more_peer(lit)) {
+    peerinfo_reset(&BWV_PEER_INFO(view, lit->peer_it));
+    __iter_next_peer(lit);
+  }
+  view->need_gc_peerinfo = (view->peerinfo.cnt > 0);
+  view->peerinfo_cnt[BGPVIEW_FIELD_INACTIVE] = 0;
+  view->peerinfo_cnt[BGPVIEW_FIELD_ACTIVE] = 0;
+
+  /* the removed prefixes are not recorded, so the journal is useless until
+     the next checkpoint */
+  view->journal_cnt = 0;
+  view->journal_complete = 0;
+
+  bgpview_iter_destroy(lit);
+}
 
-#define SCAN_FOR_MATCHING_PFX_PEER(iter, peertable)                            \
+#define GC_DIRTY_PFX(view, tabletype, table, version, key)                     \
   do {                                                                         \
-    for ( ; (iter)->pfx_peer_it != kh_end(peertable); ++(iter)->pfx_peer_it) { \
-      if (!kh_exist(peertable, (iter)->pfx_peer_it)) continue;                 \
-      if ((iter)->pfx_peer_state_mask &                                        \
-          kh_val(peertable, (iter)->pfx_peer_it).state) {                      \
-        __iter_seek_peer((iter), kh_key(peertable, (iter)->pfx_peer_it),       \
-            (iter)->pfx_peer_state_mask);                                      \
-        (iter)->pfx_peer_it_valid = 1;                                         \
-        break;                                                                 \
+    khiter_t k = kh_get(tabletype, table, key);                                \
+    bwv_peerid_pfxinfo_t *v;                                                   \
+    if (k == kh_end(table)) {                                                  \
+      /* already collected by bgpview_gc */                                    \
+      break;                                                                   \
+    }                                                                          \
+    v = kh_val(table, k);                                                      \
+    v->gc_dirty = 0;                                                           \
+    if (v->state != BGPVIEW_FIELD_INVALID) {                                   \
+      /* the pfx is still in use, just free its invalid pfx-peers */           \
+      if (peerid_pfxinfo_compact(view, v) != 0) {                              \
+        fprintf(stderr, "WARN: Could not shrink pfx-peer table\n");            \
       }                                                                        \
+      break;                                                                   \
+    }                                                                          \
+    if ((view)->snapshots_cnt != 0 && v->gen != (view)->snap_gen &&            \
+        snapshot_preserve_pfx(view, version, k) != 0) {                        \
+      break;                                                                   \
     }                                                                          \
+    peerid_pfxinfo_destroy(view, v);                                           \
+    kh_del(tabletype, table, k);                                               \
   } while (0)
 
-#define __iter_pfx_first_peer_tab(iter, peertable, state_mask)                 \
-  do {                                                                         \
-    (iter)->pfx_peer_state_mask = state_mask;                                  \
-    (iter)->pfx_peer_it = 0;                                                   \
-    (iter)->pfx_peer_it_valid = 0;                                             \
-    if (!peertable) break;                                                     \
-    SCAN_FOR_MATCHING_PFX_PEER(iter, peertable);                               \
-  } while (0)
+/* garbage collect a prefix from the dirty list */
+static void gc_dirty_pfx(bgpview_t *view, bgpstream_pfx_t *pfx)
+{
+  switch (pfx->address.version) {
+  case BGPSTREAM_ADDR_VERSION_IPV4:
+    GC_DIRTY_PFX(view, bwv_v4pfx_peerid_pfxinfo, view->v4pfxs,
+                 BGPSTREAM_ADDR_VERSION_IPV4, pfx->bs_ipv4);
+    break;
 
-#define __iter_pfx_first_peer(iter, state_mask)                                \
-  do {                                                                         \
-    bwv_peerid_pfxinfo_t *__infos = __pfx_peerinfos((iter));                   \
-    if ((iter)->view->disable_extended) {                                      \
-      __iter_pfx_first_peer_tab(iter, __infos->peers_min, state_mask);         \
-    } else {                                                                   \
-      __iter_pfx_first_peer_tab(iter, __infos->peers_ext, state_mask);         \
-    }                                                                          \
-  } while (0)
+  case BGPSTREAM_ADDR_VERSION_IPV6:
+    GC_DIRTY_PFX(view, bwv_v6pfx_peerid_pfxinfo, view->v6pfxs,
+                 BGPSTREAM_ADDR_VERSION_IPV6, pfx->bs_ipv6);
+    break;
 
-#define __iter_pfx_next_peer_tab(iter, peertable)                              \
-  do {                                                                         \
-    (iter)->pfx_peer_it_valid = 0;                                             \
-    (iter)->pfx_peer_it++;                                                     \
-    SCAN_FOR_MATCHING_PFX_PEER(iter, peertable);                               \
-  } while (0)
+  default:
+    break;
+  }
+}
 
-#define __iter_pfx_next_peer(iter)                                             \
-  do {                                                                         \
-    bwv_peerid_pfxinfo_t *__infos = __pfx_peerinfos((iter));                   \
-    if ((iter)->view->disable_extended) {                                      \
-      __iter_pfx_next_peer_tab(iter, __infos->peers_min);                      \
-    } else {                                                                   \
-      __iter_pfx_next_peer_tab(iter, __infos->peers_ext);                      \
-    }                                                                          \
-  } while (0)
+static void gc_peers(bgpview_t *view)
+{
+  bgpstream_peer_id_t peerid;
+  bwv_peerinfo_t *pi;
+  uint32_t i;
+
+  if (view->need_gc_peerinfo == 0) {
+    return;
+  }
+
+  /* walk the list backwards, as deleting moves the last peer into place */
+  for (i = view->peerinfo.cnt; i > 0; i--) {
+    peerid = view->peerinfo.ids[i - 1];
+    pi = &BWV_PEER_INFO(view, peerid);
+    if (pi->state == BGPVIEW_FIELD_INVALID) {
+      if (view->peer_user_destructor != NULL && pi->user != NULL) {
+        view->peer_user_destructor(pi->user);
+      }
+      peerinfo_destroy_idx(pi);
+      peertab_del(&view->peerinfo, peerid);
+    }
+  }
+  view->need_gc_peerinfo = 0;
+}
+
+void bgpview_gc(bgpview_t *view)
+{
+  khiter_t k;
+
+  if (view->is_snapshot) {
+    /* prefixes of a snapshot (mostly) belong to the source view */
+    return;
+  }
+
+  /* first free the invalid pfx-peers of the prefixes that are still in use
+     (only prefixes that had pfx-peers removed need to be visited) */
+  while (view->gc_dirty_cnt > 0) {
+    gc_dirty_pfx(view, &view->gc_dirty[--view->gc_dirty_cnt]);
+  }
+
+  if (view->need_gc_v4pfxs || view->gc_dirty_lost) {
+    for (k = kh_begin(view->v4pfxs); k != kh_end(view->v4pfxs); ++k) {
+      if (!kh_exist(view->v4pfxs, k)) {
+        continue;
+      }
+      if (kh_value(view->v4pfxs, k)->state != BGPVIEW_FIELD_INVALID) {
+        /* pfx-peers may have been removed without the pfx being marked */
+        if (view->gc_dirty_lost &&
+            peerid_pfxinfo_compact(view, kh_value(view->v4pfxs, k)) != 0) {
+          fprintf(stderr, "WARN: Could not shrink pfx-peer table\n");
+        }
+      } else {
+        if (view->snapshots_cnt != 0 &&
+            kh_value(view->v4pfxs, k)->gen != view->snap_gen &&
+            snapshot_preserve_pfx(view, BGPSTREAM_ADDR_VERSION_IPV4, k) != 0) {
+          continue;
+        }
+        peerid_pfxinfo_destroy(view, kh_value(view->v4pfxs, k));
+        kh_del(bwv_v4pfx_peerid_pfxinfo, view->v4pfxs, k);
+      }
+    }
+    view->need_gc_v4pfxs = 0;
+  }
+
+  if (view->need_gc_v6pfxs || view->gc_dirty_lost) {
+    for (k = kh_begin(view->v6pfxs); k != kh_end(view->v6pfxs); ++k) {
+      if (!kh_exist(view->v6pfxs, k)) {
+        continue;
+      }
+      if (kh_value(view->v6pfxs, k)->state != BGPVIEW_FIELD_INVALID) {
+        /* pfx-peers may have been removed without the pfx being marked */
+        if (view->gc_dirty_lost &&
+            peerid_pfxinfo_compact(view, kh_value(view->v6pfxs, k)) != 0) {
+          fprintf(stderr, "WARN: Could not shrink pfx-peer table\n");
+        }
+      } else {
+        if (view->snapshots_cnt != 0 &&
+            kh_value(view->v6pfxs, k)->gen != view->snap_gen &&
+            snapshot_preserve_pfx(view, BGPSTREAM_ADDR_VERSION_IPV6, k) != 0) {
+          continue;
+        }
+        peerid_pfxinfo_destroy(view, kh_value(view->v6pfxs, k));
+        kh_del(bwv_v6pfx_peerid_pfxinfo, view->v6pfxs, k);
+      }
+    }
+    view->need_gc_v6pfxs = 0;
+  }
 
-#define __iter_pfx_has_more_peer(iter)                                         \
-  ((iter)->pfx_peer_it_valid)
+  view->gc_dirty_lost = 0;
 
-#define __iter_pfx_seek_peer_tab(iter, tabtype, peertable, peerid, state_mask) \
-  do {                                                                         \
-    (iter)->pfx_peer_state_mask = state_mask;                                  \
-    khiter_t k;                                                                \
-    if (peertable &&                                                           \
-        (k = kh_get(tabtype, peertable, peerid)) != kh_end(peertable) &&       \
-        ((iter)->pfx_peer_state_mask & kh_val(peertable, k).state)) {          \
-      (iter)->pfx_peer_it_valid = 1;                                           \
-      (iter)->pfx_peer_it = k;                                                 \
-      __iter_seek_peer((iter), peerid, state_mask);                            \
-    } else {                                                                   \
-      iter->pfx_peer_it_valid = 0;                                             \
-    }                                                                          \
-  } while (0)
+  gc_peers(view);
+}
 
-#define __iter_pfx_seek_peer(iter, peerid, state_mask)                         \
-  do {                                                                         \
-    bwv_peerid_pfxinfo_t *__infos = __pfx_peerinfos((iter));                   \
-    if ((iter)->view->disable_extended) {                                      \
-      __iter_pfx_seek_peer_tab(iter, bwv_peerid_pfx_peerinfo,                  \
-          __infos->peers_min, peerid, state_mask);                             \
-    } else {                                                                   \
-      __iter_pfx_seek_peer_tab(iter, bwv_peerid_pfx_peerinfo_ext,              \
-          __infos->peers_ext, peerid, state_mask);                             \
-    }                                                                          \
-  } while (0)
+uint32_t bgpview_gc_step(bgpview_t *view, int budget)
+{
+  if (view->is_snapshot) {
+    return 0;
+  }
 
-/* public accessor functions */
+  /* the list is incomplete, so only a full collection will do */
+  if (view->gc_dirty_lost) {
+    bgpview_gc(view);
+    return 0;
+  }
 
-int bgpview_iter_pfx_first_peer(bgpview_iter_t *iter, uint8_t state_mask)
-{
-  __iter_pfx_first_peer(iter, state_mask);
-  assert(iter->pfx_peer_it_valid == 0 || __iter_has_more_peer(iter));
-  return (iter->pfx_peer_it_valid);
-}
+  while (view->gc_dirty_cnt > 0 && budget > 0) {
+    gc_dirty_pfx(view, &view->gc_dirty[--view->gc_dirty_cnt]);
+    budget--;
+  }
 
-int bgpview_iter_pfx_next_peer(bgpview_iter_t *iter)
-{
-  __iter_pfx_next_peer(iter);
-  assert(iter->pfx_peer_it_valid == 0 || __iter_has_more_peer(iter));
-  return (iter->pfx_peer_it_valid);
-}
+  /* there are usually few peers, so they are always collected at once */
+  gc_peers(view);
 
-int bgpview_iter_pfx_has_more_peer(bgpview_iter_t *iter)
-{
-  return __iter_pfx_has_more_peer(iter);
+  return view->gc_dirty_cnt;
 }
 
-int bgpview_iter_pfx_seek_peer(bgpview_iter_t *iter, bgpstream_peer_id_t peerid,
-                               uint8_t state_mask)
+int bgpview_copy(bgpview_t *dst, bgpview_t *src)
 {
-  __iter_pfx_seek_peer(iter, peerid, state_mask);
-  return (iter->pfx_peer_it_valid);
-}
+  bgpview_iter_t *src_iter = NULL;
+  bgpview_iter_t *dst_iter = NULL;
 
-/* =================== ALL-PFX-PEER ITERATORS ==================== */
+  bgpstream_peer_sig_t *ps;
+  bgpstream_peer_id_t src_id, dst_id;
+  bgpstream_peer_id_t dstids[UINT16_MAX];
 
-int bgpview_iter_first_pfx_peer(bgpview_iter_t *iter, int version,
-                                uint8_t pfx_mask, uint8_t peer_mask)
-{
-  // set the version(s) we iterate through
-  iter->version_filter = version;
+  int first;
+  bgpstream_pfx_t *pfx;
+  bgpstream_as_path_store_path_id_t pathid;
+  bgpstream_as_path_t *path;
 
-  // set the version we start iterating through
-  iter->version_ptr = (iter->version_filter == BGPSTREAM_ADDR_VERSION_IPV6)
-                        ? BGPSTREAM_ADDR_VERSION_IPV6
-                        : BGPSTREAM_ADDR_VERSION_IPV4;
+  dst->time = src->time;
 
-  // masks are going to be set by each first function
-  iter->pfx_state_mask = 0;
-  iter->pfx_peer_state_mask = 0;
+  if (((src_iter = bgpview_iter_create(src)) == NULL) ||
+      ((dst_iter = bgpview_iter_create(dst)) == NULL)) {
+    goto err;
+  }
 
-  // start from the first matching prefix
-  bgpview_iter_first_pfx(iter, version, pfx_mask);
-  while (__iter_has_more_pfx(iter)) {
-    // look for the first matching peer within the prefix
-    if (bgpview_iter_pfx_first_peer(iter, peer_mask)) {
-      return 1;
+  for (bgpview_iter_first_peer(src_iter, BGPVIEW_FIELD_ACTIVE);
+       bgpview_iter_has_more_peer(src_iter); bgpview_iter_next_peer(src_iter)) {
+    ps = bgpview_iter_peer_get_sig(src_iter);
+    src_id = bgpview_iter_peer_get_peer_id(src_iter);
+    if ((dst_id = bgpview_iter_add_peer(
+           dst_iter, ps->collector_str,
+           &ps->peer_ip_addr, ps->peer_asnumber)) == 0) {
+      goto err;
     }
-    __iter_next_pfx(iter);
+    dstids[src_id] = dst_id;
+    bgpview_iter_activate_peer(dst_iter);
   }
-  return 0;
-}
 
-#define __iter_has_more_pfx_peer(iter)                                         \
-  (__iter_has_more_pfx(iter) && __iter_pfx_has_more_peer(iter))
+  for (bgpview_iter_first_pfx(src_iter, 0, BGPVIEW_FIELD_ACTIVE);
+       bgpview_iter_has_more_pfx(src_iter); bgpview_iter_next_pfx(src_iter)) {
+    first = 1;
+    pfx = bgpview_iter_pfx_get_pfx(src_iter);
+    for (bgpview_iter_pfx_first_peer(src_iter, BGPVIEW_FIELD_ACTIVE);
+         bgpview_iter_pfx_has_more_peer(src_iter);
+         bgpview_iter_pfx_next_peer(src_iter)) {
+      src_id = bgpview_iter_peer_get_peer_id(src_iter);
+      dst_id = dstids[src_id];
+      pathid = bgpview_iter_pfx_peer_get_as_path_store_path_id(src_iter);
 
-#define __iter_next_pfx_peer(iter)                                             \
-  do {                                                                         \
-    while (__iter_has_more_pfx(iter)) {                                        \
-      /* look for the next matching peer within the prefix */                  \
-      __iter_pfx_next_peer(iter);                                              \
-      if (__iter_pfx_has_more_peer(iter))                                      \
-        break;                                                                 \
-      /* no more peers, go to the next prefix */                               \
-      __iter_next_pfx(iter);                                                   \
-      if (__iter_has_more_pfx(iter)) {                                         \
-        /* go to the first peer */                                             \
-        __iter_pfx_first_peer(iter, iter->pfx_peer_state_mask);                \
-        break;                                                                 \
-      }                                                                        \
-    }                                                                          \
-  } while (0)
+      /* if they share tables, be more efficient */
+      if (dst->pathstore == src->pathstore) {
+        if (first != 0) {
+          /* this is the first pfx-peer for this prefix */
+          if (bgpview_iter_add_pfx_peer_by_id(dst_iter, pfx, dst_id, pathid) !=
+              0) {
+            goto err;
+          }
+          first = 0;
+        } else {
+          if (bgpview_iter_pfx_add_peer_by_id(dst_iter, dst_id, pathid) != 0) {
+            goto err;
+          }
+        }
+      } else {
+        /* inefficiently copy */
+        path = bgpview_iter_pfx_peer_get_as_path(src_iter);
 
-int bgpview_iter_next_pfx_peer(bgpview_iter_t *iter)
-{
-  __iter_next_pfx_peer(iter);
-  return __iter_has_more_pfx_peer(iter);
+        if (first != 0) {
+          if (bgpview_iter_add_pfx_peer(dst_iter, pfx, dst_id, path) != 0) {
+            goto err;
+          }
+          first = 0;
+        } else {
+          if (bgpview_iter_pfx_add_peer(dst_iter, dst_id, path) != 0) {
+            goto err;
+          }
+        }
+
+        bgpstream_as_path_destroy(path);
+      }
+      bgpview_iter_pfx_activate_peer(dst_iter);
+    }
+  }
+
+  bgpview_iter_destroy(src_iter);
+  bgpview_iter_destroy(dst_iter);
+
+  return 0;
+
+err:
+  bgpview_iter_destroy(src_iter);
+  bgpview_iter_destroy(dst_iter);
+  return -1;
 }
 
-int bgpview_iter_has_more_pfx_peer(bgpview_iter_t *iter)
+bgpview_t *bgpview_dup(bgpview_t *src)
 {
-  return bgpview_iter_has_more_pfx(iter) &&
-         bgpview_iter_pfx_has_more_peer(iter);
+  bgpview_t *dst = NULL;
+
+  if ((dst = bgpview_create_shared(
+         src->peersigns, src->pathstore, src->user_destructor,
+         src->peer_user_destructor, src->pfx_user_destructor,
+         src->pfx_peer_user_destructor)) == NULL) {
+    return NULL;
+  }
+
+  dst->disable_extended = src->disable_extended;
+  dst->cell_layout = src->cell_layout;
+  update_cell_kind(dst);
+  dst->peer_pfx_index = src->peer_pfx_index;
+  if (src->huge_pages != 0 && bgpview_enable_huge_pages(dst) != 0) {
+    goto err;
+  }
+
+  if (bgpview_copy(dst, src) != 0) {
+    goto err;
+  }
+
+  return dst;
+
+err:
+  bgpview_destroy(dst);
+  return NULL;
 }
 
-int bgpview_iter_seek_pfx_peer(bgpview_iter_t *iter, bgpstream_pfx_t *pfx,
-                               bgpstream_peer_id_t peerid, uint8_t pfx_mask,
-                               uint8_t peer_mask)
+bgpview_t *bgpview_snapshot_create(bgpview_t *view)
 {
-  if (bgpview_iter_seek_pfx(iter, pfx, pfx_mask) &&
-      bgpview_iter_pfx_seek_peer(iter, peerid, peer_mask)) {
-    return 1;
+  bgpview_t *snap = NULL;
+  bgpview_t **tmp;
+
+  /* no snapshots of snapshots */
+  assert(view->is_snapshot == 0);
+
+  if ((tmp = realloc(view->snapshots, sizeof(bgpview_t *) *
+                                        (view->snapshots_cnt + 1))) == NULL) {
+    return NULL;
   }
+  view->snapshots = tmp;
 
-  // if the peer is not found we reset the iterators
-  iter->version_ptr = BGPSTREAM_ADDR_VERSION_IPV4;
-  iter->pfx_it = kh_end(iter->view->v4pfxs);
-  iter->pfx_peer_it_valid = 0;
-  iter->pfx_peer_it = 0;
+  if ((snap = bgpview_create_shared(view->peersigns, view->pathstore, NULL,
+                                    NULL, NULL, NULL)) == NULL) {
+    return NULL;
+  }
+  snap->disable_extended = view->disable_extended;
+  snap->cell_layout = view->cell_layout;
+  update_cell_kind(snap);
+  snap->is_snapshot = 1;
+  snap->snapshot_src = view;
+  view->snapshots[view->snapshots_cnt++] = snap;
+  if (view->huge_pages != 0 && bgpview_enable_huge_pages(snap) != 0) {
+    bgpview_destroy(snap);
+    return NULL;
+  }
 
-  return 0;
-}
+  if (bgpview_snapshot_update(snap) != 0) {
+    bgpview_destroy(snap);
+    return NULL;
+  }
 
-/* ==================== CREATION FUNCS ==================== */
+  return snap;
+}
 
-bgpstream_peer_id_t bgpview_iter_add_peer(bgpview_iter_t *iter,
-                                          const char *collector_str,
-                                          bgpstream_ip_addr_t *peer_address,
-                                          uint32_t peer_asnumber)
+int bgpview_snapshot_update(bgpview_t *snap)
 {
-  bgpstream_peer_id_t peer_id;
-  khiter_t k;
-  int khret;
+  bgpview_t *view = snap->snapshot_src;
+  bwv_peerinfo_t *pi;
+  uint32_t i;
 
-  /* add peer to signatures' map */
-  if ((peer_id =
-         bgpstream_peer_sig_map_get_id(iter->view->peersigns, collector_str,
-                                       peer_address, peer_asnumber)) == 0) {
-    fprintf(stderr, "Could not add peer to peersigns\n");
-    fprintf(stderr, "Consider making bgpstream_peer_sig_map_set more robust\n");
-    return 0;
+  assert(snap->is_snapshot);
+  if (view == NULL) {
+    fprintf(stderr, "ERROR: Source view of snapshot has been destroyed\n");
+    return -1;
   }
 
-  /* populate peer information in peerinfo */
+  /* release the prefixes that changed since the last update */
+  snapshot_release_copies(snap);
 
-  if ((k = kh_get(bwv_peerid_peerinfo, iter->view->peerinfo, peer_id)) ==
-      kh_end(iter->view->peerinfo)) {
-    /* new peer!  */
-    k = kh_put(bwv_peerid_peerinfo, iter->view->peerinfo, peer_id, &khret);
-    memset(&kh_val(iter->view->peerinfo, k), 0, sizeof(bwv_peerinfo_t));
-    /* peer is invalid */
+  /* and share everything with the source view again */
+  if (kh_copy_bwv_v4pfx_peerid_pfxinfo(snap->v4pfxs, view->v4pfxs) != 0 ||
+      kh_copy_bwv_v6pfx_peerid_pfxinfo(snap->v6pfxs, view->v6pfxs) != 0 ||
+      peertab_copy(&snap->peerinfo, &view->peerinfo) != 0) {
+    goto err;
+  }
+  /* user pointers (and the prefix index) are not preserved in snapshots */
+  for (i = 0; i < snap->peerinfo.cnt; i++) {
+    pi = &BWV_PEER_INFO(snap, snap->peerinfo.ids[i]);
+    pi->user = NULL;
+    pi->v4pfxs_idx = NULL;
+    pi->v6pfxs_idx = NULL;
   }
 
-  /* seek the iterator */
-  iter->peer_it = k;
-  iter->peer_state_mask = BGPVIEW_FIELD_ALL_VALID;
-  iter->pfx_peer_it_valid = 0; // moving peer_it invalidates pfx_peer_it
+  memcpy(snap->v4pfxs_cnt, view->v4pfxs_cnt, sizeof(view->v4pfxs_cnt));
+  memcpy(snap->v6pfxs_cnt, view->v6pfxs_cnt, sizeof(view->v6pfxs_cnt));
+  memcpy(snap->peerinfo_cnt, view->peerinfo_cnt, sizeof(view->peerinfo_cnt));
+  snap->time = view->time;
+  snap->time_created = view->time_created;
+  snap->state = view->state;
 
-  /* here iter->peer_it points to a peer, it could be invalid, inactive,
-     active */
-  if (kh_val(iter->view->peerinfo, k).state != BGPVIEW_FIELD_INVALID) {
-    /* it was already here, and it was inactive/active, just return */
-    return peer_id;
-  }
+  /* start a new generation: every prefix of the view is now shared */
+  view->snap_gen++;
+  snap->snap_update_gen = view->snap_gen;
+  snapshot_sweep_retired(view);
+
+  return 0;
+
+err:
+  fprintf(stderr, "ERROR: Could not update view snapshot\n");
+  /* leave an empty (but consistent) snapshot */
+  kh_clear(bwv_v4pfx_peerid_pfxinfo, snap->v4pfxs);
+  kh_clear(bwv_v6pfx_peerid_pfxinfo, snap->v6pfxs);
+  snap->peerinfo.cnt = 0;
+  memset(snap->v4pfxs_cnt, 0, sizeof(snap->v4pfxs_cnt));
+  memset(snap->v6pfxs_cnt, 0, sizeof(snap->v6pfxs_cnt));
+  memset(snap->peerinfo_cnt, 0, sizeof(snap->peerinfo_cnt));
+  view->snap_gen++;
+  snap->snap_update_gen = view->snap_gen;
+  snapshot_sweep_retired(view);
+  return -1;
+}
+
+void bgpview_disable_user_data(bgpview_t *view)
+{
+  /* the user can't be wanting to destroy pfx-peer user data... */
+  assert(view->pfx_peer_user_destructor == NULL);
+  /* nor can they have any prefixes... */
+  assert(bgpview_pfx_cnt(view, BGPVIEW_FIELD_ALL_VALID) == 0);
 
-  /* by here, it was invalid */
-  kh_val(iter->view->peerinfo, k).state = BGPVIEW_FIELD_INACTIVE;
+  view->disable_extended = 1;
+  update_cell_kind(view);
+}
 
-  /* and count one more inactive peer */
-  iter->view->peerinfo_cnt[BGPVIEW_FIELD_INACTIVE]++;
+void bgpview_set_cell_layout(bgpview_t *view, bgpview_cell_layout_t layout)
+{
+  /* the layout of existing prefixes cannot be changed, so the view must
+     not have any prefixes (not even invalid ones) */
+  assert(kh_size(view->v4pfxs) == 0 && kh_size(view->v6pfxs) == 0);
 
-  return peer_id;
+  view->cell_layout = layout;
+  update_cell_kind(view);
 }
 
-int bgpview_iter_remove_peer(bgpview_iter_t *iter)
+void bgpview_enable_peer_pfx_index(bgpview_t *view)
 {
-  bgpview_iter_t *lit;
-  /* we have to have a valid peer */
-  assert(__iter_has_more_peer(iter));
-
-  /* if the peer is active, then we deactivate it first */
-  if (bgpview_iter_peer_get_state(iter) == BGPVIEW_FIELD_ACTIVE) {
-    bgpview_iter_deactivate_peer(iter);
-  }
-  assert(bgpview_iter_peer_get_state(iter) == BGPVIEW_FIELD_INACTIVE);
+  /* the index is built as pfx-peers are added, so the view must not have
+     any prefixes yet */
+  assert(kh_size(view->v4pfxs) == 0 && kh_size(view->v6pfxs) == 0);
+  assert(view->is_snapshot == 0);
 
-  /* if the peer had prefixes, then we need to remove all pfx-peers for this
-     peer */
-  if (bgpview_iter_peer_get_pfx_cnt(iter, 0, BGPVIEW_FIELD_ALL_VALID) > 0) {
-    lit = bgpview_iter_create(iter->view);
-    assert(lit != NULL);
-    for (bgpview_iter_first_pfx_peer(lit, 0, BGPVIEW_FIELD_ALL_VALID,
-                                     BGPVIEW_FIELD_ALL_VALID);
-         bgpview_iter_has_more_pfx_peer(lit); bgpview_iter_next_pfx_peer(lit)) {
-      // remove all the peer-pfx associated with the peer
-      if (bgpview_iter_peer_get_peer_id(iter) ==
-          bgpview_iter_peer_get_peer_id(lit)) {
-        bgpview_iter_pfx_remove_peer(lit);
-      }
-    }
-    bgpview_iter_destroy(lit);
-  }
+  view->peer_pfx_index = 1;
+}
 
-  /* set the state to invalid and reset the counters */
-  peerinfo_reset(&kh_value(iter->view->peerinfo, iter->peer_it));
-  iter->view->need_gc_peerinfo = 1;
-  iter->view->peerinfo_cnt[BGPVIEW_FIELD_INACTIVE]--;
+int bgpview_enable_huge_pages(bgpview_t *view)
+{
+  assert(kh_size(view->v4pfxs) == 0 && kh_size(view->v6pfxs) == 0);
 
+  /* the cell slabs are created on demand, and pick up the setting then */
+  if (bgpview_slab_enable_huge_pages(view->pfxinfo_slab) != 0) {
+    fprintf(stderr, "ERROR: Huge pages must be enabled before any prefix is "
+                    "added to the view\n");
+    return -1;
+  }
+  view->huge_pages = 1;
   return 0;
 }
 
-int bgpview_iter_add_pfx_peer(bgpview_iter_t *iter,
-                                   bgpstream_pfx_t *pfx,
-                                   bgpstream_peer_id_t peer_id,
-                                   bgpstream_as_path_t *as_path)
+int bgpview_enable_concurrent_writers(bgpview_t *view, int shards_cnt)
 {
-  bgpstream_as_path_store_path_id_t path_id;
-  bgpstream_peer_sig_t *ps;
+  bwv_writers_t *writers;
+  int i;
 
-  /* first seek to the prefix */
-  if (bgpview_iter_seek_pfx(iter, pfx, BGPVIEW_FIELD_ALL_VALID) == 0) {
-    /* we have to first create (or un-invalid) the prefix */
-    if (add_pfx(iter, pfx) != 0) {
-      return -1;
-    }
+  assert(view->is_snapshot == 0);
+
+  if (view->writers != NULL) {
+    return 0;
   }
 
-  /* the peer must already exist */
-  __iter_seek_peer(iter, peer_id, BGPVIEW_FIELD_ALL_VALID);
-  iter->pfx_peer_it_valid = 0; // moving peer_it invalidates pfx_peer_it
-  if (iter->peer_it == kh_end(iter->view->peerinfo)) {
+  if (shards_cnt < 1) {
+    fprintf(stderr, "ERROR: Invalid number of prefix shards (%d)\n",
+            shards_cnt);
     return -1;
   }
-  /* get the peer ASN */
-  ps = bgpview_iter_peer_get_sig(iter);
 
-  if (bgpstream_as_path_store_get_path_id(iter->view->pathstore, as_path,
-                                          ps->peer_asnumber, &path_id) != 0) {
-    fprintf(stderr, "ERROR: Failed to get AS Path ID from store\n");
+  if ((writers = malloc_zero(sizeof(bwv_writers_t))) == NULL) {
+    return -1;
+  }
+  if ((writers->shards = malloc(sizeof(pthread_mutex_t) * shards_cnt)) ==
+      NULL) {
+    free(writers);
     return -1;
   }
+  for (i = 0; i < shards_cnt; i++) {
+    pthread_mutex_init(&writers->shards[i], NULL);
+  }
+  writers->shards_cnt = shards_cnt;
+  pthread_rwlock_init(&writers->tables, NULL);
+  pthread_mutex_init(&writers->misc, NULL);
+  pthread_mutex_init(&writers->pathstore, NULL);
 
-  /* now insert the prefix-peer info */
-  return bgpview_iter_pfx_add_peer_by_id(iter, peer_id, path_id);
+  view->writers = writers;
+  return 0;
 }
 
-int bgpview_iter_add_pfx_peer_by_id(bgpview_iter_t *iter, bgpstream_pfx_t *pfx,
-                                    bgpstream_peer_id_t peer_id,
-                                    bgpstream_as_path_store_path_id_t path_id)
+void bgpview_disable_concurrent_writers(bgpview_t *view)
 {
-  /* the peer must already exist */
-  if (bgpview_iter_seek_peer(iter, peer_id, BGPVIEW_FIELD_ALL_VALID) == 0) {
+  writers_destroy(view->writers);
+  view->writers = NULL;
+}
+
+int bgpview_has_concurrent_writers(bgpview_t *view)
+{
+  return view->writers != NULL;
+}
+
+int bgpview_get_concurrent_writers_stats(bgpview_t *view, uint64_t *locked_cnt,
+                                         uint64_t *inserted_cnt,
+                                         uint64_t *insert_wait_usec)
+{
+  if (view->writers == NULL) {
     return -1;
   }
 
-  /* now seek to the prefix */
-  if (bgpview_iter_seek_pfx(iter, pfx, BGPVIEW_FIELD_ALL_VALID) == 0) {
-    /* we have to first create (or un-invalid) the prefix */
-    if (add_pfx(iter, pfx) != 0) {
-      return -1;
-    }
+  /* the writers must be done, so the counters are stable */
+  *locked_cnt = view->writers->locked_cnt;
+  *inserted_cnt = view->writers->inserted_cnt;
+  *insert_wait_usec = view->writers->insert_wait_usec;
+  return 0;
+}
+
+void bgpview_lock_as_path_store(bgpview_t *view)
+{
+  if (view->writers != NULL) {
+    pthread_mutex_lock(&view->writers->pathstore);
   }
+}
 
-  /* now insert the prefix-peer info */
-  return bgpview_iter_pfx_add_peer_by_id(iter, peer_id, path_id);
+void bgpview_unlock_as_path_store(bgpview_t *view)
+{
+  if (view->writers != NULL) {
+    pthread_mutex_unlock(&view->writers->pathstore);
+  }
 }
 
-int bgpview_iter_remove_pfx(bgpview_iter_t *iter)
+void bgpview_enable_journal(bgpview_t *view)
 {
-  bwv_peerid_pfxinfo_t *pfxinfo = __pfx_peerinfos(iter);
-  bgpview_iter_t ti;
+  assert(view->is_snapshot == 0);
 
-  /* if the pfx is active, then we deactivate it first */
-  if (bgpview_iter_pfx_get_state(iter) == BGPVIEW_FIELD_ACTIVE) {
-    bgpview_iter_deactivate_pfx(iter);
+  if (view->journal_enabled) {
+    return;
   }
+  view->journal_enabled = 1;
+  /* changes made so far were not recorded */
+  view->journal_complete = 0;
+}
 
-  assert(pfxinfo->state == BGPVIEW_FIELD_INACTIVE);
+void bgpview_journal_checkpoint(bgpview_t *view)
+{
+  bwv_peerid_pfxinfo_t *pfxinfo;
+  uint32_t i;
 
-  pfxinfo->state = BGPVIEW_FIELD_INVALID;
+  if (view->journal_enabled == 0) {
+    return;
+  }
 
-  /* if there are any active or inactive pfx-peers, we remove them now */
-  if (bgpview_iter_pfx_get_peer_cnt(iter, BGPVIEW_FIELD_ALL_VALID) > 0) {
-    ti = *iter;
-    /* iterate over all pfx-peers for this pfx */
-    __iter_pfx_first_peer(&ti, BGPVIEW_FIELD_ALL_VALID);
-    while (bgpview_iter_pfx_has_more_peer(&ti)) {
-      bgpview_iter_pfx_remove_peer(&ti);
-      __iter_pfx_next_peer(&ti);
+  for (i = 0; i < view->journal_cnt; i++) {
+    if ((pfxinfo = journal_get_pfxinfo(view, &view->journal[i])) != NULL) {
+      pfxinfo->journal_dirty = 0;
     }
   }
+  view->journal_cnt = 0;
+  view->journal_complete = 1;
+  view->journal_time = view->time;
+}
 
-  assert(pfxinfo->peers_cnt[BGPVIEW_FIELD_INACTIVE] == 0 &&
-         pfxinfo->peers_cnt[BGPVIEW_FIELD_ACTIVE] == 0);
+int bgpview_journal_is_complete(bgpview_t *view)
+{
+  return view->journal_enabled && view->journal_complete;
+}
 
-  /* set the state to invalid and update counters */
+uint32_t bgpview_journal_get_checkpoint_time(bgpview_t *view)
+{
+  return view->journal_time;
+}
 
-  switch (iter->version_ptr) {
-  case BGPSTREAM_ADDR_VERSION_IPV4:
-    iter->view->v4pfxs_cnt[BGPVIEW_FIELD_INACTIVE]--;
-    iter->view->need_gc_v4pfxs = 1;
-    break;
+/* ==================== SIMPLE ACCESSOR FUNCTIONS ==================== */
 
-  case BGPSTREAM_ADDR_VERSION_IPV6:
-    iter->view->v6pfxs_cnt[BGPVIEW_FIELD_INACTIVE]--;
-    iter->view->need_gc_v6pfxs = 1;
-    break;
+uint32_t bgpview_v4pfx_cnt(bgpview_t *view, uint8_t state_mask)
+{
+  return __cnt_by_mask(view->v4pfxs_cnt, state_mask);
+}
 
-  default:
-    return -1;
-  }
+uint32_t bgpview_v6pfx_cnt(bgpview_t *view, uint8_t state_mask)
+{
+  return __cnt_by_mask(view->v6pfxs_cnt, state_mask);
+}
 
-  return 0;
+uint32_t bgpview_pfx_cnt(bgpview_t *view, uint8_t state_mask)
+{
+  return __cnt_by_mask(view->v4pfxs_cnt, state_mask) +
+         __cnt_by_mask(view->v6pfxs_cnt, state_mask);
 }
 
-int bgpview_iter_pfx_add_peer(bgpview_iter_t *iter, bgpstream_peer_id_t peer_id,
-                              bgpstream_as_path_t *as_path)
+uint32_t bgpview_peer_cnt(bgpview_t *view, uint8_t state_mask)
 {
-  bgpstream_as_path_store_path_id_t path_id;
+  return __cnt_by_mask(view->peerinfo_cnt, state_mask);
+}
 
-  /* get the peer ASN */
-  if (bgpstream_as_path_store_get_path_id(
-        iter->view->pathstore, as_path,
-        __iter_peer_get_sig(iter)->peer_asnumber, &path_id) != 0) {
-    fprintf(stderr, "ERROR: Failed to get AS Path ID from store\n");
-    return -1;
+int bgpview_peer_bitmap_words(bgpview_t *view)
+{
+  uint32_t i;
+  int max_id = 0;
+
+  for (i = 0; i < view->peerinfo.cnt; i++) {
+    if (view->peerinfo.ids[i] > max_id) {
+      max_id = view->peerinfo.ids[i];
+    }
   }
 
-  __iter_seek_peer(iter, peer_id, BGPVIEW_FIELD_ALL_VALID);
+  return BGPVIEW_PEER_BITMAP_WORDS(max_id);
+}
 
-  return peerid_pfxinfo_insert(iter, __pfx_peerinfos(iter), peer_id, path_id);
+uint32_t bgpview_get_time(bgpview_t *view)
+{
+  return view->time;
 }
 
-int bgpview_iter_pfx_add_peer_by_id(bgpview_iter_t *iter,
-                                    bgpstream_peer_id_t peer_id,
-                                    bgpstream_as_path_store_path_id_t path_id)
+void bgpview_set_time(bgpview_t *view, uint32_t time)
 {
-  /* this code is mostly a duplicate of the above func, for efficiency */
-  __iter_seek_peer(iter, peer_id, BGPVIEW_FIELD_ALL_VALID);
+  view->time = time;
+}
 
-  return peerid_pfxinfo_insert(iter, __pfx_peerinfos(iter), peer_id, path_id);
+uint32_t bgpview_get_time_created(bgpview_t *view)
+{
+  return view->time_created;
 }
 
-int bgpview_iter_pfx_remove_peer(bgpview_iter_t *iter)
+void *bgpview_get_user(bgpview_t *view)
 {
-  bwv_peerid_pfxinfo_t *pfxinfo = __pfx_peerinfos(iter);
+  return view->user;
+}
 
-  /* if the pfx-peer is active, then we deactivate it first */
-  if (__iter_pfx_peer_get_state(iter) == BGPVIEW_FIELD_ACTIVE) {
-    bgpview_iter_pfx_deactivate_peer(iter);
+int bgpview_set_user(bgpview_t *view, void *user)
+{
+  if (view->user == user) {
+    return 0;
   }
+  if (view->user != NULL && view->user_destructor != NULL) {
+    view->user_destructor(view->user);
+  }
+  view->user = user;
+  return 1;
+}
 
-  assert(BWV_PFX_GET_PEER_STATE(iter->view, pfxinfo, iter->pfx_peer_it) ==
-         BGPVIEW_FIELD_INACTIVE);
-
-  /* now, simply set the state to invalid and reset the pfx counters */
-  // XXX view->need_gc_pfx_peers = 1;
-  BWV_PFX_SET_PEER_STATE(iter->view, pfxinfo, iter->pfx_peer_it,
-      BGPVIEW_FIELD_INVALID);
-  pfxinfo->peers_cnt[BGPVIEW_FIELD_INACTIVE]--;
-
-  assert(__iter_has_more_peer(iter));
-  switch (iter->version_ptr) {
-  case BGPSTREAM_ADDR_VERSION_IPV4:
-    kh_value(iter->view->peerinfo, iter->peer_it)
-      .v4_pfx_cnt[BGPVIEW_FIELD_INACTIVE]--;
-    break;
+void bgpview_set_user_destructor(bgpview_t *view,
+                                 bgpview_destroy_user_t *bwv_user_destructor)
+{
+  if (view->user_destructor == bwv_user_destructor) {
+    return;
+  }
+  assert(view->user_destructor == NULL);
+  view->user_destructor = bwv_user_destructor;
+}
 
-  case BGPSTREAM_ADDR_VERSION_IPV6:
-    kh_value(iter->view->peerinfo, iter->peer_it)
-      .v6_pfx_cnt[BGPVIEW_FIELD_INACTIVE]--;
-    break;
+void bgpview_set_pfx_user_destructor(
+  bgpview_t *view, bgpview_destroy_user_t *bwv_pfx_user_destructor)
+{
+  if (view->pfx_user_destructor == bwv_pfx_user_destructor) {
+    return;
+  }
+  assert(view->pfx_user_destructor == NULL);
+  view->pfx_user_destructor = bwv_pfx_user_destructor;
+}
 
-  default:
-    return -1;
+void bgpview_set_peer_user_destructor(
+  bgpview_t *view, bgpview_destroy_user_t *bwv_peer_user_destructor)
+{
+  if (view->peer_user_destructor == bwv_peer_user_destructor) {
+    return;
   }
+  assert(view->peer_user_destructor == NULL);
+  view->peer_user_destructor = bwv_peer_user_destructor;
+}
 
-  /* if there are no peers left in this pfx, the pfx should be removed */
-  if (pfxinfo->state != BGPVIEW_FIELD_INVALID &&
-      pfxinfo->peers_cnt[BGPVIEW_FIELD_INACTIVE] == 0 &&
-      pfxinfo->peers_cnt[BGPVIEW_FIELD_ACTIVE] == 0) {
-    return bgpview_iter_remove_pfx(iter);
+void bgpview_set_pfx_peer_user_destructor(
+  bgpview_t *view, bgpview_destroy_user_t *bwv_pfx_peer_user_destructor)
+{
+  ASSERT_BWV_PFX_PEERINFO_EXT(view);
+  if (view->pfx_peer_user_destructor == bwv_pfx_peer_user_destructor) {
+    return;
   }
+  assert(view->pfx_peer_user_destructor == NULL);
+  view->pfx_peer_user_destructor = bwv_pfx_peer_user_destructor;
+}
 
-  return 0;
+bgpstream_as_path_store_t *bgpview_get_as_path_store(bgpview_t *view)
+{
+  return view->pathstore;
+}
+
+bgpstream_peer_sig_map_t *bgpview_get_peersigns(bgpview_t *view)
+{
+  return view->peersigns;
 }
 
-/* ==================== ACTIVATE/DEACTIVATE ==================== */
-
-#define ACTIVATE_FIELD_CNT(field)                                              \
-  do {                                                                         \
-    field[BGPVIEW_FIELD_INACTIVE]--;                                           \
-    field[BGPVIEW_FIELD_ACTIVE]++;                                             \
-  } while (0);
+bgpstream_peer_id_t bgpview_get_peer_id(bgpview_t *view,
+                                        bgpstream_peer_sig_t *ps)
+{
+  return bgpstream_peer_sig_map_get_id(view->peersigns, ps->collector_str,
+                                       &ps->peer_ip_addr,
+                                       ps->peer_asnumber);
+}
 
-#define DEACTIVATE_FIELD_CNT(field)                                            \
+/* add the memory used by a khash table to used (header, flags and buckets in
+   use) and to slack (buckets not in use) */
+#define KH_MEM(h, bucket_size, used, slack)                                    \
   do {                                                                         \
-    field[BGPVIEW_FIELD_INACTIVE]++;                                           \
-    field[BGPVIEW_FIELD_ACTIVE]--;                                             \
+    (used) += sizeof(*(h)) +                                                   \
+              __ac_fsize(kh_n_buckets(h)) * sizeof(khint32_t) +                \
+              (uint64_t)kh_size(h) * (bucket_size);                            \
+    (slack) += (uint64_t)(kh_n_buckets(h) - kh_size(h)) * (bucket_size);       \
   } while (0)
 
-int bgpview_iter_activate_peer(bgpview_iter_t *iter)
+static void mem_stats_cells(bgpview_t *view, bwv_peerid_pfxinfo_t *v,
+                            bgpview_mem_stats_t *stats)
 {
-  assert(__iter_has_more_peer(iter));
-  assert(__iter_peer_get_state(iter) > 0);
+  size_t cell_size;
 
-  if (__iter_peer_get_state(iter) != BGPVIEW_FIELD_INACTIVE) {
-    return 0;
+  if (v->peers_generic == NULL) {
+    return;
   }
 
-  kh_val(iter->view->peerinfo, iter->peer_it).state = BGPVIEW_FIELD_ACTIVE;
-  ACTIVATE_FIELD_CNT(iter->view->peerinfo_cnt);
-  return 1;
+  if (view->cell_layout == BGPVIEW_CELL_LAYOUT_SORTED) {
+    cell_size = sizeof(bgpstream_peer_id_t) + BWV_PFX_PEERINFO_SIZE(view);
+    stats->cells_sorted +=
+      sizeof(bwv_pfx_peer_vec_t) + v->peers_vec->cnt * cell_size;
+    stats->cells_slack +=
+      (v->peers_vec->alloc - v->peers_vec->cnt) * cell_size;
+  } else if (view->disable_extended) {
+    KH_MEM(v->peers_min, sizeof(uint16_t) + sizeof(bwv_pfx_peerinfo_t),
+           stats->cells_min, stats->cells_slack);
+  } else {
+    KH_MEM(v->peers_ext, sizeof(uint16_t) + sizeof(bwv_pfx_peerinfo_ext_t),
+           stats->cells_ext, stats->cells_slack);
+  }
 }
 
-int bgpview_iter_deactivate_peer(bgpview_iter_t *iter)
+void bgpview_get_mem_stats(bgpview_t *view, bgpview_mem_stats_t *stats)
 {
-  assert(__iter_has_more_peer(iter));
-  assert(__iter_peer_get_state(iter) > 0);
-
-  bgpview_iter_t *lit;
-  bgpstream_peer_id_t current_id;
-
-  if (__iter_peer_get_state(iter) != BGPVIEW_FIELD_ACTIVE) {
-    return 0;
-  }
-
-  /* only do the massive work of deactivating all pfx-peers if this peer has any
-     active pfxs */
-  if (__iter_peer_get_pfx_cnt(iter, 0, BGPVIEW_FIELD_ACTIVE) > 0) {
-    lit = bgpview_iter_create(iter->view);
-    assert(lit != NULL);
-    current_id = __iter_peer_get_peer_id(iter);
-
-    bgpview_iter_first_pfx_peer(lit, 0, BGPVIEW_FIELD_ACTIVE,
-                                BGPVIEW_FIELD_ACTIVE);
-    while (__iter_has_more_pfx_peer(lit)) {
-      // deactivate all the peer-pfx associated with the peer
-      if (__iter_peer_get_peer_id(lit) == current_id) {
-        bgpview_iter_pfx_deactivate_peer(lit);
+  khiter_t k;
+  uint32_t i;
+  size_t used, total;
+  bwv_peerinfo_t *pi;
+  bgpstream_as_path_store_path_t *spath;
+
+  memset(stats, 0, sizeof(bgpview_mem_stats_t));
+
+  /* prefix tables */
+  KH_MEM(view->v4pfxs,
+         sizeof(bgpstream_ipv4_pfx_t) + sizeof(bwv_peerid_pfxinfo_t *),
+         stats->pfx_tables, stats->pfx_tables_slack);
+  KH_MEM(view->v6pfxs,
+         sizeof(bgpstream_ipv6_pfx_t) + sizeof(bwv_peerid_pfxinfo_t *),
+         stats->pfx_tables, stats->pfx_tables_slack);
+
+  /* prefix infos (a snapshot's slab only holds the infos it owns) */
+  bgpview_slab_get_mem(view->pfxinfo_slab, &used, &total);
+  stats->pfx_infos = used;
+  stats->pfx_infos_slack = total - used;
+
+  /* cells */
+  if (view->is_snapshot) {
+    for (i = 0; i < view->snap_copies_cnt; i++) {
+      mem_stats_cells(view, view->snap_copies[i], stats);
+    }
+  } else {
+    for (k = kh_begin(view->v4pfxs); k != kh_end(view->v4pfxs); ++k) {
+      if (kh_exist(view->v4pfxs, k)) {
+        mem_stats_cells(view, kh_val(view->v4pfxs, k), stats);
       }
-      __iter_next_pfx_peer(lit);
     }
-    bgpview_iter_destroy(lit);
+    for (k = kh_begin(view->v6pfxs); k != kh_end(view->v6pfxs); ++k) {
+      if (kh_exist(view->v6pfxs, k)) {
+        mem_stats_cells(view, kh_val(view->v6pfxs, k), stats);
+      }
+    }
+  }
+  for (i = 0; i < BWV_PFX_PEER_VEC_CLASS_CNT; i++) {
+    if (view->cells_slab[i] == NULL) {
+      continue;
+    }
+    /* the arrays in use are already counted above, this adds the free ones */
+    bgpview_slab_get_mem(view->cells_slab[i], &used, &total);
+    stats->cells_slack += total - used;
   }
 
-  /* mark as inactive */
-  kh_val(iter->view->peerinfo, iter->peer_it).state = BGPVIEW_FIELD_INACTIVE;
+  /* peers */
+  stats->peer_table =
+    view->peerinfo.cnt * (sizeof(bwv_peerinfo_t) + sizeof(bgpstream_peer_id_t));
+  stats->peer_table_slack =
+    (view->peerinfo.infos_alloc_cnt - view->peerinfo.cnt) *
+      sizeof(bwv_peerinfo_t) +
+    (view->peerinfo.ids_alloc_cnt - view->peerinfo.cnt) *
+      sizeof(bgpstream_peer_id_t);
+  for (i = 0; i < view->peerinfo.cnt; i++) {
+    pi = &BWV_PEER_INFO(view, view->peerinfo.ids[i]);
+    if (pi->v4pfxs_idx != NULL) {
+      KH_MEM(pi->v4pfxs_idx, sizeof(bgpstream_ipv4_pfx_t),
+             stats->peer_pfx_index, stats->peer_pfx_index);
+    }
+    if (pi->v6pfxs_idx != NULL) {
+      KH_MEM(pi->v6pfxs_idx, sizeof(bgpstream_ipv6_pfx_t),
+             stats->peer_pfx_index, stats->peer_pfx_index);
+    }
+  }
 
-  /* update the counters */
-  DEACTIVATE_FIELD_CNT(iter->view->peerinfo_cnt);
+  /* shared stores */
+  for (bgpstream_as_path_store_iter_first_path(view->pathstore);
+       bgpstream_as_path_store_iter_has_more_path(view->pathstore);
+       bgpstream_as_path_store_iter_next_path(view->pathstore)) {
+    spath = bgpstream_as_path_store_iter_get_path(view->pathstore);
+    stats->pathstore += bgpstream_as_path_store_path_get_size(spath);
+  }
+  stats->peersigns =
+    (uint64_t)bgpstream_peer_sig_map_get_size(view->peersigns) *
+    sizeof(bgpstream_peer_sig_t);
+
+  /* bookkeeping */
+  stats->other = sizeof(bgpview_t) +
+                 view->gc_dirty_alloc_cnt * sizeof(bgpstream_pfx_t) +
+                 view->journal_alloc_cnt * sizeof(bgpstream_pfx_t) +
+                 (view->pfx_index_alloc_cnt + view->pfx_index_new_alloc_cnt) *
+                   sizeof(bwv_sorted_pfx_t) +
+                 view->pfx_index_marks_alloc_cnt * sizeof(uint64_t) +
+                 view->snapshots_cnt * sizeof(bgpview_t *) +
+                 view->snap_copies_alloc_cnt * sizeof(bwv_peerid_pfxinfo_t *);
+  if (view->writers != NULL) {
+    stats->other += sizeof(bwv_writers_t) +
+                    view->writers->shards_cnt * sizeof(pthread_mutex_t);
+  }
 
-  return 1;
+  stats->total = stats->pfx_tables + stats->pfx_tables_slack +
+                 stats->pfx_infos + stats->pfx_infos_slack + stats->cells_min +
+                 stats->cells_ext + stats->cells_sorted + stats->cells_slack +
+                 stats->peer_table + stats->peer_table_slack +
+                 stats->peer_pfx_index + stats->pathstore + stats->peersigns +
+                 stats->other;
 }
 
-static inline int activate_pfx(bgpview_iter_t *iter)
-{
-  bwv_peerid_pfxinfo_t *pfxinfo = __pfx_peerinfos(iter);
+/* ==================== FROZEN VIEW FUNCTIONS ==================== */
 
-  assert(pfxinfo->state > 0);
-  if (pfxinfo->state != BGPVIEW_FIELD_INACTIVE) {
-    return 0;
-  }
+/* initial sizes of the path arrays of a frozen view that owns its paths */
+#define FREEZE_PATHS_ALLOC_MIN 1024
+#define FREEZE_PATH_DATA_ALLOC_MIN (64 * 1024)
 
-  pfxinfo->state = BGPVIEW_FIELD_ACTIVE;
+/* release everything held by the given freeze (including the frozen view,
+   unless it was taken) */
+static void freeze_reset(bwv_freeze_t *fz)
+{
+  bgpview_iter_destroy(fz->it);
+  bgpview_frozen_destroy(fz->frozen);
+  free(fz->sorted);
+  free(fz->idx_map);
+  memset(fz, 0, sizeof(*fz));
+}
 
-  switch (iter->version_ptr) {
-  case BGPSTREAM_ADDR_VERSION_IPV4:
-    ACTIVATE_FIELD_CNT(iter->view->v4pfxs_cnt);
-    break;
+/* start freezing the given view (fz must not hold a freeze) */
+static int freeze_start(bwv_freeze_t *fz, bgpview_t *view, int own_paths)
+{
+  bgpview_frozen_t *frozen;
 
-  case BGPSTREAM_ADDR_VERSION_IPV6:
-    ACTIVATE_FIELD_CNT(iter->view->v6pfxs_cnt);
-    break;
+  memset(fz, 0, sizeof(*fz));
+  fz->own_paths = own_paths;
 
-  default:
+  if ((frozen = fz->frozen = malloc_zero(sizeof(bgpview_frozen_t))) == NULL ||
+      (fz->it = bgpview_iter_create(view)) == NULL) {
     return -1;
   }
+  frozen->time = view->time;
+  frozen->pathstore = view->pathstore;
 
-  return 1;
+  frozen->pfxs_cnt = bgpview_pfx_cnt(view, BGPVIEW_FIELD_ACTIVE);
+  if (frozen->pfxs_cnt > 0 &&
+      (fz->sorted = malloc(sizeof(bwv_sorted_pfx_t) * frozen->pfxs_cnt)) ==
+        NULL) {
+    return -1;
+  }
+
+  bgpview_iter_first_pfx(fz->it, 0, BGPVIEW_FIELD_ACTIVE);
+  fz->phase = BWV_FREEZE_COLLECT;
+  return 0;
 }
 
-int bgpview_iter_deactivate_pfx(bgpview_iter_t *iter)
+/* give the frozen view its own copy of the given path (unless it already
+   has one), and set idx to its index in the frozen view */
+static int freeze_own_path(bwv_freeze_t *fz,
+                           bgpstream_as_path_store_path_t *spath,
+                           uint32_t *idx)
 {
-  bwv_peerid_pfxinfo_t *pfxinfo = __pfx_peerinfos(iter);
-  bgpview_iter_t ti = *iter;
-
-  assert(pfxinfo->state > 0);
-  if (pfxinfo->state != BGPVIEW_FIELD_ACTIVE) {
+  bgpview_frozen_t *frozen = fz->frozen;
+  uint32_t sidx = bgpstream_as_path_store_path_get_idx(spath);
+  uint8_t *path_data;
+  uint16_t path_len;
+  uint64_t alloc;
+  uint32_t cnt;
+  void *tmp;
+
+  if (sidx >= fz->idx_map_cnt) {
+    cnt = (fz->idx_map_cnt == 0) ? FREEZE_PATHS_ALLOC_MIN : fz->idx_map_cnt;
+    while (sidx >= cnt) {
+      cnt *= 2;
+    }
+    if ((tmp = realloc(fz->idx_map, sizeof(uint32_t) * cnt)) == NULL) {
+      return -1;
+    }
+    fz->idx_map = tmp;
+    memset(&fz->idx_map[fz->idx_map_cnt], 0xff,
+           sizeof(uint32_t) * (cnt - fz->idx_map_cnt));
+    fz->idx_map_cnt = cnt;
+  }
+  if (fz->idx_map[sidx] != UINT32_MAX) {
+    *idx = fz->idx_map[sidx];
     return 0;
   }
 
-  /* now mark the pfx as inactive */
-  pfxinfo->state = BGPVIEW_FIELD_INACTIVE;
-
-  /* deactivate all pfx-peers for this prefix */
-  __iter_pfx_first_peer(&ti, BGPVIEW_FIELD_ACTIVE);
-  while (__iter_pfx_has_more_peer(&ti)) {
-    bgpview_iter_pfx_deactivate_peer(&ti);
-    __iter_pfx_next_peer(&ti);
+  /* path_offsets has an extra entry for the end of the last path */
+  if (frozen->paths_cnt + 1 >= fz->paths_alloc_cnt) {
+    cnt = (fz->paths_alloc_cnt == 0) ? FREEZE_PATHS_ALLOC_MIN
+                                     : fz->paths_alloc_cnt * 2;
+    if ((tmp = realloc(frozen->path_offsets, sizeof(uint32_t) * cnt)) ==
+        NULL) {
+      return -1;
+    }
+    frozen->path_offsets = tmp;
+    if ((tmp = realloc(frozen->path_cores, sizeof(uint8_t) * cnt)) == NULL) {
+      return -1;
+    }
+    frozen->path_cores = tmp;
+    fz->paths_alloc_cnt = cnt;
   }
 
-  /* now update the counters */
-  switch (iter->version_ptr) {
-  case BGPSTREAM_ADDR_VERSION_IPV4:
-    DEACTIVATE_FIELD_CNT(iter->view->v4pfxs_cnt);
-    break;
-
-  case BGPSTREAM_ADDR_VERSION_IPV6:
-    DEACTIVATE_FIELD_CNT(iter->view->v6pfxs_cnt);
-    break;
-
-  default:
+  path_len = bgpstream_as_path_get_data(
+    bgpstream_as_path_store_path_get_int_path(spath), &path_data);
+  if (fz->path_data_len + path_len > UINT32_MAX) {
     return -1;
   }
-
-  return 1;
+  if (fz->path_data_len + path_len > fz->path_data_alloc) {
+    alloc = (fz->path_data_alloc == 0) ? FREEZE_PATH_DATA_ALLOC_MIN
+                                       : fz->path_data_alloc;
+    while (fz->path_data_len + path_len > alloc) {
+      alloc *= 2;
+    }
+    if ((tmp = realloc(frozen->path_data, alloc)) == NULL) {
+      return -1;
+    }
+    frozen->path_data = tmp;
+    fz->path_data_alloc = alloc;
+  }
+  memcpy(frozen->path_data + fz->path_data_len, path_data, path_len);
+
+  frozen->path_offsets[frozen->paths_cnt] = fz->path_data_len;
+  frozen->path_cores[frozen->paths_cnt] =
+    bgpstream_as_path_store_path_is_core(spath);
+  fz->path_data_len += path_len;
+  fz->idx_map[sidx] = frozen->paths_cnt;
+  *idx = frozen->paths_cnt++;
+  return 0;
 }
 
-int bgpview_iter_pfx_activate_peer(bgpview_iter_t *iter)
+/* collect the active prefixes and count their active cells */
+static void freeze_collect(bwv_freeze_t *fz, uint32_t *budget)
 {
-  bwv_peerid_pfxinfo_t *pfxinfo = __pfx_peerinfos(iter);
-
-  assert(__iter_pfx_has_more_peer(iter));
-
-  assert(BWV_PFX_GET_PEER_STATE(iter->view, pfxinfo, iter->pfx_peer_it) > 0);
-  if (BWV_PFX_GET_PEER_STATE(iter->view, pfxinfo, iter->pfx_peer_it) !=
-      BGPVIEW_FIELD_INACTIVE) {
-    return 0;
+  bgpview_frozen_t *frozen = fz->frozen;
+  bgpview_iter_t *it = fz->it;
+
+  for (; *budget > 0 && __iter_has_more_pfx(it);
+       bgpview_iter_next_pfx(it), (*budget)--) {
+    assert(fz->pfx_idx < frozen->pfxs_cnt);
+    bgpstream_pfx_copy(&fz->sorted[fz->pfx_idx].pfx, __iter_pfx_get_pfx(it));
+    fz->sorted[fz->pfx_idx].k = it->pfx_it;
+    frozen->cells_cnt += __pfx_peerinfos(it)->peers_cnt[BGPVIEW_FIELD_ACTIVE];
+    fz->pfx_idx++;
   }
+}
 
-  /* update the number of peers that observe this pfx */
-  ACTIVATE_FIELD_CNT(pfxinfo->peers_cnt);
+/* sort the collected prefixes, and allocate the cells */
+static int freeze_sort(bwv_freeze_t *fz)
+{
+  bgpview_frozen_t *frozen = fz->frozen;
 
-  /* this is the first active peer, so pfx must be activated */
-  if (pfxinfo->peers_cnt[BGPVIEW_FIELD_ACTIVE] == 1) {
-    activate_pfx(iter);
+  assert(fz->pfx_idx == frozen->pfxs_cnt);
+  if (frozen->pfxs_cnt > 0) {
+    qsort(fz->sorted, frozen->pfxs_cnt, sizeof(bwv_sorted_pfx_t),
+          sorted_pfx_cmp);
   }
 
-  /* the peer MUST be active */
-  assert(__iter_peer_get_state(iter) == BGPVIEW_FIELD_ACTIVE);
-
-  // increment the number of prefixes observed by the peer
-  switch (iter->version_ptr) {
-  case BGPSTREAM_ADDR_VERSION_IPV4:
-    ACTIVATE_FIELD_CNT(
-      kh_value(iter->view->peerinfo, iter->peer_it).v4_pfx_cnt);
-    break;
-  case BGPSTREAM_ADDR_VERSION_IPV6:
-    ACTIVATE_FIELD_CNT(
-      kh_value(iter->view->peerinfo, iter->peer_it).v6_pfx_cnt);
-    break;
-  default:
+  if ((frozen->pfxs = malloc(sizeof(bgpstream_pfx_t) *
+                             (frozen->pfxs_cnt + 1))) == NULL ||
+      (frozen->cell_offsets =
+         malloc(sizeof(uint32_t) * (frozen->pfxs_cnt + 1))) == NULL ||
+      (frozen->peer_ids = malloc(sizeof(bgpstream_peer_id_t) *
+                                 (frozen->cells_cnt + 1))) == NULL ||
+      (frozen->path_ids = malloc(sizeof(bgpstream_as_path_store_path_id_t) *
+                                 (frozen->cells_cnt + 1))) == NULL ||
+      (frozen->origin_asns =
+         malloc(sizeof(uint32_t) * (frozen->cells_cnt + 1))) == NULL) {
+    return -1;
+  }
+  if (fz->own_paths != 0 &&
+      (frozen->path_idxs =
+         malloc(sizeof(uint32_t) * (frozen->cells_cnt + 1))) == NULL) {
     return -1;
   }
 
-  BWV_PFX_SET_PEER_STATE(iter->view, pfxinfo, iter->pfx_peer_it,
-      BGPVIEW_FIELD_ACTIVE);
-
-  return 1;
+  fz->pfx_idx = 0;
+  return 0;
 }
 
-int bgpview_iter_pfx_deactivate_peer(bgpview_iter_t *iter)
+/* fill in the cells of each prefix, in address order */
+static int freeze_fill(bwv_freeze_t *fz, uint32_t *budget)
 {
-  bwv_peerid_pfxinfo_t *pfxinfo = __pfx_peerinfos(iter);
-
-  assert(__iter_pfx_has_more_peer(iter));
-
-  assert(BWV_PFX_GET_PEER_STATE(iter->view, pfxinfo, iter->pfx_peer_it) > 0);
-  if (BWV_PFX_GET_PEER_STATE(iter->view, pfxinfo, iter->pfx_peer_it) !=
-      BGPVIEW_FIELD_ACTIVE) {
-    return 0;
+  bgpview_frozen_t *frozen = fz->frozen;
+  bgpview_iter_t *it = fz->it;
+  uint32_t c = fz->cell_idx;
+  uint32_t i;
+
+  for (; *budget > 0 && fz->pfx_idx < frozen->pfxs_cnt;
+       fz->pfx_idx++, (*budget)--) {
+    i = fz->pfx_idx;
+    frozen->pfxs[i] = fz->sorted[i].pfx;
+    frozen->cell_offsets[i] = c;
+
+    it->version_ptr = fz->sorted[i].pfx.address.version;
+    it->pfx_it = fz->sorted[i].k;
+    for (bgpview_iter_pfx_first_peer(it, BGPVIEW_FIELD_ACTIVE);
+         __iter_pfx_has_more_peer(it); bgpview_iter_pfx_next_peer(it)) {
+      assert(c < frozen->cells_cnt);
+      frozen->peer_ids[c] = __iter_peer_get_peer_id(it);
+      frozen->path_ids[c] = __iter_pfx_peer_get_as_path_store_path_id(it);
+      frozen->origin_asns[c] = bgpview_iter_pfx_peer_get_origin_asn(it);
+      if (fz->own_paths != 0 &&
+          freeze_own_path(fz, __iter_pfx_peer_get_as_path_store_path(it),
+                          &frozen->path_idxs[c]) != 0) {
+        fz->cell_idx = c;
+        return -1;
+      }
+      c++;
+    }
   }
+  fz->cell_idx = c;
+  return 0;
+}
 
-  /* set the state to inactive */
-  BWV_PFX_SET_PEER_STATE(iter->view, pfxinfo, iter->pfx_peer_it,
-      BGPVIEW_FIELD_INACTIVE);
+/* copy the signatures of the peers, so that the frozen view (and its image)
+   is self-contained */
+static int freeze_peersigs(bwv_freeze_t *fz)
+{
+  bgpview_frozen_t *frozen = fz->frozen;
+  bgpview_t *view = fz->it->view;
+  bgpstream_peer_sig_t *ps;
+  bgpstream_peer_id_t peerid;
+  uint32_t i;
 
-  /* update the number of peers that observe the pfx */
-  DEACTIVATE_FIELD_CNT(pfxinfo->peers_cnt);
-  if (pfxinfo->peers_cnt[BGPVIEW_FIELD_ACTIVE] == 0) {
-    bgpview_iter_deactivate_pfx(iter);
+  for (i = 0; i < view->peerinfo.cnt; i++) {
+    if (view->peerinfo.ids[i] >= frozen->peersigs_cnt) {
+      frozen->peersigs_cnt = view->peerinfo.ids[i] + 1;
+    }
   }
-
-  // decrement the number of pfxs observed by the peer
-  switch (iter->version_ptr) {
-  case BGPSTREAM_ADDR_VERSION_IPV4:
-    DEACTIVATE_FIELD_CNT(
-      kh_value(iter->view->peerinfo, iter->peer_it).v4_pfx_cnt);
-    break;
-  case BGPSTREAM_ADDR_VERSION_IPV6:
-    DEACTIVATE_FIELD_CNT(
-      kh_value(iter->view->peerinfo, iter->peer_it).v6_pfx_cnt);
-    break;
-  default:
+  if ((frozen->peersigs = malloc_zero(sizeof(bgpstream_peer_sig_t) *
+                                      (frozen->peersigs_cnt + 1))) == NULL) {
     return -1;
   }
-
-  return 1;
+  for (i = 0; i < view->peerinfo.cnt; i++) {
+    peerid = view->peerinfo.ids[i];
+    if ((ps = bgpstream_peer_sig_map_get_sig(view->peersigns, peerid)) !=
+        NULL) {
+      frozen->peersigs[peerid] = *ps;
+    }
+  }
+  return 0;
 }
 
-/* ========== PUBLIC FUNCTIONS ========== */
-
-bgpview_t *
-bgpview_create_shared(bgpstream_peer_sig_map_t *peersigns,
-                      bgpstream_as_path_store_t *pathstore,
-                      bgpview_destroy_user_t *bwv_user_destructor,
-                      bgpview_destroy_user_t *bwv_peer_user_destructor,
-                      bgpview_destroy_user_t *bwv_pfx_user_destructor,
-                      bgpview_destroy_user_t *bwv_pfx_peer_user_destructor)
+/* freeze up to budget prefixes (all of them if budget is not positive), and
+   return 1 if the frozen view is complete, 0 if it is not, and -1 if an
+   error occurred */
+static int freeze_step(bwv_freeze_t *fz, int budget)
 {
-  bgpview_t *view;
-  struct timeval time_created;
+  uint32_t left = (budget > 0) ? (uint32_t)budget : UINT32_MAX;
 
-  if ((view = malloc_zero(sizeof(bgpview_t))) == NULL) {
-    return NULL;
+  if (fz->phase == BWV_FREEZE_COLLECT) {
+    freeze_collect(fz, &left);
+    if (__iter_has_more_pfx(fz->it)) {
+      return 0;
+    }
+    if (freeze_sort(fz) != 0) {
+      return -1;
+    }
+    fz->phase = BWV_FREEZE_FILL;
   }
 
-  if ((view->v4pfxs = kh_init(bwv_v4pfx_peerid_pfxinfo)) == NULL) {
-    goto err;
+  if (fz->phase == BWV_FREEZE_FILL) {
+    if (freeze_fill(fz, &left) != 0) {
+      return -1;
+    }
+    if (fz->pfx_idx < fz->frozen->pfxs_cnt) {
+      return 0;
+    }
+    assert(fz->cell_idx == fz->frozen->cells_cnt);
+    fz->frozen->cell_offsets[fz->frozen->pfxs_cnt] = fz->cell_idx;
+    if (fz->own_paths != 0) {
+      if (fz->frozen->path_offsets == NULL &&
+          (fz->frozen->path_offsets = malloc(sizeof(uint32_t))) == NULL) {
+        return -1;
+      }
+      fz->frozen->path_offsets[fz->frozen->paths_cnt] = fz->path_data_len;
+    }
+    if (freeze_peersigs(fz) != 0) {
+      return -1;
+    }
+    fz->phase = BWV_FREEZE_DONE;
   }
 
-  if ((view->v6pfxs = kh_init(bwv_v6pfx_peerid_pfxinfo)) == NULL) {
-    goto err;
-  }
+  return 1;
+}
 
-  if (peersigns != NULL) {
-    view->peersigns_shared = 1;
-    view->peersigns = peersigns;
-  } else {
-    if ((view->peersigns = bgpstream_peer_sig_map_create()) == NULL) {
-      fprintf(stderr, "Failed to create peersigns table\n");
-      goto err;
-    }
-    view->peersigns_shared = 0;
-  }
+bgpview_frozen_t *bgpview_freeze(bgpview_t *view)
+{
+  bwv_freeze_t fz;
+  bgpview_frozen_t *frozen;
 
-  if (pathstore != NULL) {
-    view->pathstore_shared = 1;
-    view->pathstore = pathstore;
-  } else {
-    if ((view->pathstore = bgpstream_as_path_store_create()) == NULL) {
-      fprintf(stderr, "Failed to create AS Path Store\n");
-      goto err;
-    }
-    view->pathstore_shared = 0;
+  if (freeze_start(&fz, view, 0) != 0 || freeze_step(&fz, 0) != 1) {
+    fprintf(stderr, "ERROR: Could not freeze view\n");
+    freeze_reset(&fz);
+    return NULL;
   }
 
-  if ((view->peerinfo = kh_init(bwv_peerid_peerinfo)) == NULL) {
-    fprintf(stderr, "Failed to create peer info table\n");
-    goto err;
+  /* take the frozen view */
+  frozen = fz.frozen;
+  fz.frozen = NULL;
+  freeze_reset(&fz);
+  return frozen;
+}
+
+void bgpview_frozen_destroy(bgpview_frozen_t *frozen)
+{
+  if (frozen == NULL) {
+    return;
   }
+  if (frozen->mapped == 0) {
+    free(frozen->pfxs);
+    free(frozen->cell_offsets);
+    free(frozen->peer_ids);
+    free(frozen->path_ids);
+    free(frozen->origin_asns);
+    free(frozen->peersigs);
+    free(frozen->path_idxs);
+    free(frozen->path_offsets);
+    free(frozen->path_cores);
+    free(frozen->path_data);
+  }
+  free(frozen->image);
+  free(frozen);
+}
 
-  gettimeofday(&time_created, NULL);
-  view->time_created = time_created.tv_sec;
+/* compute the section offsets and the length of an image from its counts */
+static void frozen_image_layout(bwv_frozen_image_hdr_t *hdr)
+{
+  uint64_t off = BWV_FROZEN_IMAGE_PAD(sizeof(bwv_frozen_image_hdr_t));
 
-  view->user_destructor = bwv_user_destructor;
-  view->peer_user_destructor = bwv_peer_user_destructor;
-  view->pfx_user_destructor = bwv_pfx_user_destructor;
-  view->pfx_peer_user_destructor = bwv_pfx_peer_user_destructor;
+#define SECTION(name, size)                                                    \
+  do {                                                                         \
+    hdr->name##_off = off;                                                     \
+    off = BWV_FROZEN_IMAGE_PAD(off + (uint64_t)(size));                        \
+  } while (0)
 
-  /* all other fields are memset to 0 */
+  SECTION(peersigs, hdr->peersigs_cnt * (uint64_t)hdr->peersig_size);
+  SECTION(pfxs, hdr->pfxs_cnt * (uint64_t)hdr->pfx_size);
+  SECTION(cell_offsets, (hdr->pfxs_cnt + 1ULL) * sizeof(uint32_t));
+  SECTION(peer_ids, hdr->cells_cnt * sizeof(bgpstream_peer_id_t));
+  SECTION(path_idxs, hdr->cells_cnt * sizeof(uint32_t));
+  SECTION(origin_asns, hdr->cells_cnt * sizeof(uint32_t));
+  SECTION(path_offsets, (hdr->paths_cnt + 1ULL) * sizeof(uint32_t));
+  SECTION(path_cores, hdr->paths_cnt * sizeof(uint8_t));
+  SECTION(path_data, hdr->path_data_len);
 
-  return view;
+#undef SECTION
 
-err:
-  fprintf(stderr, "Failed to create BGPView\n");
-  bgpview_destroy(view);
-  return NULL;
+  hdr->len = off;
 }
 
-bgpview_t *bgpview_create(bgpview_destroy_user_t *bwv_user_destructor,
-                          bgpview_destroy_user_t *bwv_peer_user_destructor,
-                          bgpview_destroy_user_t *bwv_pfx_user_destructor,
-                          bgpview_destroy_user_t *bwv_pfx_peer_user_destructor)
+static int frozen_image_write(bgpview_frozen_write_cb_t *cb, void *user,
+                              const void *buf, uint64_t len, uint64_t *off)
 {
-  return bgpview_create_shared(
-    NULL, NULL, bwv_user_destructor, bwv_peer_user_destructor,
-    bwv_pfx_user_destructor, bwv_pfx_peer_user_destructor);
+  if (len > 0 && cb(user, buf, len) != (int64_t)len) {
+    return -1;
+  }
+  *off += len;
+  return 0;
 }
 
-void bgpview_destroy(bgpview_t *view)
+/* pad the image up to the start of the next section */
+static int frozen_image_pad(bgpview_frozen_write_cb_t *cb, void *user,
+                            uint64_t *off)
 {
-  if (view == NULL) {
-    return;
-  }
+  static const uint8_t zeros[BWV_FROZEN_IMAGE_ALIGN] = {0};
 
-  khiter_t k;
+  return frozen_image_write(cb, user, zeros,
+                            BWV_FROZEN_IMAGE_PAD(*off) - *off, off);
+}
 
-  if (view->v4pfxs != NULL) {
-    for (k = kh_begin(view->v4pfxs); k != kh_end(view->v4pfxs); ++k) {
-      if (kh_exist(view->v4pfxs, k)) {
-        peerid_pfxinfo_destroy(view, kh_value(view->v4pfxs, k));
+#define IMAGE_WRITE(buf, len)                                                  \
+  do {                                                                         \
+    if (frozen_image_write(cb, user, (buf), (len), &off) != 0) {               \
+      goto err;                                                                \
+    }                                                                          \
+  } while (0)
+
+#define IMAGE_PAD()                                                            \
+  do {                                                                         \
+    if (frozen_image_pad(cb, user, &off) != 0) {                               \
+      goto err;                                                                \
+    }                                                                          \
+  } while (0)
+
+/* number of path indexes converted at a time when writing an image */
+#define FROZEN_IMAGE_IDX_BATCH_LEN 1024
+
+int64_t bgpview_frozen_write(bgpview_frozen_t *frozen,
+                             bgpview_frozen_write_cb_t *cb, void *user)
+{
+  bwv_frozen_image_hdr_t hdr;
+  bgpstream_as_path_store_t *ps = frozen->pathstore;
+  bgpstream_as_path_store_path_t *spath;
+  bgpstream_as_path_store_path_t **paths = NULL;
+  uint32_t idx;
+  uint8_t *path_data;
+  uint16_t path_len;
+  uint32_t *path_offsets = frozen->path_offsets;
+  uint8_t *path_cores = frozen->path_cores;
+  uint32_t *idx_map = NULL;
+  uint32_t idx_map_cnt = 0;
+  uint32_t idx_batch[FROZEN_IMAGE_IDX_BATCH_LEN];
+  uint64_t off = 0;
+  uint32_t i, c, n;
+  int own_paths;
+
+  /* mapped views, and views frozen for publication, have their own copy of
+     their paths */
+  own_paths = (frozen->path_idxs != NULL);
+
+  memset(&hdr, 0, sizeof(hdr));
+  hdr.magic = BWV_FROZEN_IMAGE_MAGIC;
+  hdr.version = BWV_FROZEN_IMAGE_VERSION;
+  hdr.bom = BWV_FROZEN_IMAGE_BOM;
+  hdr.time = frozen->time;
+  hdr.peersig_size = sizeof(bgpstream_peer_sig_t);
+  hdr.pfx_size = sizeof(bgpstream_pfx_t);
+  hdr.peersigs_cnt = frozen->peersigs_cnt;
+  hdr.pfxs_cnt = frozen->pfxs_cnt;
+  hdr.cells_cnt = frozen->cells_cnt;
+
+  if (own_paths != 0) {
+    hdr.paths_cnt = frozen->paths_cnt;
+    hdr.path_data_len = frozen->path_offsets[frozen->paths_cnt];
+  } else {
+    /* only the paths used by the cells are written: number them in order
+       of first use, and map their store indexes to these numbers */
+    for (c = 0; c < frozen->cells_cnt; c++) {
+      spath = bgpstream_as_path_store_get_store_path(ps, frozen->path_ids[c]);
+      if (bgpstream_as_path_store_path_get_idx(spath) >= idx_map_cnt) {
+        idx_map_cnt = bgpstream_as_path_store_path_get_idx(spath) + 1;
       }
     }
-    kh_destroy(bwv_v4pfx_peerid_pfxinfo, view->v4pfxs);
-    view->v4pfxs = NULL;
+    /* there cannot be more paths than cells, or than store indexes */
+    n = frozen->cells_cnt < idx_map_cnt ? frozen->cells_cnt : idx_map_cnt;
+    if ((path_offsets = malloc(sizeof(uint32_t) * (n + 1))) == NULL ||
+        (path_cores = malloc(sizeof(uint8_t) * (n + 1))) == NULL ||
+        (paths = malloc(sizeof(bgpstream_as_path_store_path_t *) * (n + 1))) ==
+          NULL ||
+        (idx_map = malloc(sizeof(uint32_t) * (idx_map_cnt + 1))) == NULL) {
+      goto err;
+    }
+    memset(idx_map, 0xff, sizeof(uint32_t) * (idx_map_cnt + 1));
+    i = 0;
+    for (c = 0; c < frozen->cells_cnt; c++) {
+      spath = bgpstream_as_path_store_get_store_path(ps, frozen->path_ids[c]);
+      idx = bgpstream_as_path_store_path_get_idx(spath);
+      if (idx_map[idx] != UINT32_MAX) {
+        continue;
+      }
+      assert(i < n);
+      idx_map[idx] = i;
+      paths[i] = spath;
+      path_offsets[i] = hdr.path_data_len;
+      path_cores[i] = bgpstream_as_path_store_path_is_core(spath);
+      hdr.path_data_len += bgpstream_as_path_get_data(
+        bgpstream_as_path_store_path_get_int_path(spath), &path_data);
+      i++;
+    }
+    hdr.paths_cnt = i;
+    path_offsets[i] = hdr.path_data_len;
+    if (hdr.path_data_len > UINT32_MAX) {
+      goto err;
+    }
   }
 
-  if (view->v6pfxs != NULL) {
-    for (k = kh_begin(view->v6pfxs); k != kh_end(view->v6pfxs); ++k) {
-      if (kh_exist(view->v6pfxs, k)) {
-        peerid_pfxinfo_destroy(view, kh_value(view->v6pfxs, k));
+  frozen_image_layout(&hdr);
+
+  IMAGE_WRITE(&hdr, sizeof(hdr));
+  IMAGE_PAD();
+  IMAGE_WRITE(frozen->peersigs,
+              sizeof(bgpstream_peer_sig_t) * (uint64_t)frozen->peersigs_cnt);
+  IMAGE_PAD();
+  IMAGE_WRITE(frozen->pfxs,
+              sizeof(bgpstream_pfx_t) * (uint64_t)frozen->pfxs_cnt);
+  IMAGE_PAD();
+  IMAGE_WRITE(frozen->cell_offsets,
+              sizeof(uint32_t) * (frozen->pfxs_cnt + 1ULL));
+  IMAGE_PAD();
+  IMAGE_WRITE(frozen->peer_ids,
+              sizeof(bgpstream_peer_id_t) * (uint64_t)frozen->cells_cnt);
+  IMAGE_PAD();
+
+  if (own_paths != 0) {
+    IMAGE_WRITE(frozen->path_idxs,
+                sizeof(uint32_t) * (uint64_t)frozen->cells_cnt);
+  } else {
+    for (c = 0; c < frozen->cells_cnt; c += n) {
+      n = frozen->cells_cnt - c;
+      if (n > FROZEN_IMAGE_IDX_BATCH_LEN) {
+        n = FROZEN_IMAGE_IDX_BATCH_LEN;
+      }
+      for (i = 0; i < n; i++) {
+        spath =
+          bgpstream_as_path_store_get_store_path(ps, frozen->path_ids[c + i]);
+        idx_batch[i] = idx_map[bgpstream_as_path_store_path_get_idx(spath)];
       }
+      IMAGE_WRITE(idx_batch, sizeof(uint32_t) * n);
     }
-    kh_destroy(bwv_v6pfx_peerid_pfxinfo, view->v6pfxs);
-    view->v6pfxs = NULL;
   }
-
-  if (view->peersigns_shared == 0 && view->peersigns != NULL) {
-    bgpstream_peer_sig_map_destroy(view->peersigns);
-    view->peersigns = NULL;
+  IMAGE_PAD();
+
+  IMAGE_WRITE(frozen->origin_asns,
+              sizeof(uint32_t) * (uint64_t)frozen->cells_cnt);
+  IMAGE_PAD();
+  IMAGE_WRITE(path_offsets, sizeof(uint32_t) * (hdr.paths_cnt + 1ULL));
+  IMAGE_PAD();
+  IMAGE_WRITE(path_cores, sizeof(uint8_t) * (uint64_t)hdr.paths_cnt);
+  IMAGE_PAD();
+
+  if (own_paths != 0) {
+    IMAGE_WRITE(frozen->path_data, hdr.path_data_len);
+  } else {
+    for (i = 0; i < hdr.paths_cnt; i++) {
+      path_len = bgpstream_as_path_get_data(
+        bgpstream_as_path_store_path_get_int_path(paths[i]), &path_data);
+      IMAGE_WRITE(path_data, path_len);
+    }
   }
+  IMAGE_PAD();
 
-  if (view->pathstore_shared == 0 && view->pathstore != NULL) {
-    bgpstream_as_path_store_destroy(view->pathstore);
-    view->pathstore = NULL;
-  }
+  assert(off == hdr.len);
 
-  if (view->peerinfo != NULL) {
-    peerinfo_destroy_user(view);
-    kh_destroy(bwv_peerid_peerinfo, view->peerinfo);
-    view->peerinfo = NULL;
+  if (own_paths == 0) {
+    free(path_offsets);
+    free(path_cores);
   }
+  free(paths);
+  free(idx_map);
+  return off;
 
-  if (view->user != NULL) {
-    if (view->user_destructor != NULL) {
-      view->user_destructor(view->user);
-    }
-    view->user = NULL;
+err:
+  fprintf(stderr, "ERROR: Could not write frozen view image\n");
+  if (own_paths == 0) {
+    free(path_offsets);
+    free(path_cores);
   }
-
-  free(view);
+  free(paths);
+  free(idx_map);
+  return -1;
 }
 
-void bgpview_clear(bgpview_t *view)
+bgpview_frozen_t *bgpview_frozen_map(const void *buf, uint64_t len,
+                                     uint64_t *image_len)
 {
-  struct timeval time_created;
-  bwv_peerid_pfxinfo_t *pfxinfo;
-  bgpview_iter_t *lit = bgpview_iter_create(view);
-  assert(lit != NULL);
+  const bwv_frozen_image_hdr_t *hdr = buf;
+  bwv_frozen_image_hdr_t layout;
+  uint8_t *base = (uint8_t *)buf;
+  bgpview_frozen_t *frozen = NULL;
+  uint32_t i;
+
+  if (len < sizeof(bwv_frozen_image_hdr_t) ||
+      hdr->magic != BWV_FROZEN_IMAGE_MAGIC) {
+    fprintf(stderr, "ERROR: Missing frozen view image magic number\n");
+    return NULL;
+  }
 
-  view->time = 0;
+  if (hdr->version != BWV_FROZEN_IMAGE_VERSION ||
+      hdr->bom != BWV_FROZEN_IMAGE_BOM ||
+      hdr->peersig_size != sizeof(bgpstream_peer_sig_t) ||
+      hdr->pfx_size != sizeof(bgpstream_pfx_t)) {
+    fprintf(stderr, "ERROR: Frozen view image was written by an "
+                    "incompatible version or host\n");
+    return NULL;
+  }
 
-  gettimeofday(&time_created, NULL);
-  view->time_created = time_created.tv_sec;
+  /* the layout is fully determined by the counts, so rather than checking
+     each offset, check that it matches the one we would have written */
+  layout = *hdr;
+  frozen_image_layout(&layout);
+  if (memcmp(&layout, hdr, sizeof(layout)) != 0 || hdr->len > len) {
+    goto corrupt;
+  }
 
-  /* mark all prefixes as invalid */
-  bgpview_iter_first_pfx(lit, 0, BGPVIEW_FIELD_ALL_VALID);
-  while (__iter_has_more_pfx(lit)) {
-    pfxinfo = __pfx_peerinfos(lit);
-    pfxinfo->peers_cnt[BGPVIEW_FIELD_INACTIVE] = 0;
-    pfxinfo->peers_cnt[BGPVIEW_FIELD_ACTIVE] = 0;
-    pfxinfo->state = BGPVIEW_FIELD_INVALID;
-    if (view->disable_extended) {
-      kh_clear(bwv_peerid_pfx_peerinfo, pfxinfo->peers_min);
-    } else {
-      kh_clear(bwv_peerid_pfx_peerinfo_ext, pfxinfo->peers_ext);
+  if ((frozen = malloc_zero(sizeof(bgpview_frozen_t))) == NULL) {
+    return NULL;
+  }
+  frozen->mapped = 1;
+  frozen->time = hdr->time;
+  frozen->peersigs_cnt = hdr->peersigs_cnt;
+  frozen->peersigs = (bgpstream_peer_sig_t *)(base + hdr->peersigs_off);
+  frozen->pfxs_cnt = hdr->pfxs_cnt;
+  frozen->pfxs = (bgpstream_pfx_t *)(base + hdr->pfxs_off);
+  frozen->cell_offsets = (uint32_t *)(base + hdr->cell_offsets_off);
+  frozen->cells_cnt = hdr->cells_cnt;
+  frozen->peer_ids = (bgpstream_peer_id_t *)(base + hdr->peer_ids_off);
+  frozen->path_idxs = (uint32_t *)(base + hdr->path_idxs_off);
+  frozen->origin_asns = (uint32_t *)(base + hdr->origin_asns_off);
+  frozen->paths_cnt = hdr->paths_cnt;
+  frozen->path_offsets = (uint32_t *)(base + hdr->path_offsets_off);
+  frozen->path_cores = base + hdr->path_cores_off;
+  frozen->path_data = base + hdr->path_data_off;
+
+  /* the iterators and getters index the arrays with these values, so check
+     that they are all in range */
+  if (frozen->cell_offsets[0] != 0 ||
+      frozen->cell_offsets[frozen->pfxs_cnt] != frozen->cells_cnt ||
+      frozen->path_offsets[0] != 0 ||
+      frozen->path_offsets[frozen->paths_cnt] != hdr->path_data_len) {
+    goto corrupt;
+  }
+  for (i = 0; i < frozen->pfxs_cnt; i++) {
+    if (frozen->cell_offsets[i] > frozen->cell_offsets[i + 1]) {
+      goto corrupt;
+    }
+  }
+  for (i = 0; i < frozen->cells_cnt; i++) {
+    if (frozen->peer_ids[i] >= frozen->peersigs_cnt ||
+        frozen->path_idxs[i] >= frozen->paths_cnt) {
+      goto corrupt;
+    }
+  }
+  for (i = 0; i < frozen->paths_cnt; i++) {
+    if (frozen->path_offsets[i] > frozen->path_offsets[i + 1]) {
+      goto corrupt;
     }
-    __iter_next_pfx(lit);
   }
-  view->need_gc_v4pfxs = (kh_size(view->v4pfxs) > 0);
-  view->need_gc_v6pfxs = (kh_size(view->v6pfxs) > 0);
-  view->v4pfxs_cnt[BGPVIEW_FIELD_INACTIVE] = 0;
-  view->v4pfxs_cnt[BGPVIEW_FIELD_ACTIVE] = 0;
-  view->v6pfxs_cnt[BGPVIEW_FIELD_INACTIVE] = 0;
-  view->v6pfxs_cnt[BGPVIEW_FIELD_ACTIVE] = 0;
 
-  /* clear out the peerinfo table */
-  __iter_first_peer(lit, BGPVIEW_FIELD_ALL_VALID);
-  while (__iter_has_more_peer(lit)) {
-    peerinfo_reset(&kh_value(view->peerinfo, lit->peer_it));
-    __iter_next_peer(lit);
+  if (image_len != NULL) {
+    *image_len = hdr->len;
   }
-  view->need_gc_peerinfo = (kh_size(view->peerinfo) > 0);
-  view->peerinfo_cnt[BGPVIEW_FIELD_INACTIVE] = 0;
-  view->peerinfo_cnt[BGPVIEW_FIELD_ACTIVE] = 0;
+  return frozen;
 
-  bgpview_iter_destroy(lit);
+corrupt:
+  fprintf(stderr, "ERROR: Corrupt frozen view image\n");
+  bgpview_frozen_destroy(frozen);
+  return NULL;
 }
 
-void bgpview_gc(bgpview_t *view)
+uint32_t bgpview_frozen_get_time(bgpview_frozen_t *frozen)
 {
-  khiter_t k;
+  return frozen->time;
+}
 
-  /* note: in the current implementation we don't free pfx-peers for pfxs that
-     are not invalid since it would be an expensive walk and/or we just haven't
-     implemented it yet. */
+uint32_t bgpview_frozen_pfx_cnt(bgpview_frozen_t *frozen)
+{
+  return frozen->pfxs_cnt;
+}
 
-  if (view->need_gc_v4pfxs) {
-    for (k = kh_begin(view->v4pfxs); k != kh_end(view->v4pfxs); ++k) {
-      if (kh_exist(view->v4pfxs, k) &&
-          kh_value(view->v4pfxs, k)->state == BGPVIEW_FIELD_INVALID) {
-        peerid_pfxinfo_destroy(view, kh_value(view->v4pfxs, k));
-        kh_del(bwv_v4pfx_peerid_pfxinfo, view->v4pfxs, k);
-      }
-    }
-    view->need_gc_v4pfxs = 0;
-  }
+uint32_t bgpview_frozen_cell_cnt(bgpview_frozen_t *frozen)
+{
+  return frozen->cells_cnt;
+}
 
-  if (view->need_gc_v6pfxs) {
-    for (k = kh_begin(view->v6pfxs); k != kh_end(view->v6pfxs); ++k) {
-      if (kh_exist(view->v6pfxs, k) &&
-          kh_value(view->v6pfxs, k)->state == BGPVIEW_FIELD_INVALID) {
-        peerid_pfxinfo_destroy(view, kh_value(view->v6pfxs, k));
-        kh_del(bwv_v6pfx_peerid_pfxinfo, view->v6pfxs, k);
-      }
-    }
-    view->need_gc_v6pfxs = 0;
-  }
+uint32_t bgpview_frozen_peer_id_cnt(bgpview_frozen_t *frozen)
+{
+  return frozen->peersigs_cnt;
+}
 
-  if (view->need_gc_peerinfo) {
-    for (k = kh_begin(view->peerinfo); k != kh_end(view->peerinfo); ++k) {
-      if (kh_exist(view->peerinfo, k) &&
-          kh_value(view->peerinfo, k).state == BGPVIEW_FIELD_INVALID) {
-        if (view->peer_user_destructor != NULL &&
-            kh_value(view->peerinfo, k).user != NULL) {
-          view->peer_user_destructor(kh_value(view->peerinfo, k).user);
-        }
-        kh_del(bwv_peerid_peerinfo, view->peerinfo, k);
-      }
-    }
-    view->need_gc_peerinfo = 0;
+bgpstream_peer_sig_t *bgpview_frozen_get_peer_sig(bgpview_frozen_t *frozen,
+                                                  bgpstream_peer_id_t peer_id)
+{
+  /* unused IDs have a zeroed signature */
+  if (peer_id >= frozen->peersigs_cnt ||
+      frozen->peersigs[peer_id].collector_str[0] == '\0') {
+    return NULL;
   }
+  return &frozen->peersigs[peer_id];
 }
 
-int bgpview_copy(bgpview_t *dst, bgpview_t *src)
+uint32_t bgpview_frozen_path_cnt(bgpview_frozen_t *frozen)
 {
-  bgpview_iter_t *src_iter = NULL;
-  bgpview_iter_t *dst_iter = NULL;
+  return frozen->paths_cnt;
+}
 
-  bgpstream_peer_sig_t *ps;
-  bgpstream_peer_id_t src_id, dst_id;
-  bgpstream_peer_id_t dstids[UINT16_MAX];
+bgpview_frozen_iter_t *bgpview_frozen_iter_create(bgpview_frozen_t *frozen)
+{
+  bgpview_frozen_iter_t *iter;
 
-  int first;
-  bgpstream_pfx_t *pfx;
-  bgpstream_as_path_store_path_id_t pathid;
-  bgpstream_as_path_t *path;
+  if ((iter = malloc_zero(sizeof(bgpview_frozen_iter_t))) == NULL) {
+    return NULL;
+  }
+  iter->frozen = frozen;
+  iter->pfx_idx = frozen->pfxs_cnt;
+  iter->cell_idx = frozen->cells_cnt;
 
-  dst->time = src->time;
+  return iter;
+}
 
-  if (((src_iter = bgpview_iter_create(src)) == NULL) ||
-      ((dst_iter = bgpview_iter_create(dst)) == NULL)) {
-    goto err;
-  }
+void bgpview_frozen_iter_destroy(bgpview_frozen_iter_t *iter)
+{
+  free(iter);
+}
 
-  for (bgpview_iter_first_peer(src_iter, BGPVIEW_FIELD_ACTIVE);
-       bgpview_iter_has_more_peer(src_iter); bgpview_iter_next_peer(src_iter)) {
-    ps = bgpview_iter_peer_get_sig(src_iter);
-    src_id = bgpview_iter_peer_get_peer_id(src_iter);
-    if ((dst_id = bgpview_iter_add_peer(
-           dst_iter, ps->collector_str,
-           &ps->peer_ip_addr, ps->peer_asnumber)) == 0) {
-      goto err;
-    }
-    dstids[src_id] = dst_id;
-    bgpview_iter_activate_peer(dst_iter);
+int bgpview_frozen_iter_first_pfx(bgpview_frozen_iter_t *iter)
+{
+  iter->pfx_idx = 0;
+  iter->cell_idx = 0;
+  return (iter->pfx_idx < iter->frozen->pfxs_cnt);
+}
+
+int bgpview_frozen_iter_next_pfx(bgpview_frozen_iter_t *iter)
+{
+  iter->pfx_idx++;
+  if (iter->pfx_idx < iter->frozen->pfxs_cnt) {
+    iter->cell_idx = iter->frozen->cell_offsets[iter->pfx_idx];
+    return 1;
   }
+  iter->cell_idx = iter->frozen->cells_cnt;
+  return 0;
+}
 
-  for (bgpview_iter_first_pfx(src_iter, 0, BGPVIEW_FIELD_ACTIVE);
-       bgpview_iter_has_more_pfx(src_iter); bgpview_iter_next_pfx(src_iter)) {
-    first = 1;
-    pfx = bgpview_iter_pfx_get_pfx(src_iter);
-    for (bgpview_iter_pfx_first_peer(src_iter, BGPVIEW_FIELD_ACTIVE);
-         bgpview_iter_pfx_has_more_peer(src_iter);
-         bgpview_iter_pfx_next_peer(src_iter)) {
-      src_id = bgpview_iter_peer_get_peer_id(src_iter);
-      dst_id = dstids[src_id];
-      pathid = bgpview_iter_pfx_peer_get_as_path_store_path_id(src_iter);
+int bgpview_frozen_iter_has_more_pfx(bgpview_frozen_iter_t *iter)
+{
+  return (iter->pfx_idx < iter->frozen->pfxs_cnt);
+}
 
-      /* if they share tables, be more efficient */
-      if (dst->pathstore == src->pathstore) {
-        if (first != 0) {
-          /* this is the first pfx-peer for this prefix */
-          if (bgpview_iter_add_pfx_peer_by_id(dst_iter, pfx, dst_id, pathid) !=
-              0) {
-            goto err;
-          }
-          first = 0;
-        } else {
-          if (bgpview_iter_pfx_add_peer_by_id(dst_iter, dst_id, pathid) != 0) {
-            goto err;
-          }
-        }
-      } else {
-        /* inefficiently copy */
-        path = bgpview_iter_pfx_peer_get_as_path(src_iter);
+bgpstream_pfx_t *bgpview_frozen_iter_pfx_get_pfx(bgpview_frozen_iter_t *iter)
+{
+  return &iter->frozen->pfxs[iter->pfx_idx];
+}
 
-        if (first != 0) {
-          if (bgpview_iter_add_pfx_peer(dst_iter, pfx, dst_id, path) != 0) {
-            goto err;
-          }
-          first = 0;
-        } else {
-          if (bgpview_iter_pfx_add_peer(dst_iter, dst_id, path) != 0) {
-            goto err;
-          }
-        }
+int bgpview_frozen_iter_pfx_get_cells(
+  bgpview_frozen_iter_t *iter, bgpstream_peer_id_t **peer_ids,
+  bgpstream_as_path_store_path_id_t **path_ids, uint32_t **origin_asns)
+{
+  bgpview_frozen_t *frozen = iter->frozen;
+  uint32_t first = frozen->cell_offsets[iter->pfx_idx];
 
-        bgpstream_as_path_destroy(path);
-      }
-      bgpview_iter_pfx_activate_peer(dst_iter);
-    }
+  if (peer_ids != NULL) {
+    *peer_ids = &frozen->peer_ids[first];
+  }
+  if (path_ids != NULL) {
+    *path_ids = (frozen->path_ids != NULL) ? &frozen->path_ids[first] : NULL;
   }
+  if (origin_asns != NULL) {
+    *origin_asns = &frozen->origin_asns[first];
+  }
+  return frozen->cell_offsets[iter->pfx_idx + 1] - first;
+}
+
+int bgpview_frozen_iter_pfx_first_peer(bgpview_frozen_iter_t *iter)
+{
+  iter->cell_idx = iter->frozen->cell_offsets[iter->pfx_idx];
+  return (iter->cell_idx < iter->frozen->cell_offsets[iter->pfx_idx + 1]);
+}
+
+int bgpview_frozen_iter_pfx_next_peer(bgpview_frozen_iter_t *iter)
+{
+  iter->cell_idx++;
+  return (iter->cell_idx < iter->frozen->cell_offsets[iter->pfx_idx + 1]);
+}
+
+int bgpview_frozen_iter_pfx_has_more_peer(bgpview_frozen_iter_t *iter)
+{
+  return (iter->pfx_idx < iter->frozen->pfxs_cnt &&
+          iter->cell_idx < iter->frozen->cell_offsets[iter->pfx_idx + 1]);
+}
 
-  bgpview_iter_destroy(src_iter);
-  bgpview_iter_destroy(dst_iter);
+bgpstream_peer_id_t
+bgpview_frozen_iter_pfx_peer_get_peer_id(bgpview_frozen_iter_t *iter)
+{
+  return iter->frozen->peer_ids[iter->cell_idx];
+}
 
-  return 0;
+bgpstream_peer_sig_t *
+bgpview_frozen_iter_pfx_peer_get_sig(bgpview_frozen_iter_t *iter)
+{
+  bgpstream_peer_id_t peerid = iter->frozen->peer_ids[iter->cell_idx];
 
-err:
-  bgpview_iter_destroy(src_iter);
-  bgpview_iter_destroy(dst_iter);
-  return -1;
+  if (peerid >= iter->frozen->peersigs_cnt) {
+    return NULL;
+  }
+  return &iter->frozen->peersigs[peerid];
 }
 
-bgpview_t *bgpview_dup(bgpview_t *src)
+bgpstream_as_path_store_path_id_t
+bgpview_frozen_iter_pfx_peer_get_as_path_store_path_id(
+  bgpview_frozen_iter_t *iter)
 {
-  bgpview_t *dst = NULL;
+  assert(iter->frozen->path_ids != NULL);
+  return iter->frozen->path_ids[iter->cell_idx];
+}
 
-  if ((dst = bgpview_create_shared(
-         src->peersigns, src->pathstore, src->user_destructor,
-         src->peer_user_destructor, src->pfx_user_destructor,
-         src->pfx_peer_user_destructor)) == NULL) {
+bgpstream_as_path_store_path_t *
+bgpview_frozen_iter_pfx_peer_get_as_path_store_path(
+  bgpview_frozen_iter_t *iter)
+{
+  if (iter->frozen->pathstore == NULL) {
     return NULL;
   }
+  return bgpstream_as_path_store_get_store_path(
+    iter->frozen->pathstore, iter->frozen->path_ids[iter->cell_idx]);
+}
 
-  dst->disable_extended = src->disable_extended;
+/* build a path of a mapped view the way the AS Path Store does: core paths
+   are stored without the peer ASN, which is prepended here */
+static bgpstream_as_path_t *frozen_path_get(bgpview_frozen_t *frozen,
+                                            uint32_t idx, uint32_t peer_asn)
+{
+  bgpstream_as_path_t *path = NULL;
+  bgpstream_as_path_seg_asn_t *seg;
+  uint8_t *data = NULL;
+  uint32_t first, len;
+  int ret;
+
+  /* the offsets of a mapped image were checked by bgpview_frozen_map */
+  assert(idx < frozen->paths_cnt);
+  first = frozen->path_offsets[idx];
+  len = frozen->path_offsets[idx + 1] - first;
+
+  if ((path = bgpstream_as_path_create()) == NULL) {
+    return NULL;
+  }
 
-  if (bgpview_copy(dst, src) != 0) {
-    goto err;
+  if (frozen->path_cores[idx] == 0) {
+    ret = bgpstream_as_path_populate_from_data(path, &frozen->path_data[first],
+                                               len);
+  } else {
+    if ((data = malloc(sizeof(bgpstream_as_path_seg_asn_t) + len)) == NULL) {
+      bgpstream_as_path_destroy(path);
+      return NULL;
+    }
+    seg = (bgpstream_as_path_seg_asn_t *)data;
+    seg->type = BGPSTREAM_AS_PATH_SEG_ASN;
+    seg->asn = peer_asn;
+    memcpy(data + sizeof(bgpstream_as_path_seg_asn_t),
+           &frozen->path_data[first], len);
+    ret = bgpstream_as_path_populate_from_data(
+      path, data, sizeof(bgpstream_as_path_seg_asn_t) + len);
+    free(data);
   }
 
-  return dst;
+  if (ret != 0) {
+    bgpstream_as_path_destroy(path);
+    return NULL;
+  }
+  return path;
+}
 
-err:
-  bgpview_destroy(dst);
-  return NULL;
+bgpstream_as_path_t *
+bgpview_frozen_iter_pfx_peer_get_as_path(bgpview_frozen_iter_t *iter)
+{
+  bgpstream_peer_sig_t *ps = bgpview_frozen_iter_pfx_peer_get_sig(iter);
+  uint32_t peer_asn = (ps != NULL) ? ps->peer_asnumber : 0;
+
+  if (iter->frozen->mapped == 0) {
+    return bgpstream_as_path_store_path_get_path(
+      bgpview_frozen_iter_pfx_peer_get_as_path_store_path(iter), peer_asn);
+  }
+  return frozen_path_get(iter->frozen, iter->frozen->path_idxs[iter->cell_idx],
+                         peer_asn);
 }
 
-void bgpview_disable_user_data(bgpview_t *view)
+uint32_t bgpview_frozen_iter_pfx_peer_get_origin_asn(bgpview_frozen_iter_t *iter)
 {
-  /* the user can't be wanting to destroy pfx-peer user data... */
-  assert(view->pfx_peer_user_destructor == NULL);
-  /* nor can they have any prefixes... */
-  assert(bgpview_pfx_cnt(view, BGPVIEW_FIELD_ALL_VALID) == 0);
+  return iter->frozen->origin_asns[iter->cell_idx];
+}
 
-  view->disable_extended = 1;
+uint32_t bgpview_frozen_iter_pfx_peer_get_path_idx(bgpview_frozen_iter_t *iter)
+{
+  assert(iter->frozen->path_idxs != NULL);
+  return iter->frozen->path_idxs[iter->cell_idx];
 }
 
-/* ==================== SIMPLE ACCESSOR FUNCTIONS ==================== */
+/* ==================== PUBLICATION FUNCTIONS ==================== */
 
-uint32_t bgpview_v4pfx_cnt(bgpview_t *view, uint8_t state_mask)
+/* initial size of the buffer that a published version is written to */
+#define PUB_IMAGE_ALLOC_MIN (1024 * 1024)
+
+/* buffer that the image of a published version is written to */
+typedef struct bwv_pub_image {
+  uint8_t *buf;
+  uint64_t len;
+  uint64_t alloc;
+} bwv_pub_image_t;
+
+static int64_t pub_image_write(void *user, const void *buf, int64_t len)
 {
-  return __cnt_by_mask(view->v4pfxs_cnt, state_mask);
+  bwv_pub_image_t *image = user;
+  uint64_t alloc = image->alloc;
+  uint8_t *tmp;
+
+  if (image->len + len > alloc) {
+    if (alloc == 0) {
+      alloc = PUB_IMAGE_ALLOC_MIN;
+    }
+    while (image->len + len > alloc) {
+      alloc *= 2;
+    }
+    if ((tmp = realloc(image->buf, alloc)) == NULL) {
+      return -1;
+    }
+    image->buf = tmp;
+    image->alloc = alloc;
+  }
+
+  memcpy(image->buf + image->len, buf, len);
+  image->len += len;
+  return len;
 }
 
-uint32_t bgpview_v6pfx_cnt(bgpview_t *view, uint8_t state_mask)
+/* create a version that neither references the view nor its AS Path Store
+   by mapping the image of the given frozen view (which owns its paths, so
+   writing the image only copies its arrays) */
+static bgpview_frozen_t *pub_version_create(bgpview_frozen_t *frozen)
 {
-  return __cnt_by_mask(view->v6pfxs_cnt, state_mask);
+  bgpview_frozen_t *version;
+  bwv_pub_image_t image = {NULL, 0, 0};
+
+  if (bgpview_frozen_write(frozen, pub_image_write, &image) < 0 ||
+      (version = bgpview_frozen_map(image.buf, image.len, NULL)) == NULL) {
+    free(image.buf);
+    return NULL;
+  }
+  version->image = image.buf;
+
+  return version;
 }
 
-uint32_t bgpview_pfx_cnt(bgpview_t *view, uint8_t state_mask)
+/* free the retired versions that no reader can be using anymore */
+static void pub_reclaim(bgpview_pub_t *pub)
 {
-  return __cnt_by_mask(view->v4pfxs_cnt, state_mask) +
-         __cnt_by_mask(view->v6pfxs_cnt, state_mask);
+  bgpview_pub_reader_t *reader;
+  bwv_pub_retired_t **rp, *r;
+  uint64_t min_epoch = UINT64_MAX;
+  uint64_t epoch;
+
+  /* a reader that acquired a version before it was replaced observed an
+     older epoch than the one the version was retired with */
+  pthread_mutex_lock(&pub->readers_lock);
+  for (reader = pub->readers; reader != NULL; reader = reader->next) {
+    epoch = reader->epoch;
+    if (epoch != 0 && epoch < min_epoch) {
+      min_epoch = epoch;
+    }
+  }
+  pthread_mutex_unlock(&pub->readers_lock);
+
+  rp = &pub->retired;
+  while ((r = *rp) != NULL) {
+    if (r->epoch <= min_epoch) {
+      *rp = r->next;
+      bgpview_frozen_destroy(r->frozen);
+      free(r);
+    } else {
+      rp = &r->next;
+    }
+  }
 }
 
-uint32_t bgpview_peer_cnt(bgpview_t *view, uint8_t state_mask)
+bgpview_pub_t *bgpview_pub_create(void)
 {
-  return __cnt_by_mask(view->peerinfo_cnt, state_mask);
+  bgpview_pub_t *pub;
+
+  if ((pub = malloc_zero(sizeof(bgpview_pub_t))) == NULL) {
+    return NULL;
+  }
+  pub->epoch = 1;
+  pthread_mutex_init(&pub->readers_lock, NULL);
+
+  return pub;
 }
 
-uint32_t bgpview_get_time(bgpview_t *view)
+void bgpview_pub_destroy(bgpview_pub_t *pub)
 {
-  return view->time;
+  bgpview_pub_reader_t *reader;
+  bwv_pub_retired_t *r;
+
+  if (pub == NULL) {
+    return;
+  }
+
+  while ((r = pub->retired) != NULL) {
+    pub->retired = r->next;
+    bgpview_frozen_destroy(r->frozen);
+    free(r);
+  }
+  bgpview_frozen_destroy(pub->current);
+  freeze_reset(&pub->freeze);
+  bgpview_destroy(pub->snap);
+
+  /* readers that were not destroyed can no longer be used */
+  while ((reader = pub->readers) != NULL) {
+    pub->readers = reader->next;
+    free(reader);
+  }
+  pthread_mutex_destroy(&pub->readers_lock);
+
+  free(pub);
 }
 
-void bgpview_set_time(bgpview_t *view, uint32_t time)
+/* make the given version the current one */
+static int pub_install(bgpview_pub_t *pub, bgpview_frozen_t *version)
 {
-  view->time = time;
+  bgpview_frozen_t *old;
+  bwv_pub_retired_t *r = NULL;
+
+  old = pub->current;
+  if (old != NULL && (r = malloc(sizeof(bwv_pub_retired_t))) == NULL) {
+    bgpview_frozen_destroy(version);
+    return -1;
+  }
+
+  /* make the version visible before advancing the epoch (the atomic
+     increment is a full barrier) */
+  __sync_synchronize();
+  pub->current = version;
+  if (r != NULL) {
+    r->frozen = old;
+    r->epoch = __sync_add_and_fetch(&pub->epoch, 1);
+    r->next = pub->retired;
+    pub->retired = r;
+  } else {
+    __sync_add_and_fetch(&pub->epoch, 1);
+  }
+
+  pub_reclaim(pub);
+  return 0;
 }
 
-uint32_t bgpview_get_time_created(bgpview_t *view)
+/* abandon the version being built (if any) */
+static void pub_abandon(bgpview_pub_t *pub)
 {
-  return view->time_created;
+  if (pub->building != 0) {
+    freeze_reset(&pub->freeze);
+    pub->building = 0;
+  }
 }
 
-void *bgpview_get_user(bgpview_t *view)
+int bgpview_pub_publish(bgpview_pub_t *pub, bgpview_t *view)
 {
-  return view->user;
+  bgpview_frozen_t *version = NULL;
+  bwv_freeze_t fz;
+
+  /* it would replace this (newer) version once built */
+  pub_abandon(pub);
+
+  if (freeze_start(&fz, view, 1) != 0 || freeze_step(&fz, 0) != 1 ||
+      (version = pub_version_create(fz.frozen)) == NULL) {
+    goto err;
+  }
+  freeze_reset(&fz);
+
+  if (pub_install(pub, version) != 0) {
+    goto err;
+  }
+  return 0;
+
+err:
+  fprintf(stderr, "ERROR: Could not publish view\n");
+  freeze_reset(&fz);
+  return -1;
 }
 
-int bgpview_set_user(bgpview_t *view, void *user)
+int bgpview_pub_publish_start(bgpview_pub_t *pub, bgpview_t *view)
 {
-  if (view->user == user) {
+  pub_abandon(pub);
+
+  /* the snapshot is kept between publications, so that updating it only
+     costs a copy of the prefix tables */
+  if (pub->snap != NULL && pub->snap->snapshot_src != view) {
+    bgpview_destroy(pub->snap);
+    pub->snap = NULL;
+  }
+  if (pub->snap == NULL) {
+    if ((pub->snap = bgpview_snapshot_create(view)) == NULL) {
+      goto err;
+    }
+  } else if (bgpview_snapshot_update(pub->snap) != 0) {
+    goto err;
+  }
+
+  if (freeze_start(&pub->freeze, pub->snap, 1) != 0) {
+    freeze_reset(&pub->freeze);
+    goto err;
+  }
+  pub->building = 1;
+  return 0;
+
+err:
+  fprintf(stderr, "ERROR: Could not start publishing view\n");
+  return -1;
+}
+
+int bgpview_pub_publish_step(bgpview_pub_t *pub, int budget)
+{
+  bgpview_frozen_t *version;
+  int ret;
+
+  if (pub->building == 0) {
     return 0;
   }
-  if (view->user != NULL && view->user_destructor != NULL) {
-    view->user_destructor(view->user);
+
+  if ((ret = freeze_step(&pub->freeze, budget)) == 0) {
+    return 0;
+  }
+  version = (ret == 1) ? pub_version_create(pub->freeze.frozen) : NULL;
+  pub_abandon(pub);
+
+  if (version == NULL || pub_install(pub, version) != 0) {
+    fprintf(stderr, "ERROR: Could not publish view\n");
+    return -1;
   }
-  view->user = user;
   return 1;
 }
 
-void bgpview_set_user_destructor(bgpview_t *view,
-                                 bgpview_destroy_user_t *bwv_user_destructor)
+bgpview_pub_reader_t *bgpview_pub_reader_create(bgpview_pub_t *pub)
 {
-  if (view->user_destructor == bwv_user_destructor) {
-    return;
+  bgpview_pub_reader_t *reader;
+
+  if ((reader = malloc_zero(sizeof(bgpview_pub_reader_t))) == NULL) {
+    return NULL;
   }
-  assert(view->user_destructor == NULL);
-  view->user_destructor = bwv_user_destructor;
+  reader->pub = pub;
+
+  pthread_mutex_lock(&pub->readers_lock);
+  reader->next = pub->readers;
+  pub->readers = reader;
+  pthread_mutex_unlock(&pub->readers_lock);
+
+  return reader;
 }
 
-void bgpview_set_pfx_user_destructor(
-  bgpview_t *view, bgpview_destroy_user_t *bwv_pfx_user_destructor)
+void bgpview_pub_reader_destroy(bgpview_pub_reader_t *reader)
 {
-  if (view->pfx_user_destructor == bwv_pfx_user_destructor) {
+  bgpview_pub_t *pub;
+  bgpview_pub_reader_t **rp;
+
+  if (reader == NULL) {
     return;
   }
-  assert(view->pfx_user_destructor == NULL);
-  view->pfx_user_destructor = bwv_pfx_user_destructor;
+  pub = reader->pub;
+
+  pthread_mutex_lock(&pub->readers_lock);
+  for (rp = &pub->readers; *rp != NULL; rp = &(*rp)->next) {
+    if (*rp == reader) {
+      *rp = reader->next;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&pub->readers_lock);
+
+  free(reader);
 }
 
-void bgpview_set_peer_user_destructor(
-  bgpview_t *view, bgpview_destroy_user_t *bwv_peer_user_destructor)
+bgpview_frozen_t *bgpview_pub_reader_acquire(bgpview_pub_reader_t *reader)
 {
-  if (view->peer_user_destructor == bwv_peer_user_destructor) {
-    return;
-  }
-  assert(view->peer_user_destructor == NULL);
-  view->peer_user_destructor = bwv_peer_user_destructor;
+  bgpview_pub_t *pub = reader->pub;
+
+  /* announce the epoch before loading the version, so that the writer either
+     sees the announcement or has already published a newer version */
+  reader->epoch = pub->epoch;
+  __sync_synchronize();
+
+  return pub->current;
 }
 
-void bgpview_set_pfx_peer_user_destructor(
-  bgpview_t *view, bgpview_destroy_user_t *bwv_pfx_peer_user_destructor)
+void bgpview_pub_reader_release(bgpview_pub_reader_t *reader)
 {
-  ASSERT_BWV_PFX_PEERINFO_EXT(view);
-  if (view->pfx_peer_user_destructor == bwv_pfx_peer_user_destructor) {
-    return;
-  }
-  assert(view->pfx_peer_user_destructor == NULL);
-  view->pfx_peer_user_destructor = bwv_pfx_peer_user_destructor;
+  /* complete all reads of the version before giving it back */
+  __sync_synchronize();
+  reader->epoch = 0;
 }
 
-bgpstream_as_path_store_t *bgpview_get_as_path_store(bgpview_t *view)
+/* ==================== DIFF FUNCTIONS ==================== */
+
+#define DIFF_CB(cb, a_it, b_it)                                                \
+  do {                                                                         \
+    if (cbs->cb != NULL && cbs->cb((a_it), (b_it), user) < 0) {                \
+      goto err;                                                                \
+    }                                                                          \
+  } while (0)
+
+#define DIFF_CELL_CB(cb, a_it, b_it)                                           \
+  do {                                                                         \
+    changed = 1;                                                               \
+    DIFF_CB(cb, a_it, b_it);                                                   \
+  } while (0)
+
+static int diff_path_ids(bgpview_iter_t *a_it, bgpview_iter_t *b_it)
 {
-  return view->pathstore;
+  bgpstream_as_path_store_path_id_t a_id =
+    bgpview_iter_pfx_peer_get_as_path_store_path_id(a_it);
+  bgpstream_as_path_store_path_id_t b_id =
+    bgpview_iter_pfx_peer_get_as_path_store_path_id(b_it);
+  return memcmp(&a_id, &b_id, sizeof(bgpstream_as_path_store_path_id_t));
 }
 
-bgpstream_peer_sig_map_t *bgpview_get_peersigns(bgpview_t *view)
+/* diff the active cells of the prefix that both iterators point at */
+static int diff_cells(bgpview_iter_t *a_it, bgpview_iter_t *b_it,
+                      bgpview_diff_cbs_t *cbs, void *user)
 {
-  return view->peersigns;
+  bgpstream_peer_id_t a_id, b_id;
+  int a_more, b_more;
+  int changed = 0;
+
+  if (a_it->view->cell_layout == BGPVIEW_CELL_LAYOUT_SORTED &&
+      b_it->view->cell_layout == BGPVIEW_CELL_LAYOUT_SORTED) {
+    /* both cell lists are sorted by peer id: merge them */
+    a_more = bgpview_iter_pfx_first_peer(a_it, BGPVIEW_FIELD_ACTIVE);
+    b_more = bgpview_iter_pfx_first_peer(b_it, BGPVIEW_FIELD_ACTIVE);
+    while (a_more || b_more) {
+      a_id = a_more ? bgpview_iter_peer_get_peer_id(a_it) : 0;
+      b_id = b_more ? bgpview_iter_peer_get_peer_id(b_it) : 0;
+      if (!b_more || (a_more && a_id < b_id)) {
+        DIFF_CELL_CB(cell_removed, a_it, NULL);
+        a_more = bgpview_iter_pfx_next_peer(a_it);
+      } else if (!a_more || b_id < a_id) {
+        DIFF_CELL_CB(cell_added, NULL, b_it);
+        b_more = bgpview_iter_pfx_next_peer(b_it);
+      } else {
+        if (diff_path_ids(a_it, b_it) != 0) {
+          DIFF_CELL_CB(cell_changed, a_it, b_it);
+        }
+        a_more = bgpview_iter_pfx_next_peer(a_it);
+        b_more = bgpview_iter_pfx_next_peer(b_it);
+      }
+    }
+  } else {
+    /* cells that are in b: either added or (maybe) changed */
+    for (bgpview_iter_pfx_first_peer(b_it, BGPVIEW_FIELD_ACTIVE);
+         bgpview_iter_pfx_has_more_peer(b_it);
+         bgpview_iter_pfx_next_peer(b_it)) {
+      if (bgpview_iter_pfx_seek_peer(a_it, bgpview_iter_peer_get_peer_id(b_it),
+                                     BGPVIEW_FIELD_ACTIVE) == 0) {
+        DIFF_CELL_CB(cell_added, NULL, b_it);
+      } else if (diff_path_ids(a_it, b_it) != 0) {
+        DIFF_CELL_CB(cell_changed, a_it, b_it);
+      }
+    }
+    /* cells that are only in a */
+    for (bgpview_iter_pfx_first_peer(a_it, BGPVIEW_FIELD_ACTIVE);
+         bgpview_iter_pfx_has_more_peer(a_it);
+         bgpview_iter_pfx_next_peer(a_it)) {
+      if (bgpview_iter_pfx_seek_peer(b_it, bgpview_iter_peer_get_peer_id(a_it),
+                                     BGPVIEW_FIELD_ACTIVE) == 0) {
+        DIFF_CELL_CB(cell_removed, a_it, NULL);
+      }
+    }
+  }
+
+  if (changed != 0) {
+    DIFF_CB(pfx_changed, a_it, b_it);
+  }
+
+  return 0;
+
+err:
+  return -1;
 }
 
-bgpstream_peer_id_t bgpview_get_peer_id(bgpview_t *view,
-                                        bgpstream_peer_sig_t *ps)
+int bgpview_diff(bgpview_t *a, bgpview_t *b, bgpview_diff_cbs_t *cbs,
+                 void *user)
 {
-  return bgpstream_peer_sig_map_get_id(view->peersigns, ps->collector_str,
-                                       &ps->peer_ip_addr,
-                                       ps->peer_asnumber);
+  bgpview_iter_t *a_it = NULL;
+  bgpview_iter_t *b_it = NULL;
+  int cells;
+  int cmp;
+
+  if ((a_it = bgpview_iter_create(a)) == NULL ||
+      (b_it = bgpview_iter_create(b)) == NULL) {
+    fprintf(stderr, "ERROR: Could not create diff iterators\n");
+    goto err;
+  }
+
+  cells = (cbs->cell_added != NULL || cbs->cell_removed != NULL ||
+           cbs->cell_changed != NULL || cbs->pfx_changed != NULL);
+
+  if (ord_pfxs_build(a_it, 0, BGPVIEW_FIELD_ACTIVE) != 0 ||
+      ord_pfxs_build(b_it, 0, BGPVIEW_FIELD_ACTIVE) != 0) {
+    fprintf(stderr, "ERROR: Could not sort the prefixes of the views\n");
+    goto err;
+  }
+
+  ord_pfxs_scan(a_it);
+  ord_pfxs_scan(b_it);
+  while (bgpview_iter_has_more_pfx_ordered(a_it) ||
+         bgpview_iter_has_more_pfx_ordered(b_it)) {
+    if (!bgpview_iter_has_more_pfx_ordered(a_it)) {
+      cmp = 1;
+    } else if (!bgpview_iter_has_more_pfx_ordered(b_it)) {
+      cmp = -1;
+    } else {
+      cmp = sorted_pfx_cmp(&a_it->ord_pfxs[a_it->ord_idx],
+                           &b_it->ord_pfxs[b_it->ord_idx]);
+    }
+
+    if (cmp < 0) {
+      DIFF_CB(pfx_removed, a_it, NULL);
+      bgpview_iter_next_pfx_ordered(a_it);
+    } else if (cmp > 0) {
+      DIFF_CB(pfx_added, NULL, b_it);
+      bgpview_iter_next_pfx_ordered(b_it);
+    } else {
+      DIFF_CB(pfx_common, a_it, b_it);
+      if (cells != 0 && diff_cells(a_it, b_it, cbs, user) != 0) {
+        goto err;
+      }
+      bgpview_iter_next_pfx_ordered(a_it);
+      bgpview_iter_next_pfx_ordered(b_it);
+    }
+  }
+
+  bgpview_iter_destroy(a_it);
+  bgpview_iter_destroy(b_it);
+  return 0;
+
+err:
+  bgpview_iter_destroy(a_it);
+  bgpview_iter_destroy(b_it);
+  return -1;
+}
+
+int bgpview_diff_journal(bgpview_t *a, bgpview_t *b, bgpview_diff_cbs_t *cbs,
+                         void *user)
+{
+  bgpview_iter_t *a_it = NULL;
+  bgpview_iter_t *b_it = NULL;
+  bgpstream_pfx_t *pfx;
+  int a_has, b_has;
+  int cells;
+  uint32_t i;
+
+  if (bgpview_journal_is_complete(b) == 0) {
+    fprintf(stderr, "ERROR: The journal of the view is not complete\n");
+    return -1;
+  }
+
+  if ((a_it = bgpview_iter_create(a)) == NULL ||
+      (b_it = bgpview_iter_create(b)) == NULL) {
+    fprintf(stderr, "ERROR: Could not create diff iterators\n");
+    goto err;
+  }
+
+  cells = (cbs->cell_added != NULL || cbs->cell_removed != NULL ||
+           cbs->cell_changed != NULL || cbs->pfx_changed != NULL);
+
+  /* every other prefix is the same in both views */
+  journal_sort(b);
+  for (i = 0; i < b->journal_cnt; i++) {
+    pfx = &b->journal[i];
+    a_has = bgpview_iter_seek_pfx(a_it, pfx, BGPVIEW_FIELD_ACTIVE);
+    b_has = bgpview_iter_seek_pfx(b_it, pfx, BGPVIEW_FIELD_ACTIVE);
+
+    if (a_has && b_has) {
+      DIFF_CB(pfx_common, a_it, b_it);
+      if (cells != 0 && diff_cells(a_it, b_it, cbs, user) != 0) {
+        goto err;
+      }
+    } else if (a_has) {
+      DIFF_CB(pfx_removed, a_it, NULL);
+    } else if (b_has) {
+      DIFF_CB(pfx_added, NULL, b_it);
+    }
+  }
+
+  bgpview_iter_destroy(a_it);
+  bgpview_iter_destroy(b_it);
+  return 0;
+
+err:
+  bgpview_iter_destroy(a_it);
+  bgpview_iter_destroy(b_it);
+  return -1;
 }
@@ -54,6 +54,22 @@ typedef struct bgpview bgpview_t;
 /** Opaque handle for iterating over fields of a BGP View table. */
 typedef struct bgpview_iter bgpview_iter_t;
 
+/** Opaque handle to an immutable, read-only snapshot of the active prefixes
+ * and pfx-peers of a BGP View (see bgpview_freeze).
+ */
+typedef struct bgpview_frozen bgpview_frozen_t;
+
+/** Opaque handle for iterating over a frozen BGP View. */
+typedef struct bgpview_frozen_iter bgpview_frozen_iter_t;
+
+/** Opaque handle to a publisher of immutable versions of a BGP View (see
+ * bgpview_pub_publish).
+ */
+typedef struct bgpview_pub bgpview_pub_t;
+
+/** Opaque handle used by a reader thread to access published versions. */
+typedef struct bgpview_pub_reader bgpview_pub_reader_t;
+
 /** @} */
 
 /**
@@ -80,6 +96,19 @@ typedef enum {
 
 } bgpview_field_state_t;
 
+/** Storage layout used for the pfx-peer cells of each prefix */
+typedef enum {
+
+  /** Each prefix keeps a hash table of peers (default) */
+  BGPVIEW_CELL_LAYOUT_HASH = 0,
+
+  /** Each prefix keeps a compact array of cells sorted by peer ID. This uses
+   *  considerably less memory than the hash layout for prefixes with few
+   *  peers, and iterates over the cells of a prefix sequentially. */
+  BGPVIEW_CELL_LAYOUT_SORTED = 1,
+
+} bgpview_cell_layout_t;
+
 /** @} */
 
 /**
@@ -115,6 +144,139 @@ typedef enum {
  */
 typedef void(bgpview_destroy_user_t)(void *user);
 
+/** Callback for a difference found by bgpview_diff
+ *
+ * @param a_it          iterator into the first view, pointing at the prefix
+ *                      (or pfx-peer) of the difference, NULL if the prefix (or
+ *                      pfx-peer) does not exist in the first view
+ * @param b_it          iterator into the second view, same as a_it
+ * @param user          user pointer passed to bgpview_diff
+ * @return 0 to continue the diff, -1 to abort it
+ */
+typedef int(bgpview_diff_cb_t)(bgpview_iter_t *a_it, bgpview_iter_t *b_it,
+                               void *user);
+
+/** Callback used by bgpview_frozen_write to output the image of a frozen view
+ *
+ * @param user          user pointer passed to bgpview_frozen_write
+ * @param buf           pointer to the bytes to write
+ * @param len           number of bytes to write
+ * @return the number of bytes written, -1 if an error occurred
+ */
+typedef int64_t(bgpview_frozen_write_cb_t)(void *user, const void *buf,
+                                           int64_t len);
+
+/** Callbacks invoked by bgpview_diff, any of them may be NULL */
+typedef struct bgpview_diff_cbs {
+
+  /** Active prefix only in the second view */
+  bgpview_diff_cb_t *pfx_added;
+
+  /** Active prefix only in the first view */
+  bgpview_diff_cb_t *pfx_removed;
+
+  /** Active prefix in both views (called before the cells are compared) */
+  bgpview_diff_cb_t *pfx_common;
+
+  /** Active prefix in both views whose active cells differ (called after the
+      cell callbacks for the prefix) */
+  bgpview_diff_cb_t *pfx_changed;
+
+  /** Active pfx-peer only in the second view */
+  bgpview_diff_cb_t *cell_added;
+
+  /** Active pfx-peer only in the first view */
+  bgpview_diff_cb_t *cell_removed;
+
+  /** Active pfx-peer in both views, with a different AS path */
+  bgpview_diff_cb_t *cell_changed;
+
+} bgpview_diff_cbs_t;
+
+/** Memory used by a view, in bytes (see bgpview_get_mem_stats) */
+typedef struct bgpview_mem_stats {
+
+  /** v4 and v6 prefix tables (buckets in use) */
+  uint64_t pfx_tables;
+
+  /** Unused buckets of the prefix tables */
+  uint64_t pfx_tables_slack;
+
+  /** Per-prefix info structures in use */
+  uint64_t pfx_infos;
+
+  /** Per-prefix info structures that are allocated but free */
+  uint64_t pfx_infos_slack;
+
+  /** Per-prefix cell hash tables without user pointers (used buckets) */
+  uint64_t cells_min;
+
+  /** Per-prefix cell hash tables with user pointers (used buckets) */
+  uint64_t cells_ext;
+
+  /** Per-prefix sorted cell arrays (BGPVIEW_CELL_LAYOUT_SORTED, used
+      cells) */
+  uint64_t cells_sorted;
+
+  /** Unused buckets of the cell tables, unused cells of the sorted arrays
+      and free sorted arrays */
+  uint64_t cells_slack;
+
+  /** Peer table (buckets in use) */
+  uint64_t peer_table;
+
+  /** Unused buckets of the peer table */
+  uint64_t peer_table_slack;
+
+  /** Per-peer prefix index (see bgpview_enable_peer_pfx_index) */
+  uint64_t peer_pfx_index;
+
+  /** AS paths in the path store (may be shared with other views) */
+  uint64_t pathstore;
+
+  /** Peer signatures (may be shared with other views) */
+  uint64_t peersigns;
+
+  /** Everything else (iterators excluded): gc list, journal, snapshot
+      bookkeeping, ... */
+  uint64_t other;
+
+  /** Sum of all of the above */
+  uint64_t total;
+
+} bgpview_mem_stats_t;
+
+/** Apply X(field, extra) to each field of bgpview_mem_stats_t, so that users
+    that report every field do not have to list them */
+#define BGPVIEW_MEM_STATS_FIELDS(X, extra)                                     \
+  X(pfx_tables, extra)                                                         \
+  X(pfx_tables_slack, extra)                                                   \
+  X(pfx_infos, extra)                                                          \
+  X(pfx_infos_slack, extra)                                                    \
+  X(cells_min, extra)                                                          \
+  X(cells_ext, extra)                                                          \
+  X(cells_sorted, extra)                                                       \
+  X(cells_slack, extra)                                                        \
+  X(peer_table, extra)                                                         \
+  X(peer_table_slack, extra)                                                   \
+  X(peer_pfx_index, extra)                                                     \
+  X(pathstore, extra)                                                          \
+  X(peersigns, extra)                                                          \
+  X(other, extra)                                                              \
+  X(total, extra)
+
+/** Number of 64-bit words needed by a peer bitmap that can hold peer IDs up
+    to (and including) max_id */
+#define BGPVIEW_PEER_BITMAP_WORDS(max_id) (((max_id) / 64) + 1)
+
+/** Set the bit of the given peer in a peer bitmap */
+#define BGPVIEW_PEER_BITMAP_SET(bitmap, peerid)                                \
+  ((bitmap)[(peerid) / 64] |= (UINT64_C(1) << ((peerid) % 64)))
+
+/** Check if the bit of the given peer is set in a peer bitmap */
+#define BGPVIEW_PEER_BITMAP_TEST(bitmap, peerid)                               \
+  (((bitmap)[(peerid) / 64] >> ((peerid) % 64)) & 1)
+
 /** @} */
 
 /** Create a new BGP View
@@ -208,6 +370,30 @@ void bgpview_clear(bgpview_t *view);
  */
 void bgpview_gc(bgpview_t *view);
 
+/** Incrementally garbage collect a view
+ *
+ * @param view          view to garbage collect on
+ * @param budget        maximum number of prefixes to garbage collect
+ * @return the number of prefixes still waiting to be garbage collected
+ *
+ * The view keeps a list of the prefixes that have been removed, or that have
+ * had pfx-peers removed, by the various *_remove_* functions. This function
+ * processes at most `budget` prefixes from that list: removed prefixes are
+ * freed, and the removed pfx-peers of the remaining prefixes are freed (and
+ * their pfx-peer tables shrunk if they are mostly empty). This allows the
+ * cost of garbage collection to be spread over time rather than walking the
+ * whole view in bgpview_gc.
+ *
+ * If a prefix could not be added to the list (i.e. memory allocation failed),
+ * the list is incomplete, and a full bgpview_gc is run instead. Callers
+ * should also run bgpview_gc if the backlog keeps growing.
+ *
+ * @note prefixes invalidated by bgpview_clear are only freed by bgpview_gc.
+ * As with bgpview_gc, any user data stored in the freed portions of the view
+ * is freed using the appropriate destructor.
+ */
+uint32_t bgpview_gc_step(bgpview_t *view, int budget);
+
 /** Copy one BGPView into another
  *
  * @param dst           pointer to the destination view
@@ -228,6 +414,44 @@ int bgpview_copy(bgpview_t *dst, bgpview_t *src);
  */
 bgpview_t *bgpview_dup(bgpview_t *src);
 
+/** Create a copy-on-write snapshot of the given view
+ *
+ * @param view          pointer to the view to snapshot
+ * @return pointer to the snapshot if successful, NULL otherwise
+ *
+ * The snapshot is a read-only view that retains the state of the source view
+ * at the time of the last call to bgpview_snapshot_update, without copying
+ * it: prefixes are shared with the source view until they are changed, at
+ * which point the snapshot is given its own copy of the prefix. Keeping
+ * a snapshot of the previous view therefore only costs bookkeeping for the
+ * prefixes that change. The snapshot shares the peer signatures and AS Path
+ * Store of the source view.
+ *
+ * A view may have several snapshots (e.g., one per consumer), each of which
+ * is updated independently. A snapshot must not be modified (or cleared), and
+ * does not carry any user data. It is destroyed with
+ * bgpview_destroy; if the source view is destroyed first, the snapshot is
+ * left without prefixes and can no longer be updated. The peer signatures and
+ * AS Path Store of the source view are then kept until its last snapshot is
+ * destroyed (tables that the source view shares with other views must outlive
+ * the snapshots, as they must outlive the source view).
+ *
+ * A bgpview_clear of the source view does not copy its prefixes into the
+ * snapshots: they are handed over to the snapshots, and released once every
+ * snapshot has been updated.
+ */
+bgpview_t *bgpview_snapshot_create(bgpview_t *view);
+
+/** Update a snapshot to the current state of its source view
+ *
+ * @param snap          pointer to a snapshot created by bgpview_snapshot_create
+ * @return 0 if the snapshot was updated successfully, -1 otherwise
+ *
+ * Releases the prefixes that the snapshot had to copy, and shares the
+ * current prefixes of the source view again.
+ */
+int bgpview_snapshot_update(bgpview_t *snap);
+
 /** Disable user data for a view
  *
  * @param view          view to disable user data for
@@ -238,6 +462,174 @@ bgpview_t *bgpview_dup(bgpview_t *src);
  */
 void bgpview_disable_user_data(bgpview_t *view);
 
+/** Set the storage layout used for pfx-peer cells
+ *
+ * @param view          view to set the cell layout for
+ * @param layout        layout to use
+ *
+ * This must be called immediately after the view is created, before any
+ * prefixes are added. Views created with bgpview_dup inherit the layout of
+ * the source view. Iteration order of the peers of a prefix is only
+ * guaranteed to be by increasing peer ID when using
+ * BGPVIEW_CELL_LAYOUT_SORTED.
+ */
+void bgpview_set_cell_layout(bgpview_t *view, bgpview_cell_layout_t layout);
+
+/** Enable the per-peer prefix index
+ *
+ * @param view          view to enable the index for
+ *
+ * Maintains, for each peer, the set of prefixes that the peer has a
+ * pfx-peer for, so that bgpview_iter_peer_first_pfx (and therefore
+ * bgpview_iter_deactivate_peer and bgpview_iter_remove_peer) only visit the
+ * prefixes of the peer rather than every prefix in the view. The index costs
+ * one prefix per pfx-peer. This must be called immediately after the view is
+ * created, before any prefixes are added. Views created with bgpview_dup
+ * inherit the setting, snapshots never have an index.
+ */
+void bgpview_enable_peer_pfx_index(bgpview_t *view);
+
+/** Back the large tables of the view with huge pages
+ *
+ * @param view          view to enable huge pages for
+ * @return 0 if successful, -1 if the view already had prefixes
+ *
+ * The prefix info structures and sorted cell arrays are allocated from
+ * slabs of huge pages (from the reserved pool if there is one, transparent
+ * huge pages otherwise), and the kernel is asked to back the bucket arrays
+ * of the prefix tables with transparent huge pages. This reduces TLB misses
+ * when iterating over large views, at the cost of rounding each slab up to
+ * a huge page. It falls back to normal pages if huge pages are not
+ * available. This must be called immediately after the view is created,
+ * before any prefixes are added. Views created with bgpview_dup and
+ * snapshots inherit the setting. The AS Path Store is not affected.
+ */
+int bgpview_enable_huge_pages(bgpview_t *view);
+
+/** Allow several threads to write to the view at the same time
+ *
+ * @param view          view to enable concurrent writers for
+ * @param shards_cnt    number of prefix shards (i.e. prefix row locks)
+ * @return 0 if successful, -1 otherwise
+ *
+ * Once enabled, prefix rows (i.e. a prefix and its pfx-peers) may be updated
+ * concurrently by threads that each use their own iterator, as long as every
+ * update of a row is done between bgpview_iter_lock_pfx and
+ * bgpview_iter_unlock_pfx. Rows of prefixes that the view already has, and
+ * that hash to different shards, are updated in parallel. The prefix tables
+ * themselves are not sharded, though: inserting a prefix that the view does
+ * not have yet needs exclusive access to them, which waits for every row
+ * update in progress. Building a view from scratch (e.g. the first sync of a
+ * global Kafka view) is therefore serialized on its prefix inserts (see
+ * bgpview_get_concurrent_writers_stats). bgpview_iter_add_peer,
+ * bgpview_iter_activate_peer and bgpview_iter_deactivate_peer may also be
+ * called concurrently with row updates (but not while the calling iterator
+ * holds a prefix lock). All other functions that change the view (removing
+ * peers, clearing, garbage collection, snapshot updates, ...) still require
+ * exclusive access to the view. Calling this on a view that already has
+ * concurrent writers enabled has no effect.
+ */
+int bgpview_enable_concurrent_writers(bgpview_t *view, int shards_cnt);
+
+/** Stop allowing several threads to write to the view at the same time
+ *
+ * @param view          view to disable concurrent writers for
+ *
+ * Must be called once the concurrent writers are done (i.e. with exclusive
+ * access to the view). Prefixes can then be added without being locked
+ * first. Does nothing if concurrent writers are not enabled.
+ */
+void bgpview_disable_concurrent_writers(bgpview_t *view);
+
+/** Check whether concurrent writers are enabled for the view
+ *
+ * @param view          pointer to a view structure
+ * @return 1 if bgpview_enable_concurrent_writers was called for the view, 0
+ * otherwise
+ */
+int bgpview_has_concurrent_writers(bgpview_t *view);
+
+/** Get the lock statistics of the concurrent writers of the view
+ *
+ * @param view             pointer to a view with concurrent writers
+ * @param[out] locked_cnt  set to the number of prefix rows locked
+ * @param[out] inserted_cnt set to the number of locked rows whose prefix had
+ *                         to be inserted (with exclusive access to the view)
+ * @param[out] insert_wait_usec set to the total time writers waited for that
+ *                         exclusive access, in microseconds
+ * @return 0 if successful, -1 if concurrent writers are not enabled
+ *
+ * Should be called once the writers are done (e.g. right before
+ * bgpview_disable_concurrent_writers), to measure how much the writers
+ * contended on prefix inserts.
+ */
+int bgpview_get_concurrent_writers_stats(bgpview_t *view, uint64_t *locked_cnt,
+                                         uint64_t *inserted_cnt,
+                                         uint64_t *insert_wait_usec);
+
+/** Lock the AS Path Store of the view
+ *
+ * @param view          pointer to a view structure
+ *
+ * Concurrent writers must hold this lock while inserting paths into the
+ * store. Does nothing unless concurrent writers are enabled. If the store is
+ * shared with other views, their writers are not excluded.
+ */
+void bgpview_lock_as_path_store(bgpview_t *view);
+
+/** Unlock the AS Path Store of the view
+ *
+ * @param view          pointer to a view structure
+ */
+void bgpview_unlock_as_path_store(bgpview_t *view);
+
+/** Start recording which prefixes change in the view
+ *
+ * @param view          view to enable the journal for
+ *
+ * Once enabled, every prefix whose pfx-peers are added, removed, activated,
+ * deactivated or given a different AS path is recorded in the journal, until
+ * bgpview_journal_checkpoint is called. The journal may also hold prefixes
+ * that ended up unchanged (e.g. a pfx-peer that was deactivated and then
+ * activated again). Changes of user pointers are not recorded. The journal is
+ * only complete (see bgpview_journal_is_complete) once it has been
+ * checkpointed. Snapshots never have a journal.
+ */
+void bgpview_enable_journal(bgpview_t *view);
+
+/** Empty the journal of the view
+ *
+ * @param view          pointer to a view structure
+ *
+ * From now on the journal records the changes made to the view since this
+ * call, and bgpview_journal_get_checkpoint_time returns the current time of
+ * the view. Typically called once a view has been processed (and copied or
+ * snapshotted for the next diff). Does nothing if the journal is not
+ * enabled.
+ */
+void bgpview_journal_checkpoint(bgpview_t *view);
+
+/** Check whether the journal holds every change since the last checkpoint
+ *
+ * @param view          pointer to a view structure
+ * @return 1 if the journal is enabled and complete, 0 otherwise
+ *
+ * The journal is incomplete until it is first checkpointed, and after the
+ * view is cleared or a change could not be recorded (out of memory).
+ */
+int bgpview_journal_is_complete(bgpview_t *view);
+
+/** Get the time the view had when the journal was last checkpointed
+ *
+ * @param view          pointer to a view structure
+ * @return the time of the view at the last call to bgpview_journal_checkpoint
+ *
+ * Consumers that keep a copy of a previous view can compare its time with
+ * this to find out whether the journal covers exactly the changes since the
+ * copy was taken.
+ */
+uint32_t bgpview_journal_get_checkpoint_time(bgpview_t *view);
+
 /**
  * @name Simple Accessor Functions
  *
@@ -279,6 +671,18 @@ uint32_t bgpview_pfx_cnt(bgpview_t *view, uint8_t state_mask);
  */
 uint32_t bgpview_peer_cnt(bgpview_t *view, uint8_t state_mask);
 
+/** Get the number of 64-bit words needed by a bitmap of the peers of the view
+ *
+ * @param view          pointer to a view structure
+ * @return the number of words needed to hold the largest peer ID in the view
+ *
+ * Peer IDs are small dense integers, so a set of peers (e.g. the full-feed
+ * peers) can be stored as a bitmap, and tested with BGPVIEW_PEER_BITMAP_TEST
+ * instead of probing a hash set. This walks the peer table, so it should be
+ * called once per view, not once per prefix.
+ */
+int bgpview_peer_bitmap_words(bgpview_t *view);
+
 /** Get the BGP time that the view represents
  *
  * @param view          pointer to a view structure
@@ -382,6 +786,20 @@ bgpstream_peer_sig_map_t *bgpview_get_peersigns(bgpview_t *view);
 bgpstream_peer_id_t bgpview_get_peer_id(bgpview_t *view,
                                         bgpstream_peer_sig_t *ps);
 
+/** Get the amount of memory used by a view
+ *
+ * @param view          pointer to the view to measure
+ * @param[out] stats    pointer to a structure to fill with the breakdown
+ *
+ * Walks all the prefixes of the view, and all the paths of its path store, so
+ * this should not be called for every update. The sizes of the path store and
+ * of the peer signatures count the stored paths and signatures, not the
+ * internal overhead of libbgpstream. For a snapshot, only the prefix infos
+ * (and cells) that the snapshot owns are counted. The path store iterator is
+ * used, so no other thread may be iterating over the path store.
+ */
+void bgpview_get_mem_stats(bgpview_t *view, bgpview_mem_stats_t *stats);
+
 /** @} */
 
 /**
@@ -396,6 +814,34 @@ bgpstream_peer_id_t bgpview_get_peer_id(bgpview_t *view,
  */
 bgpview_iter_t *bgpview_iter_create(bgpview_t *view);
 
+/** Create a new view iterator restricted to a partition of the prefixes
+ *
+ * @param view          Pointer to the view to create iterator for
+ * @param part_idx      Index of the partition to iterate (0 to part_cnt-1)
+ * @param part_cnt      Number of partitions
+ * @return pointer to an iterator if successful, NULL otherwise
+ *
+ * The prefixes of the view are split into part_cnt disjoint partitions
+ * (of roughly the same number of hash buckets). Prefix iteration with the
+ * returned iterator (bgpview_iter_first_pfx, bgpview_iter_first_pfx_peer
+ * and the corresponding next functions) only visits the prefixes of the
+ * part_idx'th partition, and the partitions of all part_cnt iterators
+ * together cover every prefix exactly once, as long as no prefixes are added
+ * to the view in the meantime. All other functions (seek, peer iteration,
+ * getters, etc.) are not restricted to the partition.
+ *
+ * This allows a pass over a view to be split between several threads, each
+ * using its own partitioned iterator. Any number of iterators may be used
+ * concurrently on a view, from different threads, as long as only read-only
+ * functions are called: iterator movement (first/next/seek) and getters,
+ * including AS path lookups. Functions that change the view (add, remove,
+ * activate, deactivate, set_* functions, including setting user pointers)
+ * must not be called while other threads are using the view, and neither
+ * must bgpview_clear or bgpview_gc.
+ */
+bgpview_iter_t *bgpview_iter_create_partition(bgpview_t *view, int part_idx,
+                                              int part_cnt);
+
 /** Destroy the given iterator
  *
  * @param               Pointer to the iterator to destroy
@@ -498,6 +944,86 @@ int bgpview_iter_has_more_pfx(bgpview_iter_t *iter);
 int bgpview_iter_seek_pfx(bgpview_iter_t *iter, bgpstream_pfx_t *pfx,
                           uint8_t state_mask);
 
+/** Reset the prefix iterator to the first prefix that matches the mask, in
+ *  address order
+ *
+ * @param iter          Pointer to an iterator structure
+ * @param version       0 if all prefix versions should be iterated,
+ *                      otherwise BGPSTREAM_ADDR_VERSION_IPV4 or
+ *                      BGPSTREAM_ADDR_VERSION_IPV6
+ * @param state_mask    A mask that indicates the state of the pfx
+ *                      fields we iterate through
+ * @return 1 if the iterator points at an existing prefix,
+ *         0 if the end has been reached
+ *
+ * Prefixes are visited IPv4 first, then IPv6, by increasing address and then
+ * mask length. The view keeps its prefixes in a sorted index, which this
+ * function brings up to date: one pass drops the prefixes that were removed,
+ * and only the prefixes added since the last ordered iteration (or diff) are
+ * sorted and merged in. Prefixes must not be added to or removed from the view
+ * until the iteration is over (changing their state is fine). The partition of
+ * iterators from bgpview_iter_create_partition is ignored. Only
+ * bgpview_iter_next_pfx_ordered and bgpview_iter_has_more_pfx_ordered may be
+ * used to move the prefix iterator; pfx-peer iteration of the current prefix
+ * works as usual.
+ */
+int bgpview_iter_first_pfx_ordered(bgpview_iter_t *iter, int version,
+                                   uint8_t state_mask);
+
+/** Advance the provided iterator to the next prefix in address order
+ *
+ * @param iter          Pointer to an iterator structure
+ * @return 1 if the iterator points at an existing prefix,
+ *         0 if the end has been reached
+ */
+int bgpview_iter_next_pfx_ordered(bgpview_iter_t *iter);
+
+/** Check if the provided ordered iterator points at an existing prefix
+ *  or the end has been reached
+ *
+ * @param iter          Pointer to an iterator structure
+ * @return 1 if the iterator points at an existing prefix,
+ *         0 if the end has been reached
+ */
+int bgpview_iter_has_more_pfx_ordered(bgpview_iter_t *iter);
+
+/** Reset the prefix iterator to the first prefix of the journal that matches
+ *  the mask
+ *
+ * @param iter          Pointer to an iterator structure
+ * @param version       0 if all prefix versions should be iterated,
+ *                      otherwise BGPSTREAM_ADDR_VERSION_IPV4 or
+ *                      BGPSTREAM_ADDR_VERSION_IPV6
+ * @param state_mask    A mask that indicates the state of the pfx
+ *                      fields we iterate through
+ * @return 1 if the iterator points at an existing prefix,
+ *         0 if the end has been reached
+ *
+ * Only the prefixes that changed since the last bgpview_journal_checkpoint
+ * are visited (see bgpview_enable_journal), in address order. Prefixes that
+ * were removed and garbage collected since are not visited. The same
+ * restrictions as for bgpview_iter_first_pfx_ordered apply.
+ */
+int bgpview_iter_first_dirty_pfx(bgpview_iter_t *iter, int version,
+                                 uint8_t state_mask);
+
+/** Advance the provided iterator to the next prefix of the journal
+ *
+ * @param iter          Pointer to an iterator structure
+ * @return 1 if the iterator points at an existing prefix,
+ *         0 if the end has been reached
+ */
+int bgpview_iter_next_dirty_pfx(bgpview_iter_t *iter);
+
+/** Check if the provided journal iterator points at an existing prefix
+ *  or the end has been reached
+ *
+ * @param iter          Pointer to an iterator structure
+ * @return 1 if the iterator points at an existing prefix,
+ *         0 if the end has been reached
+ */
+int bgpview_iter_has_more_dirty_pfx(bgpview_iter_t *iter);
+
 /** Reset the peer iterator to the first peer (of the current
  *  prefix) that matches the mask
  *
@@ -548,6 +1074,73 @@ int bgpview_iter_pfx_has_more_peer(bgpview_iter_t *iter);
 int bgpview_iter_pfx_seek_peer(bgpview_iter_t *iter, bgpstream_peer_id_t peerid,
                                uint8_t state_mask);
 
+/** Get the peer IDs and AS path IDs of the pfx-peers of the current prefix
+ *
+ * @param iter          Pointer to an iterator structure
+ * @param state_mask    A mask that indicates the state of the pfx-peers to
+ *                      include
+ * @param peer_ids      Array to fill with the peer IDs
+ * @param path_ids      Array to fill with the AS Path Store IDs of the
+ *                      pfx-peers (may be NULL)
+ * @param max           Number of elements in peer_ids (and path_ids)
+ * @return the number of pfx-peers written to the arrays, or -1 if the prefix
+ *         has more than max matching pfx-peers
+ *
+ * This reads the cells of the prefix in a single pass instead of seeking the
+ * peer of each pfx-peer, and it also prefetches the next prefix. The
+ * pfx-peers are not returned in any particular order, and the pfx-peer
+ * iterator is not moved.
+ */
+int bgpview_iter_pfx_get_cells(bgpview_iter_t *iter, uint8_t state_mask,
+                               bgpstream_peer_id_t *peer_ids,
+                               bgpstream_as_path_store_path_id_t *path_ids,
+                               int max);
+
+/** Reset the prefix iterator to the first prefix of the current peer
+ *  that matches the IP version and the pfx_mask, and for which the
+ *  pfx-peer matches the pfx_peer_mask
+ *
+ * @param iter          Pointer to an iterator structure
+ * @param version       0 if the intention is to iterate over
+ *                      all IP versions, BGPSTREAM_ADDR_VERSION_IPV4 or
+ *                      BGPSTREAM_ADDR_VERSION_IPV6 to iterate over a
+ *                      single version
+ * @param pfx_mask      A mask that indicates the state of the
+ *                      prefixes we iterate through
+ * @param pfx_peer_mask A mask that indicates the state of the
+ *                      pfx-peers we iterate through
+ * @return 1 if the iterator points at an existing prefix,
+ *         0 if the end has been reached
+ *
+ * @note: the iterator must point at a peer. Everytime the iterator is moved
+ * to a new prefix, the pfx-peer iterator is moved to the cell of the peer
+ * for that prefix (so the pfx-peer functions can be used). If the per-peer
+ * prefix index is enabled (see bgpview_enable_peer_pfx_index), only the
+ * prefixes of the peer are visited, otherwise all the prefixes of the view
+ * are scanned. The pfx-peers of the peer may be deactivated or removed while
+ * iterating, but no pfx-peers may be added.
+ */
+int bgpview_iter_peer_first_pfx(bgpview_iter_t *iter, int version,
+                                uint8_t pfx_mask, uint8_t pfx_peer_mask);
+
+/** Advance the provided iterator to the next prefix of the peer that
+ *  matches the masks given to bgpview_iter_peer_first_pfx
+ *
+ * @param iter          Pointer to an iterator structure
+ * @return 1 if the iterator points at an existing prefix,
+ *         0 if the end has been reached
+ */
+int bgpview_iter_peer_next_pfx(bgpview_iter_t *iter);
+
+/** Check if the provided iterator points at an existing prefix of the peer
+ *  or the end has been reached
+ *
+ * @param iter          Pointer to an iterator structure
+ * @return 1 if the iterator points at an existing prefix,
+ *         0 if the end has been reached
+ */
+int bgpview_iter_peer_has_more_pfx(bgpview_iter_t *iter);
+
 /** Reset the peer iterator to the first peer that matches the
  *  the peer mask for the first pfx that matches the IP version
  *  and the pfx_mask
@@ -639,6 +1232,29 @@ bgpstream_peer_id_t bgpview_iter_add_peer(bgpview_iter_t *iter,
                                           bgpstream_ip_addr_t *peer_address,
                                           uint32_t peer_asnumber);
 
+/** Lock a prefix row for update by a concurrent writer
+ *
+ * @param iter             pointer to a view iterator
+ * @param pfx              pointer to the prefix to lock
+ * @return 0 if successful, -1 otherwise
+ *
+ * Does nothing unless concurrent writers are enabled for the view (see
+ * bgpview_enable_concurrent_writers). Otherwise, the prefix is inserted
+ * (invalid) if the view does not have it yet, which waits for all the other
+ * writers to unlock their rows, and the calling thread then waits until no
+ * other writer holds the shard of the prefix. Until
+ * bgpview_iter_unlock_pfx is called, the iterator may be used to add, remove,
+ * activate and deactivate the prefix and its pfx-peers (for peers that
+ * already exist), and must not be used for anything else.
+ */
+int bgpview_iter_lock_pfx(bgpview_iter_t *iter, bgpstream_pfx_t *pfx);
+
+/** Unlock the prefix row locked by bgpview_iter_lock_pfx
+ *
+ * @param iter             pointer to the iterator that locked the row
+ */
+void bgpview_iter_unlock_pfx(bgpview_iter_t *iter);
+
 /** Remove the current peer from the BGPView
  *
  * @param iter             pointer to a view iterator
@@ -747,6 +1363,34 @@ int bgpview_iter_pfx_add_peer_by_id(bgpview_iter_t *iter,
                                     bgpstream_peer_id_t peer_id,
                                     bgpstream_as_path_store_path_id_t path_id);
 
+/** Insert (and optionally activate) a whole row of pfx-peers at once
+ *
+ * @param iter          pointer to a view iterator
+ * @param pfx           pointer to the prefix
+ * @param peer_ids      array of peer identifiers
+ * @param path_ids      array of AS Path IDs, one for each peer in peer_ids
+ * @param peers_cnt     number of elements in peer_ids and path_ids
+ * @param state         BGPVIEW_FIELD_ACTIVE to activate the pfx-peers, or
+ *                      BGPVIEW_FIELD_INACTIVE to only insert them
+ * @return 0 if the pfx-peers were inserted successfully, -1 otherwise
+ *
+ * This is equivalent to calling bgpview_iter_add_pfx_peer_by_id for the first
+ * peer, bgpview_iter_pfx_add_peer_by_id for the others (and
+ * bgpview_iter_pfx_activate_peer for each one if state is
+ * BGPVIEW_FIELD_ACTIVE), but the cell table of the prefix is sized once for
+ * the whole row and the prefix counters are updated once. It is intended for
+ * readers that decode complete rows (e.g. the file, Kafka and ZMQ readers).
+ *
+ * The peers must already exist, and must be active if state is
+ * BGPVIEW_FIELD_ACTIVE. Pfx-peers that already exist get the new path, and
+ * are never deactivated. On return the iterator points to the prefix, but not
+ * to any of its pfx-peers.
+ */
+int bgpview_iter_add_pfx_row(bgpview_iter_t *iter, bgpstream_pfx_t *pfx,
+                             bgpstream_peer_id_t *peer_ids,
+                             bgpstream_as_path_store_path_id_t *path_ids,
+                             int peers_cnt, bgpview_field_state_t state);
+
 /** Remove the current peer from the current prefix currently referenced by the
  * given iterator
  *
@@ -917,6 +1561,23 @@ bgpstream_as_path_t *bgpview_iter_pfx_peer_get_as_path(bgpview_iter_t *iter);
 bgpstream_as_path_seg_t *
 bgpview_iter_pfx_peer_get_origin_seg(bgpview_iter_t *iter);
 
+/** Get the origin ASN for the current pfx-peer structure pointed by the
+ *  given iterator
+ *
+ * @param iter          Pointer to an iterator structure
+ * @return the origin ASN, or 0 if the origin segment is not a simple ASN
+ *         (e.g. an AS set)
+ */
+uint32_t bgpview_iter_pfx_peer_get_origin_asn(bgpview_iter_t *iter);
+
+/** Get the number of segments in the AS path of the current pfx-peer
+ *  structure pointed by the given iterator
+ *
+ * @param iter          Pointer to an iterator structure
+ * @return the number of segments in the AS path
+ */
+int bgpview_iter_pfx_peer_get_as_path_len(bgpview_iter_t *iter);
+
 /** Get the AS Path Store Path for the current pfx-peer structure pointed at by
  * the given iterator
  *
@@ -1083,4 +1744,427 @@ int bgpview_iter_pfx_deactivate_peer(bgpview_iter_t *iter);
 
 /** @} */
 
+/**
+ * @name Frozen View Functions
+ *
+ * A frozen view is a compact, immutable copy of the active prefixes and
+ * pfx-peers of a view, stored in compressed-sparse-row form: prefixes are
+ * sorted by address (IPv4 first), and the active cells of each prefix are
+ * stored contiguously as arrays of peer IDs, path IDs and origin ASNs. It is
+ * intended for consumers that make several read-only passes over a view.
+ *
+ * A frozen view can also be written out as a position-independent image (see
+ * bgpview_frozen_write), made of offset-based arrays that are used in place
+ * by bgpview_frozen_map, e.g. directly from a memory-mapped file. A mapped
+ * view has no AS Path Store: the paths are stored in the image, and are
+ * obtained using bgpview_frozen_iter_pfx_peer_get_as_path.
+ *
+ * @{ */
+
+/** Create a frozen snapshot of the given view
+ *
+ * @param view          pointer to the view to freeze
+ * @return pointer to the frozen view if successful, NULL otherwise
+ *
+ * Only active prefixes and active pfx-peers are included. The snapshot does
+ * not reflect subsequent changes to the view, but it references the AS Path
+ * Store of the view, which must therefore outlive the snapshot.
+ */
+bgpview_frozen_t *bgpview_freeze(bgpview_t *view);
+
+/** Destroy the given frozen view
+ *
+ * @param frozen        pointer to the frozen view to destroy
+ *
+ * The buffer that a mapped view was created from is not released.
+ */
+void bgpview_frozen_destroy(bgpview_frozen_t *frozen);
+
+/** Write the image of the given frozen view
+ *
+ * @param frozen        pointer to the frozen view to write
+ * @param cb            callback used to output the image
+ * @param user          user pointer passed to the callback
+ * @return the length of the image if successful, -1 otherwise
+ *
+ * The image holds the peer signatures, the prefixes, the cells and the AS
+ * paths referenced by the cells (but not the other paths of the store), in
+ * host byte order. Its length is a multiple of 8
+ * bytes, so images can be written one after the other (e.g. to the same
+ * file) and still be mapped in place.
+ */
+int64_t bgpview_frozen_write(bgpview_frozen_t *frozen,
+                             bgpview_frozen_write_cb_t *cb, void *user);
+
+/** Create a frozen view that uses the given image in place
+ *
+ * @param buf           pointer to the image (aligned to 8 bytes)
+ * @param len           number of bytes available at buf
+ * @param[out] image_len set to the length of the image (may be NULL)
+ * @return pointer to the frozen view if successful, NULL if buf does not
+ * start with a valid image
+ *
+ * The header is checked, and every cell is checked to reference a valid
+ * peer and path, so that a corrupt image cannot make the iterators read
+ * outside of it. This takes a single pass over the cells, but nothing is
+ * copied. The buffer must not be modified or released until the frozen view
+ * is destroyed.
+ */
+bgpview_frozen_t *bgpview_frozen_map(const void *buf, uint64_t len,
+                                     uint64_t *image_len);
+
+/** Get the BGP time of the view the snapshot was created from
+ *
+ * @param frozen        pointer to a frozen view
+ * @return the BGP time of the frozen view
+ */
+uint32_t bgpview_frozen_get_time(bgpview_frozen_t *frozen);
+
+/** Get the number of prefixes in the frozen view
+ *
+ * @param frozen        pointer to a frozen view
+ * @return the number of prefixes in the frozen view
+ */
+uint32_t bgpview_frozen_pfx_cnt(bgpview_frozen_t *frozen);
+
+/** Get the number of pfx-peer cells in the frozen view
+ *
+ * @param frozen        pointer to a frozen view
+ * @return the number of pfx-peer cells in the frozen view
+ */
+uint32_t bgpview_frozen_cell_cnt(bgpview_frozen_t *frozen);
+
+/** Get the number of peer IDs of the frozen view
+ *
+ * @param frozen        pointer to a frozen view
+ * @return one more than the largest peer ID of the frozen view
+ */
+uint32_t bgpview_frozen_peer_id_cnt(bgpview_frozen_t *frozen);
+
+/** Get the signature of the given peer of the frozen view
+ *
+ * @param frozen        pointer to a frozen view
+ * @param peer_id       ID of the peer
+ * @return borrowed pointer to the peer signature, NULL if no peer of the view
+ * has this ID
+ */
+bgpstream_peer_sig_t *bgpview_frozen_get_peer_sig(bgpview_frozen_t *frozen,
+                                                  bgpstream_peer_id_t peer_id);
+
+/** Get the number of paths of a mapped frozen view
+ *
+ * @param frozen        pointer to a mapped frozen view
+ * @return the number of paths in the image of the view (0 if the view is not
+ * a mapped view)
+ */
+uint32_t bgpview_frozen_path_cnt(bgpview_frozen_t *frozen);
+
+/** Create a new frozen view iterator
+ *
+ * @param frozen        pointer to the frozen view to iterate over
+ * @return pointer to the iterator if successful, NULL otherwise
+ */
+bgpview_frozen_iter_t *bgpview_frozen_iter_create(bgpview_frozen_t *frozen);
+
+/** Destroy the given frozen view iterator
+ *
+ * @param iter          pointer to the iterator to destroy
+ */
+void bgpview_frozen_iter_destroy(bgpview_frozen_iter_t *iter);
+
+/** Reset the prefix iterator to the first prefix (in address order)
+ *
+ * @param iter          pointer to a frozen view iterator
+ * @return 0 if there are no prefixes in the frozen view, 1 otherwise
+ */
+int bgpview_frozen_iter_first_pfx(bgpview_frozen_iter_t *iter);
+
+/** Advance the iterator to the next prefix
+ *
+ * @param iter          pointer to a frozen view iterator
+ * @return 0 if the iterator has reached the end of the prefixes, 1 otherwise
+ */
+int bgpview_frozen_iter_next_pfx(bgpview_frozen_iter_t *iter);
+
+/** Check if the iterator points to a valid prefix
+ *
+ * @param iter          pointer to a frozen view iterator
+ * @return 0 if the iterator has reached the end of the prefixes, 1 otherwise
+ */
+int bgpview_frozen_iter_has_more_pfx(bgpview_frozen_iter_t *iter);
+
+/** Get the current prefix
+ *
+ * @param iter          pointer to a frozen view iterator
+ * @return pointer to the current prefix
+ */
+bgpstream_pfx_t *bgpview_frozen_iter_pfx_get_pfx(bgpview_frozen_iter_t *iter);
+
+/** Get the cell arrays of the current prefix
+ *
+ * @param iter          pointer to a frozen view iterator
+ * @param[out] peer_ids    set to the array of peer IDs (may be NULL)
+ * @param[out] path_ids    set to the array of AS Path Store IDs (may be NULL)
+ * @param[out] origin_asns set to the array of origin ASNs (may be NULL)
+ * @return the number of cells (i.e. peers) of the current prefix
+ *
+ * The arrays are parallel and owned by the frozen view. Cells are ordered by
+ * peer ID only if the source view used the sorted cell layout. An origin ASN
+ * of 0 indicates that the origin segment is not a simple ASN (e.g. an AS set)
+ * and must be obtained from the AS path. A mapped view has no AS Path Store
+ * IDs, so path_ids is set to NULL.
+ */
+int bgpview_frozen_iter_pfx_get_cells(
+  bgpview_frozen_iter_t *iter, bgpstream_peer_id_t **peer_ids,
+  bgpstream_as_path_store_path_id_t **path_ids, uint32_t **origin_asns);
+
+/** Reset the peer iterator to the first peer of the current prefix
+ *
+ * @param iter          pointer to a frozen view iterator
+ * @return 0 if the current prefix has no peers, 1 otherwise
+ */
+int bgpview_frozen_iter_pfx_first_peer(bgpview_frozen_iter_t *iter);
+
+/** Advance the iterator to the next peer of the current prefix
+ *
+ * @param iter          pointer to a frozen view iterator
+ * @return 0 if the iterator has reached the end of the peers, 1 otherwise
+ */
+int bgpview_frozen_iter_pfx_next_peer(bgpview_frozen_iter_t *iter);
+
+/** Check if the iterator points to a valid peer of the current prefix
+ *
+ * @param iter          pointer to a frozen view iterator
+ * @return 0 if the iterator has reached the end of the peers, 1 otherwise
+ */
+int bgpview_frozen_iter_pfx_has_more_peer(bgpview_frozen_iter_t *iter);
+
+/** Get the peer ID of the current pfx-peer
+ *
+ * @param iter          pointer to a frozen view iterator
+ * @return the peer ID of the current pfx-peer
+ */
+bgpstream_peer_id_t
+bgpview_frozen_iter_pfx_peer_get_peer_id(bgpview_frozen_iter_t *iter);
+
+/** Get the signature of the peer of the current pfx-peer
+ *
+ * @param iter          pointer to a frozen view iterator
+ * @return borrowed pointer to the peer signature, NULL if it is unknown
+ */
+bgpstream_peer_sig_t *
+bgpview_frozen_iter_pfx_peer_get_sig(bgpview_frozen_iter_t *iter);
+
+/** Get the AS Path Store ID of the current pfx-peer
+ *
+ * @param iter          pointer to a frozen view iterator
+ * @return the AS Path Store ID of the current pfx-peer
+ *
+ * Must not be used with a mapped view.
+ */
+bgpstream_as_path_store_path_id_t
+bgpview_frozen_iter_pfx_peer_get_as_path_store_path_id(
+  bgpview_frozen_iter_t *iter);
+
+/** Get the AS Path Store path of the current pfx-peer
+ *
+ * @param iter          pointer to a frozen view iterator
+ * @return borrowed pointer to the store path of the current pfx-peer, NULL
+ * if the view is a mapped view
+ */
+bgpstream_as_path_store_path_t *
+bgpview_frozen_iter_pfx_peer_get_as_path_store_path(
+  bgpview_frozen_iter_t *iter);
+
+/** Get the AS path of the current pfx-peer
+ *
+ * @param iter          pointer to a frozen view iterator
+ * @return pointer to a new AS path that the caller must destroy, NULL if an
+ * error occurred
+ */
+bgpstream_as_path_t *
+bgpview_frozen_iter_pfx_peer_get_as_path(bgpview_frozen_iter_t *iter);
+
+/** Get the origin ASN of the current pfx-peer
+ *
+ * @param iter          pointer to a frozen view iterator
+ * @return the origin ASN, or 0 if the origin is not a simple ASN
+ */
+uint32_t bgpview_frozen_iter_pfx_peer_get_origin_asn(bgpview_frozen_iter_t *iter);
+
+/** Get the index of the path of the current pfx-peer in a mapped view
+ *
+ * @param iter          pointer to a frozen view iterator
+ * @return the index of the path in the image (less than
+ * bgpview_frozen_path_cnt)
+ *
+ * Cells that share a path share its index, so it can be used to convert each
+ * path only once. Must only be used with a mapped view.
+ */
+uint32_t bgpview_frozen_iter_pfx_peer_get_path_idx(bgpview_frozen_iter_t *iter);
+
+/** @} */
+
+/**
+ * @name View Publication Functions
+ *
+ * A publisher allows the thread that updates a view to periodically publish
+ * immutable versions of it, which other threads read without taking any
+ * lock. Each version is a self-contained frozen view (it does not reference
+ * the AS Path Store of the view, so paths are obtained using
+ * bgpview_frozen_iter_pfx_peer_get_as_path).
+ *
+ * Replaced versions are reclaimed using epochs: each reader announces the
+ * epoch it acquired a version in, and a replaced version is freed (during a
+ * later publication) once no reader that may still hold it remains.
+ *
+ * Building a version takes time proportional to the size of the view, so
+ * bgpview_pub_publish_start and bgpview_pub_publish_step allow the thread
+ * that updates the view to build it in small steps, between updates.
+ *
+ * @{ */
+
+/** Create a new publisher
+ *
+ * @return pointer to the publisher if successful, NULL otherwise
+ */
+bgpview_pub_t *bgpview_pub_create(void);
+
+/** Destroy the given publisher and all its versions
+ *
+ * @param pub           pointer to the publisher to destroy
+ *
+ * No reader may be using the publisher anymore.
+ */
+void bgpview_pub_destroy(bgpview_pub_t *pub);
+
+/** Publish a new version of the given view
+ *
+ * @param pub           pointer to the publisher
+ * @param view          pointer to the view to publish
+ * @return 0 if the version was published, -1 otherwise
+ *
+ * Only one thread (usually the one that updates the view) may publish
+ * versions. The view is not modified, and is only read during the call. A
+ * version being built in steps is abandoned.
+ */
+int bgpview_pub_publish(bgpview_pub_t *pub, bgpview_t *view);
+
+/** Start publishing a new version of the given view in steps
+ *
+ * @param pub           pointer to the publisher
+ * @param view          pointer to the view to publish (not a snapshot)
+ * @return 0 if the publication was started, -1 otherwise
+ *
+ * The version is built from a snapshot of the view (see
+ * bgpview_snapshot_create) that the publisher keeps between publications,
+ * so starting a publication only costs a copy of the prefix tables, and the
+ * view may be updated while the version is being built. The version is
+ * published by the last of the following calls to bgpview_pub_publish_step.
+ * A version being built is abandoned.
+ */
+int bgpview_pub_publish_start(bgpview_pub_t *pub, bgpview_t *view);
+
+/** Continue building the version started by bgpview_pub_publish_start
+ *
+ * @param pub           pointer to the publisher
+ * @param budget        maximum number of prefixes to process (no limit if
+ *                      not positive)
+ * @return 1 if the version was completed and published, 0 if it was not (or
+ * no version is being built), -1 if an error occurred
+ *
+ * Must be called by the thread that started the publication. Once the
+ * prefixes are frozen, the version is completed by copying the frozen arrays
+ * into its image, which does not depend on the budget.
+ */
+int bgpview_pub_publish_step(bgpview_pub_t *pub, int budget);
+
+/** Register a reader with the given publisher
+ *
+ * @param pub           pointer to the publisher
+ * @return pointer to the reader if successful, NULL otherwise
+ *
+ * A reader must only be used by a single thread.
+ */
+bgpview_pub_reader_t *bgpview_pub_reader_create(bgpview_pub_t *pub);
+
+/** Unregister and destroy the given reader
+ *
+ * @param reader        pointer to the reader to destroy
+ *
+ * The reader must not hold a version.
+ */
+void bgpview_pub_reader_destroy(bgpview_pub_reader_t *reader);
+
+/** Acquire the most recently published version
+ *
+ * @param reader        pointer to the reader
+ * @return pointer to the version, or NULL if none has been published yet
+ *
+ * The version remains valid until bgpview_pub_reader_release is called, and
+ * must not be destroyed by the caller. A reader holds at most one version at
+ * a time. Holding a version for a long time delays the reclamation of the
+ * versions published in the meantime.
+ */
+bgpview_frozen_t *bgpview_pub_reader_acquire(bgpview_pub_reader_t *reader);
+
+/** Release the version acquired by the given reader
+ *
+ * @param reader        pointer to the reader
+ *
+ * This must also be called if bgpview_pub_reader_acquire returned NULL.
+ */
+void bgpview_pub_reader_release(bgpview_pub_reader_t *reader);
+
+/** @} */
+
+/**
+ * @name View Diff Functions
+ *
+ * @{ */
+
+/** Compute the differences between two views
+ *
+ * @param a             pointer to the first (e.g. the older) view
+ * @param b             pointer to the second (e.g. the newer) view
+ * @param cbs           callbacks to invoke for each difference
+ * @param user          user pointer passed to the callbacks
+ * @return 0 if the diff completed, -1 if an error occurred or a callback
+ *         aborted the diff
+ *
+ * Walks the active prefixes of both views in address order, in a single
+ * linear merge of the sorted prefix indexes of the views (see
+ * bgpview_iter_first_pfx_ordered) rather than one lookup per prefix. Cells
+ * are only compared if a cell callback or pfx_changed is set; if both views
+ * use BGPVIEW_CELL_LAYOUT_SORTED the cells are merged, otherwise they are
+ * looked up by peer ID. Cells are compared by peer ID and AS Path Store path
+ * ID, so when cells are compared the views must share their peer IDs and
+ * path store (e.g. created with bgpview_create_shared, bgpview_dup or
+ * bgpview_snapshot_create). The views must not be modified during the diff.
+ */
+int bgpview_diff(bgpview_t *a, bgpview_t *b, bgpview_diff_cbs_t *cbs,
+                 void *user);
+
+/** Compute the differences between a view and its state at the last journal
+ *  checkpoint
+ *
+ * @param a             pointer to a copy of b taken at the last checkpoint
+ * @param b             pointer to a view with a complete journal
+ * @param cbs           callbacks to invoke for each difference
+ * @param user          user pointer passed to the callbacks
+ * @return 0 if the diff completed, -1 if an error occurred, the journal of b
+ *         is not complete, or a callback aborted the diff
+ *
+ * Same as bgpview_diff, except that only the prefixes in the journal of b are
+ * compared, so a must hold the same prefixes as b did when
+ * bgpview_journal_checkpoint was last called for b (e.g. a snapshot updated
+ * at that time, which callers can check using
+ * bgpview_journal_get_checkpoint_time). pfx_common is only called for
+ * prefixes in the journal.
+ */
+int bgpview_diff_journal(bgpview_t *a, bgpview_t *b, bgpview_diff_cbs_t *cbs,
+                         void *user);
+
+/** @} */
+
 #endif /* __BGPVIEW_H */
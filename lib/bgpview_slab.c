@@ -0,0 +1,261 @@
+/*
+ * Copyright (C) 2014 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bgpview_slab.h"
+#include "config.h"
+#include "utils.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+
+/* objects are rounded up to a multiple of the pointer size so that they are
+   aligned and a free object can hold the free list link */
+#define OBJ_ALIGN (sizeof(void *))
+
+/* number of slab pointers to grow the slab list by */
+#define SLABS_ALLOC_STEP 16
+
+/** Link stored inside free objects */
+typedef struct slab_free_obj {
+  struct slab_free_obj *next;
+} slab_free_obj_t;
+
+struct bgpview_slab {
+
+  /** Size of each object */
+  size_t obj_size;
+
+  /** Number of objects per slab */
+  size_t objs_per_slab;
+
+  /** Number of bytes allocated for each slab */
+  size_t slab_len;
+
+  /** Are the slabs mapped (rather than malloc'd) huge pages? */
+  int huge_pages;
+
+  /** Array of slabs */
+  uint8_t **slabs;
+
+  /** Number of slabs allocated */
+  int slabs_cnt;
+
+  /** Number of slab pointers allocated */
+  int slabs_alloc_cnt;
+
+  /** Index of the slab currently used for bump allocation */
+  int cur_slab;
+
+  /** Number of objects handed out from the current slab */
+  size_t cur_obj;
+
+  /** List of freed objects available for reuse */
+  slab_free_obj_t *free_list;
+
+  /** Number of objects currently allocated */
+  size_t used_cnt;
+};
+
+/* map len bytes (a multiple of the huge page size), preferably from the
+   reserved huge pages */
+static void *huge_pages_map(size_t len)
+{
+  void *p;
+
+#ifdef MAP_HUGETLB
+  if ((p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0)) !=
+      MAP_FAILED) {
+    return p;
+  }
+#endif
+
+  /* no huge pages are reserved, fall back to transparent huge pages */
+  if ((p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                -1, 0)) == MAP_FAILED) {
+    return NULL;
+  }
+  bgpview_slab_advise_huge_pages(p, len);
+  return p;
+}
+
+static int add_slab(bgpview_slab_t *slab)
+{
+  uint8_t **tmp;
+
+  if (slab->slabs_cnt == slab->slabs_alloc_cnt) {
+    if ((tmp = realloc(slab->slabs,
+                       sizeof(uint8_t *) *
+                         (slab->slabs_alloc_cnt + SLABS_ALLOC_STEP))) ==
+        NULL) {
+      return -1;
+    }
+    slab->slabs = tmp;
+    slab->slabs_alloc_cnt += SLABS_ALLOC_STEP;
+  }
+
+  if (slab->huge_pages != 0) {
+    slab->slabs[slab->slabs_cnt] = huge_pages_map(slab->slab_len);
+  } else {
+    slab->slabs[slab->slabs_cnt] = malloc(slab->slab_len);
+  }
+  if (slab->slabs[slab->slabs_cnt] == NULL) {
+    return -1;
+  }
+  slab->slabs_cnt++;
+
+  return 0;
+}
+
+bgpview_slab_t *bgpview_slab_create(size_t obj_size, size_t slab_size)
+{
+  bgpview_slab_t *slab;
+
+  if ((slab = malloc_zero(sizeof(bgpview_slab_t))) == NULL) {
+    return NULL;
+  }
+
+  if (obj_size == 0) {
+    obj_size = 1;
+  }
+  slab->obj_size = (obj_size + OBJ_ALIGN - 1) & ~(OBJ_ALIGN - 1);
+  slab->objs_per_slab = slab_size / slab->obj_size;
+  if (slab->objs_per_slab == 0) {
+    slab->objs_per_slab = 1;
+  }
+  slab->slab_len = slab->obj_size * slab->objs_per_slab;
+
+  /* slabs are allocated on demand */
+  slab->cur_obj = slab->objs_per_slab;
+  slab->cur_slab = -1;
+
+  return slab;
+}
+
+int bgpview_slab_enable_huge_pages(bgpview_slab_t *slab)
+{
+  if (slab->slabs_cnt > 0) {
+    return -1;
+  }
+
+  slab->huge_pages = 1;
+  slab->slab_len = (slab->slab_len + BGPVIEW_SLAB_HUGE_PAGE_SIZE - 1) &
+                   ~((size_t)BGPVIEW_SLAB_HUGE_PAGE_SIZE - 1);
+  slab->objs_per_slab = slab->slab_len / slab->obj_size;
+  slab->cur_obj = slab->objs_per_slab;
+  return 0;
+}
+
+void bgpview_slab_advise_huge_pages(void *ptr, size_t len)
+{
+#ifdef MADV_HUGEPAGE
+  uintptr_t start = ((uintptr_t)ptr + BGPVIEW_SLAB_HUGE_PAGE_SIZE - 1) &
+                    ~((uintptr_t)BGPVIEW_SLAB_HUGE_PAGE_SIZE - 1);
+  uintptr_t end =
+    ((uintptr_t)ptr + len) & ~((uintptr_t)BGPVIEW_SLAB_HUGE_PAGE_SIZE - 1);
+
+  /* this is only a hint, so failures are ignored */
+  if (end > start) {
+    madvise((void *)start, end - start, MADV_HUGEPAGE);
+  }
+#endif
+}
+
+void bgpview_slab_destroy(bgpview_slab_t *slab)
+{
+  int i;
+
+  if (slab == NULL) {
+    return;
+  }
+
+  for (i = 0; i < slab->slabs_cnt; i++) {
+    if (slab->huge_pages != 0) {
+      munmap(slab->slabs[i], slab->slab_len);
+    } else {
+      free(slab->slabs[i]);
+    }
+  }
+  free(slab->slabs);
+  slab->slabs = NULL;
+
+  free(slab);
+}
+
+void *bgpview_slab_alloc(bgpview_slab_t *slab)
+{
+  void *obj;
+
+  /* prefer recycled objects */
+  if (slab->free_list != NULL) {
+    obj = slab->free_list;
+    slab->free_list = slab->free_list->next;
+    slab->used_cnt++;
+    return obj;
+  }
+
+  if (slab->cur_obj == slab->objs_per_slab) {
+    /* current slab is full, move on to the next (possibly new) one */
+    if (slab->cur_slab + 1 == slab->slabs_cnt && add_slab(slab) != 0) {
+      return NULL;
+    }
+    slab->cur_slab++;
+    slab->cur_obj = 0;
+  }
+
+  obj = slab->slabs[slab->cur_slab] + (slab->cur_obj * slab->obj_size);
+  slab->cur_obj++;
+  slab->used_cnt++;
+  return obj;
+}
+
+void bgpview_slab_free(bgpview_slab_t *slab, void *obj)
+{
+  slab_free_obj_t *fo = obj;
+
+  if (obj == NULL) {
+    return;
+  }
+
+  fo->next = slab->free_list;
+  slab->free_list = fo;
+  slab->used_cnt--;
+}
+
+void bgpview_slab_reset(bgpview_slab_t *slab)
+{
+  slab->free_list = NULL;
+  slab->used_cnt = 0;
+  slab->cur_slab = -1;
+  slab->cur_obj = slab->objs_per_slab;
+}
+
+void bgpview_slab_get_mem(bgpview_slab_t *slab, size_t *used, size_t *total)
+{
+  *used = slab->used_cnt * slab->obj_size;
+  *total = sizeof(bgpview_slab_t) + sizeof(uint8_t *) * slab->slabs_alloc_cnt +
+           slab->slabs_cnt * slab->slab_len;
+}
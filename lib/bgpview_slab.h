@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2014 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __BGPVIEW_SLAB_H
+#define __BGPVIEW_SLAB_H
+
+#include <stddef.h>
+
+/** @file
+ *
+ * @brief Private fixed-size object allocator used by bgpview to allocate
+ * prefix info structures and pfx-peer cell arrays in bulk.
+ *
+ * Objects are carved out of large slabs. Freed objects are kept on a free
+ * list and handed back by subsequent allocations, and all objects can be
+ * released at once by resetting (or destroying) the allocator, which costs
+ * O(number of slabs) rather than one free per object.
+ */
+
+/** Size of the huge pages that slabs are rounded up to (see
+ *  bgpview_slab_enable_huge_pages) */
+#define BGPVIEW_SLAB_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+/** Opaque handle for a slab allocator */
+typedef struct bgpview_slab bgpview_slab_t;
+
+/** Create a new slab allocator
+ *
+ * @param obj_size      size (in bytes) of each object
+ * @param slab_size     minimum size (in bytes) of each slab
+ * @return pointer to the allocator if successful, NULL otherwise
+ *
+ * Each slab holds as many objects as fit in slab_size (at least one).
+ */
+bgpview_slab_t *bgpview_slab_create(size_t obj_size, size_t slab_size);
+
+/** Back the slabs of the given allocator with huge pages
+ *
+ * @param slab          pointer to an allocator that has no slabs yet
+ * @return 0 if successful, -1 if the allocator already has slabs
+ *
+ * Slabs are rounded up to a multiple of BGPVIEW_SLAB_HUGE_PAGE_SIZE and
+ * mapped from the reserved huge pages (MAP_HUGETLB). If none are available,
+ * normal pages are mapped instead, and the kernel is asked to back them with
+ * transparent huge pages.
+ */
+int bgpview_slab_enable_huge_pages(bgpview_slab_t *slab);
+
+/** Ask the kernel to back the given memory with transparent huge pages
+ *
+ * @param ptr           pointer to the memory
+ * @param len           length of the memory
+ *
+ * Only the huge pages that fit entirely in the memory are affected. Does
+ * nothing if transparent huge pages are not supported.
+ */
+void bgpview_slab_advise_huge_pages(void *ptr, size_t len);
+
+/** Destroy the given slab allocator and all memory it owns
+ *
+ * @param slab          pointer to the allocator to destroy
+ */
+void bgpview_slab_destroy(bgpview_slab_t *slab);
+
+/** Allocate an (uninitialized) object
+ *
+ * @param slab          pointer to the allocator
+ * @return pointer to the object if successful, NULL otherwise
+ */
+void *bgpview_slab_alloc(bgpview_slab_t *slab);
+
+/** Return an object to the allocator so that it can be recycled
+ *
+ * @param slab          pointer to the allocator the object came from
+ * @param obj           pointer to the object to free
+ */
+void bgpview_slab_free(bgpview_slab_t *slab, void *obj);
+
+/** Release all objects at once
+ *
+ * @param slab          pointer to the allocator to reset
+ *
+ * All objects previously allocated become invalid. The slabs themselves are
+ * retained and will be reused by subsequent allocations.
+ */
+void bgpview_slab_reset(bgpview_slab_t *slab);
+
+/** Get the memory used by the allocator
+ *
+ * @param slab          pointer to the allocator
+ * @param[out] used     set to the number of bytes of objects in use
+ * @param[out] total    set to the number of bytes owned by the allocator
+ *                      (including free objects and bookkeeping)
+ */
+void bgpview_slab_get_mem(bgpview_slab_t *slab, size_t *used, size_t *total);
+
+#endif /* __BGPVIEW_SLAB_H */
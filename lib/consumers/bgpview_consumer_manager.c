@@ -272,6 +272,7 @@ static int init_bvc_chain_state(bgpview_consumer_manager_t *mgr)
 
   for (i = 0; i < BGPSTREAM_MAX_IP_VERSION_IDX; i++) {
     mgr->chain_state.full_feed_peer_ids[i] = bgpstream_id_set_create();
+    mgr->chain_state.full_feed_peer_bitmap[i] = NULL;
     mgr->chain_state.peer_ids_cnt[i] = 0;
     mgr->chain_state.full_feed_peer_asns_cnt[i] = 0;
     mgr->chain_state.usable_table_flag[i] = 0;
@@ -287,6 +288,8 @@ static void destroy_bvc_chain_state(bgpview_consumer_manager_t *mgr)
       bgpstream_id_set_destroy(mgr->chain_state.full_feed_peer_ids[i]);
       mgr->chain_state.full_feed_peer_ids[i] = NULL;
     }
+    free(mgr->chain_state.full_feed_peer_bitmap[i]);
+    mgr->chain_state.full_feed_peer_bitmap[i] = NULL;
   }
 }
 
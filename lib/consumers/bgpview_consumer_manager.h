@@ -89,6 +89,13 @@ typedef struct bvc_chain_state {
   /* Set of full feed peers */
   bgpstream_id_set_t *full_feed_peer_ids[BGPSTREAM_MAX_IP_VERSION_IDX];
 
+  /** Full feed peers as a bitmap indexed by peer ID (see
+      BGPVIEW_PEER_BITMAP_TEST) */
+  uint64_t *full_feed_peer_bitmap[BGPSTREAM_MAX_IP_VERSION_IDX];
+
+  /** Number of 64-bit words in each full_feed_peer_bitmap */
+  int peer_bitmap_words;
+
   /** Total number of full feed peer ASns in the view */
   uint32_t full_feed_peer_asns_cnt[BGPSTREAM_MAX_IP_VERSION_IDX];
 
@@ -56,7 +56,7 @@
 static bvc_t bvc_archiver = {BVC_ID_ARCHIVER, NAME,
                              BVC_GENERATE_PTRS(archiver)};
 
-enum format { BINARY, ASCII };
+enum format { BINARY, ASCII, IMAGE, BINARY_V2, BINARY_V3 };
 
 typedef struct bvc_archiver_state {
 
@@ -72,7 +72,20 @@ typedef struct bvc_archiver_state {
   /** Current output file */
   iow_t *outfile;
 
-  /** Output format (binary or ascii) */
+  /** Write an index of the views alongside each output file */
+  int write_index;
+
+  /** Index of the current output file */
+  iow_t *idxfile;
+
+  /** Number of bytes written to the current output file */
+  uint64_t outfile_offset;
+
+  /** Compression level of each view of the current output file (-1 if the
+      file is compressed as a whole, or not at all) */
+  int view_compress_level;
+
+  /** Output format (binary, ascii, image, binary-v2 or binary-v3) */
   enum format output_format;
 
   /** Filename to use for the 'latest file' file */
@@ -108,8 +121,16 @@ static void usage(bvc_t *consumer)
     "       -l <filename> file to write the filename of the latest complete "
     "output file to\n"
     "       -c <level>    output compression level to use (default: %d)\n"
-    "       -m <mode>     output mode: 'ascii' or 'binary' (default: "
-    "binary)\n",
+    "       -i            write an index of the views alongside each binary "
+    "output file\n"
+    "                       gzip files are then written one view at a time, "
+    "so that they can be seeked\n"
+    "       -m <mode>     output mode: 'ascii', 'binary', 'binary-v2', "
+    "'binary-v3' or 'image' (default: binary)\n"
+    "                       binary-v2 uses the compact prefix row encoding\n"
+    "                       binary-v3 also writes a dictionary of peer sets\n"
+    "                       image files are never compressed, so that they "
+    "can be mapped\n",
     consumer->name, BVCU_DEFAULT_COMPRESS_LEVEL);
 }
 
@@ -151,6 +172,11 @@ static int complete_file(bvc_t *consumer)
   wandio_wdestroy(state->outfile);
   state->outfile = NULL;
 
+  if (state->idxfile != NULL) {
+    wandio_wdestroy(state->idxfile);
+    state->idxfile = NULL;
+  }
+
   /* now write the name of that file to the latest file */
   if (state->latest_filename == NULL) {
     return 0;
@@ -243,7 +269,7 @@ static int parse_args(bvc_t *consumer, int argc, char **argv)
   optind = 1;
 
   /* remember the argv strings DO NOT belong to us */
-  while ((opt = getopt(argc, argv, ":c:f:l:m:r:?a")) >= 0) {
+  while ((opt = getopt(argc, argv, ":c:f:l:m:r:?ai")) >= 0) {
     switch (opt) {
     case 'a':
       state->rotate_noalign = 1;
@@ -253,6 +279,10 @@ static int parse_args(bvc_t *consumer, int argc, char **argv)
       state->outfile_compress_level = atoi(optarg);
       break;
 
+    case 'i':
+      state->write_index = 1;
+      break;
+
     case 'f':
       if ((state->outfile_pattern = strdup(optarg)) == NULL) {
         return -1;
@@ -270,9 +300,15 @@ static int parse_args(bvc_t *consumer, int argc, char **argv)
         state->output_format = ASCII;
       } else if (strcmp(optarg, "binary") == 0) {
         state->output_format = BINARY;
+      } else if (strcmp(optarg, "binary-v2") == 0) {
+        state->output_format = BINARY_V2;
+      } else if (strcmp(optarg, "binary-v3") == 0) {
+        state->output_format = BINARY_V3;
+      } else if (strcmp(optarg, "image") == 0) {
+        state->output_format = IMAGE;
       } else {
-        fprintf(stderr,
-                "ERROR: Output mode must be either 'ascii' or 'binary'\n");
+        fprintf(stderr, "ERROR: Output mode must be one of 'ascii', 'binary', "
+                        "'binary-v2', 'binary-v3' or 'image'\n");
         usage(consumer);
         return -1;
       }
@@ -327,7 +363,7 @@ int bvc_archiver_init(bvc_t *consumer, int argc, char **argv)
     } else {
       /* refuse to write binary to stdout by default */
       fprintf(stderr, "ERROR: Output file pattern must be set using -f when "
-                      "using the binary output format\n");
+                      "using the binary or image output formats\n");
       usage(consumer);
       return -1;
     }
@@ -340,6 +376,14 @@ int bvc_archiver_init(bvc_t *consumer, int argc, char **argv)
     state->rotation_interval = 0;
   }
 
+  if (state->write_index != 0 &&
+      (strcmp("-", state->outfile_pattern) == 0 ||
+       (state->output_format != BINARY && state->output_format != BINARY_V2 &&
+        state->output_format != BINARY_V3))) {
+    fprintf(stderr, "WARN: Only binary output files can be indexed\n");
+    state->write_index = 0;
+  }
+
   /* outfile is opened when first view is processed */
 
   return 0;
@@ -379,6 +423,8 @@ int bvc_archiver_process_view(bvc_t *consumer, bgpview_t *view)
   uint32_t view_time = bgpview_get_time(view);
   uint32_t file_time = view_time;
   int compress_type;
+  bgpview_io_row_encoding_t encoding;
+  char idxfile_name[BUFFER_LEN];
 
   if (state->outfile == NULL || SHOULD_ROTATE(state, view_time)) {
     if (state->rotation_interval > 0) {
@@ -401,6 +447,16 @@ int bvc_archiver_process_view(bvc_t *consumer, bgpview_t *view)
       goto err;
     }
     compress_type = wandio_detect_compression_type(state->outfile_name);
+    if (state->output_format == IMAGE) {
+      /* images are mapped in place, so they must not be compressed */
+      compress_type = WANDIO_COMPRESS_NONE;
+    }
+    state->view_compress_level = -1;
+    if (state->write_index != 0 && compress_type == WANDIO_COMPRESS_ZLIB) {
+      /* each view is its own gzip member, so that the index can point to it */
+      state->view_compress_level = state->outfile_compress_level;
+      compress_type = WANDIO_COMPRESS_NONE;
+    }
     if ((state->outfile =
            wandio_wcreate(state->outfile_name, compress_type,
                           state->outfile_compress_level, O_CREAT)) == NULL) {
@@ -408,6 +464,19 @@ int bvc_archiver_process_view(bvc_t *consumer, bgpview_t *view)
               state->outfile_name);
       goto err;
     }
+    state->outfile_offset = 0;
+
+    /* the index is small, so it is never compressed */
+    if (state->write_index != 0) {
+      snprintf(idxfile_name, sizeof(idxfile_name), "%s%s",
+               state->outfile_name, BGPVIEW_IO_FILE_INDEX_SUFFIX);
+      if ((state->idxfile = wandio_wcreate(idxfile_name, WANDIO_COMPRESS_NONE,
+                                           0, O_CREAT)) == NULL) {
+        fprintf(stderr, "ERROR: Could not open %s for writing\n",
+                idxfile_name);
+        goto err;
+      }
+    }
   }
 
   switch (state->output_format) {
@@ -419,8 +488,33 @@ int bvc_archiver_process_view(bvc_t *consumer, bgpview_t *view)
     break;
 
   case BINARY:
+  case BINARY_V2:
+  case BINARY_V3:
+    if (state->output_format == BINARY_V3) {
+      encoding = BGPVIEW_IO_ROW_ENCODING_V3;
+    } else if (state->output_format == BINARY_V2) {
+      encoding = BGPVIEW_IO_ROW_ENCODING_V2;
+    } else {
+      encoding = BGPVIEW_IO_ROW_ENCODING_V1;
+    }
     /* simply ask the IO library to dump the view to a file */
-    if (bgpview_io_file_write(state->outfile, view, NULL, NULL) != 0) {
+    if (state->idxfile != NULL) {
+      if (bgpview_io_file_write_indexed(state->outfile, state->idxfile,
+                                        &state->outfile_offset,
+                                        state->view_compress_level, view,
+                                        NULL, NULL, encoding) != 0) {
+        fprintf(stderr, "ERROR: Failed to write view to file\n");
+        goto err;
+      }
+    } else if (bgpview_io_file_write(state->outfile, view, NULL, NULL,
+                                     encoding) != 0) {
+      fprintf(stderr, "ERROR: Failed to write view to file\n");
+      goto err;
+    }
+    break;
+
+  case IMAGE:
+    if (bgpview_io_file_image_write(state->outfile, view) != 0) {
       fprintf(stderr, "ERROR: Failed to write view to file\n");
       goto err;
     }
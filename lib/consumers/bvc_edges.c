@@ -507,8 +507,8 @@ static int print_new_newrec(bvc_t *consumer, bgpstream_pfx_t *pfx,
 
         // printing a path for each peer
         peerid = bgpview_iter_peer_get_peer_id(it);
-        if (bgpstream_id_set_exists(
-              BVC_GET_CHAIN_STATE(consumer)->full_feed_peer_ids[ipv_idx],
+        if (BGPVIEW_PEER_BITMAP_TEST(
+              BVC_GET_CHAIN_STATE(consumer)->full_feed_peer_bitmap[ipv_idx],
               peerid)) {
 
           if (bvcu_print_pfx_peer_as_path(state->file_newedges, it, "", " ") < 0)
@@ -555,8 +555,8 @@ static int print_new_newrec(bvc_t *consumer, bgpstream_pfx_t *pfx,
 
         // printing a path for each peer
         peerid = bgpview_iter_peer_get_peer_id(it);
-        if (bgpstream_id_set_exists(
-              BVC_GET_CHAIN_STATE(consumer)->full_feed_peer_ids[ipv_idx],
+        if (BGPVIEW_PEER_BITMAP_TEST(
+              BVC_GET_CHAIN_STATE(consumer)->full_feed_peer_bitmap[ipv_idx],
               peerid)) {
 
           if (bvcu_print_pfx_peer_as_path(state->file_newedges, it, "", " ") < 0)
@@ -777,6 +777,14 @@ int bvc_edges_process_view(bvc_t *consumer, bgpview_t *view)
   state->time_now = time_now;
   /* compute arrival delay */
   state->arrival_delay = epoch_sec() - bgpview_get_time(view);
+
+  /* full-feed peers come from the Visibility consumer */
+  if (BVC_GET_CHAIN_STATE(consumer)->visibility_computed == 0) {
+    fprintf(stderr, "ERROR: The Edges consumer requires the Visibility "
+                    "consumer to be run first\n");
+    return -1;
+  }
+
   // as_paths_t *as_paths = kh_init(as_paths);
   new_edges_t *new_edges = kh_init(new_edges);
   newrec_edges_t *newrec_edges = kh_init(newrec_edges);
@@ -843,8 +851,8 @@ int bvc_edges_process_view(bvc_t *consumer, bgpview_t *view)
       /* only consider peers that are full-feed */
       peerid = bgpview_iter_peer_get_peer_id(it);
 
-      if (bgpstream_id_set_exists(
-            BVC_GET_CHAIN_STATE(consumer)->full_feed_peer_ids[ipv_idx],
+      if (BGPVIEW_PEER_BITMAP_TEST(
+            BVC_GET_CHAIN_STATE(consumer)->full_feed_peer_bitmap[ipv_idx],
             peerid)) {
         /* get origin asn */
         if ((origin_seg = bgpview_iter_pfx_peer_get_origin_seg(it)) == NULL) {
@@ -244,28 +244,12 @@ static int create_ts_metrics(bvc_t *consumer)
   return 0;
 }
 
-/* returns 0 if they are the same */
-static int diff_cells(bgpview_iter_t *parent_view_it, bgpview_iter_t *itC)
+/* called by bgpview_diff for each common pfx-peer whose path id changed */
+static int diff_cell_changed(bgpview_iter_t *parent_view_it,
+                             bgpview_iter_t *it, void *user)
 {
-  bgpstream_as_path_store_path_id_t idxH =
-    bgpview_iter_pfx_peer_get_as_path_store_path_id(parent_view_it);
-  bgpstream_as_path_store_path_id_t idxC =
-    bgpview_iter_pfx_peer_get_as_path_store_path_id(itC);
-
-  return bcmp(&idxH, &idxC, sizeof(bgpstream_as_path_store_path_id_t)) != 0;
-}
-
-static int diff_paths(bvc_t *consumer, bgpview_t *view)
-{
-  if (STATE->parent_view == NULL) {
-    /* nothing to compare with */
-    return 0;
-  }
-
-  bgpview_iter_t *it;
-  bgpview_iter_t *parent_view_it;
+  bvc_t *consumer = user;
   bgpstream_pfx_t *pfx;
-  bgpstream_peer_id_t peer_id;
 
   char pfx_str[INET6_ADDRSTRLEN + 3] = "";
   bgpstream_peer_sig_t *ps;
@@ -275,74 +259,58 @@ static int diff_paths(bvc_t *consumer, bgpview_t *view)
   char new_path_str[4096] = "";
   bgpstream_as_path_t *new_path = NULL;
 
-  if ((it = bgpview_iter_create(view)) == NULL) {
-    return -1;
-  }
-
-  if ((parent_view_it = bgpview_iter_create(STATE->parent_view)) == NULL) {
-    return -1;
-  }
-
-  /* for each prefix in view */
-  for (bgpview_iter_first_pfx(it, 0, BGPVIEW_FIELD_ACTIVE); //
-       bgpview_iter_has_more_pfx(it);                       //
-       bgpview_iter_next_pfx(it)) {
-
+  /* there is currently a bug somewhere that causes us to use different
+   * path store IDs for the same effective path, so we need to do a full
+   * check of the paths */
+  old_path = bgpview_iter_pfx_peer_get_as_path(parent_view_it);
+  new_path = bgpview_iter_pfx_peer_get_as_path(it);
+  if (bgpstream_as_path_equal(old_path, new_path) == 0) {
     pfx = bgpview_iter_pfx_get_pfx(it);
+    bgpstream_pfx_snprintf(pfx_str, INET6_ADDRSTRLEN + 3, pfx);
+    ps = bgpview_iter_peer_get_sig(it);
+    bgpstream_addr_ntop(peer_str, INET6_ADDRSTRLEN, &ps->peer_ip_addr);
+    bgpstream_as_path_snprintf(old_path_str, 4096, old_path);
+    bgpstream_as_path_snprintf(new_path_str, 4096, new_path);
+
+    wandio_printf(STATE->outfile, "%" PRIu32 "|" /* time */
+                                  "%s|"          /* prefix */
+                                  "%s|"          /* collector */
+                                  "%" PRIu32 "|" /* peer ASN */
+                                  "%s|"          /* peer IP */
+                                  "%s|"          /* old-path */
+                                  "%s"           /* new-path */
+                                  "\n",
+                  bgpview_get_time(bgpview_iter_get_view(it)), pfx_str,
+                  ps->collector_str, ps->peer_asnumber, peer_str, old_path_str,
+                  new_path_str);
+  }
+  bgpstream_as_path_destroy(old_path);
+  bgpstream_as_path_destroy(new_path);
 
-    if (bgpview_iter_seek_pfx(parent_view_it, pfx, BGPVIEW_FIELD_ACTIVE) == 0) {
-      // this is a new prefix, skip it...
-      continue;
-    }
-
-    for (bgpview_iter_pfx_first_peer(it, BGPVIEW_FIELD_ACTIVE); //
-         bgpview_iter_pfx_has_more_peer(it);                    //
-         bgpview_iter_pfx_next_peer(it)) {
+  return 0;
+}
 
-      peer_id = bgpview_iter_peer_get_peer_id(it);
+static int diff_paths(bvc_t *consumer, bgpview_t *view)
+{
+  /* new prefixes and new peers are skipped, only changed paths matter */
+  bgpview_diff_cbs_t cbs = {
+    .cell_changed = diff_cell_changed,
+  };
 
-      /* is it in parent view? */
-      if (bgpview_iter_pfx_seek_peer(parent_view_it, peer_id,
-                                     BGPVIEW_FIELD_ACTIVE) == 0) {
-        // new peer, skip it...
-        continue;
-      }
+  if (STATE->parent_view == NULL) {
+    /* nothing to compare with */
+    return 0;
+  }
 
-      /* is the path different? */
-      if (diff_cells(parent_view_it, it) != 0) {
-        /* there is currently a bug somewhere that causes us to use different
-         * path store IDs for the same effective path, so we need to do a full
-         * check of the paths */
-        old_path = bgpview_iter_pfx_peer_get_as_path(parent_view_it);
-        new_path = bgpview_iter_pfx_peer_get_as_path(it);
-        if (bgpstream_as_path_equal(old_path, new_path) == 0) {
-          bgpstream_pfx_snprintf(pfx_str, INET6_ADDRSTRLEN + 3, pfx);
-          ps = bgpview_iter_peer_get_sig(it);
-          bgpstream_addr_ntop(peer_str, INET6_ADDRSTRLEN, &ps->peer_ip_addr);
-          bgpstream_as_path_snprintf(old_path_str, 4096, old_path);
-          bgpstream_as_path_snprintf(new_path_str, 4096, new_path);
-
-          wandio_printf(STATE->outfile, "%" PRIu32 "|" /* time */
-                                        "%s|"          /* prefix */
-                                        "%s|"          /* collector */
-                                        "%" PRIu32 "|" /* peer ASN */
-                                        "%s|"          /* peer IP */
-                                        "%s|"          /* old-path */
-                                        "%s"           /* new-path */
-                                        "\n",
-                        bgpview_get_time(view), pfx_str, ps->collector_str,
-                        ps->peer_asnumber, peer_str, old_path_str,
-                        new_path_str);
-        }
-        bgpstream_as_path_destroy(old_path);
-        bgpstream_as_path_destroy(new_path);
-      }
-    }
+  /* if the view journals its changes since our snapshot, only look at the
+     prefixes that changed */
+  if (bgpview_journal_is_complete(view) &&
+      bgpview_journal_get_checkpoint_time(view) ==
+        bgpview_get_time(STATE->parent_view)) {
+    return bgpview_diff_journal(STATE->parent_view, view, &cbs, consumer);
   }
 
-  bgpview_iter_destroy(it);
-  bgpview_iter_destroy(parent_view_it);
-  return 0;
+  return bgpview_diff(STATE->parent_view, view, &cbs, consumer);
 }
 
 /* ==================== CONSUMER INTERFACE FUNCTIONS ==================== */
@@ -473,14 +441,12 @@ int bvc_pathchange_process_view(bvc_t *consumer, bgpview_t *view)
   /* NB: this code is borrowed from viewsender */
   if (STATE->parent_view == NULL) {
     /* this is our first */
-    if ((STATE->parent_view = bgpview_dup(view)) == NULL) {
+    if ((STATE->parent_view = bgpview_snapshot_create(view)) == NULL) {
       goto err;
     }
   } else {
-    /* we have a parent view, just copy into it */
-    /* first, clear the destination */
-    bgpview_clear(STATE->parent_view);
-    if (bgpview_copy(STATE->parent_view, view) != 0) {
+    /* we have a parent view, just bring it up to date */
+    if (bgpview_snapshot_update(STATE->parent_view) != 0) {
       goto err;
     }
   }
@@ -44,6 +44,10 @@
     timeseries_set_single(BVC_GET_TIMESERIES(consumer), buf, value, time);     \
   } while (0)
 
+#define DUMP_MEM_METRIC(field, mem)                                            \
+  DUMP_METRIC((mem).field, bgpview_get_time(view), "mem.%s",                   \
+              CHAIN_STATE->metric_prefix, #field);
+
 #define STATE (BVC_GET_STATE(consumer, perfmonitor))
 
 #define CHAIN_STATE (BVC_GET_CHAIN_STATE(consumer))
@@ -197,6 +201,11 @@ int bvc_perfmonitor_process_view(bvc_t *consumer, bgpview_t *view)
   /* destroy the view iterator */
   bgpview_iter_destroy(it);
 
+  // memory used by the view
+  bgpview_mem_stats_t mem;
+  bgpview_get_mem_stats(view, &mem);
+  BGPVIEW_MEM_STATS_FIELDS(DUMP_MEM_METRIC, mem)
+
   STATE->view_cnt++;
 
   uint32_t time_end = epoch_sec();
@@ -1211,9 +1211,9 @@ static int compute_geo_pfx_visibility(bvc_t *consumer, bgpview_iter_t *it)
 
       /* only consider peers that are full-feed (checking if peer id is a full
        * feed for the current pfx IP version) */
-      if (bgpstream_id_set_exists(
+      if (BGPVIEW_PEER_BITMAP_TEST(
             BVC_GET_CHAIN_STATE(consumer)
-              ->full_feed_peer_ids[bgpstream_ipv2idx(pfx->address.version)],
+              ->full_feed_peer_bitmap[bgpstream_ipv2idx(pfx->address.version)],
             bgpview_iter_peer_get_peer_id(it)) == 0) {
         continue;
       }
@@ -559,16 +559,15 @@ int bvc_viewsender_process_view(bvc_t *consumer, bgpview_t *view)
     uint64_t send_end = epoch_sec();
     uint64_t send_time = send_end - start_time;
 
-    // do the create/copy
+    // take/update the snapshot
     if (state->parent_view == NULL) {
-      if ((state->parent_view = bgpview_dup(view)) == NULL) {
+      if ((state->parent_view = bgpview_snapshot_create(view)) == NULL) {
         return -1;
       }
     } else {
-      /* we have a parent view, just copy into it */
-      /* first, clear the destination */
-      bgpview_clear(state->parent_view);
-      if (bgpview_copy(state->parent_view, view) != 0) {
+      /* we have a parent view, just bring it up to date (only the prefixes
+         that changed since the last view will have been copied) */
+      if (bgpview_snapshot_update(state->parent_view) != 0) {
         return -1;
       }
     }
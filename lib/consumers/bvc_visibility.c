@@ -34,6 +34,7 @@
 #include <libipmeta.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 #define NAME "visibility"
@@ -232,6 +233,7 @@ static void find_ff_peers(bvc_t *consumer, bgpview_iter_t *it)
       if (pfx_cnt >= STATE->full_feed_size[i]) {
         /* add to the  full_feed set */
         bgpstream_id_set_insert(CHAIN_STATE->full_feed_peer_ids[i], peerid);
+        BGPVIEW_PEER_BITMAP_SET(CHAIN_STATE->full_feed_peer_bitmap[i], peerid);
         bgpstream_id_set_insert(STATE->full_feed_asns[i], sg->peer_asnumber);
       }
     }
@@ -245,6 +247,29 @@ static void find_ff_peers(bvc_t *consumer, bgpview_iter_t *it)
   }
 }
 
+/* size the full-feed bitmaps for the peers of the given view */
+static int resize_ff_bitmaps(bvc_t *consumer, bgpview_t *view)
+{
+  int words = bgpview_peer_bitmap_words(view);
+  uint64_t *tmp;
+  int i;
+
+  for (i = 0; i < BGPSTREAM_MAX_IP_VERSION_IDX; i++) {
+    if (words != CHAIN_STATE->peer_bitmap_words ||
+        CHAIN_STATE->full_feed_peer_bitmap[i] == NULL) {
+      if ((tmp = realloc(CHAIN_STATE->full_feed_peer_bitmap[i],
+                         sizeof(uint64_t) * words)) == NULL) {
+        return -1;
+      }
+      CHAIN_STATE->full_feed_peer_bitmap[i] = tmp;
+    }
+    memset(CHAIN_STATE->full_feed_peer_bitmap[i], 0, sizeof(uint64_t) * words);
+  }
+  CHAIN_STATE->peer_bitmap_words = words;
+
+  return 0;
+}
+
 static void dump_gen_metrics(bvc_t *consumer)
 {
   int i;
@@ -383,6 +408,10 @@ int bvc_visibility_process_view(bvc_t *consumer, bgpview_t *view)
 
   reset_chain_state(consumer);
 
+  if (resize_ff_bitmaps(consumer, view) != 0) {
+    return -1;
+  }
+
   /* create a new iterator */
   if ((it = bgpview_iter_create(view)) == NULL) {
     return -1;
@@ -26,8 +26,12 @@
 
 #include "bgpview_io.h"
 #include "config.h"
+#include "khash.h"
+#include "utils.h"
 #include <assert.h>
+#include <inttypes.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 /* because the values of AF_INET* vary from system to system we need to use
@@ -35,6 +39,111 @@
 #define BW_INTERNAL_AF_INET 4
 #define BW_INTERNAL_AF_INET6 6
 
+/* in the v2 encoding, each cell starts with the zigzag-coded difference
+   between its peer ID and the one of the previous cell, shifted left by one
+   bit to make room for a flag that is set if the cell has the same path as
+   the previous cell. As peer IDs are unique within a row, a 0 header marks
+   the end of the cells. */
+#define ROW_V2_SAME_PATH 0x1
+#define ROW_V2_END 0
+
+/* in a row that refers to a peer set, the path of each peer of the set is
+   written as its index plus one, or as 0 if it is the same as the path of the
+   previous peer. When full paths are used, other paths are written as 1
+   followed by the path itself. */
+#define ROW_SET_SAME_PATH 0
+#define ROW_SET_NEW_PATH 1
+
+/* number of sets to grow the peer set array by */
+#define PEERSETS_ALLOC_STEP 1024
+
+/** A set of peers */
+typedef struct peerset {
+
+  /** Hash of the peer IDs */
+  uint32_t hash;
+
+  /** Number of peers in the set */
+  uint16_t cnt;
+
+  /** Peer IDs (sorted, unless they have been mapped to the IDs of a view) */
+  bgpstream_peer_id_t *peerids;
+
+} peerset_t;
+
+#define peerset_hash_func(key) ((key).hash)
+#define peerset_hash_equal(a, b)                                               \
+  ((a).hash == (b).hash && (a).cnt == (b).cnt &&                               \
+   memcmp((a).peerids, (b).peerids,                                            \
+          sizeof(bgpstream_peer_id_t) * (a).cnt) == 0)
+
+/** Map from a set of peers to its ID (-1 if it has none) */
+KHASH_INIT(peerset_id_map, peerset_t, int, 1, peerset_hash_func,
+           peerset_hash_equal)
+
+struct bgpview_io_peersets {
+
+  /** Map from set of peers to set ID (the keys own the peer IDs) */
+  khash_t(peerset_id_map) * ids;
+
+  /** Sets with an ID, indexed by ID */
+  peerset_t *sets;
+
+  /** Number of sets with an ID */
+  int sets_cnt;
+
+  /** Number of sets allocated */
+  int sets_alloc_cnt;
+};
+
+/** A pfx-peer, used to sort the cells of a prefix by peer ID */
+typedef struct cell {
+
+  /** Peer ID */
+  bgpstream_peer_id_t peerid;
+
+  /** Store path */
+  bgpstream_as_path_store_path_t *spath;
+
+} cell_t;
+
+int bgpview_io_serialize_varint(uint8_t *buf, size_t len, uint64_t val)
+{
+  size_t written = 0;
+
+  while (val >= 0x80) {
+    if (written == len) {
+      return -1;
+    }
+    buf[written++] = (uint8_t)(val | 0x80);
+    val >>= 7;
+  }
+  if (written == len) {
+    return -1;
+  }
+  buf[written++] = (uint8_t)val;
+
+  return written;
+}
+
+int bgpview_io_deserialize_varint(uint8_t *buf, size_t len, uint64_t *val)
+{
+  size_t read = 0;
+  uint64_t v = 0;
+  int shift = 0;
+
+  while (read < len && read < BGPVIEW_IO_VARINT_MAX_LEN) {
+    v |= (uint64_t)(buf[read] & 0x7f) << shift;
+    if ((buf[read++] & 0x80) == 0) {
+      *val = v;
+      return read;
+    }
+    shift += 7;
+  }
+
+  return -1;
+}
+
 int bgpview_io_serialize_ip(uint8_t *buf, size_t len, bgpstream_ip_addr_t *ip)
 {
   size_t written = 0;
@@ -75,7 +184,9 @@ int bgpview_io_deserialize_ip(uint8_t *buf, size_t len,
 {
   size_t read = 0;
 
-  assert(len >= 1);
+  if (len < 1) {
+    return -1;
+  }
 
   /* switch on the internal version */
   switch (*buf) {
@@ -84,7 +195,9 @@ int bgpview_io_deserialize_ip(uint8_t *buf, size_t len,
     buf++;
     read++;
 
-    assert((len - read) >= sizeof(uint32_t));
+    if ((len - read) < sizeof(uint32_t)) {
+      return -1;
+    }
     memcpy(&ip->bs_ipv4.addr.s_addr, buf, sizeof(uint32_t));
     return read + sizeof(uint32_t);
 
@@ -93,7 +206,9 @@ int bgpview_io_deserialize_ip(uint8_t *buf, size_t len,
     buf++;
     read++;
 
-    assert((len - read) >= (sizeof(uint8_t) * 16));
+    if ((len - read) < (sizeof(uint8_t) * 16)) {
+      return -1;
+    }
     memcpy(&ip->bs_ipv6.addr.s6_addr, buf, sizeof(uint8_t) * 16);
     return read + (sizeof(uint8_t) * 16);
 
@@ -140,7 +255,7 @@ int bgpview_io_deserialize_pfx(uint8_t *buf, size_t len,
   buf += s;
 
   /* pfx len */
-  BGPVIEW_IO_DESERIALIZE_VAL(buf, len, read, pfx->mask_len);
+  BGPVIEW_IO_DESERIALIZE_VAL_CHECKED(buf, len, read, pfx->mask_len);
 
   return read;
 
@@ -192,26 +307,29 @@ int bgpview_io_deserialize_peer(uint8_t *buf, size_t len,
   ssize_t s;
 
   /* grab the peer ID */
-  BGPVIEW_IO_DESERIALIZE_VAL(buf, len, read, peerid);
+  BGPVIEW_IO_DESERIALIZE_VAL_CHECKED(buf, len, read, peerid);
   *id = peerid;
 
   /* the collector string */
-  BGPVIEW_IO_DESERIALIZE_VAL(buf, len, read, nlen);
-  assert((len - read) >= (nlen + 1));
+  BGPVIEW_IO_DESERIALIZE_VAL_CHECKED(buf, len, read, nlen);
+  if ((len - read) < nlen || nlen >= sizeof(sig->collector_str)) {
+    goto err;
+  }
   memcpy(sig->collector_str, buf, nlen);
   sig->collector_str[nlen] = '\0';
   read += nlen;
   buf += nlen;
 
   /* Peer IP */
-  if ((s = bgpview_io_deserialize_ip(buf, len, &sig->peer_ip_addr)) < 0) {
+  if ((s = bgpview_io_deserialize_ip(buf, (len - read), &sig->peer_ip_addr)) <
+      0) {
     goto err;
   }
   read += s;
   buf += s;
 
   /* Peer ASN */
-  BGPVIEW_IO_DESERIALIZE_VAL(buf, len, read, sig->peer_asnumber);
+  BGPVIEW_IO_DESERIALIZE_VAL_CHECKED(buf, len, read, sig->peer_asnumber);
 
   return read;
 
@@ -256,12 +374,14 @@ int bgpview_io_deserialize_as_path_store_path(
   uint8_t is_core;
 
   /* is core */
-  BGPVIEW_IO_DESERIALIZE_VAL(buf, len, read, is_core);
+  BGPVIEW_IO_DESERIALIZE_VAL_CHECKED(buf, len, read, is_core);
 
   /* path len */
-  BGPVIEW_IO_DESERIALIZE_VAL(buf, len, read, pathlen);
+  BGPVIEW_IO_DESERIALIZE_VAL_CHECKED(buf, len, read, pathlen);
 
-  assert((len - read) >= pathlen);
+  if ((len - read) < pathlen) {
+    goto err;
+  }
   if (store != NULL) {
     /* now add this path to the store */
     if (bgpstream_as_path_store_insert_path(store, buf, pathlen, is_core,
@@ -278,31 +398,16 @@ err:
   return -1;
 }
 
-int bgpview_io_serialize_pfx_peer(uint8_t *buf, size_t len, bgpview_iter_t *it,
-                                  bgpview_io_filter_cb_t *cb, void *cb_user,
-                                  int use_pathid)
+/* serialize the peer id and AS path of a single pfx-peer */
+static ssize_t serialize_cell(uint8_t *buf, size_t len, uint16_t peerid,
+                              bgpstream_as_path_store_path_t *spath,
+                              int use_pathid)
 {
-  int filter;
-  uint16_t peerid;
-
-  bgpstream_as_path_store_path_t *spath;
   uint32_t idx;
 
   size_t written = 0;
   ssize_t s;
 
-  if (cb != NULL) {
-    /* ask the caller if they want this pfx-peer */
-    if ((filter = cb(it, BGPVIEW_IO_FILTER_PFX_PEER, cb_user)) < 0) {
-      goto err;
-    }
-    if (filter == 0) {
-      return 0;
-    }
-  }
-
-  peerid = bgpview_iter_peer_get_peer_id(it);
-
   /* peer id */
   assert(peerid > 0);
   assert(peerid < BGPVIEW_IO_END_OF_PEERS);
@@ -310,7 +415,6 @@ int bgpview_io_serialize_pfx_peer(uint8_t *buf, size_t len, bgpview_iter_t *it,
   BGPVIEW_IO_SERIALIZE_VAL(buf, len, written, peerid);
 
   /* AS Path */
-  spath = bgpview_iter_pfx_peer_get_as_path_store_path(it);
   if (use_pathid == 1) {
     idx = bgpstream_as_path_store_path_get_idx(spath);
     BGPVIEW_IO_SERIALIZE_VAL(buf, len, written, idx);
@@ -329,27 +433,140 @@ err:
   return -1;
 }
 
-int bgpview_io_serialize_pfx_peers(uint8_t *buf, size_t len, bgpview_iter_t *it,
-                                   int *peers_cnt, bgpview_io_filter_cb_t *cb,
-                                   void *cb_user, int use_pathid)
+/* serialize a single pfx-peer using the v2 encoding */
+static ssize_t serialize_cell_v2(uint8_t *buf, size_t len,
+                                 bgpview_io_row_t *row, uint16_t peerid,
+                                 bgpstream_as_path_store_path_t *spath,
+                                 int use_pathid)
 {
+  int32_t delta = (int32_t)peerid - (int32_t)row->last_peerid;
+  uint32_t zigzag = ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31);
+  uint64_t hdr;
+  uint32_t idx;
+  int same_path;
+
   size_t written = 0;
   ssize_t s;
 
-  assert(peers_cnt != NULL);
-  *peers_cnt = 0;
+  assert(peerid > 0);
+  assert(peerid < BGPVIEW_IO_END_OF_PEERS);
 
-  for (bgpview_iter_pfx_first_peer(it, BGPVIEW_FIELD_ACTIVE);
-       bgpview_iter_pfx_has_more_peer(it); bgpview_iter_pfx_next_peer(it)) {
-    if ((s = bgpview_io_serialize_pfx_peer(buf, (len - written), it, cb,
-                                           cb_user, use_pathid)) == -1) {
+  /* cells of the same prefix often share a path, in which case only the
+     header is written */
+  same_path = (use_pathid >= 0 && row->cells_cnt > 0 &&
+               spath == row->last_spath);
+
+  hdr = ((uint64_t)zigzag << 1) | (same_path ? ROW_V2_SAME_PATH : 0);
+  assert(hdr != ROW_V2_END);
+  if ((s = bgpview_io_serialize_varint(buf, len, hdr)) == -1) {
+    goto err;
+  }
+  written += s;
+  buf += s;
+
+  if (use_pathid == 1 && same_path == 0) {
+    idx = bgpstream_as_path_store_path_get_idx(spath);
+    if ((s = bgpview_io_serialize_varint(buf, (len - written), idx)) == -1) {
+      goto err;
+    }
+    written += s;
+    buf += s;
+  } else if (use_pathid == 0 && same_path == 0) {
+    if ((s = bgpview_io_serialize_as_path_store_path(buf, (len - written),
+                                                     spath)) == -1) {
       goto err;
     }
-    if (s > 0) { // 0 if the callback filtered the pfx-peer
+    written += s;
+    buf += s;
+  }
+
+  row->last_peerid = peerid;
+  row->last_spath = spath;
+  return written;
+
+err:
+  return -1;
+}
+
+int bgpview_io_serialize_pfx_peer(uint8_t *buf, size_t len, bgpview_iter_t *it,
+                                  bgpview_io_filter_cb_t *cb, void *cb_user,
+                                  int use_pathid)
+{
+  int filter;
+
+  if (cb != NULL) {
+    /* ask the caller if they want this pfx-peer */
+    if ((filter = cb(it, BGPVIEW_IO_FILTER_PFX_PEER, cb_user)) < 0) {
+      return -1;
+    }
+    if (filter == 0) {
+      return 0;
+    }
+  }
+
+  return serialize_cell(buf, len, bgpview_iter_peer_get_peer_id(it),
+                        bgpview_iter_pfx_peer_get_as_path_store_path(it),
+                        use_pathid);
+}
+
+/* serialize the pfx-peers of the current prefix into the given row */
+static ssize_t serialize_row_cells(uint8_t *buf, size_t len,
+                                   bgpview_iter_t *it, bgpview_io_row_t *row,
+                                   bgpview_io_filter_cb_t *cb, void *cb_user,
+                                   int use_pathid)
+{
+  size_t written = 0;
+  ssize_t s;
+  int filter;
+
+  bgpstream_peer_id_t peerids[BGPVIEW_IO_ROW_BATCH_LEN];
+  bgpstream_as_path_store_path_id_t pathids[BGPVIEW_IO_ROW_BATCH_LEN];
+  bgpstream_as_path_store_t *pathstore;
+  int cells_cnt = -1;
+  int i;
+
+  /* without a filter, the cells can be fetched all at once (unless the
+     prefix has more pfx-peers than we can buffer) */
+  if (cb == NULL) {
+    cells_cnt =
+      bgpview_iter_pfx_get_cells(it, BGPVIEW_FIELD_ACTIVE, peerids, pathids,
+                                 BGPVIEW_IO_ROW_BATCH_LEN);
+  }
+
+  if (cells_cnt >= 0) {
+    pathstore = bgpview_get_as_path_store(bgpview_iter_get_view(it));
+    for (i = 0; i < cells_cnt; i++) {
+      if ((s = bgpview_io_serialize_pfx_row_cell(
+             buf, (len - written), row, peerids[i],
+             bgpstream_as_path_store_get_store_path(pathstore, pathids[i]),
+             use_pathid)) == -1) {
+        goto err;
+      }
       written += s;
       buf += s;
-      (*peers_cnt)++;
     }
+    return written;
+  }
+
+  for (bgpview_iter_pfx_first_peer(it, BGPVIEW_FIELD_ACTIVE);
+       bgpview_iter_pfx_has_more_peer(it); bgpview_iter_pfx_next_peer(it)) {
+    if (cb != NULL) {
+      /* ask the caller if they want this pfx-peer */
+      if ((filter = cb(it, BGPVIEW_IO_FILTER_PFX_PEER, cb_user)) < 0) {
+        goto err;
+      }
+      if (filter == 0) {
+        continue;
+      }
+    }
+    if ((s = bgpview_io_serialize_pfx_row_cell(
+           buf, (len - written), row, bgpview_iter_peer_get_peer_id(it),
+           bgpview_iter_pfx_peer_get_as_path_store_path(it), use_pathid)) ==
+        -1) {
+      goto err;
+    }
+    written += s;
+    buf += s;
   }
 
   return written;
@@ -358,56 +575,142 @@ err:
   return -1;
 }
 
+int bgpview_io_serialize_pfx_peers(uint8_t *buf, size_t len, bgpview_iter_t *it,
+                                   int *peers_cnt, bgpview_io_filter_cb_t *cb,
+                                   void *cb_user, int use_pathid)
+{
+  bgpview_io_row_t row = {BGPVIEW_IO_ROW_ENCODING_V1, 0, 0, NULL};
+  ssize_t s;
+
+  assert(peers_cnt != NULL);
+
+  s = serialize_row_cells(buf, len, it, &row, cb, cb_user, use_pathid);
+  *peers_cnt = row.cells_cnt;
+  return s;
+}
+
+int bgpview_io_serialize_pfx_row_start(uint8_t *buf, size_t len,
+                                       bgpview_io_row_t *row,
+                                       bgpview_io_row_encoding_t encoding,
+                                       bgpstream_pfx_t *pfx)
+{
+  size_t written = 0;
+  ssize_t s;
+  uint8_t hdr;
+
+  row->encoding = encoding;
+  row->cells_cnt = 0;
+  row->last_peerid = 0;
+  row->last_spath = NULL;
+
+  if (encoding != BGPVIEW_IO_ROW_ENCODING_V1) {
+    hdr = BGPVIEW_IO_ROW_V2_HDR;
+    BGPVIEW_IO_SERIALIZE_VAL(buf, len, written, hdr);
+  }
+
+  if ((s = bgpview_io_serialize_pfx(buf, (len - written), pfx)) == -1) {
+    return -1;
+  }
+
+  return written + s;
+}
+
+int bgpview_io_serialize_pfx_row_cell(uint8_t *buf, size_t len,
+                                      bgpview_io_row_t *row,
+                                      bgpstream_peer_id_t peerid,
+                                      bgpstream_as_path_store_path_t *spath,
+                                      int use_pathid)
+{
+  ssize_t s;
+
+  if (row->encoding != BGPVIEW_IO_ROW_ENCODING_V1) {
+    s = serialize_cell_v2(buf, len, row, peerid, spath, use_pathid);
+  } else {
+    s = serialize_cell(buf, len, peerid, spath, use_pathid);
+  }
+  if (s >= 0) {
+    row->cells_cnt++;
+  }
+
+  return s;
+}
+
+int bgpview_io_serialize_pfx_row_end(uint8_t *buf, size_t len,
+                                     bgpview_io_row_t *row)
+{
+  size_t written = 0;
+  ssize_t s;
+  uint16_t u16;
+
+  if (row->encoding != BGPVIEW_IO_ROW_ENCODING_V1) {
+    /* end of cells, and cell cnt for cross validation */
+    if ((s = bgpview_io_serialize_varint(buf, len, ROW_V2_END)) == -1) {
+      return -1;
+    }
+    written += s;
+    buf += s;
+    if ((s = bgpview_io_serialize_varint(buf, (len - written),
+                                         row->cells_cnt)) == -1) {
+      return -1;
+    }
+    return written + s;
+  }
+
+  /* send a magic peerid to indicate end of peers */
+  u16 = BGPVIEW_IO_END_OF_PEERS;
+  BGPVIEW_IO_SERIALIZE_VAL(buf, len, written, u16);
+
+  /* peer cnt for cross validation */
+  assert(row->cells_cnt > 0 && row->cells_cnt <= UINT16_MAX);
+  u16 = htons(row->cells_cnt);
+  BGPVIEW_IO_SERIALIZE_VAL(buf, len, written, u16);
+
+  return written;
+}
+
 int bgpview_io_serialize_pfx_row(uint8_t *buf, size_t len, bgpview_iter_t *it,
                                  int *peers_cnt, bgpview_io_filter_cb_t *cb,
-                                 void *cb_user, int use_pathid)
+                                 void *cb_user, int use_pathid,
+                                 bgpview_io_row_encoding_t encoding)
 {
   size_t written = 0;
   ssize_t s = 0;
 
+  bgpview_io_row_t row;
   bgpstream_pfx_t *pfx;
-  int peers_tx = 0;
-
-  uint16_t u16;
 
   pfx = bgpview_iter_pfx_get_pfx(it);
   assert(pfx != NULL);
 
-  if ((s = bgpview_io_serialize_pfx(buf, (len - written), pfx)) == -1) {
+  if ((s = bgpview_io_serialize_pfx_row_start(buf, (len - written), &row,
+                                              encoding, pfx)) == -1) {
     goto err;
   }
   written += s;
   buf += s;
 
   /* send the peers */
-  if ((s = bgpview_io_serialize_pfx_peers(buf, (len - written), it, &peers_tx,
-                                          cb, cb_user, use_pathid)) == -1) {
+  if ((s = serialize_row_cells(buf, (len - written), it, &row, cb, cb_user,
+                               use_pathid)) == -1) {
     goto err;
   }
   written += s;
   buf += s;
 
   if (peers_cnt != NULL) {
-    *peers_cnt = peers_tx;
+    *peers_cnt = row.cells_cnt;
   }
 
   /* for a pfx to be sent it must have active peers */
-  if (peers_tx == 0) {
+  if (row.cells_cnt == 0) {
     return 0;
   }
 
-  if (peers_cnt != NULL) {
-    *peers_cnt = peers_tx;
+  if ((s = bgpview_io_serialize_pfx_row_end(buf, (len - written), &row)) ==
+      -1) {
+    goto err;
   }
-
-  /* send a magic peerid to indicate end of peers */
-  u16 = BGPVIEW_IO_END_OF_PEERS;
-  BGPVIEW_IO_SERIALIZE_VAL(buf, len, written, u16);
-
-  /* peer cnt for cross validation */
-  assert(peers_tx > 0);
-  u16 = htons(peers_tx);
-  BGPVIEW_IO_SERIALIZE_VAL(buf, len, written, u16);
+  written += s;
 
   return written;
 
@@ -415,83 +718,957 @@ err:
   return -1;
 }
 
-int bgpview_io_deserialize_pfx_row(
-  uint8_t *buf, size_t len, bgpview_iter_t *it,
-  bgpview_io_filter_pfx_cb_t *pfx_cb,
-  bgpview_io_filter_pfx_peer_cb_t *pfx_peer_cb, bgpstream_peer_id_t *peerid_map,
-  int peerid_map_cnt, bgpstream_as_path_store_path_id_t *pathid_map,
-  int pathid_map_cnt, bgpview_field_state_t state)
+static uint32_t peerset_hash(bgpstream_peer_id_t *peerids, int cnt)
 {
-  size_t read = 0;
-  size_t s = 0;
-  int skip_pfx = 0;
+  uint32_t h = 2166136261U;
+  int i;
 
-  bgpstream_pfx_t pfx;
+  /* FNV-1a over the peer IDs */
+  for (i = 0; i < cnt; i++) {
+    h = (h ^ peerids[i]) * 16777619U;
+  }
+  return h;
+}
 
-  int filter = 0;
+static int cell_cmp(const void *a, const void *b)
+{
+  const cell_t *x = (const cell_t *)a;
+  const cell_t *y = (const cell_t *)b;
 
-  int pfx_peers_added = 0;
-  int pfx_peer_rx = 0;
+  return (int)x->peerid - (int)y->peerid;
+}
 
-  int j;
+/* get the pfx-peers of the current prefix, sorted by peer ID. Returns the
+   number of pfx-peers, which is more than BGPVIEW_IO_ROW_BATCH_LEN (and the
+   cells are not filled) if they do not all fit, or -1 on error */
+static int get_sorted_cells(bgpview_iter_t *it, bgpview_io_filter_cb_t *cb,
+                            void *cb_user, cell_t *cells)
+{
+  bgpstream_peer_id_t peerids[BGPVIEW_IO_ROW_BATCH_LEN];
+  bgpstream_as_path_store_path_id_t pathids[BGPVIEW_IO_ROW_BATCH_LEN];
+  bgpstream_as_path_store_t *pathstore;
+  int cnt = 0;
+  int filter;
+  int i;
 
-  bgpstream_peer_id_t peerid;
-  uint32_t pathidx;
+  if (cb == NULL) {
+    if ((cnt = bgpview_iter_pfx_get_cells(it, BGPVIEW_FIELD_ACTIVE, peerids,
+                                          pathids,
+                                          BGPVIEW_IO_ROW_BATCH_LEN)) < 0) {
+      return BGPVIEW_IO_ROW_BATCH_LEN + 1;
+    }
+    pathstore = bgpview_get_as_path_store(bgpview_iter_get_view(it));
+    for (i = 0; i < cnt; i++) {
+      cells[i].peerid = peerids[i];
+      cells[i].spath =
+        bgpstream_as_path_store_get_store_path(pathstore, pathids[i]);
+    }
+  } else {
+    for (bgpview_iter_pfx_first_peer(it, BGPVIEW_FIELD_ACTIVE);
+         bgpview_iter_pfx_has_more_peer(it); bgpview_iter_pfx_next_peer(it)) {
+      /* ask the caller if they want this pfx-peer */
+      if ((filter = cb(it, BGPVIEW_IO_FILTER_PFX_PEER, cb_user)) < 0) {
+        return -1;
+      }
+      if (filter == 0) {
+        continue;
+      }
+      if (cnt == BGPVIEW_IO_ROW_BATCH_LEN) {
+        return BGPVIEW_IO_ROW_BATCH_LEN + 1;
+      }
+      cells[cnt].peerid = bgpview_iter_peer_get_peer_id(it);
+      cells[cnt].spath = bgpview_iter_pfx_peer_get_as_path_store_path(it);
+      cnt++;
+    }
+  }
 
-  bgpview_t *view = NULL;
-  bgpstream_as_path_store_t *store = NULL;
-  bgpstream_as_path_store_path_t *store_path = NULL;
-  bgpstream_as_path_store_path_id_t pathid;
+  qsort(cells, cnt, sizeof(cell_t), cell_cmp);
+  return cnt;
+}
 
-  uint16_t peer_cnt;
+/* find the given set of peers in the map, adding it (without an ID) if it is
+   not there yet. Returns 1 if the set was added, 0 if it was found, or -1 on
+   error */
+static int peerset_get(bgpview_io_peersets_t *sets,
+                       bgpstream_peer_id_t *peerids, int cnt, khiter_t *kp)
+{
+  peerset_t key;
+  khiter_t k;
+  int khret;
 
-  if (it != NULL) {
-    view = bgpview_iter_get_view(it);
-    store = bgpview_get_as_path_store(view);
-  }
+  key.hash = peerset_hash(peerids, cnt);
+  key.cnt = cnt;
+  key.peerids = peerids;
 
-  if ((s = bgpview_io_deserialize_pfx(buf, (len - read), &pfx)) == -1) {
-    goto err;
+  if ((k = kh_get(peerset_id_map, sets->ids, key)) != kh_end(sets->ids)) {
+    *kp = k;
+    return 0;
   }
-  read += s;
-  buf += s;
 
-  if (pfx_cb != NULL && state == BGPVIEW_FIELD_ACTIVE) {
-    /* ask the caller if they want this pfx */
-    if ((filter = pfx_cb(&pfx)) < 0) {
-      goto err;
-    }
-    if (filter == 0) {
-      skip_pfx = 1;
-    }
+  /* the map keeps its own copy of the peer IDs */
+  if ((key.peerids = malloc(sizeof(bgpstream_peer_id_t) * cnt)) == NULL) {
+    return -1;
   }
+  memcpy(key.peerids, peerids, sizeof(bgpstream_peer_id_t) * cnt);
 
-  pfx_peers_added = 0;
-  pfx_peer_rx = 0;
+  k = kh_put(peerset_id_map, sets->ids, key, &khret);
+  if (khret < 0) {
+    free(key.peerids);
+    return -1;
+  }
+  kh_val(sets->ids, k) = -1;
+
+  *kp = k;
+  return 1;
+}
+
+/* give the next ID to the set at the given position of the map */
+static int peerset_add_id(bgpview_io_peersets_t *sets, khiter_t k)
+{
+  peerset_t *tmp;
+
+  if (sets->sets_cnt == sets->sets_alloc_cnt) {
+    if ((tmp = realloc(sets->sets,
+                       sizeof(peerset_t) *
+                         (sets->sets_alloc_cnt + PEERSETS_ALLOC_STEP))) ==
+        NULL) {
+      return -1;
+    }
+    sets->sets = tmp;
+    sets->sets_alloc_cnt += PEERSETS_ALLOC_STEP;
+  }
+
+  /* the set shares the peer IDs of the key */
+  sets->sets[sets->sets_cnt] = kh_key(sets->ids, k);
+  if (kh_val(sets->ids, k) == -1) {
+    kh_val(sets->ids, k) = sets->sets_cnt;
+  }
+  sets->sets_cnt++;
+
+  return 0;
+}
+
+bgpview_io_peersets_t *bgpview_io_peersets_create(void)
+{
+  bgpview_io_peersets_t *sets;
+
+  if ((sets = malloc_zero(sizeof(bgpview_io_peersets_t))) == NULL) {
+    return NULL;
+  }
+
+  if ((sets->ids = kh_init(peerset_id_map)) == NULL) {
+    free(sets);
+    return NULL;
+  }
+
+  return sets;
+}
+
+void bgpview_io_peersets_destroy(bgpview_io_peersets_t *sets)
+{
+  if (sets == NULL) {
+    return;
+  }
+
+  bgpview_io_peersets_clear(sets);
+  kh_destroy(peerset_id_map, sets->ids);
+  sets->ids = NULL;
+
+  free(sets->sets);
+  sets->sets = NULL;
+
+  free(sets);
+}
+
+void bgpview_io_peersets_clear(bgpview_io_peersets_t *sets)
+{
+  khiter_t k;
+
+  for (k = kh_begin(sets->ids); k < kh_end(sets->ids); k++) {
+    if (kh_exist(sets->ids, k)) {
+      free(kh_key(sets->ids, k).peerids);
+    }
+  }
+  kh_clear(peerset_id_map, sets->ids);
+
+  sets->sets_cnt = 0;
+}
+
+int bgpview_io_peersets_build(bgpview_io_peersets_t *sets, bgpview_iter_t *it,
+                              bgpview_io_filter_cb_t *cb, void *cb_user)
+{
+  cell_t cells[BGPVIEW_IO_ROW_BATCH_LEN];
+  bgpstream_peer_id_t peerids[BGPVIEW_IO_ROW_BATCH_LEN];
+  khiter_t k;
+  int filter;
+  int cnt;
+  int ret;
+  int i;
+
+  bgpview_io_peersets_clear(sets);
+
+  for (bgpview_iter_first_pfx(it, 0, /* all pfx versions */
+                              BGPVIEW_FIELD_ACTIVE);
+       bgpview_iter_has_more_pfx(it); bgpview_iter_next_pfx(it)) {
+    if (cb != NULL) {
+      /* ask the caller if they want this pfx */
+      if ((filter = cb(it, BGPVIEW_IO_FILTER_PFX, cb_user)) < 0) {
+        return -1;
+      }
+      if (filter == 0) {
+        continue;
+      }
+    }
+
+    if ((cnt = get_sorted_cells(it, cb, cb_user, cells)) < 0) {
+      return -1;
+    }
+    if (cnt == 0 || cnt > BGPVIEW_IO_ROW_BATCH_LEN) {
+      /* such rows are always serialized literally */
+      continue;
+    }
+
+    for (i = 0; i < cnt; i++) {
+      peerids[i] = cells[i].peerid;
+    }
+    if ((ret = peerset_get(sets, peerids, cnt, &k)) < 0) {
+      return -1;
+    }
+    /* a set is only worth an ID once a second prefix has it */
+    if (ret == 0 && kh_val(sets->ids, k) == -1 &&
+        peerset_add_id(sets, k) != 0) {
+      return -1;
+    }
+  }
+
+  return sets->sets_cnt;
+}
+
+int bgpview_io_peersets_get_cnt(bgpview_io_peersets_t *sets)
+{
+  return sets->sets_cnt;
+}
+
+int bgpview_io_serialize_peerset(uint8_t *buf, size_t len,
+                                 bgpview_io_peersets_t *sets, int id)
+{
+  size_t written = 0;
+  ssize_t s;
+  peerset_t *set;
+  bgpstream_peer_id_t last_peerid = 0;
+  int i;
+
+  if (id < 0 || id >= sets->sets_cnt) {
+    return -1;
+  }
+  set = &sets->sets[id];
+
+  /* number of peers, then the (positive) differences between peer IDs */
+  if ((s = bgpview_io_serialize_varint(buf, len, set->cnt)) == -1) {
+    return -1;
+  }
+  written += s;
+  buf += s;
+
+  for (i = 0; i < set->cnt; i++) {
+    if ((s = bgpview_io_serialize_varint(buf, (len - written),
+                                         set->peerids[i] - last_peerid)) ==
+        -1) {
+      return -1;
+    }
+    written += s;
+    buf += s;
+    last_peerid = set->peerids[i];
+  }
+
+  return written;
+}
+
+int bgpview_io_deserialize_peerset(uint8_t *buf, size_t len,
+                                   bgpview_io_peersets_t *sets,
+                                   bgpstream_peer_id_t *peerid_map,
+                                   int peerid_map_cnt)
+{
+  size_t read = 0;
+  ssize_t s;
+  uint64_t u64;
+  bgpstream_peer_id_t peerids[BGPVIEW_IO_ROW_BATCH_LEN];
+  uint32_t peerid = 0;
+  khiter_t k;
+  int cnt;
+  int i;
+
+  if ((s = bgpview_io_deserialize_varint(buf, len, &u64)) == -1 || u64 == 0 ||
+      u64 > BGPVIEW_IO_ROW_BATCH_LEN) {
+    goto err;
+  }
+  read += s;
+  cnt = u64;
+
+  for (i = 0; i < cnt; i++) {
+    if ((s = bgpview_io_deserialize_varint(buf + read, (len - read), &u64)) ==
+          -1 ||
+        u64 == 0 || u64 >= BGPVIEW_IO_END_OF_PEERS - peerid) {
+      goto err;
+    }
+    read += s;
+    peerid += u64;
+
+    if (peerid_map == NULL) {
+      peerids[i] = peerid;
+    } else if (peerid < (uint32_t)peerid_map_cnt) {
+      peerids[i] = peerid_map[peerid];
+    } else {
+      peerids[i] = 0;
+    }
+  }
+
+  /* sets that are the same once mapped share their peer IDs */
+  if (peerset_get(sets, peerids, cnt, &k) < 0 || peerset_add_id(sets, k) != 0) {
+    goto err;
+  }
+
+  return read;
+
+err:
+  return -1;
+}
+
+int bgpview_io_serialize_pfx_set_row(uint8_t *buf, size_t len,
+                                     bgpview_iter_t *it,
+                                     bgpview_io_peersets_t *sets,
+                                     int *peers_cnt, bgpview_io_filter_cb_t *cb,
+                                     void *cb_user, int use_pathid)
+{
+  size_t written = 0;
+  ssize_t s;
+
+  cell_t cells[BGPVIEW_IO_ROW_BATCH_LEN];
+  bgpstream_peer_id_t peerids[BGPVIEW_IO_ROW_BATCH_LEN];
+  int cnt;
+  int i;
+
+  peerset_t key;
+  khiter_t k;
+  int id = -1;
+
+  bgpview_io_row_t row;
+  bgpstream_pfx_t *pfx;
+  bgpstream_as_path_store_path_t *last_spath = NULL;
+  uint64_t code;
+  uint8_t hdr;
+
+  if (peers_cnt != NULL) {
+    *peers_cnt = 0;
+  }
+
+  assert(use_pathid == 0 || use_pathid == 1);
+
+  if ((cnt = get_sorted_cells(it, cb, cb_user, cells)) < 0) {
+    return -1;
+  }
+  if (cnt > BGPVIEW_IO_ROW_BATCH_LEN) {
+    /* too many peers to be in the dictionary */
+    return bgpview_io_serialize_pfx_row(buf, len, it, peers_cnt, cb, cb_user,
+                                        use_pathid,
+                                        BGPVIEW_IO_ROW_ENCODING_V2);
+  }
+  if (cnt == 0) {
+    /* for a pfx to be sent it must have active peers */
+    return 0;
+  }
+
+  pfx = bgpview_iter_pfx_get_pfx(it);
+  assert(pfx != NULL);
+
+  for (i = 0; i < cnt; i++) {
+    peerids[i] = cells[i].peerid;
+  }
+  key.hash = peerset_hash(peerids, cnt);
+  key.cnt = cnt;
+  key.peerids = peerids;
+  if ((k = kh_get(peerset_id_map, sets->ids, key)) != kh_end(sets->ids)) {
+    id = kh_val(sets->ids, k);
+  }
+
+  if (id == -1) {
+    /* not in the dictionary, so list the peers */
+    if ((s = bgpview_io_serialize_pfx_row_start(
+           buf, len, &row, BGPVIEW_IO_ROW_ENCODING_V2, pfx)) == -1) {
+      goto err;
+    }
+    written += s;
+    buf += s;
+
+    for (i = 0; i < cnt; i++) {
+      if ((s = bgpview_io_serialize_pfx_row_cell(
+             buf, (len - written), &row, cells[i].peerid, cells[i].spath,
+             use_pathid)) == -1) {
+        goto err;
+      }
+      written += s;
+      buf += s;
+    }
+
+    if ((s = bgpview_io_serialize_pfx_row_end(buf, (len - written), &row)) ==
+        -1) {
+      goto err;
+    }
+    written += s;
+  } else {
+    hdr = BGPVIEW_IO_ROW_SET_HDR;
+    BGPVIEW_IO_SERIALIZE_VAL(buf, len, written, hdr);
+
+    if ((s = bgpview_io_serialize_pfx(buf, (len - written), pfx)) == -1) {
+      goto err;
+    }
+    written += s;
+    buf += s;
+
+    if ((s = bgpview_io_serialize_varint(buf, (len - written), id)) == -1) {
+      goto err;
+    }
+    written += s;
+    buf += s;
+
+    /* the path of each peer of the set, in the order of the set */
+    for (i = 0; i < cnt; i++) {
+      if (cells[i].spath == last_spath) {
+        code = ROW_SET_SAME_PATH;
+      } else if (use_pathid == 0) {
+        code = ROW_SET_NEW_PATH;
+      } else {
+        code = (uint64_t)bgpstream_as_path_store_path_get_idx(cells[i].spath) +
+               1;
+      }
+      if ((s = bgpview_io_serialize_varint(buf, (len - written), code)) ==
+          -1) {
+        goto err;
+      }
+      written += s;
+      buf += s;
+      if (use_pathid == 0 && code == ROW_SET_NEW_PATH) {
+        if ((s = bgpview_io_serialize_as_path_store_path(
+               buf, (len - written), cells[i].spath)) == -1) {
+          goto err;
+        }
+        written += s;
+        buf += s;
+      }
+      last_spath = cells[i].spath;
+    }
+  }
+
+  if (peers_cnt != NULL) {
+    *peers_cnt = cnt;
+  }
+  return written;
+
+err:
+  return -1;
+}
+
+/* read a varint from a row that has already been validated */
+static size_t read_valid_varint(uint8_t *buf, uint64_t *val)
+{
+  size_t read = 0;
+  uint64_t v = 0;
+  int shift = 0;
+
+  do {
+    v |= (uint64_t)(buf[read] & 0x7f) << shift;
+    shift += 7;
+  } while ((buf[read++] & 0x80) != 0);
+
+  *val = v;
+  return read;
+}
+
+/* validate a row that refers to a peer set */
+static int validate_set_row(uint8_t *buf, size_t len, int use_pathid,
+                            bgpview_io_peersets_t *sets, int pathid_map_cnt)
+{
+  size_t read = 1; /* header */
+  ssize_t s;
+  bgpstream_pfx_t pfx;
+  uint64_t u64;
+  uint16_t u16;
+  peerset_t *set;
+  int i;
+
+  /* such rows always carry their paths */
+  if (sets == NULL || use_pathid == -1) {
+    goto err;
+  }
+
+  if ((s = bgpview_io_deserialize_pfx(buf + read, (len - read), &pfx)) == -1) {
+    goto err;
+  }
+  read += s;
+
+  /* set ID */
+  if ((s = bgpview_io_deserialize_varint(buf + read, (len - read), &u64)) ==
+        -1 ||
+      u64 >= (uint64_t)sets->sets_cnt) {
+    goto err;
+  }
+  read += s;
+  set = &sets->sets[u64];
+
+  /* a path for each peer of the set */
+  for (i = 0; i < set->cnt; i++) {
+    if ((s = bgpview_io_deserialize_varint(buf + read, (len - read), &u64)) ==
+          -1 ||
+        (u64 == ROW_SET_SAME_PATH && i == 0) ||
+        u64 > (uint64_t)UINT32_MAX + 1 ||
+        (use_pathid == 0 && u64 > ROW_SET_NEW_PATH) ||
+        (use_pathid == 1 && pathid_map_cnt >= 0 &&
+         u64 > (uint64_t)pathid_map_cnt)) {
+      goto err;
+    }
+    read += s;
+
+    if (use_pathid == 0 && u64 == ROW_SET_NEW_PATH) {
+      /* is core, path len and the path itself */
+      if ((len - read) < sizeof(uint8_t) + sizeof(u16)) {
+        goto err;
+      }
+      memcpy(&u16, buf + read + sizeof(uint8_t), sizeof(u16));
+      read += sizeof(uint8_t) + sizeof(u16);
+      if ((len - read) < u16) {
+        goto err;
+      }
+      read += u16;
+    }
+  }
+
+  return read;
+
+err:
+  return -1;
+}
+
+int bgpview_io_validate_pfx_row(uint8_t *buf, size_t len, int use_pathid,
+                                bgpview_io_peersets_t *sets,
+                                int peerid_map_cnt, int pathid_map_cnt)
+{
+  size_t read = 0;
+  ssize_t s;
+  bgpstream_pfx_t pfx;
+
+  int v2 = 0;
+  uint64_t u64;
+  uint32_t zigzag;
+  int32_t last_peerid = 0;
+  int same_path = 0;
+  int cells_cnt = 0;
+
+  uint16_t u16;
+  uint32_t u32;
+
+  if (len < 1) {
+    goto err;
+  }
+  if (*buf == BGPVIEW_IO_ROW_SET_HDR) {
+    return validate_set_row(buf, len, use_pathid, sets, pathid_map_cnt);
+  }
+  if (*buf == BGPVIEW_IO_ROW_V2_HDR) {
+    v2 = 1;
+    read++;
+  }
+
+  if ((s = bgpview_io_deserialize_pfx(buf + read, (len - read), &pfx)) == -1) {
+    goto err;
+  }
+  read += s;
+
+  while (1) {
+    if (v2 != 0) {
+      if ((s = bgpview_io_deserialize_varint(buf + read, (len - read),
+                                             &u64)) == -1) {
+        goto err;
+      }
+      read += s;
+      if (u64 == ROW_V2_END) {
+        break;
+      }
+      if (u64 > UINT32_MAX) {
+        goto err;
+      }
+      same_path = (u64 & ROW_V2_SAME_PATH) != 0;
+      zigzag = (uint32_t)(u64 >> 1);
+      last_peerid += (int32_t)(zigzag >> 1) ^ -(int32_t)(zigzag & 1);
+      if (last_peerid <= 0 || last_peerid >= BGPVIEW_IO_END_OF_PEERS ||
+          (same_path != 0 && cells_cnt == 0) ||
+          (peerid_map_cnt >= 0 && last_peerid >= peerid_map_cnt)) {
+        goto err;
+      }
+    } else {
+      if ((len - read) < sizeof(u16)) {
+        goto err;
+      }
+      memcpy(&u16, buf + read, sizeof(u16));
+      read += sizeof(u16);
+      if (ntohs(u16) == BGPVIEW_IO_END_OF_PEERS) {
+        break;
+      }
+      if (peerid_map_cnt >= 0 && ntohs(u16) >= peerid_map_cnt) {
+        goto err;
+      }
+    }
 
-  for (j = 0; j < UINT16_MAX; j++) {
-    /* peer id */
-    BGPVIEW_IO_DESERIALIZE_VAL(buf, len, read, peerid);
-    peerid = ntohs(peerid);
+    /* peer IDs are unique within a row, so there cannot be more cells */
+    if (++cells_cnt == BGPVIEW_IO_END_OF_PEERS) {
+      goto err;
+    }
 
-    if (peerid == BGPVIEW_IO_END_OF_PEERS) {
-      /* end of peers */
-      break;
+    if (same_path != 0 || use_pathid == -1) {
+      continue;
     }
 
-    pfx_peer_rx++;
+    if (use_pathid == 1) {
+      /* path index */
+      if (v2 != 0) {
+        if ((s = bgpview_io_deserialize_varint(buf + read, (len - read),
+                                               &u64)) == -1 ||
+            u64 > UINT32_MAX ||
+            (pathid_map_cnt >= 0 && u64 >= (uint64_t)pathid_map_cnt)) {
+          goto err;
+        }
+        read += s;
+      } else {
+        if ((len - read) < sizeof(u32)) {
+          goto err;
+        }
+        /* indexes are written in host byte order (see
+           bgpview_io_deserialize_valid_pfx_row) */
+        memcpy(&u32, buf + read, sizeof(u32));
+        read += sizeof(u32);
+        if (pathid_map_cnt >= 0 && u32 >= (uint32_t)pathid_map_cnt) {
+          goto err;
+        }
+      }
+    } else {
+      /* is core, path len and the path itself */
+      if ((len - read) < sizeof(uint8_t) + sizeof(u16)) {
+        goto err;
+      }
+      memcpy(&u16, buf + read + sizeof(uint8_t), sizeof(u16));
+      read += sizeof(uint8_t) + sizeof(u16);
+      if ((len - read) < u16) {
+        goto err;
+      }
+      read += u16;
+    }
+  }
 
-    /* are the paths actually serialized, or just an index? */
-    if (pathid_map_cnt >= 0 && state == BGPVIEW_FIELD_ACTIVE) {
+  /* cell count */
+  if (v2 != 0) {
+    if ((s = bgpview_io_deserialize_varint(buf + read, (len - read), &u64)) ==
+          -1 ||
+        u64 != (uint64_t)cells_cnt) {
+      goto err;
+    }
+    read += s;
+  } else {
+    if ((len - read) < sizeof(u16)) {
+      goto err;
+    }
+    memcpy(&u16, buf + read, sizeof(u16));
+    read += sizeof(u16);
+    if (ntohs(u16) != cells_cnt) {
+      goto err;
+    }
+  }
+
+  return read;
+
+err:
+  return -1;
+}
+
+/* deserialize a validated row that refers to a peer set */
+static int deserialize_valid_set_row(
+  uint8_t *buf, size_t len, bgpview_iter_t *it,
+  bgpview_io_filter_pfx_cb_t *pfx_cb,
+  bgpview_io_filter_pfx_peer_cb_t *pfx_peer_cb,
+  bgpstream_as_path_store_path_id_t *pathid_map, int pathid_map_cnt,
+  bgpview_io_peersets_t *sets)
+{
+  size_t read = 0;
+  ssize_t s;
+  int skip_pfx = 0;
+  int filter;
+  int locked = 0;
+  int i;
+
+  bgpstream_pfx_t pfx;
+  peerset_t *set;
+  uint64_t u64;
+  uint32_t pathidx;
+
+  bgpview_t *view = NULL;
+  bgpstream_as_path_store_t *store = NULL;
+  bgpstream_as_path_store_path_t *store_path = NULL;
+  bgpstream_as_path_store_path_id_t pathid;
+
+  /* sets have at most BGPVIEW_IO_ROW_BATCH_LEN peers, so the row is inserted
+     in one go */
+  bgpstream_peer_id_t row_peerids[BGPVIEW_IO_ROW_BATCH_LEN];
+  bgpstream_as_path_store_path_id_t row_pathids[BGPVIEW_IO_ROW_BATCH_LEN];
+  int row_cnt = 0;
+
+  if (it != NULL) {
+    view = bgpview_iter_get_view(it);
+    store = bgpview_get_as_path_store(view);
+  }
+
+  /* header */
+  buf++;
+  read++;
+
+  if ((s = bgpview_io_deserialize_pfx(buf, (len - read), &pfx)) == -1) {
+    goto err;
+  }
+  read += s;
+  buf += s;
+
+  if (pfx_cb != NULL) {
+    /* ask the caller if they want this pfx */
+    if ((filter = pfx_cb(&pfx)) < 0) {
+      goto err;
+    }
+    if (filter == 0) {
+      skip_pfx = 1;
+    }
+  }
+
+  s = read_valid_varint(buf, &u64);
+  read += s;
+  buf += s;
+  set = &sets->sets[u64];
+
+  for (i = 0; i < set->cnt; i++) {
+    s = read_valid_varint(buf, &u64);
+    read += s;
+    buf += s;
+
+    /* otherwise pathid is still the path of the previous peer */
+    if (u64 != ROW_SET_SAME_PATH && pathid_map_cnt < 0) {
+      /* we ask to deserialize (and insert) the path into the store */
+      if (view != NULL) {
+        bgpview_lock_as_path_store(view);
+      }
+      s = bgpview_io_deserialize_as_path_store_path(buf, (len - read), store,
+                                                    &pathid);
+      if (view != NULL) {
+        bgpview_unlock_as_path_store(view);
+      }
+      if (s == -1) {
+        goto err;
+      }
+      read += s;
+      buf += s;
+    } else if (u64 != ROW_SET_SAME_PATH && view != NULL) {
+      pathidx = u64 - 1;
+      if (pathidx >= (uint32_t)pathid_map_cnt) {
+        fprintf(stderr, "ERROR: Invalid path index %" PRIu32 "\n", pathidx);
+        goto err;
+      }
+      pathid = pathid_map[pathidx];
+    }
+
+    /* the peer IDs of the set have already been mapped (to 0 if the peer is
+       not in the view) */
+    if (it == NULL || skip_pfx != 0 || set->peerids[i] == 0) {
+      continue;
+    }
+
+    if (pfx_peer_cb != NULL) {
+      /* get the store path using the id */
+      store_path = bgpstream_as_path_store_get_store_path(store, pathid);
+      /* ask the caller if they want this pfx-peer */
+      if ((filter = pfx_peer_cb(store_path)) < 0) {
+        goto err;
+      }
+      if (filter == 0) {
+        continue;
+      }
+    }
+
+    if (locked == 0) {
+      /* with concurrent writers, other rows may be updated meanwhile */
+      if (bgpview_iter_lock_pfx(it, &pfx) != 0) {
+        goto err;
+      }
+      locked = 1;
+    }
+
+    row_peerids[row_cnt] = set->peerids[i];
+    row_pathids[row_cnt] = pathid;
+    row_cnt++;
+  }
+
+  if (row_cnt > 0) {
+    if (bgpview_iter_add_pfx_row(it, &pfx, row_peerids, row_pathids, row_cnt,
+                                 BGPVIEW_FIELD_ACTIVE) != 0) {
+      fprintf(stderr, "Could not add prefix\n");
+      goto err;
+    }
+  }
+
+  if (locked != 0) {
+    bgpview_iter_unlock_pfx(it);
+  }
+
+  return read;
+
+err:
+  if (locked != 0) {
+    bgpview_iter_unlock_pfx(it);
+  }
+  return -1;
+}
+
+int bgpview_io_deserialize_valid_pfx_row(
+  uint8_t *buf, size_t len, bgpview_iter_t *it,
+  bgpview_io_filter_pfx_cb_t *pfx_cb,
+  bgpview_io_filter_pfx_peer_cb_t *pfx_peer_cb, bgpstream_peer_id_t *peerid_map,
+  int peerid_map_cnt, bgpstream_as_path_store_path_id_t *pathid_map,
+  int pathid_map_cnt, bgpview_io_peersets_t *sets,
+  bgpview_field_state_t state)
+{
+  size_t read = 0;
+  ssize_t s = 0;
+  int skip_pfx = 0;
+
+  bgpstream_pfx_t pfx;
+
+  int filter = 0;
+
+  int pfx_peers_added = 0;
+
+  int locked = 0;
+
+  bgpstream_peer_id_t peerid;
+  uint32_t pathidx;
+
+  int v2 = 0;
+  uint64_t u64;
+  uint32_t zigzag;
+  int32_t last_peerid = 0;
+  int same_path = 0;
+
+  bgpview_t *view = NULL;
+  bgpstream_as_path_store_t *store = NULL;
+  bgpstream_as_path_store_path_t *store_path = NULL;
+  bgpstream_as_path_store_path_id_t pathid;
+
+  /* active pfx-peers waiting to be inserted into the view */
+  bgpstream_peer_id_t row_peerids[BGPVIEW_IO_ROW_BATCH_LEN];
+  bgpstream_as_path_store_path_id_t row_pathids[BGPVIEW_IO_ROW_BATCH_LEN];
+  int row_cnt = 0;
+
+  if (it != NULL) {
+    view = bgpview_iter_get_view(it);
+    store = bgpview_get_as_path_store(view);
+  }
+
+  /* the row has been validated, so from here on the fields are read without
+     checking the length of the buffer (and the end of row marker is always
+     found) */
+
+  if (*buf == BGPVIEW_IO_ROW_SET_HDR) {
+    /* the validation ensured that the set exists */
+    return deserialize_valid_set_row(buf, len, it, pfx_cb, pfx_peer_cb,
+                                     pathid_map, pathid_map_cnt, sets);
+  }
+
+  /* v2 rows start with a header byte, v1 rows directly with the prefix */
+  if (*buf == BGPVIEW_IO_ROW_V2_HDR) {
+    v2 = 1;
+    buf++;
+    read++;
+  }
+
+  if ((s = bgpview_io_deserialize_pfx(buf, (len - read), &pfx)) == -1) {
+    goto err;
+  }
+  read += s;
+  buf += s;
+
+  if (pfx_cb != NULL && state == BGPVIEW_FIELD_ACTIVE) {
+    /* ask the caller if they want this pfx */
+    if ((filter = pfx_cb(&pfx)) < 0) {
+      goto err;
+    }
+    if (filter == 0) {
+      skip_pfx = 1;
+    }
+  }
+
+  while (1) {
+    if (v2 != 0) {
+      /* delta-coded peer id and same-path flag */
+      s = read_valid_varint(buf, &u64);
+      read += s;
+      buf += s;
+
+      if (u64 == ROW_V2_END) {
+        /* end of peers */
+        break;
+      }
+
+      same_path = (u64 & ROW_V2_SAME_PATH) != 0;
+      zigzag = (uint32_t)(u64 >> 1);
+      last_peerid += (int32_t)(zigzag >> 1) ^ -(int32_t)(zigzag & 1);
+      peerid = last_peerid;
+    } else {
+      /* peer id */
+      memcpy(&peerid, buf, sizeof(peerid));
+      read += sizeof(peerid);
+      buf += sizeof(peerid);
+      peerid = ntohs(peerid);
+
+      if (peerid == BGPVIEW_IO_END_OF_PEERS) {
+        /* end of peers */
+        break;
+      }
+    }
+
+    /* are the paths actually serialized, or just an index? (if the cell has
+       the same path as the previous one, pathid is already set) */
+    if (same_path == 0 && pathid_map_cnt >= 0 &&
+        state == BGPVIEW_FIELD_ACTIVE) {
       /* AS Path Index */
-      BGPVIEW_IO_DESERIALIZE_VAL(buf, len, read, pathidx);
+      if (v2 != 0) {
+        s = read_valid_varint(buf, &u64);
+        read += s;
+        buf += s;
+        pathidx = u64;
+      } else {
+        memcpy(&pathidx, buf, sizeof(pathidx));
+        read += sizeof(pathidx);
+        buf += sizeof(pathidx);
+      }
       if (view != NULL) {
+        if (pathidx >= (uint32_t)pathid_map_cnt) {
+          fprintf(stderr, "ERROR: Invalid path index %" PRIu32 "\n", pathidx);
+          goto err;
+        }
         pathid = pathid_map[pathidx];
       }
-    } else if (state == BGPVIEW_FIELD_ACTIVE) {
+    } else if (same_path == 0 && state == BGPVIEW_FIELD_ACTIVE) {
       /* we ask to deserialize (and insert) the path into the store */
-      if ((s = bgpview_io_deserialize_as_path_store_path(
-             buf, (len - read), store, &pathid)) == -1) {
+      if (view != NULL) {
+        bgpview_lock_as_path_store(view);
+      }
+      s = bgpview_io_deserialize_as_path_store_path(buf, (len - read), store,
+                                                    &pathid);
+      if (view != NULL) {
+        bgpview_unlock_as_path_store(view);
+      }
+      if (s == -1) {
         goto err;
       }
       read += s;
@@ -503,7 +1680,10 @@ int bgpview_io_deserialize_pfx_row(
     }
     /* all code below here has a valid iter */
 
-    assert(peerid < peerid_map_cnt);
+    if (peerid >= peerid_map_cnt) {
+      fprintf(stderr, "ERROR: Invalid peer ID %" PRIu16 "\n", peerid);
+      goto err;
+    }
 
     if (pfx_peer_cb != NULL && state == BGPVIEW_FIELD_ACTIVE) {
       /* get the store path using the id */
@@ -517,25 +1697,25 @@ int bgpview_io_deserialize_pfx_row(
       }
     }
 
+    if (locked == 0) {
+      /* with concurrent writers, other rows may be updated meanwhile */
+      if (bgpview_iter_lock_pfx(it, &pfx) != 0) {
+        goto err;
+      }
+      locked = 1;
+    }
+
     if (state == BGPVIEW_FIELD_ACTIVE) {
-      if (pfx_peers_added == 0) {
-        /* we have to use add_pfx_peer */
-        if (bgpview_iter_add_pfx_peer_by_id(it, &pfx,
-                                            peerid_map[peerid], pathid) != 0) {
-          fprintf(stderr, "Could not add prefix\n");
-          goto err;
-        }
-      } else {
-        /* we can use pfx_add_peer for efficiency */
-        if (bgpview_iter_pfx_add_peer_by_id(it, peerid_map[peerid], pathid) !=
-            0) {
+      /* buffer the cell, the row is inserted in one go */
+      row_peerids[row_cnt] = peerid_map[peerid];
+      row_pathids[row_cnt] = pathid;
+      if (++row_cnt == BGPVIEW_IO_ROW_BATCH_LEN) {
+        if (bgpview_iter_add_pfx_row(it, &pfx, row_peerids, row_pathids,
+                                     row_cnt, BGPVIEW_FIELD_ACTIVE) != 0) {
           fprintf(stderr, "Could not add prefix\n");
           goto err;
         }
-      }
-      if (bgpview_iter_pfx_activate_peer(it) < 0) {
-        fprintf(stderr, "Could not activate prefix\n");
-        goto err;
+        row_cnt = 0;
       }
     } else {
       if (pfx_peers_added == 0) {
@@ -557,13 +1737,63 @@ int bgpview_io_deserialize_pfx_row(
     pfx_peers_added++;
   }
 
-  /* peer cnt */
-  BGPVIEW_IO_DESERIALIZE_VAL(buf, len, read, peer_cnt);
-  peer_cnt = ntohs(peer_cnt);
-  assert(peer_cnt == pfx_peer_rx);
+  if (row_cnt > 0) {
+    if (bgpview_iter_add_pfx_row(it, &pfx, row_peerids, row_pathids, row_cnt,
+                                 BGPVIEW_FIELD_ACTIVE) != 0) {
+      fprintf(stderr, "Could not add prefix\n");
+      goto err;
+    }
+    row_cnt = 0;
+  }
+
+  if (locked != 0) {
+    bgpview_iter_unlock_pfx(it);
+    locked = 0;
+  }
+
+  /* peer cnt (already checked by the validation) */
+  if (v2 != 0) {
+    read += read_valid_varint(buf, &u64);
+  } else {
+    read += sizeof(uint16_t);
+  }
 
   return read;
 
 err:
+  if (locked != 0) {
+    bgpview_iter_unlock_pfx(it);
+  }
   return -1;
 }
+
+int bgpview_io_deserialize_pfx_row(
+  uint8_t *buf, size_t len, bgpview_iter_t *it,
+  bgpview_io_filter_pfx_cb_t *pfx_cb,
+  bgpview_io_filter_pfx_peer_cb_t *pfx_peer_cb, bgpstream_peer_id_t *peerid_map,
+  int peerid_map_cnt, bgpstream_as_path_store_path_id_t *pathid_map,
+  int pathid_map_cnt, bgpview_io_peersets_t *sets,
+  bgpview_field_state_t state)
+{
+  int use_pathid;
+
+  if (state != BGPVIEW_FIELD_ACTIVE) {
+    use_pathid = -1;
+  } else if (pathid_map_cnt >= 0) {
+    use_pathid = 1;
+  } else {
+    use_pathid = 0;
+  }
+
+  /* the maps are only used if there is a view to deserialize into */
+  if (bgpview_io_validate_pfx_row(buf, len, use_pathid, sets,
+                                  (it != NULL) ? peerid_map_cnt : -1,
+                                  (it != NULL) ? pathid_map_cnt : -1) == -1) {
+    fprintf(stderr, "ERROR: Malformed prefix row\n");
+    return -1;
+  }
+
+  return bgpview_io_deserialize_valid_pfx_row(
+    buf, len, it, pfx_cb, pfx_peer_cb, peerid_map, peerid_map_cnt, pathid_map,
+    pathid_map_cnt, sets, state);
+}
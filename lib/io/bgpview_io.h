@@ -44,9 +44,71 @@ typedef enum {
 
 } bgpview_io_filter_type_t;
 
+/** Encodings of the cells of a prefix row */
+typedef enum {
+
+  /** Fixed-size peer IDs and path indexes, terminated by
+      BGPVIEW_IO_END_OF_PEERS */
+  BGPVIEW_IO_ROW_ENCODING_V1 = 1,
+
+  /** Delta-coded varint peer IDs, varint path indexes, and a flag for paths
+      that repeat the path of the previous cell */
+  BGPVIEW_IO_ROW_ENCODING_V2 = 2,
+
+  /** The v2 encoding, but rows may instead refer to a dictionary of the peer
+      sets of the view (see bgpview_io_peersets_t), which is sent once per
+      view along with the peer and path tables. Kafka producers only send the
+      dictionary with sync frames, the rows of diff frames use the v2
+      encoding. */
+  BGPVIEW_IO_ROW_ENCODING_V3 = 3,
+
+} bgpview_io_row_encoding_t;
+
+/** Opaque structure for a dictionary of the sets of peers that observe the
+    prefixes of a view. Many prefixes are observed by exactly the same peers
+    (e.g., all the full-feed peers of a collector), so a row can refer to its
+    set by ID rather than list the peers. */
+typedef struct bgpview_io_peersets bgpview_io_peersets_t;
+
+/** State of a prefix row that is serialized one cell at a time (see
+ * bgpview_io_serialize_pfx_row_start)
+ */
+typedef struct bgpview_io_row {
+
+  /** Encoding of the row */
+  bgpview_io_row_encoding_t encoding;
+
+  /** Number of cells serialized so far */
+  int cells_cnt;
+
+  /** Peer ID of the previous cell */
+  bgpstream_peer_id_t last_peerid;
+
+  /** Path of the previous cell */
+  bgpstream_as_path_store_path_t *last_spath;
+
+} bgpview_io_row_t;
+
 /** Magic number that denotes the end of the peers array */
 #define BGPVIEW_IO_END_OF_PEERS 0xffff
 
+/** First byte of a prefix row in the v2 encoding. Rows in the v1 encoding
+    start with the IP version of the prefix (4 or 6), so the deserializer
+    tells them apart by this byte. */
+#define BGPVIEW_IO_ROW_V2_HDR 0x82
+
+/** First byte of a prefix row that refers to a set of the peer set
+    dictionary. Such a row only has the path of each peer of the set. */
+#define BGPVIEW_IO_ROW_SET_HDR 0x83
+
+/** Maximum number of bytes used by a serialized varint */
+#define BGPVIEW_IO_VARINT_MAX_LEN 10
+
+/** Maximum number of pfx-peers that readers buffer before inserting them into
+    the view with bgpview_iter_add_pfx_row, and that writers fetch at once
+    with bgpview_iter_pfx_get_cells */
+#define BGPVIEW_IO_ROW_BATCH_LEN 1024
+
 /** Convenience macro to serialize a simple variable into a byte array.
  *
  * @param buf           pointer to the buffer (will be updated)
@@ -78,6 +140,26 @@ typedef enum {
     buf += sizeof(to);                                                         \
   } while (0)
 
+/** Convenience macro to deserialize a simple variable from a byte array,
+ * jumping to the `err` label (rather than asserting) if the buffer is too
+ * short. Use this for data received from the network.
+ *
+ * @param buf           pointer to the buffer (will be updated)
+ * @param len           total length of the buffer
+ * @param read          the number of bytes already read from the buffer
+ *                      (will be updated)
+ * @param to            the variable to deserialize
+ */
+#define BGPVIEW_IO_DESERIALIZE_VAL_CHECKED(buf, len, read, to)                 \
+  do {                                                                         \
+    if (((len) - (read)) < sizeof(to)) {                                       \
+      goto err;                                                                \
+    }                                                                          \
+    memcpy(&(to), (buf), sizeof(to));                                          \
+    read += sizeof(to);                                                        \
+    buf += sizeof(to);                                                         \
+  } while (0)
+
 /** Callback for filtering entries in a view when sending from
  * bgpview_io_client.
  *
@@ -119,6 +201,26 @@ typedef int(bgpview_io_filter_pfx_cb_t)(bgpstream_pfx_t *pfx);
 typedef int(bgpview_io_filter_pfx_peer_cb_t)(
   bgpstream_as_path_store_path_t *store_path);
 
+/** Serialize the given value as a varint (7 bits per byte, least significant
+ * group first)
+ *
+ * @param buf           pointer to the buffer to serialize into
+ * @param len           length of the buffer
+ * @param val           value to serialize
+ * @return the number of bytes written, or -1 if the buffer is too short
+ */
+int bgpview_io_serialize_varint(uint8_t *buf, size_t len, uint64_t val);
+
+/** Deserialize a varint from the given buffer
+ *
+ * @param buf           pointer to the buffer to deserialize from
+ * @param len           length of the buffer
+ * @param[out] val      set to the deserialized value
+ * @return the number of bytes read, or -1 if the buffer does not hold a
+ * valid varint
+ */
+int bgpview_io_deserialize_varint(uint8_t *buf, size_t len, uint64_t *val);
+
 /** Serialize the given IP address into the given buffer
  *
  * @param buf           pointer to the buffer to serialize into
@@ -257,14 +359,198 @@ int bgpview_io_serialize_pfx_peers(uint8_t *buf, size_t len, bgpview_iter_t *it,
  * @param use_pathid    if 1, only path IDs will be serialized, not the
  *                      actual paths, if -1, then no path information will be
  *                      included
+ * @param encoding      encoding of the cells
  * @return the number of bytes written, 0 if there were no peers to write, or -1
  * on error
+ *
+ * Cells are serialized in the order the view stores them, i.e. by peer ID,
+ * which keeps the deltas between the peer IDs of the v2 encoding small.
  */
 int bgpview_io_serialize_pfx_row(uint8_t *buf, size_t len, bgpview_iter_t *it,
                                  int *peers_cnt, bgpview_io_filter_cb_t *cb,
-                                 void *cb_user, int use_pathid);
+                                 void *cb_user, int use_pathid,
+                                 bgpview_io_row_encoding_t encoding);
+
+/** Start serializing a prefix row one cell at a time
+ *
+ * @param buf           pointer to the buffer to serialize into
+ * @param len           length of the buffer
+ * @param row           pointer to the row state to initialize
+ * @param encoding      encoding of the cells
+ * @param pfx           pointer to the prefix of the row
+ * @return the number of bytes written, or -1 on error
+ *
+ * This is used to serialize rows that are not read from a view iterator
+ * (e.g. the cells that changed between two views). The row must be completed
+ * by bgpview_io_serialize_pfx_row_end once all cells were added.
+ */
+int bgpview_io_serialize_pfx_row_start(uint8_t *buf, size_t len,
+                                       bgpview_io_row_t *row,
+                                       bgpview_io_row_encoding_t encoding,
+                                       bgpstream_pfx_t *pfx);
+
+/** Serialize a cell of a prefix row
+ *
+ * @param buf           pointer to the buffer to serialize into
+ * @param len           length of the buffer
+ * @param row           pointer to the row state
+ * @param peerid        ID of the peer of the cell
+ * @param spath         pointer to the store path of the cell
+ * @param use_pathid    as for bgpview_io_serialize_pfx_row (must be the same
+ *                      for all cells of the row)
+ * @return the number of bytes written, or -1 on error
+ */
+int bgpview_io_serialize_pfx_row_cell(uint8_t *buf, size_t len,
+                                      bgpview_io_row_t *row,
+                                      bgpstream_peer_id_t peerid,
+                                      bgpstream_as_path_store_path_t *spath,
+                                      int use_pathid);
+
+/** Complete the serialization of a prefix row
+ *
+ * @param buf           pointer to the buffer to serialize into
+ * @param len           length of the buffer
+ * @param row           pointer to the row state
+ * @return the number of bytes written, or -1 on error
+ */
+int bgpview_io_serialize_pfx_row_end(uint8_t *buf, size_t len,
+                                     bgpview_io_row_t *row);
+
+/** Create an empty peer set dictionary
+ *
+ * @return pointer to the dictionary, or NULL on error
+ */
+bgpview_io_peersets_t *bgpview_io_peersets_create(void);
+
+/** Destroy the given peer set dictionary
+ *
+ * @param sets          pointer to the dictionary to destroy
+ */
+void bgpview_io_peersets_destroy(bgpview_io_peersets_t *sets);
+
+/** Remove all the sets from the given peer set dictionary
+ *
+ * @param sets          pointer to the dictionary to clear
+ */
+void bgpview_io_peersets_clear(bgpview_io_peersets_t *sets);
+
+/** Build the peer set dictionary of a view
+ *
+ * @param sets          pointer to the dictionary to build (it is cleared
+ *                      first)
+ * @param it            pointer to a valid BGPView iterator
+ * @param cb            pointer to a filter callback
+ * @param cb_user       user pointer provided to filter callback
+ * @return the number of sets in the dictionary, or -1 on error
+ *
+ * Only the sets of peers shared by at least two prefixes are given an ID
+ * (the rows of other prefixes list their peers instead). The filter callback
+ * is used as when serializing the prefix rows.
+ */
+int bgpview_io_peersets_build(bgpview_io_peersets_t *sets, bgpview_iter_t *it,
+                              bgpview_io_filter_cb_t *cb, void *cb_user);
+
+/** Get the number of sets in the given peer set dictionary
+ *
+ * @param sets          pointer to the dictionary
+ * @return the number of sets (which have IDs 0 to the number of sets - 1)
+ */
+int bgpview_io_peersets_get_cnt(bgpview_io_peersets_t *sets);
+
+/** Serialize a set of the given peer set dictionary
+ *
+ * @param buf           pointer to the buffer to serialize into
+ * @param len           length of the buffer
+ * @param sets          pointer to the dictionary
+ * @param id            ID of the set to serialize
+ * @return the number of bytes written, or -1 on error
+ */
+int bgpview_io_serialize_peerset(uint8_t *buf, size_t len,
+                                 bgpview_io_peersets_t *sets, int id);
+
+/** Deserialize a set and append it to the given peer set dictionary
+ *
+ * @param buf           pointer to the buffer to deserialize from
+ * @param len           length of the buffer
+ * @param sets          pointer to the dictionary to add the set to
+ * @param peerid_map    pointer to a mapping from serialized peerid to those in
+ *                      the view (may be NULL if there is no view)
+ * @param peerid_map_cnt number of elements in the peerid_map
+ * @return the number of bytes read, or -1 on error
+ *
+ * The peer IDs are mapped once here, rather than for every row that refers
+ * to the set. Peers that are not in the view (e.g., that were filtered out)
+ * are mapped to 0, and their cells are skipped.
+ */
+int bgpview_io_deserialize_peerset(uint8_t *buf, size_t len,
+                                   bgpview_io_peersets_t *sets,
+                                   bgpstream_peer_id_t *peerid_map,
+                                   int peerid_map_cnt);
+
+/** Serialize the current prefix as a row that refers to its peer set
+ *
+ * @param buf           pointer to the buffer to serialize into
+ * @param len           length of the buffer
+ * @param it            pointer to a valid BGPView iterator
+ * @param sets          pointer to the dictionary built for the view
+ * @param peers_cnt[out] if not NULL, set to the number of pfx-peers serialized
+ * @param cb            pointer to a filter callback
+ * @param cb_user       user pointer provided to filter callback
+ * @param use_pathid    if 1, path indexes are serialized, otherwise (0) the
+ *                      full paths are
+ * @return the number of bytes written, 0 if there were no peers to write, or -1
+ * on error
+ *
+ * If the set of peers of the prefix is not in the dictionary, a (literal) v2
+ * row is serialized instead.
+ */
+int bgpview_io_serialize_pfx_set_row(uint8_t *buf, size_t len,
+                                     bgpview_iter_t *it,
+                                     bgpview_io_peersets_t *sets,
+                                     int *peers_cnt, bgpview_io_filter_cb_t *cb,
+                                     void *cb_user, int use_pathid);
+
+/** Check that the given buffer starts with a well-formed 'prefix row'
+ *
+ * @param buf           pointer to the buffer to validate
+ * @param len           length of the buffer
+ * @param use_pathid    how the paths were serialized (1 for path indexes, 0
+ *                      for full paths and -1 if paths were omitted), as for
+ *                      bgpview_io_serialize_pfx_row
+ * @param sets          pointer to the peer set dictionary that the row may
+ *                      refer to (may be NULL)
+ * @param peerid_map_cnt number of elements in the peerid_map the row will be
+ *                      deserialized with (-1 to not check the peer IDs)
+ * @param pathid_map_cnt number of elements in the pathid_map the row will be
+ *                      deserialized with (-1 to not check the path indexes,
+ *                      0 if the transport has no path ID map)
+ * @return the length of the row, or -1 if it is truncated or malformed
+ *
+ * This only walks the row (without touching a view), so that a message
+ * buffer containing several rows can be checked before any of them is
+ * applied. Peer IDs and path indexes that are out of the range of the maps
+ * make the row invalid too, so that the deserialization cannot fail half way
+ * through a message.
+ */
+int bgpview_io_validate_pfx_row(uint8_t *buf, size_t len, int use_pathid,
+                                bgpview_io_peersets_t *sets,
+                                int peerid_map_cnt, int pathid_map_cnt);
 
-/** Deserialize a full 'prefix row' from the given buffer
+/** Deserialize a 'prefix row' that has been checked using
+ * bgpview_io_validate_pfx_row
+ *
+ * Parameters are as for bgpview_io_deserialize_pfx_row. The buffer is not
+ * bounds-checked again, so this must only be given validated rows.
+ */
+int bgpview_io_deserialize_valid_pfx_row(
+  uint8_t *buf, size_t len, bgpview_iter_t *it,
+  bgpview_io_filter_pfx_cb_t *pfx_cb,
+  bgpview_io_filter_pfx_peer_cb_t *pfx_peer_cb, bgpstream_peer_id_t *peerid_map,
+  int peerid_map_cnt, bgpstream_as_path_store_path_id_t *pathid_map,
+  int pathid_map_cnt, bgpview_io_peersets_t *sets,
+  bgpview_field_state_t state);
+
+/** Deserialize a full 'prefix row' (in either encoding) from the given buffer
  *
  * @param buf           pointer to the buffer to deserialize from
  * @param len           length of the buffer
@@ -276,6 +562,8 @@ int bgpview_io_serialize_pfx_row(uint8_t *buf, size_t len, bgpview_iter_t *it,
  * @param peerid_map_cnt number of elements in the peerid_map
  * @param pathid_map    pointer to a mapping from serialized path index to IDs
  *                      in the path store
+ * @param sets          pointer to the peer set dictionary that the row may
+ *                      refer to (may be NULL)
  * @param state         indicates if the deserialized cells should be activated
  *                      or deactivated
  * @return the number of bytes read, or -1 on error
@@ -283,12 +571,21 @@ int bgpview_io_serialize_pfx_row(uint8_t *buf, size_t len, bgpview_iter_t *it,
  * If the pathid_map_cnt is < 0, then it is assumed that the full path is
  * serialized directly into the buffer. **Note:** An empty pathid_map is valid
  * iff the view is also NULL (i.e., a no-op read).
+ *
+ * The row is validated (see bgpview_io_validate_pfx_row) before it is
+ * decoded, so a malformed row is rejected without modifying the view.
+ *
+ * If concurrent writers are enabled for the view (see
+ * bgpview_enable_concurrent_writers), the row is locked while it is updated,
+ * so rows may be deserialized into the same view by several threads at once
+ * (each with its own iterator).
  */
 int bgpview_io_deserialize_pfx_row(
   uint8_t *buf, size_t len, bgpview_iter_t *it,
   bgpview_io_filter_pfx_cb_t *pfx_cb,
   bgpview_io_filter_pfx_peer_cb_t *pfx_peer_cb, bgpstream_peer_id_t *peerid_map,
   int peerid_map_cnt, bgpstream_as_path_store_path_id_t *pathid_map,
-  int pathid_map_cnt, bgpview_field_state_t state);
+  int pathid_map_cnt, bgpview_io_peersets_t *sets,
+  bgpview_field_state_t state);
 
 #endif /* __BGPVIEW_IO_H */
@@ -55,6 +55,7 @@ struct bgpview_io_bsrt {
   bgpstream_data_interface_id_t di_id;
   bgpstream_data_interface_info_t *di_info;
   bgpcorsaro_t *bgpcorsaro;
+  bgpview_pub_t *pub;
   struct {
     int gap_limit;
     char *tmpl;
@@ -64,6 +65,7 @@ struct bgpview_io_bsrt {
     int rotate;
     int meta_rotate;
     int logfile_disable;
+    int pub_interval;
     uint32_t minimum_time;
   } cfg;
 };
@@ -603,7 +605,12 @@ static void usage(bgpview_io_bsrt_t *bsrt)
     "   -i <interval>  distribution interval in seconds (default: %d)\n"
     "   -a             align the end time of the first interval\n"
     "   -g <gap-limit> maximum allowed gap between packets (0 is no limit) "
-    "(default: %d)\n",
+    "(default: %d)\n"
+    "   -u <period>    publish versions of the view for concurrent readers "
+    "every\n"
+    "                  <period> seconds (bgp time) and at the end of each "
+    "interval\n"
+    "                  (0 publishes only at the end of each interval)\n",
     BGPVIEW_IO_BSRT_INTERVAL_DEFAULT, BGPVIEW_IO_BSRT_GAPLIMIT_DEFAULT);
   fprintf(
     stderr,
@@ -675,7 +682,7 @@ static int parse_args(bgpview_io_bsrt_t *bsrt, int argc, char **argv)
   optind = 1;
 
   /* remember the argv strings DO NOT belong to us */
-  while ((opt = getopt(argc, argv, "d:o:p:c:t:w:j:k:y:P:i:ag:lLB:n:O:r:R:h")) >= 0) {
+  while ((opt = getopt(argc, argv, "d:o:p:c:t:w:j:k:y:P:i:ag:lLB:n:O:r:R:u:h")) >= 0) {
     switch (opt) {
     case 'd':
       if (strcmp(optarg, "test") == 0) {
@@ -840,6 +847,10 @@ static int parse_args(bgpview_io_bsrt_t *bsrt, int argc, char **argv)
       bsrt->cfg.meta_rotate = atoi(optarg);
       break;
 
+    case 'u':
+      bsrt->cfg.pub_interval = atoi(optarg);
+      break;
+
     case ':':
       fprintf(stderr, "ERROR: Missing option argument for -%c\n", optopt);
       usage(bsrt);
@@ -994,6 +1005,7 @@ bgpview_io_bsrt_t *bgpview_io_bsrt_init(const char *opts, timeseries_t *timeseri
   bsrt->cfg.gap_limit = BGPVIEW_IO_BSRT_GAPLIMIT_DEFAULT;
   bsrt->cfg.interval = -1000;
   bsrt->cfg.meta_rotate = -1;
+  bsrt->cfg.pub_interval = -1;
 
   if ((bsrt->stream = bgpstream_create()) == NULL) {
     fprintf(stderr, "ERROR: Could not create BGPStream instance\n");
@@ -1054,6 +1066,15 @@ bgpview_io_bsrt_t *bgpview_io_bsrt_init(const char *opts, timeseries_t *timeseri
     bgpcorsaro_disable_logfile(bsrt->bgpcorsaro);
   }
 
+  if (bsrt->cfg.pub_interval >= 0) {
+    if ((bsrt->pub = bgpview_pub_create()) == NULL) {
+      fprintf(stderr, "ERROR: Could not create view publisher\n");
+      goto err;
+    }
+    bsrt->bgpcorsaro->shared_pub = bsrt->pub;
+    bsrt->bgpcorsaro->pub_interval = bsrt->cfg.pub_interval;
+  }
+
   if (bgpcorsaro_start_output(bsrt->bgpcorsaro) != 0) {
     usage(bsrt);
     goto err;
@@ -1081,6 +1102,9 @@ void bgpview_io_bsrt_destroy(bgpview_io_bsrt_t *bsrt)
     bgpstream_destroy(bsrt->stream);
     bsrt->stream = NULL;
   }
+  /* the routing tables may publish until bgpcorsaro is finalized */
+  bgpview_pub_destroy(bsrt->pub);
+  bsrt->pub = NULL;
   if (bsrt->cfg.name)
     free(bsrt->cfg.name);
   if (bsrt->cfg.tmpl)
@@ -1118,3 +1142,8 @@ bgpview_t *bgpview_io_bsrt_get_view_ptr(bgpview_io_bsrt_t *bsrt)
 {
   return bsrt->bgpcorsaro->shared_view;
 }
+
+bgpview_pub_t *bgpview_io_bsrt_get_pub(bgpview_io_bsrt_t *bsrt)
+{
+  return bsrt->pub;
+}
@@ -107,4 +107,16 @@ int bgpview_io_bsrt_recv_view(bgpview_io_bsrt_t *client);
 /** Return a pointer to the view */
 bgpview_t *bgpview_io_bsrt_get_view_ptr(bgpview_io_bsrt_t *client);
 
+/** Return a pointer to the publisher of versions of the view
+ *
+ * @param client        pointer to a BSRT client instance
+ * @return pointer to the publisher, or NULL if publication was not enabled
+ * (using the -u option)
+ *
+ * Reader threads register with the publisher (see bgpview_pub_reader_create)
+ * to access the latest version of the view without locking, while the view
+ * is being updated. They must be done before the client is destroyed.
+ */
+bgpview_pub_t *bgpview_io_bsrt_get_pub(bgpview_io_bsrt_t *client);
+
 #endif /* __BGPVIEW_IO_BSRT_H */
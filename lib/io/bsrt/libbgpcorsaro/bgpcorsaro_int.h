@@ -199,6 +199,12 @@ struct bgpcorsaro {
 
   /** Shared bgpview */
   bgpview_t *shared_view;
+
+  /** Publisher of versions of the shared bgpview (borrowed, may be NULL) */
+  bgpview_pub_t *shared_pub;
+
+  /** Number of seconds (bgp time) between two publications */
+  uint32_t pub_interval;
 };
 
 #ifdef WITH_PLUGIN_TIMING
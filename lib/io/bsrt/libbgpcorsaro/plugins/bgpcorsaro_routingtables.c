@@ -134,6 +134,11 @@ int bgpcorsaro_routingtables_init_output(bgpcorsaro_t *bgpcorsaro)
 
   bgpcorsaro->shared_view = routingtables_get_view_ptr(state->routing_tables);
 
+  if (bgpcorsaro->shared_pub != NULL) {
+    routingtables_set_publisher(state->routing_tables, bgpcorsaro->shared_pub,
+                                bgpcorsaro->pub_interval);
+  }
+
   /* defer opening the output file until we start the first interval */
 
   return 0;
@@ -54,6 +54,20 @@
  *  in the RIB, then it is considered UNKNOWN */
 #define RT_MAX_INACTIVE_TIME 3600
 
+/** Maximum number of prefixes garbage collected at the end of each interval.
+ *  Removed prefixes (and pfx-peers) that do not fit in the budget are left
+ *  for the next interval, so that garbage collection never stops the world */
+#define RT_GC_STEP_BUDGET 100000
+
+/** Number of prefixes waiting to be garbage collected above which a full
+ *  garbage collection is run (i.e. removals outpace the step budget) */
+#define RT_GC_MAX_BACKLOG 1000000
+
+/** Maximum number of prefixes of a version of the view built for each
+ *  record (see routingtables_set_publisher). Versions are built in steps
+ *  from a snapshot of the view, so that publishing never stops the world */
+#define RT_PUB_STEP_BUDGET 10000
+
 /** string buffer to contain debugging infos */
 #define BUFFER_LEN 1024
 static char buffer[BUFFER_LEN];
@@ -309,12 +323,12 @@ static void reset_peerpfxdata(routingtables_t *rt, bgpstream_peer_id_t peer_id,
         BGPVIEW_FIELD_ALL_VALID) <= 0) {
       continue; // optimization: loop below will find nothing, so skip it
     }
-    for (bgpview_iter_first_pfx(rt->iter, ipv[i], BGPVIEW_FIELD_ALL_VALID);
-         bgpview_iter_has_more_pfx(rt->iter); bgpview_iter_next_pfx(rt->iter)) {
-      if (bgpview_iter_pfx_seek_peer(rt->iter, peer_id,
-          BGPVIEW_FIELD_ALL_VALID) == 0) {
-        continue;
-      }
+    /* only visits the prefixes of this peer (see the per-peer prefix index
+       enabled in routingtables_create) */
+    for (bgpview_iter_peer_first_pfx(rt->iter, ipv[i], BGPVIEW_FIELD_ALL_VALID,
+                                     BGPVIEW_FIELD_ALL_VALID);
+         bgpview_iter_peer_has_more_pfx(rt->iter);
+         bgpview_iter_peer_next_pfx(rt->iter)) {
       perpfx_perpeer_info_t *pp = bgpview_iter_pfx_peer_get_user(rt->iter);
       pp->pfx_status &= ~RT_ANNOUNCED_PFXSTATUS;
       pp->bgp_time_last_ts = 0;
@@ -571,8 +585,11 @@ static int apply_end_of_valid_rib_operations(routingtables_t *rt)
   /* reset the eorib_peers */
   kh_clear(peer_id_collector, rt->eorib_peers);
 
-  /* call the garbage collection process */
-  bgpview_gc(rt->view);
+  /* call the (incremental) garbage collection process, and fall back to a
+     full collection if it can't keep up */
+  if (bgpview_gc_step(rt->view, RT_GC_STEP_BUDGET) > RT_GC_MAX_BACKLOG) {
+    bgpview_gc(rt->view);
+  }
 
   /* check the number of active peers and update the collector's state */
   rt_kh_for (k, rt->collectors) {
@@ -1108,6 +1125,10 @@ routingtables_t *routingtables_create(char *plugin_name,
       NULL) {
     goto err;
   }
+  /* peer session resets need to visit all the prefixes of a peer */
+  bgpview_enable_peer_pfx_index(rt->view);
+  /* consumers can diff just the prefixes that changed in each interval */
+  bgpview_enable_journal(rt->view);
 
   if ((rt->iter = bgpview_iter_create(rt->view)) == NULL)
     goto err;
@@ -1152,6 +1173,14 @@ bgpview_t *routingtables_get_view_ptr(routingtables_t *rt)
   return rt->view;
 }
 
+void routingtables_set_publisher(routingtables_t *rt, bgpview_pub_t *pub,
+                                 uint32_t pub_interval)
+{
+  rt->pub = pub;
+  rt->pub_interval = pub_interval;
+  rt->pub_next_time = 0;
+}
+
 void routingtables_set_metric_prefix(routingtables_t *rt,
     const char *metric_prefix)
 {
@@ -1188,6 +1217,13 @@ int routingtables_interval_end(routingtables_t *rt, int end_time)
   rt->bgp_time_interval_end = (uint32_t)end_time;
   apply_end_of_valid_rib_operations(rt);
 
+  /* the version is completed while the next records are processed */
+  if (rt->pub != NULL &&
+      (bgpview_pub_publish_start(rt->pub, rt->view) != 0 ||
+       bgpview_pub_publish_step(rt->pub, RT_PUB_STEP_BUDGET) < 0)) {
+    return -1;
+  }
+
   uint32_t time_now = get_wall_time_now();
 
   if (rt->metrics_output_on) {
@@ -1250,6 +1286,22 @@ int routingtables_process_record(routingtables_t *rt,
 
   refresh_collector_time(rt, c, record);
 
+  /* periodically publish a version of the view, so that readers do not have
+     to wait for the end of the interval */
+  if (ret == 0 && rt->pub != NULL && rt->pub_interval != 0 &&
+      record->time_sec >= rt->pub_next_time) {
+    if (rt->pub_next_time != 0) {
+      ret = bgpview_pub_publish_start(rt->pub, rt->view);
+    }
+    rt->pub_next_time = record->time_sec + rt->pub_interval;
+  }
+
+  /* build the version being published a little at a time */
+  if (ret == 0 && rt->pub != NULL &&
+      bgpview_pub_publish_step(rt->pub, RT_PUB_STEP_BUDGET) < 0) {
+    ret = -1;
+  }
+
   return ret;
 }
 
@@ -62,6 +62,20 @@ routingtables_t *routingtables_create(char *plugin_name,
  */
 bgpview_t *routingtables_get_view_ptr(routingtables_t *rt);
 
+/** Publish versions of the internal view for concurrent readers
+ *
+ * @param rt               pointer to a routingtables instance to update
+ * @param pub              pointer to the publisher to use (borrowed)
+ * @param pub_interval     number of seconds (bgp time) between two
+ *                         publications, 0 to only publish at the end of
+ *                         each interval
+ *
+ * Versions are built in steps, while the following records are processed,
+ * so a version appears a few records after the time it was started at.
+ */
+void routingtables_set_publisher(routingtables_t *rt, bgpview_pub_t *pub,
+                                 uint32_t pub_interval);
+
 /** Set the metric prefix to be used for when outpting the time series
  *  variables at the end of the interval
  *
@@ -244,6 +244,16 @@ typedef struct collector_metric_idx {
 
 } __attribute__((packed)) collector_metric_idx_t;
 
+/** Indices of the view metrics for a KP */
+typedef struct view_metric_idx {
+
+  /* meta metrics (memory used by the view, see bgpview_get_mem_stats) */
+#define VIEW_MEM_METRIC_IDX(field, unused) uint32_t mem_##field##_idx;
+  BGPVIEW_MEM_STATS_FIELDS(VIEW_MEM_METRIC_IDX, 0)
+#undef VIEW_MEM_METRIC_IDX
+
+} __attribute__((packed)) view_metric_idx_t;
+
 /** A set that contains a unique set of peer ids */
 KHASH_INIT(peer_id_set, uint32_t, char, 0, kh_int_hash_func, kh_int_hash_equal)
 typedef khash_t(peer_id_set) peer_id_set_t;
@@ -347,6 +357,12 @@ struct struct_routingtables_t {
   /** Timeseries Key Package */
   timeseries_kp_t *kp;
 
+  /** Indices of the view metrics in the KP */
+  view_metric_idx_t view_kp_idxs;
+
+  /** Have the view metrics been added to the KP? */
+  uint8_t view_metrics_generated;
+
   /** per collector information: name, peers and
    *  current state */
   collector_data_t *collectors;
@@ -381,6 +397,17 @@ struct struct_routingtables_t {
   /** last time (wall time) we received
    *  an interval_start signal */
   uint32_t wall_time_interval_start;
+
+  /** a borrowed pointer to the publisher that versions of the
+   *  view are published to (NULL if publication is disabled) */
+  bgpview_pub_t *pub;
+
+  /** number of seconds (bgp time) between two publications
+   *  within an interval */
+  uint32_t pub_interval;
+
+  /** bgp time at which the next version will be published */
+  uint32_t pub_next_time;
 };
 
 /** Read the view in the current routingtables instance and populate
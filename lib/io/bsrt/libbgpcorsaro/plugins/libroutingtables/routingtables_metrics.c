@@ -44,6 +44,9 @@
 // <metric-prefix>.meta.bgpcorsaro.<plugin-name>.<collector-signature>.<peer-signature>.<metric-name>
 #define RT_PEER_META_METRIC_FORMAT "%s.meta.bgpcorsaro.%s.%s.%s.%s"
 
+// <metric-prefix>.meta.bgpcorsaro.<plugin-name>.view.mem.<metric-name>
+#define RT_VIEW_META_METRIC_FORMAT "%s.meta.bgpcorsaro.%s.view.mem.%s"
+
 #define BUFFER_LEN 1024
 static char metric_buffer[BUFFER_LEN];
 
@@ -116,6 +119,22 @@ void collector_generate_metrics(routingtables_t *rt, collector_t *c)
   C_METRICS(ADD_C_METRIC, RT_COLLECTOR_METRIC_FORMAT)
 }
 
+static void view_generate_metrics(routingtables_t *rt)
+{
+#define ADD_V_METRIC(field, fmt)                                               \
+  do {                                                                         \
+    snprintf(metric_buffer, BUFFER_LEN, fmt, rt->metric_prefix,                \
+             rt->plugin_name, #field);                                         \
+    rt->view_kp_idxs.mem_##field##_idx =                                       \
+      timeseries_kp_add_key(rt->kp, metric_buffer);                            \
+    assert(rt->view_kp_idxs.mem_##field##_idx >= 0);                           \
+  } while (0);
+
+  BGPVIEW_MEM_STATS_FIELDS(ADD_V_METRIC, RT_VIEW_META_METRIC_FORMAT)
+
+  rt->view_metrics_generated = 1;
+}
+
 #define ENABLE_METRIC(metric_idx, metric_name, ptr) \
     timeseries_kp_enable_key(kp, ptr->kp_idxs.metric_idx);
 
@@ -156,6 +175,7 @@ void routingtables_dump_metrics(routingtables_t *rt, uint32_t time_now)
   bgpstream_peer_sig_t *sg;
   int processing_time = time_now - rt->wall_time_interval_start;
   uint32_t real_time_delay = time_now - rt->bgp_time_interval_start;
+  bgpview_mem_stats_t mem;
 
   /* collectors metrics */
   for (k = kh_begin(rt->collectors); k != kh_end(rt->collectors); ++k) {
@@ -290,6 +310,16 @@ void routingtables_dump_metrics(routingtables_t *rt, uint32_t time_now)
     p->rib_negative_mismatches_cnt = 0;
   }
 
+  /* view metrics */
+  if (rt->view_metrics_generated == 0) {
+    view_generate_metrics(rt);
+  }
+  bgpview_get_mem_stats(rt->view, &mem);
+#define SET_V_METRIC(field, stats)                                             \
+  timeseries_kp_set(rt->kp, rt->view_kp_idxs.mem_##field##_idx, stats.field);
+
+  BGPVIEW_MEM_STATS_FIELDS(SET_V_METRIC, mem)
+
   if (timeseries_kp_flush(rt->kp, rt->bgp_time_interval_start) != 0) {
     fprintf(stderr, "Warning: could not flush routingtables %" PRIu32 "\n",
             rt->bgp_time_interval_start);
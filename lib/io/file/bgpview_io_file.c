@@ -29,25 +29,120 @@
 #include "utils.h"
 #include <arpa/inet.h>
 #include <assert.h>
+#include <fcntl.h>
+#include <inttypes.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <wandio.h>
+#include <zlib.h>
 
 #define VIEW_MAGIC 0x42475056 /* BGPV */
 
 #define VIEW_START_MAGIC 0x53545254    /* STRT */
+#define VIEW_START_V2_MAGIC 0x53545232 /* STR2 (prefix rows use v2) */
+#define VIEW_START_V3_MAGIC 0x53545233 /* STR3 (v2 and peer set rows) */
 #define VIEW_END_MAGIC 0x56454E44      /* VEND */
 #define VIEW_PEER_END_MAGIC 0x50454E44 /* PEND */
 #define VIEW_PATH_END_MAGIC 0x50415448 /* PATH */
+#define VIEW_PEERSET_END_MAGIC 0x50534554 /* PSET */
 #define VIEW_PFX_END_MAGIC 0x58454E44  /* XEND */
 
-#define BUFFER_LEN 1024
+/* magic number at the start of each frozen view image, in host byte order
+   (see bgpview_frozen_write) */
+#define VIEW_IMAGE_MAGIC 0x42475646 /* BGVF */
+
+/* large enough for a v2 prefix row seen by every possible peer */
+#define ROW_BUFFER_LEN (1024 * 1024)
+
+/* size of the blocks that the reader reads from the file */
+#define READER_BLOCK_LEN (1024 * 1024)
+
+/* number of u32 values in a view index entry (time and 64 bit offset) */
+#define VIEW_INDEX_ENTRY_CNT 3
+
+/* set in the high word of the offset of an index entry if the offset is the
+   one of the gzip member of the view in the compressed file */
+#define VIEW_INDEX_MEMBER_FLAG 0x80000000
+
+/* size of the buffer that views are compressed into */
+#define WRITER_ZBUF_LEN (64 * 1024)
+
+/* large enough for a serialized peer set */
+#define PEERSET_BUFFER_LEN                                                     \
+  (BGPVIEW_IO_VARINT_MAX_LEN * (BGPVIEW_IO_ROW_BATCH_LEN + 1))
+
+/** Buffered reader for views. Data is read from the file in large blocks and
+    parsed from memory. The unparsed end of a block (e.g., the start of the
+    next view) is kept for the next call. */
+struct bgpview_io_file_reader {
+
+  /** File to read from */
+  io_t *infile;
+
+  /** Block of data read from the file */
+  uint8_t *buf;
+
+  /** Number of bytes allocated for the block */
+  size_t buf_size;
+
+  /** Number of bytes in the block */
+  size_t len;
+
+  /** Number of bytes of the block that have been parsed */
+  size_t pos;
+
+  /** Only read the bytes that are parsed, so that the file is left
+      positioned right after the view (see bgpview_io_file_read) */
+  int exact;
+
+  /** Name of the file, if the reader opened (and owns) it */
+  char *filename;
+
+  /** If not NULL, the file is decompressed from a gzip member (see
+      bgpview_io_file_reader_seek) rather than read from infile */
+  gzFile gzfile;
+
+  /** Has the end of the file been reached? */
+  int eof;
+};
+
+typedef struct bgpview_io_file_reader reader_t;
+
+/** Writer for views, which counts the bytes written so that views can be
+    indexed by their offset in the file */
+typedef struct writer {
+
+  /** File to write to */
+  iow_t *outfile;
+
+  /** Number of bytes written */
+  uint64_t written;
+
+  /** If not NULL, the view is compressed as a gzip member of its own */
+  z_stream *zs;
+
+} writer_t;
+
+struct bgpview_io_file_image {
+
+  /** Start of the mapped file */
+  uint8_t *base;
+
+  /** Length of the mapped file */
+  uint64_t len;
+
+  /** Offset of the next image in the file */
+  uint64_t next;
+};
 
 /* ========== UTILITIES ========== */
 
 #define WRITE_VAL(from)                                                        \
   do {                                                                         \
-    if (wandio_wwrite(outfile, &from, sizeof(from)) != sizeof(from)) {         \
+    if (writer_write(writer, &from, sizeof(from)) != sizeof(from)) {           \
       fprintf(stderr, "%s: Could not write %s to file\n", __func__,            \
               STR(from));                                                      \
     }                                                                          \
@@ -63,52 +158,171 @@
 
 #define READ_VAL(to)                                                           \
   do {                                                                         \
-    if (wandio_read(infile, &to, sizeof(to)) != sizeof(to)) {                  \
+    if (reader_read(reader, &(to), sizeof(to)) != 0) {                         \
       fprintf(stderr, "%s: Could not read %s from file\n", __func__, STR(to)); \
+      goto err;                                                                \
     }                                                                          \
   } while (0)
 
+/* make sure that at least len unparsed bytes are in the block (which only
+   fails at the end of the file). Records may span blocks, so the unparsed end
+   of the block is moved to its start before the rest is read. */
+static int reader_fill(reader_t *reader, size_t len)
+{
+  size_t avail = reader->len - reader->pos;
+  size_t want;
+  uint8_t *tmp;
+  int64_t ret;
+
+  if (avail >= len) {
+    return 0;
+  }
+
+  if (reader->pos > 0) {
+    memmove(reader->buf, reader->buf + reader->pos, avail);
+    reader->len = avail;
+    reader->pos = 0;
+  }
+
+  want = (reader->exact != 0 || len > READER_BLOCK_LEN) ? len
+                                                        : READER_BLOCK_LEN;
+  if (want > reader->buf_size) {
+    if ((tmp = realloc(reader->buf, want)) == NULL) {
+      return -1;
+    }
+    reader->buf = tmp;
+    reader->buf_size = want;
+  }
+
+  /* wandio may return less than was asked for */
+  while (reader->len < len) {
+    if (reader->gzfile != NULL) {
+      ret = gzread(reader->gzfile, reader->buf + reader->len,
+                   want - reader->len);
+    } else {
+      ret = wandio_read(reader->infile, reader->buf + reader->len,
+                        want - reader->len);
+    }
+    if (ret < 0) {
+      return -1;
+    }
+    if (ret == 0) {
+      reader->eof = 1;
+      return -1;
+    }
+    reader->len += ret;
+  }
+
+  return 0;
+}
+
+/* get a pointer to the next len bytes, and mark them as parsed */
+static uint8_t *reader_get(reader_t *reader, size_t len)
+{
+  uint8_t *ptr;
+
+  if (reader_fill(reader, len) != 0) {
+    return NULL;
+  }
+  ptr = reader->buf + reader->pos;
+  reader->pos += len;
+
+  return ptr;
+}
+
+static int reader_read(reader_t *reader, void *dst, size_t len)
+{
+  uint8_t *ptr;
+
+  if ((ptr = reader_get(reader, len)) == NULL) {
+    return -1;
+  }
+  memcpy(dst, ptr, len);
+
+  return 0;
+}
+
+/* compress the given data (or finish the gzip member if flush is Z_FINISH)
+   and write the result to the file */
+static int writer_deflate(writer_t *writer, const void *buf, int64_t len,
+                          int flush)
+{
+  uint8_t out[WRITER_ZBUF_LEN];
+  int64_t have;
+  int ret;
+
+  writer->zs->next_in = (Bytef *)buf;
+  writer->zs->avail_in = len;
+
+  do {
+    writer->zs->next_out = out;
+    writer->zs->avail_out = sizeof(out);
+    if ((ret = deflate(writer->zs, flush)) == Z_STREAM_ERROR) {
+      return -1;
+    }
+    have = sizeof(out) - writer->zs->avail_out;
+    if (have > 0 && wandio_wwrite(writer->outfile, out, have) != have) {
+      return -1;
+    }
+    writer->written += have;
+  } while (flush == Z_FINISH ? ret != Z_STREAM_END
+                             : writer->zs->avail_out == 0);
+
+  return 0;
+}
+
+static int64_t writer_write(writer_t *writer, const void *buf, int64_t len)
+{
+  int64_t ret;
+
+  if (writer->zs != NULL) {
+    return writer_deflate(writer, buf, len, Z_NO_FLUSH) == 0 ? len : -1;
+  }
+
+  if ((ret = wandio_wwrite(writer->outfile, buf, len)) > 0) {
+    writer->written += ret;
+  }
+
+  return ret;
+}
+
 /** Checks if the given magic number is present in the file. If it is, the magic
     is consumed, otherwise the stream is left untouched */
-static int check_magic(io_t *infile, uint32_t magic)
+static int check_magic(reader_t *reader, uint32_t magic)
 {
-  uint64_t buf;
   uint32_t mgc;
-  off_t read;
-  if (wandio_peek(infile, &buf, sizeof(uint64_t)) != sizeof(uint64_t)) {
+
+  if (reader_fill(reader, sizeof(uint32_t) * 2) != 0) {
     fprintf(stderr, "Could not peek at bytes\n");
     return 0;
   }
 
-  buf = ntohll(buf);
-
   /* check the generic magic */
-  mgc = (uint32_t)(buf >> 32);
-  if (mgc != VIEW_MAGIC) {
+  memcpy(&mgc, reader->buf + reader->pos, sizeof(uint32_t));
+  if (ntohl(mgc) != VIEW_MAGIC) {
     return 0;
   }
 
   /* now, check the specific magic */
-  mgc = (buf & 0xffffffff);
-  if (mgc != magic) {
+  memcpy(&mgc, reader->buf + reader->pos + sizeof(uint32_t), sizeof(uint32_t));
+  if (ntohl(mgc) != magic) {
     return 0;
   }
 
   /* now consume the magic! */
-  read = wandio_read(infile, &buf, sizeof(uint64_t));
-  assert(read == sizeof(uint64_t));
+  reader->pos += sizeof(uint32_t) * 2;
 
   return 1;
 }
 
-static int write_ip(iow_t *outfile, bgpstream_ip_addr_t *ip)
+static int write_ip(writer_t *writer, bgpstream_ip_addr_t *ip)
 {
   uint8_t len;
   switch (ip->version) {
   case BGPSTREAM_ADDR_VERSION_IPV4:
     len = sizeof(uint32_t);
     WRITE_VAL(len);
-    if (wandio_wwrite(outfile, &ip->bs_ipv4.addr.s_addr, len) == len) {
+    if (writer_write(writer, &ip->bs_ipv4.addr.s_addr, len) == len) {
       return 0;
     }
     break;
@@ -116,7 +330,7 @@ static int write_ip(iow_t *outfile, bgpstream_ip_addr_t *ip)
   case BGPSTREAM_ADDR_VERSION_IPV6:
     len = sizeof(uint8_t) * 16;
     WRITE_VAL(len);
-    if (wandio_wwrite(outfile, &ip->bs_ipv6.addr.s6_addr, len) == len) {
+    if (writer_write(writer, &ip->bs_ipv6.addr.s6_addr, len) == len) {
       return 0;
     }
     break;
@@ -128,7 +342,7 @@ static int write_ip(iow_t *outfile, bgpstream_ip_addr_t *ip)
   return -1;
 }
 
-static int read_ip(io_t *infile, bgpstream_ip_addr_t *ip)
+static int read_ip(reader_t *reader, bgpstream_ip_addr_t *ip)
 {
   assert(ip != NULL);
 
@@ -139,13 +353,13 @@ static int read_ip(io_t *infile, bgpstream_ip_addr_t *ip)
   if (len == sizeof(uint32_t)) {
     /* v4 */
     ip->version = BGPSTREAM_ADDR_VERSION_IPV4;
-    if (wandio_read(infile, &ip->bs_ipv4.addr.s_addr, len) != len) {
+    if (reader_read(reader, &ip->bs_ipv4.addr.s_addr, len) != 0) {
       goto err;
     }
   } else if (len == sizeof(uint8_t) * 16) {
     /* v6 */
     ip->version = BGPSTREAM_ADDR_VERSION_IPV6;
-    if (wandio_read(infile, &ip->bs_ipv6.addr.s6_addr, len) != len) {
+    if (reader_read(reader, &ip->bs_ipv6.addr.s6_addr, len) != 0) {
       goto err;
     }
   } else {
@@ -160,7 +374,7 @@ err:
   return -1;
 }
 
-static int write_peers(iow_t *outfile, bgpview_iter_t *it,
+static int write_peers(writer_t *writer, bgpview_iter_t *it,
                        bgpview_io_filter_cb_t *cb, void *cb_user)
 {
   uint8_t u8;
@@ -205,12 +419,12 @@ static int write_peers(iow_t *outfile, bgpview_iter_t *it,
     assert(siglen <= UINT8_MAX);
     u8 = siglen;
     WRITE_VAL(u8);
-    if (wandio_wwrite(outfile, &ps->collector_str, u8) != u8) {
+    if (writer_write(writer, &ps->collector_str, u8) != u8) {
       goto err;
     }
 
     /* peer IP address */
-    if (write_ip(outfile, &ps->peer_ip_addr) != 0) {
+    if (write_ip(writer, &ps->peer_ip_addr) != 0) {
       goto err;
     }
 
@@ -234,7 +448,7 @@ err:
   return -1;
 }
 
-static int write_paths(iow_t *outfile, bgpview_iter_t *it)
+static int write_paths(writer_t *writer, bgpview_iter_t *it)
 {
   bgpview_t *view = bgpview_iter_get_view(it);
   assert(view != NULL);
@@ -278,7 +492,7 @@ static int write_paths(iow_t *outfile, bgpview_iter_t *it)
     WRITE_VAL(path_len);
 
     /** @todo make platform independent (paths are in host byte order) */
-    if (wandio_wwrite(outfile, path_data, path_len) != path_len) {
+    if (writer_write(writer, path_data, path_len) != path_len) {
       goto err;
     }
   }
@@ -297,8 +511,42 @@ err:
   return -1;
 }
 
-static int write_pfx_peers(iow_t *outfile, bgpview_iter_t *it, int *peers_cnt,
-                           bgpview_io_filter_cb_t *cb, void *cb_user)
+/* write the peer set dictionary, each set preceded by its length */
+static int write_peersets(writer_t *writer, bgpview_io_peersets_t *sets)
+{
+  uint8_t buf[PEERSET_BUFFER_LEN];
+  ssize_t s;
+  uint16_t u16;
+  uint32_t u32;
+  int id;
+
+  for (id = 0; id < bgpview_io_peersets_get_cnt(sets); id++) {
+    if ((s = bgpview_io_serialize_peerset(buf, sizeof(buf), sets, id)) == -1) {
+      goto err;
+    }
+    u16 = htons(s);
+    WRITE_VAL(u16);
+    if (writer_write(writer, buf, s) != s) {
+      goto err;
+    }
+  }
+
+  /* write end-of-sets magic number */
+  WRITE_MAGIC(VIEW_PEERSET_END_MAGIC);
+
+  /* now send the number of sets for cross validation */
+  u32 = htonl(bgpview_io_peersets_get_cnt(sets));
+  WRITE_VAL(u32);
+
+  return 0;
+
+err:
+  return -1;
+}
+
+static int write_pfx_peers(writer_t *writer, bgpview_iter_t *it,
+                           int *peers_cnt, bgpview_io_filter_cb_t *cb,
+                           void *cb_user)
 {
   uint16_t peerid;
   bgpstream_as_path_store_path_t *spath;
@@ -306,9 +554,37 @@ static int write_pfx_peers(iow_t *outfile, bgpview_iter_t *it, int *peers_cnt,
 
   int filter;
 
+  bgpstream_peer_id_t peerids[BGPVIEW_IO_ROW_BATCH_LEN];
+  bgpstream_as_path_store_path_id_t pathids[BGPVIEW_IO_ROW_BATCH_LEN];
+  bgpstream_as_path_store_t *pathstore;
+  int cells_cnt = -1;
+  int i;
+
   assert(peers_cnt != NULL);
   *peers_cnt = 0;
 
+  /* without a filter, fetch all the cells of the prefix at once */
+  if (cb == NULL) {
+    cells_cnt =
+      bgpview_iter_pfx_get_cells(it, BGPVIEW_FIELD_ACTIVE, peerids, pathids,
+                                 BGPVIEW_IO_ROW_BATCH_LEN);
+  }
+
+  if (cells_cnt >= 0) {
+    pathstore = bgpview_get_as_path_store(bgpview_iter_get_view(it));
+    for (i = 0; i < cells_cnt; i++) {
+      assert(peerids[i] > 0);
+      peerid = htons(peerids[i]);
+      WRITE_VAL(peerid);
+
+      spath = bgpstream_as_path_store_get_store_path(pathstore, pathids[i]);
+      idx = bgpstream_as_path_store_path_get_idx(spath);
+      WRITE_VAL(idx);
+    }
+    *peers_cnt = cells_cnt;
+    return 0;
+  }
+
   for (bgpview_iter_pfx_first_peer(it, BGPVIEW_FIELD_ACTIVE);
        bgpview_iter_pfx_has_more_peer(it); bgpview_iter_pfx_next_peer(it)) {
     if (cb != NULL) {
@@ -339,7 +615,80 @@ static int write_pfx_peers(iow_t *outfile, bgpview_iter_t *it, int *peers_cnt,
   return 0;
 }
 
-static int write_pfxs(iow_t *outfile, bgpview_iter_t *it,
+/* write the prefix rows using the v2 encoding (or as references to the peer
+   set dictionary, if sets is not NULL), each one preceded by its length */
+static int write_pfxs_v2(writer_t *writer, bgpview_iter_t *it,
+                         bgpview_io_peersets_t *sets,
+                         bgpview_io_filter_cb_t *cb, void *cb_user)
+{
+  int filter;
+
+  uint32_t u32;
+
+  uint8_t *buf = NULL;
+  ssize_t s;
+
+  /* the number of pfxs we actually sent */
+  int pfx_cnt = 0;
+
+  if ((buf = malloc(ROW_BUFFER_LEN)) == NULL) {
+    goto err;
+  }
+
+  for (bgpview_iter_first_pfx(it, 0, /* all pfx versions */
+                              BGPVIEW_FIELD_ACTIVE);
+       bgpview_iter_has_more_pfx(it); bgpview_iter_next_pfx(it)) {
+    if (cb != NULL) {
+      /* ask the caller if they want this peer */
+      if ((filter = cb(it, BGPVIEW_IO_FILTER_PFX, cb_user)) < 0) {
+        goto err;
+      }
+      if (filter == 0) {
+        continue;
+      }
+    }
+
+    if (sets != NULL) {
+      s = bgpview_io_serialize_pfx_set_row(buf, ROW_BUFFER_LEN, it, sets, NULL,
+                                           cb, cb_user, 1);
+    } else {
+      s = bgpview_io_serialize_pfx_row(buf, ROW_BUFFER_LEN, it, NULL, cb,
+                                       cb_user, 1, BGPVIEW_IO_ROW_ENCODING_V2);
+    }
+    if (s == -1) {
+      goto err;
+    }
+    if (s == 0) {
+      /* prefix has no peers so skip it */
+      continue;
+    }
+
+    u32 = htonl(s);
+    WRITE_VAL(u32);
+    if (writer_write(writer, buf, s) != s) {
+      fprintf(stderr, "ERROR: Could not write prefix row to file\n");
+      goto err;
+    }
+
+    pfx_cnt++;
+  }
+
+  /* write end-of-pfxs magic */
+  WRITE_MAGIC(VIEW_PFX_END_MAGIC);
+
+  /* send pfx cnt for cross-validation */
+  u32 = htonl(pfx_cnt);
+  WRITE_VAL(u32);
+
+  free(buf);
+  return 0;
+
+err:
+  free(buf);
+  return -1;
+}
+
+static int write_pfxs(writer_t *writer, bgpview_iter_t *it,
                       bgpview_io_filter_cb_t *cb, void *cb_user)
 {
   int filter;
@@ -370,7 +719,7 @@ static int write_pfxs(iow_t *outfile, bgpview_iter_t *it,
     assert(pfx != NULL);
 
     /* pfx address */
-    if (write_ip(outfile, &pfx->address) != 0) {
+    if (write_ip(writer, &pfx->address) != 0) {
       goto err;
     }
 
@@ -379,7 +728,7 @@ static int write_pfxs(iow_t *outfile, bgpview_iter_t *it,
 
     /* send the peers */
     peers_cnt = 0;
-    if (write_pfx_peers(outfile, it, &peers_cnt, cb, cb_user) != 0) {
+    if (write_pfx_peers(writer, it, &peers_cnt, cb, cb_user) != 0) {
       goto err;
     }
 
@@ -412,7 +761,7 @@ err:
   return -1;
 }
 
-static int read_peers(io_t *infile, bgpview_iter_t *iter,
+static int read_peers(reader_t *reader, bgpview_iter_t *iter,
                       bgpview_io_filter_peer_cb_t *peer_cb,
                       bgpstream_peer_id_t **peerid_mapping)
 {
@@ -436,7 +785,7 @@ static int read_peers(io_t *infile, bgpview_iter_t *iter,
      peer asn */
   for (i = 0; i < UINT16_MAX; i++) {
     /* peerid (or end-of-peers)*/
-    if (check_magic(infile, VIEW_PEER_END_MAGIC) != 0) {
+    if (check_magic(reader, VIEW_PEER_END_MAGIC) != 0) {
       /* end of peers */
       break;
     }
@@ -449,14 +798,14 @@ static int read_peers(io_t *infile, bgpview_iter_t *iter,
 
     /* collector name */
     READ_VAL(len);
-    if (wandio_read(infile, ps.collector_str, len) != len) {
+    if (reader_read(reader, ps.collector_str, len) != 0) {
       fprintf(stderr, "ERROR: Could not read collector name\n");
       goto err;
     }
     ps.collector_str[len] = '\0';
 
     /* peer ip */
-    if (read_ip(infile, &ps.peer_ip_addr) != 0) {
+    if (read_ip(reader, &ps.peer_ip_addr) != 0) {
       fprintf(stderr, "ERROR: Could not read peer ip\n");
       goto err;
     }
@@ -516,7 +865,7 @@ err:
   return -1;
 }
 
-static int read_paths(io_t *infile, bgpview_iter_t *iter,
+static int read_paths(reader_t *reader, bgpview_iter_t *iter,
                       bgpstream_as_path_store_path_id_t **pathid_mapping)
 {
   uint32_t pc;
@@ -524,7 +873,7 @@ static int read_paths(io_t *infile, bgpview_iter_t *iter,
   uint32_t pathidx;
   uint16_t pathlen;
   uint8_t is_core;
-  uint8_t pathdata[BUFFER_LEN];
+  uint8_t *pathdata;
 
   bgpstream_as_path_store_path_id_t *idmap = NULL;
   int idmap_cnt = 0;
@@ -549,7 +898,7 @@ static int read_paths(io_t *infile, bgpview_iter_t *iter,
   /* loop until we find the path end magic number */
   while (paths_rx < UINT32_MAX) {
     /* pathid (or end-of-paths)*/
-    if (check_magic(infile, VIEW_PATH_END_MAGIC) != 0) {
+    if (check_magic(reader, VIEW_PATH_END_MAGIC) != 0) {
       /* end of peers */
       break;
     }
@@ -566,9 +915,8 @@ static int read_paths(io_t *infile, bgpview_iter_t *iter,
     /* path len */
     READ_VAL(pathlen);
 
-    /* path data */
-    assert(pathlen <= BUFFER_LEN);
-    if (wandio_read(infile, pathdata, pathlen) != pathlen) {
+    /* path data (inserted straight from the reader block) */
+    if ((pathdata = reader_get(reader, pathlen)) == NULL) {
       fprintf(stderr, "ERROR: Could not read path data\n");
       goto err;
     }
@@ -606,7 +954,57 @@ err:
   return -1;
 }
 
-static int read_pfxs(io_t *infile, bgpview_iter_t *iter,
+static int read_peersets(reader_t *reader, bgpview_io_peersets_t *sets,
+                         bgpstream_peer_id_t *peerid_map, int peerid_map_cnt)
+{
+  uint8_t *buf;
+  uint16_t set_len;
+  uint32_t sc;
+  unsigned sets_rx = 0;
+
+  /* loop until we find the set end magic number */
+  while (sets_rx < UINT32_MAX) {
+    if (check_magic(reader, VIEW_PEERSET_END_MAGIC) != 0) {
+      /* end of sets */
+      break;
+    }
+    sets_rx++;
+
+    READ_VAL(set_len);
+    set_len = ntohs(set_len);
+    if (set_len > PEERSET_BUFFER_LEN) {
+      fprintf(stderr, "ERROR: Invalid peer set length (%" PRIu16 ")\n",
+              set_len);
+      goto err;
+    }
+    if ((buf = reader_get(reader, set_len)) == NULL) {
+      fprintf(stderr, "ERROR: Could not read peer set\n");
+      goto err;
+    }
+
+    if (bgpview_io_deserialize_peerset(buf, set_len, sets, peerid_map,
+                                       peerid_map_cnt) != set_len) {
+      fprintf(stderr, "ERROR: Malformed peer set\n");
+      goto err;
+    }
+  }
+
+  /* receive the number of sets */
+  READ_VAL(sc);
+  sc = ntohl(sc);
+  if (sc != sets_rx) {
+    fprintf(stderr, "ERROR: Expected %" PRIu32 " peer sets, got %u\n", sc,
+            sets_rx);
+    goto err;
+  }
+
+  return 0;
+
+err:
+  return -1;
+}
+
+static int read_pfxs(reader_t *reader, bgpview_iter_t *iter,
                      bgpview_io_filter_pfx_cb_t *pfx_cb,
                      bgpview_io_filter_pfx_peer_cb_t *pfx_peer_cb,
                      bgpstream_peer_id_t *peerid_map, int peerid_map_cnt,
@@ -623,7 +1021,10 @@ static int read_pfxs(io_t *infile, bgpview_iter_t *iter,
 
   uint32_t pathidx;
 
-  int pfx_peers_added = 0;
+  /* active pfx-peers waiting to be inserted into the view */
+  bgpstream_peer_id_t row_peerids[BGPVIEW_IO_ROW_BATCH_LEN];
+  bgpstream_as_path_store_path_id_t row_pathids[BGPVIEW_IO_ROW_BATCH_LEN];
+  int row_cnt = 0;
 
   unsigned pfx_rx = 0;
   unsigned pfx_peer_rx = 0;
@@ -641,7 +1042,7 @@ static int read_pfxs(io_t *infile, bgpview_iter_t *iter,
 
   /* foreach pfx, read pfx.ip, pfx.len, [peers_cnt, peer_info] */
   for (i = 0; i < UINT32_MAX; i++) {
-    if (check_magic(infile, VIEW_PFX_END_MAGIC) != 0) {
+    if (check_magic(reader, VIEW_PFX_END_MAGIC) != 0) {
       /* end of pfxs */
       break;
     }
@@ -649,7 +1050,7 @@ static int read_pfxs(io_t *infile, bgpview_iter_t *iter,
     skip_pfx = 0;
 
     /* pfx_ip */
-    if (read_ip(infile, &pfx.address) != 0) {
+    if (read_ip(reader, &pfx.address) != 0) {
       fprintf(stderr, "ERROR: Could not read pfx ip\n");
       goto err;
     }
@@ -667,11 +1068,10 @@ static int read_pfxs(io_t *infile, bgpview_iter_t *iter,
       }
     }
 
-    pfx_peers_added = 0;
     pfx_peer_rx = 0;
 
     for (j = 0; j < UINT16_MAX; j++) {
-      if (check_magic(infile, VIEW_PEER_END_MAGIC) != 0) {
+      if (check_magic(reader, VIEW_PEER_END_MAGIC) != 0) {
         /* end of peers */
         break;
       }
@@ -705,30 +1105,26 @@ static int read_pfxs(io_t *infile, bgpview_iter_t *iter,
         }
       }
 
-      if (pfx_peers_added == 0) {
-        /* we have to use add_pfx_peer */
-        if (bgpview_iter_add_pfx_peer_by_id(iter, &pfx,
-                                            peerid_map[peerid],
-                                            pathid_map[pathidx]) != 0) {
-          fprintf(stderr, "Could not add prefix\n");
-          goto err;
-        }
-      } else {
-        /* we can use pfx_add_peer for efficiency */
-        if (bgpview_iter_pfx_add_peer_by_id(iter, peerid_map[peerid],
-                                            pathid_map[pathidx]) != 0) {
+      /* buffer the cell, the row is inserted in one go */
+      row_peerids[row_cnt] = peerid_map[peerid];
+      row_pathids[row_cnt] = pathid_map[pathidx];
+      if (++row_cnt == BGPVIEW_IO_ROW_BATCH_LEN) {
+        if (bgpview_iter_add_pfx_row(iter, &pfx, row_peerids, row_pathids,
+                                     row_cnt, BGPVIEW_FIELD_ACTIVE) != 0) {
           fprintf(stderr, "Could not add prefix\n");
           goto err;
         }
+        row_cnt = 0;
       }
+    }
 
-      pfx_peers_added++;
-
-      /* now we have to activate it */
-      if (bgpview_iter_pfx_activate_peer(iter) < 0) {
-        fprintf(stderr, "Could not activate prefix\n");
+    if (row_cnt > 0) {
+      if (bgpview_iter_add_pfx_row(iter, &pfx, row_peerids, row_pathids,
+                                   row_cnt, BGPVIEW_FIELD_ACTIVE) != 0) {
+        fprintf(stderr, "Could not add prefix\n");
         goto err;
       }
+      row_cnt = 0;
     }
 
     /* peer cnt */
@@ -748,18 +1144,74 @@ err:
   return -1;
 }
 
-/* ========== PUBLIC FUNCTIONS ========== */
+/* read prefix rows written by write_pfxs_v2 */
+static int read_pfxs_v2(reader_t *reader, bgpview_iter_t *iter,
+                        bgpview_io_filter_pfx_cb_t *pfx_cb,
+                        bgpview_io_filter_pfx_peer_cb_t *pfx_peer_cb,
+                        bgpstream_peer_id_t *peerid_map, int peerid_map_cnt,
+                        bgpstream_as_path_store_path_id_t *pathid_map,
+                        int pathid_map_cnt, bgpview_io_peersets_t *sets)
+{
+  uint32_t pfx_cnt;
+  uint32_t row_len;
+  uint32_t i;
 
-int bgpview_io_file_write(iow_t *outfile, bgpview_t *view,
-                          bgpview_io_filter_cb_t *cb, void *cb_user)
+  uint8_t *buf;
+  int read;
+
+  unsigned pfx_rx = 0;
+
+  /* foreach pfx, read the length of the row, and the row */
+  for (i = 0; i < UINT32_MAX; i++) {
+    if (check_magic(reader, VIEW_PFX_END_MAGIC) != 0) {
+      /* end of pfxs */
+      break;
+    }
+    pfx_rx++;
+
+    READ_VAL(row_len);
+    row_len = ntohl(row_len);
+    if (row_len == 0 || row_len > ROW_BUFFER_LEN) {
+      fprintf(stderr, "ERROR: Invalid prefix row length (%" PRIu32 ")\n",
+              row_len);
+      goto err;
+    }
+
+    /* the row is decoded straight from the reader block */
+    if ((buf = reader_get(reader, row_len)) == NULL) {
+      fprintf(stderr, "ERROR: Could not read prefix row\n");
+      goto err;
+    }
+
+    if ((read = bgpview_io_deserialize_pfx_row(
+           buf, row_len, iter, pfx_cb, pfx_peer_cb, peerid_map, peerid_map_cnt,
+           pathid_map, pathid_map_cnt, sets, BGPVIEW_FIELD_ACTIVE)) == -1) {
+      goto err;
+    }
+    if (read != row_len) {
+      fprintf(stderr, "ERROR: Prefix row is shorter than its length\n");
+      goto err;
+    }
+  }
+
+  /* pfx cnt */
+  READ_VAL(pfx_cnt);
+  pfx_cnt = ntohl(pfx_cnt);
+  assert(pfx_rx == pfx_cnt);
+
+  return 0;
+
+err:
+  return -1;
+}
+
+static int write_view(writer_t *writer, bgpview_t *view,
+                      bgpview_io_filter_cb_t *cb, void *cb_user,
+                      bgpview_io_row_encoding_t encoding)
 {
   uint32_t u32;
   bgpview_iter_t *it = NULL;
-
-  if (view == NULL) {
-    /* no-op */
-    return 0;
-  }
+  bgpview_io_peersets_t *sets = NULL;
 
 #ifdef DEBUG
   fprintf(stderr, "DEBUG: Writing view...\n");
@@ -769,40 +1221,85 @@ int bgpview_io_file_write(iow_t *outfile, bgpview_t *view,
     goto err;
   }
 
-  /* start magic */
-  WRITE_MAGIC(VIEW_START_MAGIC);
+  /* start magic (which also tells the reader how prefix rows are encoded) */
+  if (encoding == BGPVIEW_IO_ROW_ENCODING_V3) {
+    WRITE_MAGIC(VIEW_START_V3_MAGIC);
+  } else if (encoding == BGPVIEW_IO_ROW_ENCODING_V2) {
+    WRITE_MAGIC(VIEW_START_V2_MAGIC);
+  } else {
+    WRITE_MAGIC(VIEW_START_MAGIC);
+  }
 
   /* time */
   u32 = htonl(bgpview_get_time(view));
   WRITE_VAL(u32);
 
-  if (write_peers(outfile, it, cb, cb_user) != 0) {
+  if (write_peers(writer, it, cb, cb_user) != 0) {
     goto err;
   }
 
-  if (write_paths(outfile, it) != 0) {
+  if (write_paths(writer, it) != 0) {
     goto err;
   }
 
-  if (write_pfxs(outfile, it, cb, cb_user) != 0) {
+  if (encoding == BGPVIEW_IO_ROW_ENCODING_V3) {
+    /* the dictionary needs a pass over the prefixes before they are
+       written */
+    if ((sets = bgpview_io_peersets_create()) == NULL ||
+        bgpview_io_peersets_build(sets, it, cb, cb_user) < 0 ||
+        write_peersets(writer, sets) != 0) {
+      goto err;
+    }
+  }
+
+  if (encoding != BGPVIEW_IO_ROW_ENCODING_V1) {
+    if (write_pfxs_v2(writer, it, sets, cb, cb_user) != 0) {
+      goto err;
+    }
+  } else if (write_pfxs(writer, it, cb, cb_user) != 0) {
     goto err;
   }
 
   /* write end-of-view magic number */
   WRITE_MAGIC(VIEW_END_MAGIC);
 
+  bgpview_io_peersets_destroy(sets);
   bgpview_iter_destroy(it);
 
   return 0;
 
 err:
+  bgpview_io_peersets_destroy(sets);
   return -1;
 }
 
-int bgpview_io_file_read(io_t *infile, bgpview_t *view,
-                         bgpview_io_filter_peer_cb_t *peer_cb,
-                         bgpview_io_filter_pfx_cb_t *pfx_cb,
-                         bgpview_io_filter_pfx_peer_cb_t *pfx_peer_cb)
+/* skip len bytes of the file, for files that cannot be seeked */
+static int skip_bytes(io_t *infile, uint64_t len)
+{
+  uint8_t *buf = NULL;
+  int64_t want;
+
+  if ((buf = malloc(READER_BLOCK_LEN)) == NULL) {
+    return -1;
+  }
+
+  while (len > 0) {
+    want = len > READER_BLOCK_LEN ? READER_BLOCK_LEN : len;
+    if (wandio_read(infile, buf, want) != want) {
+      free(buf);
+      return -1;
+    }
+    len -= want;
+  }
+
+  free(buf);
+  return 0;
+}
+
+static int read_view(reader_t *reader, bgpview_t *view,
+                     bgpview_io_filter_peer_cb_t *peer_cb,
+                     bgpview_io_filter_pfx_cb_t *pfx_cb,
+                     bgpview_io_filter_pfx_peer_cb_t *pfx_peer_cb)
 {
   uint32_t u32;
 
@@ -812,17 +1309,27 @@ int bgpview_io_file_read(io_t *infile, bgpview_t *view,
   bgpstream_as_path_store_path_id_t *pathid_map = NULL;
   int pathid_map_cnt;
 
-  bgpview_iter_t *it = NULL;
-  if (view != NULL && (it = bgpview_iter_create(view)) == NULL) {
-    goto err;
-  }
+  bgpview_io_peersets_t *sets = NULL;
+
+  int version = 1;
+  int ret;
+
+  bgpview_iter_t *it = NULL;
 
   /* check for eof */
-  if (wandio_peek(infile, &u32, sizeof(u32)) == 0) {
-    return 0;
+  if (reader_fill(reader, 1) != 0) {
+    return (reader->eof != 0) ? 0 : -1;
+  }
+
+  if (view != NULL && (it = bgpview_iter_create(view)) == NULL) {
+    goto err;
   }
 
-  if (check_magic(infile, VIEW_START_MAGIC) == 0) {
+  if (check_magic(reader, VIEW_START_V3_MAGIC) != 0) {
+    version = 3;
+  } else if (check_magic(reader, VIEW_START_V2_MAGIC) != 0) {
+    version = 2;
+  } else if (check_magic(reader, VIEW_START_MAGIC) == 0) {
     fprintf(stderr, "ERROR: Missing view-start magic number\n");
     goto err;
   }
@@ -833,24 +1340,38 @@ int bgpview_io_file_read(io_t *infile, bgpview_t *view,
     bgpview_set_time(view, ntohl(u32));
   }
 
-  if ((peerid_map_cnt = read_peers(infile, it, peer_cb, &peerid_map)) < 0) {
+  if ((peerid_map_cnt = read_peers(reader, it, peer_cb, &peerid_map)) < 0) {
     fprintf(stderr, "ERROR: Could not read peer table\n");
     goto err;
   }
 
-  if ((pathid_map_cnt = read_paths(infile, it, &pathid_map)) < 0) {
+  if ((pathid_map_cnt = read_paths(reader, it, &pathid_map)) < 0) {
     fprintf(stderr, "ERROR: Could not read path table\n");
     goto err;
   }
 
+  if (version == 3) {
+    if ((sets = bgpview_io_peersets_create()) == NULL ||
+        read_peersets(reader, sets, peerid_map, peerid_map_cnt) != 0) {
+      fprintf(stderr, "ERROR: Could not read peer set table\n");
+      goto err;
+    }
+  }
+
   /* pfxs */
-  if (read_pfxs(infile, it, pfx_cb, pfx_peer_cb, peerid_map, peerid_map_cnt,
-                pathid_map, pathid_map_cnt) != 0) {
+  if (version >= 2) {
+    ret = read_pfxs_v2(reader, it, pfx_cb, pfx_peer_cb, peerid_map,
+                       peerid_map_cnt, pathid_map, pathid_map_cnt, sets);
+  } else {
+    ret = read_pfxs(reader, it, pfx_cb, pfx_peer_cb, peerid_map,
+                    peerid_map_cnt, pathid_map, pathid_map_cnt);
+  }
+  if (ret != 0) {
     fprintf(stderr, "ERROR: Could not read prefixes\n");
     goto err;
   }
 
-  if (check_magic(infile, VIEW_END_MAGIC) == 0) {
+  if (check_magic(reader, VIEW_END_MAGIC) == 0) {
     fprintf(stderr, "ERROR: Missing end-of-view magic number\n");
   }
 
@@ -859,6 +1380,7 @@ int bgpview_io_file_read(io_t *infile, bgpview_t *view,
   }
 
   free(peerid_map);
+  bgpview_io_peersets_destroy(sets);
 
   /* valid view */
   return 1;
@@ -868,9 +1390,263 @@ err:
     bgpview_iter_destroy(it);
   }
   free(peerid_map);
+  bgpview_io_peersets_destroy(sets);
+  return -1;
+}
+
+/* find the first view of the index at or after the given time. Returns 1 if
+   there is one (and sets its offset, and whether it is the offset of a gzip
+   member), 0 if there is none, or -1 on error */
+static int index_find(io_t *idxfile, uint32_t time, uint64_t *offset,
+                      int *member)
+{
+  uint32_t entry[VIEW_INDEX_ENTRY_CNT];
+  int64_t ret;
+
+  while ((ret = wandio_read(idxfile, entry, sizeof(entry))) ==
+         sizeof(entry)) {
+    if (ntohl(entry[0]) >= time) {
+      break;
+    }
+  }
+  if (ret == 0) {
+    return 0;
+  }
+  if (ret != sizeof(entry)) {
+    fprintf(stderr, "ERROR: Could not read view index entry\n");
+    return -1;
+  }
+
+  *member = (ntohl(entry[1]) & VIEW_INDEX_MEMBER_FLAG) != 0;
+  *offset = ((uint64_t)(ntohl(entry[1]) & ~VIEW_INDEX_MEMBER_FLAG) << 32) |
+            ntohl(entry[2]);
+  return 1;
+}
+
+/* move the file to the given (uncompressed) offset */
+static int file_seek(io_t *infile, uint64_t offset)
+{
+  /* compressed files cannot be seeked, but skipping their data is still much
+     cheaper than parsing the views */
+  if (wandio_seek(infile, offset, SEEK_SET) >= 0) {
+    return 1;
+  }
+  if (skip_bytes(infile, offset) != 0) {
+    fprintf(stderr, "ERROR: View index points past the end of the file\n");
+    return -1;
+  }
+
+  return 1;
+}
+
+/* ========== PUBLIC FUNCTIONS ========== */
+
+int bgpview_io_file_write(iow_t *outfile, bgpview_t *view,
+                          bgpview_io_filter_cb_t *cb, void *cb_user,
+                          bgpview_io_row_encoding_t encoding)
+{
+  writer_t writer = {outfile, 0, NULL};
+
+  if (view == NULL) {
+    /* no-op */
+    return 0;
+  }
+
+  return write_view(&writer, view, cb, cb_user, encoding);
+}
+
+int bgpview_io_file_write_indexed(iow_t *outfile, iow_t *idxfile,
+                                  uint64_t *offset, int compress_level,
+                                  bgpview_t *view, bgpview_io_filter_cb_t *cb,
+                                  void *cb_user,
+                                  bgpview_io_row_encoding_t encoding)
+{
+  writer_t writer = {outfile, 0, NULL};
+  z_stream zs;
+  uint32_t entry[VIEW_INDEX_ENTRY_CNT];
+
+  if (view == NULL) {
+    /* no-op */
+    return 0;
+  }
+
+  if (compress_level >= 0) {
+    /* a gzip member can be decompressed without the ones before it */
+    memset(&zs, 0, sizeof(zs));
+    if (deflateInit2(&zs, compress_level, Z_DEFLATED, 15 + 16, 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK) {
+      fprintf(stderr, "ERROR: Could not initialize view compression\n");
+      return -1;
+    }
+    writer.zs = &zs;
+  }
+
+  if (write_view(&writer, view, cb, cb_user, encoding) != 0 ||
+      (writer.zs != NULL && writer_deflate(&writer, NULL, 0, Z_FINISH) != 0)) {
+    goto err;
+  }
+
+  /* the view is only indexed once it has been written completely */
+  entry[0] = htonl(bgpview_get_time(view));
+  entry[1] = htonl((*offset >> 32) |
+                   (writer.zs != NULL ? VIEW_INDEX_MEMBER_FLAG : 0));
+  entry[2] = htonl(*offset & 0xffffffff);
+  if (wandio_wwrite(idxfile, entry, sizeof(entry)) != sizeof(entry)) {
+    fprintf(stderr, "ERROR: Could not write view index entry\n");
+    goto err;
+  }
+
+  if (writer.zs != NULL) {
+    deflateEnd(&zs);
+  }
+  *offset += writer.written;
+  return 0;
+
+err:
+  if (writer.zs != NULL) {
+    deflateEnd(&zs);
+  }
   return -1;
 }
 
+int bgpview_io_file_read(io_t *infile, bgpview_t *view,
+                         bgpview_io_filter_peer_cb_t *peer_cb,
+                         bgpview_io_filter_pfx_cb_t *pfx_cb,
+                         bgpview_io_filter_pfx_peer_cb_t *pfx_peer_cb)
+{
+  reader_t reader = {infile, NULL, 0, 0, 0, 1, NULL, NULL, 0};
+  int ret;
+
+  ret = read_view(&reader, view, peer_cb, pfx_cb, pfx_peer_cb);
+  free(reader.buf);
+
+  return ret;
+}
+
+int bgpview_io_file_seek(io_t *infile, io_t *idxfile, uint32_t time)
+{
+  uint64_t offset;
+  int member;
+  int ret;
+
+  if ((ret = index_find(idxfile, time, &offset, &member)) <= 0) {
+    return ret;
+  }
+  if (member != 0) {
+    fprintf(stderr, "ERROR: Views compressed one by one can only be seeked by "
+                    "a reader that opened the file\n");
+    return -1;
+  }
+
+  return file_seek(infile, offset);
+}
+
+bgpview_io_file_reader_t *bgpview_io_file_reader_create(io_t *infile)
+{
+  reader_t *reader;
+
+  if ((reader = malloc_zero(sizeof(reader_t))) == NULL) {
+    return NULL;
+  }
+  reader->infile = infile;
+
+  return reader;
+}
+
+int bgpview_io_file_reader_read(bgpview_io_file_reader_t *reader,
+                                bgpview_t *view,
+                                bgpview_io_filter_peer_cb_t *peer_cb,
+                                bgpview_io_filter_pfx_cb_t *pfx_cb,
+                                bgpview_io_filter_pfx_peer_cb_t *pfx_peer_cb)
+{
+  return read_view(reader, view, peer_cb, pfx_cb, pfx_peer_cb);
+}
+
+bgpview_io_file_reader_t *bgpview_io_file_reader_open(const char *filename)
+{
+  reader_t *reader;
+
+  if ((reader = malloc_zero(sizeof(reader_t))) == NULL) {
+    return NULL;
+  }
+
+  if ((reader->filename = strdup(filename)) == NULL ||
+      (reader->infile = wandio_create(filename)) == NULL) {
+    bgpview_io_file_reader_destroy(reader);
+    return NULL;
+  }
+
+  return reader;
+}
+
+int bgpview_io_file_reader_seek(bgpview_io_file_reader_t *reader,
+                                io_t *idxfile, uint32_t time)
+{
+  uint64_t offset;
+  int member;
+  int fd = -1;
+  int ret;
+
+  if ((ret = index_find(idxfile, time, &offset, &member)) <= 0) {
+    return ret;
+  }
+
+  /* the buffered data is from the start of the file */
+  reader->len = 0;
+  reader->pos = 0;
+  reader->eof = 0;
+
+  if (member == 0) {
+    return file_seek(reader->infile, offset);
+  }
+
+  /* the view starts a gzip member, so the file can be decompressed from
+     there (gzread then carries on with the members of the later views) */
+  if (reader->filename == NULL || strcmp(reader->filename, "-") == 0 ||
+      reader->gzfile != NULL) {
+    fprintf(stderr, "ERROR: Views compressed one by one can only be seeked by "
+                    "a reader that opened the file\n");
+    return -1;
+  }
+  if ((fd = open(reader->filename, O_RDONLY)) < 0 ||
+      lseek(fd, offset, SEEK_SET) != (off_t)offset ||
+      (reader->gzfile = gzdopen(fd, "rb")) == NULL) {
+    fprintf(stderr, "ERROR: Could not open %s at offset %" PRIu64 "\n",
+            reader->filename, offset);
+    if (fd >= 0) {
+      close(fd);
+    }
+    return -1;
+  }
+  wandio_destroy(reader->infile);
+  reader->infile = NULL;
+
+  return 1;
+}
+
+void bgpview_io_file_reader_destroy(bgpview_io_file_reader_t *reader)
+{
+  if (reader == NULL) {
+    return;
+  }
+
+  if (reader->filename != NULL && reader->infile != NULL) {
+    wandio_destroy(reader->infile);
+  }
+  reader->infile = NULL;
+  if (reader->gzfile != NULL) {
+    gzclose(reader->gzfile);
+    reader->gzfile = NULL;
+  }
+  free(reader->filename);
+  reader->filename = NULL;
+
+  free(reader->buf);
+  reader->buf = NULL;
+
+  free(reader);
+}
+
 int bgpview_io_file_print(iow_t *outfile, bgpview_t *view)
 {
   bgpview_iter_t *it = NULL;
@@ -952,3 +1728,383 @@ int bgpview_io_file_print(iow_t *outfile, bgpview_t *view)
 err:
   return -1;
 }
+
+static int64_t image_write_cb(void *user, const void *buf, int64_t len)
+{
+  return wandio_wwrite((iow_t *)user, buf, len);
+}
+
+int bgpview_io_file_image_write(iow_t *outfile, bgpview_t *view)
+{
+  bgpview_frozen_t *frozen = NULL;
+
+  if (view == NULL) {
+    /* no-op */
+    return 0;
+  }
+
+  if ((frozen = bgpview_freeze(view)) == NULL) {
+    goto err;
+  }
+
+  if (bgpview_frozen_write(frozen, image_write_cb, outfile) < 0) {
+    goto err;
+  }
+
+  bgpview_frozen_destroy(frozen);
+  return 0;
+
+err:
+  bgpview_frozen_destroy(frozen);
+  return -1;
+}
+
+int bgpview_io_file_image_check(const char *filename)
+{
+  int fd;
+  uint32_t magic = 0;
+  ssize_t read_len;
+
+  if ((fd = open(filename, O_RDONLY)) < 0) {
+    return 0;
+  }
+  read_len = read(fd, &magic, sizeof(magic));
+  close(fd);
+
+  return (read_len == sizeof(magic) && magic == VIEW_IMAGE_MAGIC);
+}
+
+bgpview_io_file_image_t *bgpview_io_file_image_open(const char *filename)
+{
+  bgpview_io_file_image_t *image = NULL;
+  struct stat st;
+  int fd = -1;
+
+  if ((image = malloc_zero(sizeof(bgpview_io_file_image_t))) == NULL) {
+    goto err;
+  }
+
+  if ((fd = open(filename, O_RDONLY)) < 0 || fstat(fd, &st) != 0) {
+    fprintf(stderr, "ERROR: Could not open %s\n", filename);
+    goto err;
+  }
+
+  /* an empty file holds no views, and cannot be mapped */
+  if (st.st_size > 0) {
+    if ((image->base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) ==
+        MAP_FAILED) {
+      fprintf(stderr, "ERROR: Could not map %s\n", filename);
+      image->base = NULL;
+      goto err;
+    }
+    image->len = st.st_size;
+  }
+
+  /* the mapping holds its own reference to the file */
+  close(fd);
+  return image;
+
+err:
+  if (fd >= 0) {
+    close(fd);
+  }
+  free(image);
+  return NULL;
+}
+
+int bgpview_io_file_image_read(bgpview_io_file_image_t *image,
+                               bgpview_frozen_t **frozen)
+{
+  uint64_t image_len;
+
+  if (image->next == image->len) {
+    return 0;
+  }
+
+  if ((*frozen = bgpview_frozen_map(image->base + image->next,
+                                    image->len - image->next, &image_len)) ==
+      NULL) {
+    return -1;
+  }
+  image->next += image_len;
+
+  return 1;
+}
+
+/* add the cells of the current prefix of the frozen view to the view, in
+   rows of up to BGPVIEW_IO_ROW_BATCH_LEN cells */
+static int image_add_pfx(bgpview_iter_t *it, bgpview_frozen_iter_t *fit,
+                         bgpstream_as_path_store_t *store,
+                         bgpview_io_filter_pfx_peer_cb_t *pfx_peer_cb,
+                         bgpstream_peer_id_t *peerid_map,
+                         bgpstream_as_path_store_path_id_t *pathid_map,
+                         uint8_t *pathid_set)
+{
+  bgpstream_pfx_t pfx = *bgpview_frozen_iter_pfx_get_pfx(fit);
+  bgpstream_peer_id_t row_peerids[BGPVIEW_IO_ROW_BATCH_LEN];
+  bgpstream_as_path_store_path_id_t row_pathids[BGPVIEW_IO_ROW_BATCH_LEN];
+  int row_cnt = 0;
+  bgpstream_peer_id_t peerid;
+  bgpstream_as_path_t *path;
+  bgpstream_peer_sig_t *ps;
+  uint32_t pathidx;
+  int filter;
+
+  for (bgpview_frozen_iter_pfx_first_peer(fit);
+       bgpview_frozen_iter_pfx_has_more_peer(fit);
+       bgpview_frozen_iter_pfx_next_peer(fit)) {
+    /* peers that were filtered out are not mapped */
+    if ((peerid = peerid_map[bgpview_frozen_iter_pfx_peer_get_peer_id(fit)]) ==
+        0) {
+      continue;
+    }
+
+    /* each path of the image is only added to the store once */
+    pathidx = bgpview_frozen_iter_pfx_peer_get_path_idx(fit);
+    if (pathid_set[pathidx] == 0) {
+      ps = bgpview_frozen_iter_pfx_peer_get_sig(fit);
+      if ((path = bgpview_frozen_iter_pfx_peer_get_as_path(fit)) == NULL ||
+          bgpstream_as_path_store_get_path_id(store, path, ps->peer_asnumber,
+                                              &pathid_map[pathidx]) != 0) {
+        bgpstream_as_path_destroy(path);
+        return -1;
+      }
+      bgpstream_as_path_destroy(path);
+      pathid_set[pathidx] = 1;
+    }
+
+    if (pfx_peer_cb != NULL) {
+      /* ask the caller if they want this pfx-peer */
+      if ((filter = pfx_peer_cb(bgpstream_as_path_store_get_store_path(
+             store, pathid_map[pathidx]))) < 0) {
+        return -1;
+      }
+      if (filter == 0) {
+        continue;
+      }
+    }
+
+    row_peerids[row_cnt] = peerid;
+    row_pathids[row_cnt] = pathid_map[pathidx];
+    if (++row_cnt == BGPVIEW_IO_ROW_BATCH_LEN) {
+      if (bgpview_iter_add_pfx_row(it, &pfx, row_peerids, row_pathids,
+                                   row_cnt, BGPVIEW_FIELD_ACTIVE) != 0) {
+        return -1;
+      }
+      row_cnt = 0;
+    }
+  }
+
+  if (row_cnt > 0 &&
+      bgpview_iter_add_pfx_row(it, &pfx, row_peerids, row_pathids, row_cnt,
+                               BGPVIEW_FIELD_ACTIVE) != 0) {
+    return -1;
+  }
+  return 0;
+}
+
+int bgpview_io_file_image_read_view(
+  bgpview_io_file_image_t *image, bgpview_t *view,
+  bgpview_io_filter_peer_cb_t *peer_cb, bgpview_io_filter_pfx_cb_t *pfx_cb,
+  bgpview_io_filter_pfx_peer_cb_t *pfx_peer_cb)
+{
+  bgpview_frozen_t *frozen = NULL;
+  bgpview_frozen_iter_t *fit = NULL;
+  bgpview_iter_t *it = NULL;
+  bgpstream_as_path_store_t *store = bgpview_get_as_path_store(view);
+
+  bgpstream_peer_id_t *peerid_map = NULL;
+  uint32_t peerid_cnt;
+  bgpstream_peer_sig_t ps, *sig;
+
+  bgpstream_as_path_store_path_id_t *pathid_map = NULL;
+  uint8_t *pathid_set = NULL;
+  uint32_t paths_cnt;
+
+  bgpstream_pfx_t pfx;
+  uint32_t i;
+  int filter;
+  int ret;
+
+  if ((ret = bgpview_io_file_image_read(image, &frozen)) <= 0) {
+    return ret;
+  }
+
+  peerid_cnt = bgpview_frozen_peer_id_cnt(frozen);
+  paths_cnt = bgpview_frozen_path_cnt(frozen);
+  if ((it = bgpview_iter_create(view)) == NULL ||
+      (fit = bgpview_frozen_iter_create(frozen)) == NULL ||
+      (peerid_map = malloc_zero(sizeof(bgpstream_peer_id_t) *
+                                (peerid_cnt + 1))) == NULL ||
+      (pathid_map = malloc(sizeof(bgpstream_as_path_store_path_id_t) *
+                           (paths_cnt + 1))) == NULL ||
+      (pathid_set = malloc_zero(sizeof(uint8_t) * (paths_cnt + 1))) == NULL) {
+    goto err;
+  }
+
+  bgpview_set_time(view, bgpview_frozen_get_time(frozen));
+
+  /* the image holds every peer of the view, including those that have no
+     prefixes */
+  for (i = 0; i < peerid_cnt; i++) {
+    if ((sig = bgpview_frozen_get_peer_sig(frozen, i)) == NULL) {
+      continue;
+    }
+    /* the image is mapped read-only, so the callback gets a copy */
+    ps = *sig;
+    if (peer_cb != NULL) {
+      if ((filter = peer_cb(&ps)) < 0) {
+        goto err;
+      }
+      if (filter == 0) {
+        continue;
+      }
+    }
+    peerid_map[i] = bgpview_iter_add_peer(it, ps.collector_str,
+                                         &ps.peer_ip_addr, ps.peer_asnumber);
+    if (peerid_map[i] == 0) {
+      goto err;
+    }
+    bgpview_iter_activate_peer(it);
+  }
+
+  for (bgpview_frozen_iter_first_pfx(fit);
+       bgpview_frozen_iter_has_more_pfx(fit);
+       bgpview_frozen_iter_next_pfx(fit)) {
+    if (pfx_cb != NULL) {
+      pfx = *bgpview_frozen_iter_pfx_get_pfx(fit);
+      if ((filter = pfx_cb(&pfx)) < 0) {
+        goto err;
+      }
+      if (filter == 0) {
+        continue;
+      }
+    }
+    if (image_add_pfx(it, fit, store, pfx_peer_cb, peerid_map, pathid_map,
+                      pathid_set) != 0) {
+      fprintf(stderr, "ERROR: Could not add prefix\n");
+      goto err;
+    }
+  }
+
+  free(peerid_map);
+  free(pathid_map);
+  free(pathid_set);
+  bgpview_frozen_iter_destroy(fit);
+  bgpview_iter_destroy(it);
+  bgpview_frozen_destroy(frozen);
+  return 1;
+
+err:
+  fprintf(stderr, "ERROR: Could not read view from image\n");
+  free(peerid_map);
+  free(pathid_map);
+  free(pathid_set);
+  bgpview_frozen_iter_destroy(fit);
+  if (it != NULL) {
+    bgpview_iter_destroy(it);
+  }
+  bgpview_frozen_destroy(frozen);
+  return -1;
+}
+
+void bgpview_io_file_image_close(bgpview_io_file_image_t *image)
+{
+  if (image == NULL) {
+    return;
+  }
+  if (image->base != NULL) {
+    munmap(image->base, image->len);
+  }
+  free(image);
+}
+
+int bgpview_io_file_image_print(iow_t *outfile, bgpview_frozen_t *frozen)
+{
+  bgpview_frozen_iter_t *it = NULL;
+
+  uint32_t time;
+  int v4pfx_cnt = 0;
+
+  bgpstream_pfx_t *pfx;
+  char pfx_str[INET6_ADDRSTRLEN + 3] = "";
+
+  bgpstream_peer_sig_t *ps;
+
+  char peer_str[INET6_ADDRSTRLEN] = "";
+
+  char path_str[4096] = "";
+  bgpstream_as_path_t *path = NULL;
+
+  bgpstream_as_path_seg_t *orig_seg = NULL;
+  char orig_str[4096] = "";
+
+  if (frozen == NULL) {
+    /* no-op */
+    return 0;
+  }
+
+  time = bgpview_frozen_get_time(frozen);
+
+  if ((it = bgpview_frozen_iter_create(frozen)) == NULL) {
+    goto err;
+  }
+
+  /* prefixes are sorted with the v4 prefixes first */
+  for (bgpview_frozen_iter_first_pfx(it); bgpview_frozen_iter_has_more_pfx(it);
+       bgpview_frozen_iter_next_pfx(it)) {
+    if (bgpview_frozen_iter_pfx_get_pfx(it)->address.version !=
+        BGPSTREAM_ADDR_VERSION_IPV4) {
+      break;
+    }
+    v4pfx_cnt++;
+  }
+
+  wandio_printf(outfile, "# View %" PRIu32 "\n"
+                         "# IPv4 Prefixes: %d\n"
+                         "# IPv6 Prefixes: %d\n",
+                time, v4pfx_cnt,
+                bgpview_frozen_pfx_cnt(frozen) - v4pfx_cnt);
+
+  for (bgpview_frozen_iter_first_pfx(it); bgpview_frozen_iter_has_more_pfx(it);
+       bgpview_frozen_iter_next_pfx(it)) {
+    pfx = bgpview_frozen_iter_pfx_get_pfx(it);
+    bgpstream_pfx_snprintf(pfx_str, INET6_ADDRSTRLEN + 3, pfx);
+
+    for (bgpview_frozen_iter_pfx_first_peer(it);
+         bgpview_frozen_iter_pfx_has_more_peer(it);
+         bgpview_frozen_iter_pfx_next_peer(it)) {
+      if ((ps = bgpview_frozen_iter_pfx_peer_get_sig(it)) == NULL ||
+          (path = bgpview_frozen_iter_pfx_peer_get_as_path(it)) == NULL) {
+        goto err;
+      }
+      bgpstream_addr_ntop(peer_str, INET6_ADDRSTRLEN, &ps->peer_ip_addr);
+
+      orig_seg = bgpstream_as_path_get_origin_seg(path);
+
+      bgpstream_as_path_seg_snprintf(orig_str, 4096, orig_seg);
+
+      bgpstream_as_path_snprintf(path_str, 4096, path);
+      bgpstream_as_path_destroy(path);
+
+      wandio_printf(outfile, "%" PRIu32 "|" /* time */
+                             "%s|"          /* prefix */
+                             "%s|"          /* collector */
+                             "%" PRIu32 "|" /* peer ASN */
+                             "%s|"          /* peer IP */
+                             "%s|"          /* path */
+                             "%s"           /* origin segment */
+                             "\n",
+                    time, pfx_str, ps->collector_str, ps->peer_asnumber,
+                    peer_str, path_str, orig_str);
+    }
+  }
+
+  bgpview_frozen_iter_destroy(it);
+
+  return 0;
+
+err:
+  bgpview_frozen_iter_destroy(it);
+  return -1;
+}
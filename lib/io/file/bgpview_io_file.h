@@ -31,16 +31,62 @@
 #include "bgpview_io.h"
 #include <wandio.h>
 
+/** Suffix added to the name of a view file to get the name of its index */
+#define BGPVIEW_IO_FILE_INDEX_SUFFIX ".idx"
+
+/** Opaque handle to a memory-mapped file of frozen view images */
+typedef struct bgpview_io_file_image bgpview_io_file_image_t;
+
+/** Opaque handle to a buffered reader of a file of views */
+typedef struct bgpview_io_file_reader bgpview_io_file_reader_t;
+
 /** Write the given view to the given file (in binary format)
  *
  * @param outfile       wandio file handle to write to
  * @param view          pointer to the view to send
  * @param cb            callback function to use to filter entries (may be NULL)
  * @param cb_user       user pointer provided to callback function
+ * @param encoding      encoding of the prefix rows
  * @return 0 if the view was written successfully, -1 otherwise
+ *
+ * The encoding is recorded in the view header, so bgpview_io_file_read reads
+ * views in any encoding (and files may mix them). With
+ * BGPVIEW_IO_ROW_ENCODING_V3, a dictionary of the peer sets of the view is
+ * written after the path table, and most rows only refer to their set.
  */
 int bgpview_io_file_write(iow_t *outfile, bgpview_t *view,
-                          bgpview_io_filter_cb_t *cb, void *cb_user);
+                          bgpview_io_filter_cb_t *cb, void *cb_user,
+                          bgpview_io_row_encoding_t encoding);
+
+/** Write the given view to the given file, and add it to the file's index
+ *
+ * @param outfile       wandio file handle to write to
+ * @param idxfile       wandio file handle of the index of the file
+ * @param offset        pointer to the number of bytes written to the file so
+ *                      far, which is updated
+ * @param compress_level if >= 0, the view is written as a gzip member of its
+ *                      own, compressed with this level (and outfile must not
+ *                      compress the data again)
+ * @param view          pointer to the view to send
+ * @param cb            callback function to use to filter entries (may be NULL)
+ * @param cb_user       user pointer provided to callback function
+ * @param encoding      encoding of the prefix rows
+ * @return 0 if the view was written successfully, -1 otherwise
+ *
+ * The index maps the time of each view to its offset in the file, so that
+ * bgpview_io_file_seek can find a view without reading the earlier ones. The
+ * offset must be 0 when the file is created.
+ *
+ * A file of gzip members is a valid gzip file, but unlike a file that wandio
+ * compresses as a whole, it can be decompressed from the start of any view,
+ * so a reader (see bgpview_io_file_reader_seek) does not have to decompress
+ * the earlier views to get to one.
+ */
+int bgpview_io_file_write_indexed(iow_t *outfile, iow_t *idxfile,
+                                  uint64_t *offset, int compress_level,
+                                  bgpview_t *view, bgpview_io_filter_cb_t *cb,
+                                  void *cb_user,
+                                  bgpview_io_row_encoding_t encoding);
 
 /** Receive a view from the given file
  *
@@ -49,12 +95,83 @@ int bgpview_io_file_write(iow_t *outfile, bgpview_t *view,
  * @param cb            callback function to use to filter entries (may be NULL)
  * @return 1 if a view was successfully read, 0 if EOF was reached, -1 if an
  * error occurred
+ *
+ * Only the bytes of the view are read, so the file is left positioned at the
+ * start of the next view. This takes a library call per field, so files that
+ * are only read view after view should use a reader (see
+ * bgpview_io_file_reader_create) instead.
  */
 int bgpview_io_file_read(io_t *infile, bgpview_t *view,
                          bgpview_io_filter_peer_cb_t *peer_cb,
                          bgpview_io_filter_pfx_cb_t *pfx_cb,
                          bgpview_io_filter_pfx_peer_cb_t *pfx_peer_cb);
 
+/** Create a buffered reader for the given file of views
+ *
+ * @param infile        wandio file handle to read from (which still belongs
+ *                      to the caller)
+ * @return pointer to the reader, or NULL on error
+ *
+ * The reader reads the file in large blocks and parses the views from memory.
+ * Data after the end of a view is kept for the next call to
+ * bgpview_io_file_reader_read, so the file must not be read otherwise while
+ * the reader is in use.
+ */
+bgpview_io_file_reader_t *bgpview_io_file_reader_create(io_t *infile);
+
+/** Receive the next view from the given reader
+ *
+ * Parameters and return value are as for bgpview_io_file_read.
+ */
+int bgpview_io_file_reader_read(bgpview_io_file_reader_t *reader,
+                                bgpview_t *view,
+                                bgpview_io_filter_peer_cb_t *peer_cb,
+                                bgpview_io_filter_pfx_cb_t *pfx_cb,
+                                bgpview_io_filter_pfx_peer_cb_t *pfx_peer_cb);
+
+/** Open the given file of views, and create a buffered reader for it
+ *
+ * @param filename      name of the file to open ("-" for stdin)
+ * @return pointer to the reader (which owns the file), or NULL on error
+ *
+ * Unlike a reader created with bgpview_io_file_reader_create, this one can
+ * seek to the views of files whose views were compressed one by one (see
+ * bgpview_io_file_write_indexed).
+ */
+bgpview_io_file_reader_t *bgpview_io_file_reader_open(const char *filename);
+
+/** Move the file of the given reader to the first view at or after the given
+ * time
+ *
+ * This is bgpview_io_file_seek for a file that is read with a reader, which
+ * must not have read any view yet. If the views were compressed one by one,
+ * the file is decompressed from the start of the view, which requires a
+ * reader opened with bgpview_io_file_reader_open.
+ */
+int bgpview_io_file_reader_seek(bgpview_io_file_reader_t *reader,
+                                io_t *idxfile, uint32_t time);
+
+/** Destroy the given reader (and its file, if the reader opened it)
+ *
+ * @param reader        pointer to the reader to destroy
+ */
+void bgpview_io_file_reader_destroy(bgpview_io_file_reader_t *reader);
+
+/** Move the given file to the first view at or after the given time
+ *
+ * @param infile        wandio file handle of the file, at its start
+ * @param idxfile       wandio file handle of the index of the file
+ * @param time          time of the view to move to
+ * @return 1 if the file was moved to a view, 0 if no view of the file is at or
+ * after the given time, -1 if an error occurred
+ *
+ * Uncompressed files are seeked directly. Compressed files cannot be, so the
+ * data before the view is decompressed and skipped, but none of the earlier
+ * views are parsed. Views that were compressed one by one can only be seeked
+ * with bgpview_io_file_reader_seek.
+ */
+int bgpview_io_file_seek(io_t *infile, io_t *idxfile, uint32_t time);
+
 /** Print the given view to the given file (in ASCII format)
  *
  * @param outfile       wandio file handle to print to
@@ -63,6 +180,84 @@ int bgpview_io_file_read(io_t *infile, bgpview_t *view,
  */
 int bgpview_io_file_print(iow_t *outfile, bgpview_t *view);
 
+/** Write the given view to the given file as a frozen view image
+ *
+ * @param outfile       wandio file handle to write to
+ * @param view          pointer to the view to write
+ * @return 0 if the view was written successfully, -1 otherwise
+ *
+ * Images are laid out so that they can be used in place (see
+ * bgpview_frozen_map), so a file of images can be read with
+ * bgpview_io_file_image_open only if it is not compressed.
+ */
+int bgpview_io_file_image_write(iow_t *outfile, bgpview_t *view);
+
+/** Check if the given file holds frozen view images
+ *
+ * @param filename      name of the file to check
+ * @return 1 if the file starts with a frozen view image, 0 otherwise
+ */
+int bgpview_io_file_image_check(const char *filename);
+
+/** Map the given file of frozen view images into memory
+ *
+ * @param filename      name of the (uncompressed) file to map
+ * @return pointer to the mapped file if successful, NULL otherwise
+ *
+ * The views are not parsed: each one is used in place when it is read, so
+ * loading a view only costs the page faults of the parts that are used, and
+ * processes that map the same file share the page cache.
+ */
+bgpview_io_file_image_t *bgpview_io_file_image_open(const char *filename);
+
+/** Read the next view from the given mapped file
+ *
+ * @param image         pointer to the mapped file
+ * @param[out] frozen   set to a new frozen view that uses the mapped file
+ * @return 1 if a view was successfully read, 0 if the end of the file was
+ * reached, -1 if an error occurred
+ *
+ * The frozen view must be destroyed by the caller, before the file is
+ * closed.
+ */
+int bgpview_io_file_image_read(bgpview_io_file_image_t *image,
+                               bgpview_frozen_t **frozen);
+
+/** Read the next view from the given mapped file into a view
+ *
+ * @param image         pointer to the mapped file
+ * @param view          pointer to the clear/new view to read into
+ * @param peer_cb       callback function to filter peers (may be NULL)
+ * @param pfx_cb        callback function to filter prefixes (may be NULL)
+ * @param pfx_peer_cb   callback function to filter pfx-peers (may be NULL)
+ * @return 1 if a view was successfully read, 0 if the end of the file was
+ * reached, -1 if an error occurred
+ *
+ * This is the equivalent of bgpview_io_file_read for files of images, for
+ * users that need a (mutable) view rather than a frozen view. Each path of
+ * the image is only added to the AS Path Store of the view once.
+ */
+int bgpview_io_file_image_read_view(
+  bgpview_io_file_image_t *image, bgpview_t *view,
+  bgpview_io_filter_peer_cb_t *peer_cb, bgpview_io_filter_pfx_cb_t *pfx_cb,
+  bgpview_io_filter_pfx_peer_cb_t *pfx_peer_cb);
+
+/** Unmap and close the given file of frozen view images
+ *
+ * @param image         pointer to the mapped file to close
+ */
+void bgpview_io_file_image_close(bgpview_io_file_image_t *image);
+
+/** Print the given frozen view to the given file (in ASCII format)
+ *
+ * @param outfile       wandio file handle to print to
+ * @param frozen        pointer to the frozen view to output
+ * @return 0 if the view was output successfully, -1 otherwise
+ *
+ * The output is the same as for bgpview_io_file_print.
+ */
+int bgpview_io_file_image_print(iow_t *outfile, bgpview_frozen_t *frozen);
+
 /** Dump the given BGP View to stdout
  *
  * @param view        pointer to a view structure
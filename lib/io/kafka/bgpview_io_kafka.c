@@ -32,6 +32,7 @@
 #include <assert.h>
 #include <errno.h>
 #include <librdkafka/rdkafka.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #ifdef HAVE_TIME_H
@@ -142,7 +143,10 @@ static void usage(void)
     "       -n <namespace>        Kafka topic namespace to use (default: "
     "%s)\n"
     "       -c <channel>          Global metadata channel to use (default: "
-    "unused)\n",
+    "unused)\n"
+    "       -e <encoding>         Encoding of the prefix rows sent by a "
+    "producer\n"
+    "                             (1, 2 or 3, default: 1)\n",
     BGPVIEW_IO_KAFKA_BROKER_URI_DEFAULT, BGPVIEW_IO_KAFKA_NAMESPACE_DEFAULT);
 }
 
@@ -154,12 +158,26 @@ static int parse_args(bgpview_io_kafka_t *client, int argc, char **argv)
   optind = 1;
 
   /* remember the argv strings DO NOT belong to us */
-  while ((opt = getopt(argc, argv, ":c:i:k:n:?")) >= 0) {
+  while ((opt = getopt(argc, argv, ":c:e:i:k:n:?")) >= 0) {
     switch (opt) {
     case 'c':
       client->channel = strdup(optarg);
       break;
 
+    case 'e':
+      if (atoi(optarg) == 3) {
+        bgpview_io_kafka_set_row_encoding(client, BGPVIEW_IO_ROW_ENCODING_V3);
+      } else if (atoi(optarg) == 2) {
+        bgpview_io_kafka_set_row_encoding(client, BGPVIEW_IO_ROW_ENCODING_V2);
+      } else if (atoi(optarg) == 1) {
+        bgpview_io_kafka_set_row_encoding(client, BGPVIEW_IO_ROW_ENCODING_V1);
+      } else {
+        fprintf(stderr, "ERROR: Invalid row encoding '%s'\n", optarg);
+        usage();
+        return -1;
+      }
+      break;
+
     case 'i':
       client->identity = strdup(optarg);
       break;
@@ -302,6 +320,7 @@ bgpview_io_kafka_t *bgpview_io_kafka_init(bgpview_io_kafka_mode_t mode,
   client->mode = mode;
 
   /* set defaults */
+  client->row_encoding = BGPVIEW_IO_ROW_ENCODING_V1;
   if ((client->namespace = strdup(BGPVIEW_IO_KAFKA_NAMESPACE_DEFAULT)) ==
       NULL) {
     fprintf(stderr, "Failed to duplicate namespace string\n");
@@ -526,6 +545,12 @@ int bgpview_io_kafka_set_namespace(bgpview_io_kafka_t *client,
   return 0;
 }
 
+void bgpview_io_kafka_set_row_encoding(bgpview_io_kafka_t *client,
+                                       bgpview_io_row_encoding_t encoding)
+{
+  client->row_encoding = encoding;
+}
+
 int bgpview_io_kafka_send_view(bgpview_io_kafka_t *client, bgpview_t *view,
                                bgpview_t *parent_view,
                                bgpview_io_filter_cb_t *cb, void *cb_user)
@@ -208,6 +208,19 @@ int bgpview_io_kafka_set_broker_addresses(bgpview_io_kafka_t *client,
 int bgpview_io_kafka_set_namespace(bgpview_io_kafka_t *client,
                                    const char *namespace);
 
+/** Set the encoding of the prefix rows sent by a producer
+ *
+ * @param client        pointer to a bgpview kafka client instance
+ * @param encoding      encoding to use
+ *
+ * Consumers decode rows in any encoding, but consumers built before the v2
+ * encoding was introduced only decode v1 rows, which are therefore sent by
+ * default. With BGPVIEW_IO_ROW_ENCODING_V3, sync frames start with the peer
+ * set dictionary of the view.
+ */
+void bgpview_io_kafka_set_row_encoding(bgpview_io_kafka_t *client,
+                                       bgpview_io_row_encoding_t encoding);
+
 /** Queue the given View for transmission to Kafka
  *
  * @param client        pointer to a bgpview kafka client instance
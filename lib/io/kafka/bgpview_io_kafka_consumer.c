@@ -579,6 +579,73 @@ err:
   return -1;
 }
 
+/* add the 'D' rows of a message of the peer set dictionary to the given
+   dictionary */
+static int recv_peersets_msg(uint8_t *ptr, size_t len,
+                             bgpview_io_peersets_t *sets,
+                             bgpview_io_kafka_peeridmap_t *idmap)
+{
+  size_t read = 0;
+  ssize_t s;
+
+  while (read < len) {
+    if (ptr[read] != 'D') {
+      return -1;
+    }
+    read++;
+
+    if ((s = bgpview_io_deserialize_peerset(ptr + read, (len - read), sets,
+                                            idmap->map, idmap->alloc_cnt)) ==
+        -1) {
+      return -1;
+    }
+    read += s;
+  }
+
+  return 0;
+}
+
+/* check that all the rows in a prefix message are well-formed and only refer
+   to known peers (peerid_map_cnt is -1 if the rows are not applied), so that
+   they can then be decoded without further checks, and a corrupt message is
+   dropped before any of it is applied to the view. The rows carry their paths
+   rather than indexes into a path table, so the path ID map of this transport
+   is empty and any path index is out of range. */
+static int validate_pfxs_msg(uint8_t *ptr, size_t len,
+                             bgpview_io_peersets_t *sets, int peerid_map_cnt)
+{
+  size_t read = 0;
+  ssize_t s;
+  int use_pathid;
+
+  while (read < len) {
+    /* row type */
+    switch (ptr[read]) {
+    case 'S':
+    case 'U':
+      use_pathid = 0;
+      break;
+
+    case 'R':
+      use_pathid = -1;
+      break;
+
+    default:
+      return -1;
+    }
+    read++;
+
+    if ((s = bgpview_io_validate_pfx_row(ptr + read, (len - read),
+                                         use_pathid, sets, peerid_map_cnt,
+                                         0)) == -1) {
+      return -1;
+    }
+    read += s;
+  }
+
+  return 0;
+}
+
 static int recv_pfxs(bgpview_io_kafka_peeridmap_t *idmap,
                      bgpview_io_kafka_topic_t *topic, bgpview_iter_t *iter,
                      bgpview_io_filter_pfx_cb_t *pfx_cb,
@@ -607,6 +674,9 @@ static int recv_pfxs(bgpview_io_kafka_peeridmap_t *idmap,
 
   rd_kafka_message_t *msg = NULL;
 
+  /* created when the first message of the dictionary is received */
+  bgpview_io_peersets_t *sets = NULL;
+
   fprintf(stderr, "DEBUG: seek %s to %" PRIi64 "\n", topic->name, offset);
 
   if (seek_topic(rdk_conn, topic->rkt, BGPVIEW_IO_KAFKA_PFXS_PARTITION_DEFAULT,
@@ -618,6 +688,13 @@ static int recv_pfxs(bgpview_io_kafka_peeridmap_t *idmap,
     view = bgpview_iter_get_view(iter);
   }
 
+#ifdef WITH_THREADS
+  /* with concurrent writers, the view locks each prefix row itself */
+  if (view != NULL && bgpview_has_concurrent_writers(view)) {
+    mutex = NULL;
+  }
+#endif
+
   int msg_cnt = 0;
 
   while (1) {
@@ -630,10 +707,15 @@ static int recv_pfxs(bgpview_io_kafka_peeridmap_t *idmap,
     ptr = msg->payload;
     read = 0;
 
-    BGPVIEW_IO_DESERIALIZE_VAL(ptr, msg->len, read, type);
+    BGPVIEW_IO_DESERIALIZE_VAL_CHECKED(ptr, msg->len, read, type);
 
     if (type == 'E') {
       /* end of prefixes */
+      if ((msg->len - read) != sizeof(view_time) + sizeof(pfx_cnt)) {
+        fprintf(stderr, "WARN: Invalid prefix table received from %s\n",
+                topic->name);
+        goto err;
+      }
       BGPVIEW_IO_DESERIALIZE_VAL(ptr, msg->len, read, view_time);
       if (iter != NULL) {
         bgpview_set_time(view, view_time);
@@ -656,6 +738,29 @@ static int recv_pfxs(bgpview_io_kafka_peeridmap_t *idmap,
       break;
     }
 
+    if (type == 'D') {
+      /* the dictionary of a sync frame comes before all the rows */
+      if (pfx_rx != 0 ||
+          (sets == NULL && (sets = bgpview_io_peersets_create()) == NULL) ||
+          recv_peersets_msg(msg->payload, msg->len, sets, idmap) != 0) {
+        fprintf(stderr, "WARN: Malformed peer set message received from %s\n",
+                topic->name);
+        goto err;
+      }
+      rd_kafka_message_destroy(msg);
+      msg = NULL;
+      continue;
+    }
+
+    /* the peers were all received before the prefixes, so the peer ID map
+       is complete */
+    if (validate_pfxs_msg(msg->payload, msg->len, sets,
+                          (iter != NULL) ? idmap->alloc_cnt : -1) != 0) {
+      fprintf(stderr, "WARN: Malformed prefix message received from %s\n",
+              topic->name);
+      goto err;
+    }
+
 #ifdef WITH_THREADS
     if (mutex != NULL) {
       pthread_mutex_lock(mutex);
@@ -674,9 +779,10 @@ static int recv_pfxs(bgpview_io_kafka_peeridmap_t *idmap,
       case 'U':
         /* an update row */
         tom++;
-        if ((s = bgpview_io_deserialize_pfx_row(
+        if ((s = bgpview_io_deserialize_valid_pfx_row(
                ptr, (msg->len - read), iter, pfx_cb, pfx_peer_cb, idmap->map,
-               idmap->alloc_cnt, NULL, -1, BGPVIEW_FIELD_ACTIVE)) == -1) {
+               idmap->alloc_cnt, NULL, -1, sets, BGPVIEW_FIELD_ACTIVE)) ==
+            -1) {
 #ifdef WITH_THREADS
           if (mutex != NULL) {
             pthread_mutex_unlock(mutex);
@@ -691,9 +797,10 @@ static int recv_pfxs(bgpview_io_kafka_peeridmap_t *idmap,
       case 'R':
         /* a remove row */
         tor++;
-        if ((s = bgpview_io_deserialize_pfx_row(
+        if ((s = bgpview_io_deserialize_valid_pfx_row(
                ptr, (msg->len - read), iter, pfx_cb, pfx_peer_cb, idmap->map,
-               idmap->alloc_cnt, NULL, -1, BGPVIEW_FIELD_INACTIVE)) == -1) {
+               idmap->alloc_cnt, NULL, -1, NULL, BGPVIEW_FIELD_INACTIVE)) ==
+            -1) {
 #ifdef WITH_THREADS
           if (mutex != NULL) {
             pthread_mutex_unlock(mutex);
@@ -706,6 +813,7 @@ static int recv_pfxs(bgpview_io_kafka_peeridmap_t *idmap,
         break;
 
       default:
+        /* rejected by validate_pfxs_msg */
         assert(0);
       }
 
@@ -727,12 +835,14 @@ static int recv_pfxs(bgpview_io_kafka_peeridmap_t *idmap,
   }
 
   assert(msg == NULL);
+  bgpview_io_peersets_destroy(sets);
   return 0;
 
 err:
   if (msg != NULL) {
     rd_kafka_message_destroy(msg);
   }
+  bgpview_io_peersets_destroy(sets);
   return -1;
 }
 
@@ -958,6 +1068,9 @@ static int recv_global_view(bgpview_io_kafka_t *client, bgpview_t *view,
   bgpview_io_kafka_md_t *metas = NULL;
   int metas_cnt;
   int i;
+#ifdef WITH_THREADS
+  uint64_t locked_cnt, inserted_cnt, insert_wait_usec;
+#endif
 
   if ((metas_cnt = recv_global_metadata(client, view, &metas, 0)) <= 0) {
     goto err;
@@ -973,6 +1086,16 @@ static int recv_global_view(bgpview_io_kafka_t *client, bgpview_t *view,
      trying) so set the view time now */
   bgpview_set_time(view, metas[0].time);
 
+#ifdef WITH_THREADS
+  /* let the workers deserialize their prefix rows into the view in parallel
+     (rather than one message at a time under the global mutex). Only rows of
+     prefixes that the view already has are updated in parallel: inserting a
+     new prefix waits for all the workers */
+  if (bgpview_enable_concurrent_writers(view, GLOBAL_WRITER_SHARDS) != 0) {
+    goto err;
+  }
+#endif
+
   fprintf(stderr, "DEBUG: %d members:\n", metas_cnt);
   for (i = 0; i < metas_cnt; i++) {
     fprintf(stderr, "DEBUG: [%d] "
@@ -1125,6 +1248,17 @@ static int recv_global_view(bgpview_io_kafka_t *client, bgpview_t *view,
     gct->meta = NULL;
     pthread_mutex_unlock(&gct->mutex);
   } // for loop over metas
+
+  /* the workers are done, so the view belongs to the caller again (if the
+     sync failed, the writers stay enabled until the next one) */
+  if (bgpview_get_concurrent_writers_stats(view, &locked_cnt, &inserted_cnt,
+                                           &insert_wait_usec) == 0) {
+    fprintf(stderr,
+            "DEBUG: Locked %" PRIu64 " prefix rows, inserted %" PRIu64
+            " prefixes (waited %" PRIu64 " ms for the view)\n",
+            locked_cnt, inserted_cnt, insert_wait_usec / 1000);
+  }
+  bgpview_disable_concurrent_writers(view);
 #endif
 
   gettimeofday(&tv, NULL);
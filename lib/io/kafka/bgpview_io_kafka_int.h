@@ -52,6 +52,10 @@
 
 #define IDENTITY_MAX_LEN 1024
 
+/** Number of prefix shards used when the global consumer workers write into
+    the view concurrently */
+#define GLOBAL_WRITER_SHARDS 1024
+
 /* @} */
 
 /**
@@ -233,6 +237,9 @@ struct bgpview_io_kafka {
       run) */
   char *channel;
 
+  /** Encoding of the prefix rows sent by a producer (consumers decode both) */
+  bgpview_io_row_encoding_t row_encoding;
+
   /* STATE */
 
   /** RD Kafka connection handle */
@@ -101,6 +101,7 @@ static int64_t get_offset(bgpview_io_kafka_t *client, char *topic,
 
 static int pfx_row_serialize(bgpview_io_kafka_t *client, uint8_t *buf,
                              size_t len, char operation, bgpview_iter_t *it,
+                             bgpview_io_peersets_t *sets,
                              bgpview_io_filter_cb_t *cb, void *cb_user)
 {
   size_t written = 0;
@@ -111,9 +112,17 @@ static int pfx_row_serialize(bgpview_io_kafka_t *client, uint8_t *buf,
   // serialize the operation that must be done with this row
   // "Update" or "Remove"
   BGPVIEW_IO_SERIALIZE_VAL(buf, len, written, operation);
-  if ((s = bgpview_io_serialize_pfx_row(
-         buf, (len - written), it, operation == 'S' ? NULL : &cells_tx, cb,
-         cb_user, operation == 'R' ? -1 : 0)) == -1) {
+  if (sets != NULL) {
+    /* only sync rows may refer to the dictionary */
+    assert(operation == 'S');
+    s = bgpview_io_serialize_pfx_set_row(buf, (len - written), it, sets, NULL,
+                                         cb, cb_user, 0);
+  } else {
+    s = bgpview_io_serialize_pfx_row(
+      buf, (len - written), it, operation == 'S' ? NULL : &cells_tx, cb,
+      cb_user, operation == 'R' ? -1 : 0, client->row_encoding);
+  }
+  if (s == -1) {
     goto err;
   }
 
@@ -141,7 +150,8 @@ err:
   return -1;
 }
 
-static int pfx_row_start(uint8_t *buf, size_t len, char operation,
+static int pfx_row_start(bgpview_io_kafka_t *client, uint8_t *buf, size_t len,
+                         bgpview_io_row_t *row, char operation,
                          bgpstream_pfx_t *pfx)
 {
   size_t written = 0;
@@ -152,7 +162,9 @@ static int pfx_row_start(uint8_t *buf, size_t len, char operation,
   BGPVIEW_IO_SERIALIZE_VAL(buf, len, written, operation);
 
   // send the prefix
-  if ((s = bgpview_io_serialize_pfx(buf, (len - written), pfx)) == -1) {
+  if ((s = bgpview_io_serialize_pfx_row_start(buf, (len - written), row,
+                                              client->row_encoding, pfx)) ==
+      -1) {
     goto err;
   }
   written += s;
@@ -164,22 +176,6 @@ err:
   return -1;
 }
 
-static int pfx_row_end(uint8_t *buf, size_t len, uint16_t peer_cnt)
-{
-  size_t written = 0;
-  uint16_t u16;
-
-  /* send a magic peerid to indicate end of peers */
-  u16 = BGPVIEW_IO_END_OF_PEERS;
-  BGPVIEW_IO_SERIALIZE_VAL(buf, len, written, u16);
-
-  /* peer cnt for cross validation */
-  u16 = htons(peer_cnt);
-  BGPVIEW_IO_SERIALIZE_VAL(buf, len, written, u16);
-
-  return written;
-}
-
 /* returns 0 if they are the same */
 static int diff_cells(bgpview_iter_t *parent_view_it, bgpview_iter_t *itC)
 {
@@ -380,12 +376,12 @@ static int send_cells(bgpview_io_kafka_t *client, bgpview_iter_t *it,
   uint8_t upd_buf[BUFFER_LEN];
   uint8_t *upd_ptr = upd_buf;
   size_t upd_written = 0;
-  int upd_cells = 0;
+  bgpview_io_row_t upd_row;
 
   uint8_t rem_buf[BUFFER_LEN];
   uint8_t *rem_ptr = rem_buf;
   size_t rem_written = 0;
-  int rem_cells = 0;
+  bgpview_io_row_t rem_row;
 
   ssize_t s;
 
@@ -428,8 +424,9 @@ static int send_cells(bgpview_io_kafka_t *client, bgpview_iter_t *it,
       assert(rem_cell == 0);
       if (upd_written == 0) {
         /* start the row */
-        if ((s = pfx_row_start(upd_ptr, (BUFFER_LEN - upd_written), 'U',
-                               bgpview_iter_pfx_get_pfx(it))) == -1) {
+        if ((s = pfx_row_start(client, upd_ptr, (BUFFER_LEN - upd_written),
+                               &upd_row, 'U', bgpview_iter_pfx_get_pfx(it))) ==
+            -1) {
           goto err;
         }
         upd_written += s;
@@ -437,20 +434,19 @@ static int send_cells(bgpview_io_kafka_t *client, bgpview_iter_t *it,
       }
 
       /* add this cell */
-      if ((s = bgpview_io_serialize_pfx_peer(
-             upd_ptr, (BUFFER_LEN - upd_written), it, NULL, NULL, 0)) == -1) {
+      if ((s = bgpview_io_serialize_pfx_row_cell(
+             upd_ptr, (BUFFER_LEN - upd_written), &upd_row, peerid,
+             bgpview_iter_pfx_peer_get_as_path_store_path(it), 0)) == -1) {
         goto err;
       }
-      if (s > 0) {
-        upd_cells++;
-        upd_written += s;
-        upd_ptr += s;
-      }
+      upd_written += s;
+      upd_ptr += s;
     } else if (rem_cell == 1) {
       assert(upd_cell == 0);
       if (rem_written == 0) {
         /* start the row */
-        if ((s = pfx_row_start(rem_ptr, (BUFFER_LEN - rem_written), 'R',
+        if ((s = pfx_row_start(client, rem_ptr, (BUFFER_LEN - rem_written),
+                               &rem_row, 'R',
                                bgpview_iter_pfx_get_pfx(parent_view_it))) ==
             -1) {
           goto err;
@@ -460,16 +456,13 @@ static int send_cells(bgpview_io_kafka_t *client, bgpview_iter_t *it,
       }
 
       /* add this cell */
-      if ((s = bgpview_io_serialize_pfx_peer(
-             rem_ptr, (BUFFER_LEN - rem_written), parent_view_it, NULL, NULL,
+      if ((s = bgpview_io_serialize_pfx_row_cell(
+             rem_ptr, (BUFFER_LEN - rem_written), &rem_row, peerid, NULL,
              -1)) == -1) {
         goto err;
       }
-      if (s > 0) {
-        rem_cells++;
-        rem_written += s;
-        rem_ptr += s;
-      }
+      rem_written += s;
+      rem_ptr += s;
     }
   }
 
@@ -489,7 +482,8 @@ static int send_cells(bgpview_io_kafka_t *client, bgpview_iter_t *it,
 
       if (rem_written == 0) {
         /* start the row */
-        if ((s = pfx_row_start(rem_ptr, (BUFFER_LEN - rem_written), 'R',
+        if ((s = pfx_row_start(client, rem_ptr, (BUFFER_LEN - rem_written),
+                               &rem_row, 'R',
                                bgpview_iter_pfx_get_pfx(parent_view_it))) ==
             -1) {
           goto err;
@@ -499,23 +493,20 @@ static int send_cells(bgpview_io_kafka_t *client, bgpview_iter_t *it,
       }
 
       /* add this cell */
-      if ((s = bgpview_io_serialize_pfx_peer(
-             rem_ptr, (BUFFER_LEN - rem_written), parent_view_it, cb, cb_user,
+      if ((s = bgpview_io_serialize_pfx_row_cell(
+             rem_ptr, (BUFFER_LEN - rem_written), &rem_row, peerid, NULL,
              -1)) == -1) {
         goto err;
       }
-      if (s > 0) {
-        rem_cells++;
-        rem_written += s;
-        rem_ptr += s;
-      }
+      rem_written += s;
+      rem_ptr += s;
     }
   }
 
-  if (upd_cells > 0) {
+  if (upd_written > 0) {
     /* send the update row */
-    if ((s = pfx_row_end(upd_ptr, (BUFFER_LEN - upd_written), upd_cells)) ==
-        -1) {
+    if ((s = bgpview_io_serialize_pfx_row_end(
+           upd_ptr, (BUFFER_LEN - upd_written), &upd_row)) == -1) {
       goto err;
     }
     upd_written += s;
@@ -524,10 +515,10 @@ static int send_cells(bgpview_io_kafka_t *client, bgpview_iter_t *it,
              BGPVIEW_IO_KAFKA_PFXS_PARTITION_DEFAULT, upd_buf, upd_written);
   }
 
-  if (rem_cells > 0) {
+  if (rem_written > 0) {
     /* send the remove row */
-    if ((s = pfx_row_end(rem_ptr, (BUFFER_LEN - rem_written), rem_cells)) ==
-        -1) {
+    if ((s = bgpview_io_serialize_pfx_row_end(
+           rem_ptr, (BUFFER_LEN - rem_written), &rem_row)) == -1) {
       goto err;
     }
     rem_written += s;
@@ -536,8 +527,8 @@ static int send_cells(bgpview_io_kafka_t *client, bgpview_iter_t *it,
              BGPVIEW_IO_KAFKA_PFXS_PARTITION_DEFAULT, rem_buf, rem_written);
   }
 
-  STAT(changed_pfxs_cnt) += (upd_cells > 0 || rem_cells > 0);
-  STAT(pfx_cnt) += (upd_cells > 0) + (rem_cells > 0);
+  STAT(changed_pfxs_cnt) += (upd_written > 0 || rem_written > 0);
+  STAT(pfx_cnt) += (upd_written > 0) + (rem_written > 0);
   STAT(common_pfxs_cnt)++;
 
   return 0;
@@ -546,10 +537,141 @@ err:
   return -1;
 }
 
+/* state shared by the diff callbacks of send_pfxs */
+typedef struct diff_pfxs_state {
+  bgpview_io_kafka_t *client;
+  uint8_t *buf;
+  uint8_t *ptr;
+  size_t len;
+  size_t written;
+  bgpview_io_filter_cb_t *cb;
+  void *cb_user;
+} diff_pfxs_state_t;
+
+/* serialize an 'R' or 'U' row of a diff into the prefix buffer */
+static int diff_pfx_row(diff_pfxs_state_t *st, char operation,
+                        bgpview_iter_t *it)
+{
+  bgpview_io_kafka_t *client = st->client;
+  ssize_t s;
+
+  if ((s = pfx_row_serialize(client, st->ptr, st->len, operation, it, NULL,
+                             st->cb, st->cb_user)) < 0) {
+    goto err;
+  }
+
+  if (s > 0) {
+    if (operation == 'R') {
+      STAT(removed_pfxs_cnt)++;
+    } else {
+      STAT(added_pfxs_cnt)++;
+    }
+    STAT(pfx_cnt)++;
+    st->written += s;
+    st->ptr += s;
+    SEND_IF_FULL(BGPVIEW_IO_KAFKA_TOPIC_ID_PFXS,
+                 BGPVIEW_IO_KAFKA_PFXS_PARTITION_DEFAULT, st->buf, st->written,
+                 st->ptr, st->len);
+  }
+
+  return 0;
+
+err:
+  return -1;
+}
+
+static int diff_pfx_added(bgpview_iter_t *parent_view_it, bgpview_iter_t *it,
+                          void *user)
+{
+  diff_pfxs_state_t *st = user;
+
+  /* does the user want this prefix sent? */
+  if (st->cb(it, BGPVIEW_IO_FILTER_PFX, st->cb_user) == 0) {
+    return 0;
+  }
+  /* update row (current cb) */
+  return diff_pfx_row(st, 'U', it);
+}
+
+static int diff_pfx_removed(bgpview_iter_t *parent_view_it, bgpview_iter_t *it,
+                            void *user)
+{
+  diff_pfxs_state_t *st = user;
+
+  /* was this prefix actually sent? */
+  if (st->cb(parent_view_it, BGPVIEW_IO_FILTER_PFX, st->cb_user) == 0) {
+    return 0;
+  }
+  /* remove row (parent cb) */
+  return diff_pfx_row(st, 'R', parent_view_it);
+}
+
+static int diff_pfx_common(bgpview_iter_t *parent_view_it, bgpview_iter_t *it,
+                           void *user)
+{
+  diff_pfxs_state_t *st = user;
+
+  /* did we send this prefix last time? */
+  int parent_sent = st->cb(parent_view_it, BGPVIEW_IO_FILTER_PFX, st->cb_user);
+
+  /* does the user want this prefix sent? */
+  int send_this = st->cb(it, BGPVIEW_IO_FILTER_PFX, st->cb_user);
+
+  if (parent_sent && send_this) {
+    /* cellular diff */
+    return send_cells(st->client, it, parent_view_it, st->cb, st->cb_user);
+  } else if (parent_sent) {
+    return diff_pfx_row(st, 'R', parent_view_it);
+  } else if (send_this) {
+    return diff_pfx_row(st, 'U', it);
+  }
+
+  /* nothing to send */
+  return 0;
+}
+
+/* send the peer set dictionary of a sync frame as messages of 'D' rows, which
+   come before the prefix rows */
+static int send_peersets(bgpview_io_kafka_t *client,
+                         bgpview_io_peersets_t *sets)
+{
+  uint8_t buf[BUFFER_LEN];
+  uint8_t *ptr = buf;
+  size_t len = BUFFER_LEN;
+  size_t written = 0;
+  ssize_t s;
+
+  char type = 'D';
+  int id;
+
+  for (id = 0; id < bgpview_io_peersets_get_cnt(sets); id++) {
+    BGPVIEW_IO_SERIALIZE_VAL(ptr, len, written, type);
+    if ((s = bgpview_io_serialize_peerset(ptr, (len - written), sets, id)) ==
+        -1) {
+      goto err;
+    }
+    written += s;
+    ptr += s;
+    SEND_IF_FULL(BGPVIEW_IO_KAFKA_TOPIC_ID_PFXS,
+                 BGPVIEW_IO_KAFKA_PFXS_PARTITION_DEFAULT, buf, written, ptr,
+                 len);
+  }
+
+  /* the rows go in separate messages */
+  if (written > 0) {
+    SEND_MSG(BGPVIEW_IO_KAFKA_TOPIC_ID_PFXS,
+             BGPVIEW_IO_KAFKA_PFXS_PARTITION_DEFAULT, buf, written);
+  }
+
+  return 0;
+
+err:
+  return -1;
+}
+
 static int send_pfxs(bgpview_io_kafka_t *client, bgpview_io_kafka_md_t *meta,
                      bgpview_iter_t *it, bgpview_t *parent_view,
-                     bgpview_iter_t *parent_view_it, bgpview_io_filter_cb_t *cb,
-                     void *cb_user)
+                     bgpview_io_filter_cb_t *cb, void *cb_user)
 {
   /* serialization buffer and state */
   uint8_t buf[BUFFER_LEN];
@@ -559,6 +681,15 @@ static int send_pfxs(bgpview_io_kafka_t *client, bgpview_io_kafka_md_t *meta,
   size_t written = 0;
   ssize_t s = 0;
 
+  bgpview_io_peersets_t *sets = NULL;
+
+  diff_pfxs_state_t st;
+  bgpview_diff_cbs_t diff_cbs = {
+    .pfx_added = diff_pfx_added,
+    .pfx_removed = diff_pfx_removed,
+    .pfx_common = diff_pfx_common,
+  };
+
 again:
   /* find our current offset and update the metadata */
   if ((meta->pfxs_offset =
@@ -568,13 +699,35 @@ again:
     goto again;
   }
 
-  /* for each prefix in new view */
-  for (bgpview_iter_first_pfx(it, 0, BGPVIEW_FIELD_ACTIVE);
-       bgpview_iter_has_more_pfx(it); bgpview_iter_next_pfx(it)) {
-
-    /* if we are sending a sync frame, just send the row */
-    if (meta->type == 'S') {
-      if ((s = pfx_row_serialize(client, ptr, len, 'S', it, cb, cb_user)) < 0) {
+  if (meta->type == 'D') {
+    /* walk both views in prefix order, sending only the differences */
+    st.client = client;
+    st.buf = buf;
+    st.ptr = ptr;
+    st.len = len;
+    st.written = written;
+    st.cb = cb;
+    st.cb_user = cb_user;
+    if (bgpview_diff(parent_view, bgpview_iter_get_view(it), &diff_cbs, &st) !=
+        0) {
+      goto err;
+    }
+    ptr = st.ptr;
+    written = st.written;
+  } else {
+    /* we are sending a sync frame, just send the rows */
+    assert(meta->type == 'S');
+    if (client->row_encoding == BGPVIEW_IO_ROW_ENCODING_V3) {
+      if ((sets = bgpview_io_peersets_create()) == NULL ||
+          bgpview_io_peersets_build(sets, it, cb, cb_user) < 0 ||
+          send_peersets(client, sets) != 0) {
+        goto err;
+      }
+    }
+    for (bgpview_iter_first_pfx(it, 0, BGPVIEW_FIELD_ACTIVE);
+         bgpview_iter_has_more_pfx(it); bgpview_iter_next_pfx(it)) {
+      if ((s = pfx_row_serialize(client, ptr, len, 'S', it, sets, cb,
+                                 cb_user)) < 0) {
         goto err;
       }
       if (s > 0) {
@@ -587,94 +740,6 @@ again:
                      len);
         s = 0;
       }
-      continue;
-    }
-
-    /* we are sending a diff */
-    assert(meta->type == 'D');
-
-    bgpstream_pfx_t *pfx = bgpview_iter_pfx_get_pfx(it);
-    int parent_exists =
-      bgpview_iter_seek_pfx(parent_view_it, pfx, BGPVIEW_FIELD_ACTIVE);
-    /* did we send this prefix last time? */
-    int parent_exists_sent =
-      parent_exists && cb(parent_view_it, BGPVIEW_IO_FILTER_PFX, cb_user);
-
-    /* does the user want this prefix sent? */
-    int send_this = cb(it, BGPVIEW_IO_FILTER_PFX, cb_user);
-
-    if (parent_exists_sent && send_this) {
-      /* cellular diff */
-      if (send_cells(client, it, parent_view_it, cb, cb_user) != 0) {
-        goto err;
-      }
-    } else if (parent_exists_sent && !send_this) {
-      /* remove row (parent cb) */
-      if ((s = pfx_row_serialize(client, ptr, len, 'R', parent_view_it, cb,
-                                 cb_user)) < 0) {
-        goto err;
-      }
-
-      if (s > 0) {
-        STAT(removed_pfxs_cnt)++;
-      }
-    } else if (!parent_exists_sent && send_this) {
-      /* update row (current cb) */
-      if ((s = pfx_row_serialize(client, ptr, len, 'U', it, cb, cb_user)) < 0) {
-        goto err;
-      }
-
-      if (s > 0) {
-        STAT(added_pfxs_cnt)++;
-      }
-    } else {
-      /* nothing to send */
-      continue;
-    }
-
-    /* if one of the above cases serialized something, send the message now */
-    if (s > 0) {
-      written += s;
-      ptr += s;
-      SEND_IF_FULL(BGPVIEW_IO_KAFKA_TOPIC_ID_PFXS,
-                   BGPVIEW_IO_KAFKA_PFXS_PARTITION_DEFAULT, buf, written, ptr,
-                   len);
-      s = 0;
-      STAT(pfx_cnt)++;
-    }
-  }
-
-  /* if this is a diff, we need to send prefix-removal info */
-  if (meta->type == 'D') {
-    /* for each prefix in the parent view */
-    for (bgpview_iter_first_pfx(parent_view_it, 0, BGPVIEW_FIELD_ACTIVE);
-         bgpview_iter_has_more_pfx(parent_view_it);
-         bgpview_iter_next_pfx(parent_view_it)) {
-      /* was this prefix actually sent? */
-      if (cb(parent_view_it, BGPVIEW_IO_FILTER_PFX, cb_user) == 0) {
-        /* no need to do anything */
-        continue;
-      }
-
-      bgpstream_pfx_t *pfx = bgpview_iter_pfx_get_pfx(parent_view_it);
-      /* does this prefix exist in the new view? */
-      if (bgpview_iter_seek_pfx(it, pfx, BGPVIEW_FIELD_ACTIVE) != 1) {
-        /* does not exist, send a removal (parent iter) */
-        if ((s = pfx_row_serialize(client, ptr, len, 'R', parent_view_it, cb,
-                                   cb_user)) < 0) {
-          goto err;
-        }
-        if (s > 0) {
-          written += s;
-          ptr += s;
-          SEND_IF_FULL(BGPVIEW_IO_KAFKA_TOPIC_ID_PFXS,
-                       BGPVIEW_IO_KAFKA_PFXS_PARTITION_DEFAULT, buf, written,
-                       ptr, len);
-          s = 0;
-          STAT(removed_pfxs_cnt)++;
-          STAT(pfx_cnt)++;
-        }
-      }
     }
   }
 
@@ -697,9 +762,11 @@ again:
   SEND_MSG(BGPVIEW_IO_KAFKA_TOPIC_ID_PFXS,
            BGPVIEW_IO_KAFKA_PFXS_PARTITION_DEFAULT, buf, written);
 
+  bgpview_io_peersets_destroy(sets);
   return 0;
 
 err:
+  bgpview_io_peersets_destroy(sets);
   return -1;
 }
 
@@ -719,7 +786,7 @@ static int send_sync_view(bgpview_io_kafka_t *client, bgpview_t *view,
   if (send_peers(client, &meta, view, it, NULL, cb, cb_user) != 0) {
     goto err;
   }
-  if (send_pfxs(client, &meta, it, NULL, NULL, cb, cb_user) != 0) {
+  if (send_pfxs(client, &meta, it, NULL, cb, cb_user) != 0) {
     goto err;
   }
 
@@ -771,8 +838,7 @@ static int send_diff_view(bgpview_io_kafka_t *client, bgpview_t *view,
     goto err;
   }
 
-  if (send_pfxs(client, &meta, it, parent_view, parent_view_it, cb, cb_user) ==
-      -1) {
+  if (send_pfxs(client, &meta, it, parent_view, cb, cb_user) == -1) {
     goto err;
   }
 
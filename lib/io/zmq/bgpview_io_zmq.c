@@ -32,6 +32,10 @@
 #define BUFFER_LEN 16384
 #define BUFFER_1M 1048576
 
+/* first byte of the frames of the peer set dictionary, which are sent before
+   the prefix rows (that never start with this byte) */
+#define PEERSET_HDR 0x84
+
 #define ASSERT_MORE                                                            \
   if (zsocket_rcvmore(src) == 0) {                                             \
     fprintf(stderr, "ERROR: Malformed view message at line %d\n", __LINE__);   \
@@ -112,7 +116,7 @@ static int recv_ip(void *src, bgpstream_addr_t *ip)
 #endif
 
 static int send_pfxs(void *dest, bgpview_iter_t *it, bgpview_io_filter_cb_t *cb,
-                     void *cb_user)
+                     void *cb_user, bgpview_io_row_encoding_t encoding)
 {
   int filter;
 
@@ -127,6 +131,27 @@ static int send_pfxs(void *dest, bgpview_iter_t *it, bgpview_io_filter_cb_t *cb,
   /* the number of pfxs we actually sent */
   int pfx_cnt = 0;
 
+  bgpview_io_peersets_t *sets = NULL;
+  int id;
+
+  if (encoding == BGPVIEW_IO_ROW_ENCODING_V3) {
+    /* send the peer set dictionary, one set per frame */
+    if ((sets = bgpview_io_peersets_create()) == NULL ||
+        bgpview_io_peersets_build(sets, it, cb, cb_user) < 0) {
+      goto err;
+    }
+    buf[0] = PEERSET_HDR;
+    for (id = 0; id < bgpview_io_peersets_get_cnt(sets); id++) {
+      if ((s = bgpview_io_serialize_peerset(buf + 1, BUFFER_LEN - 1, sets,
+                                            id)) == -1) {
+        goto err;
+      }
+      if (zmq_send(dest, buf, s + 1, ZMQ_SNDMORE) != s + 1) {
+        goto err;
+      }
+    }
+  }
+
   for (bgpview_iter_first_pfx(it, 0, /* all pfx versions */
                               BGPVIEW_FIELD_ACTIVE);
        bgpview_iter_has_more_pfx(it); bgpview_iter_next_pfx(it)) {
@@ -147,8 +172,14 @@ static int send_pfxs(void *dest, bgpview_iter_t *it, bgpview_io_filter_cb_t *cb,
     s = 0;
 
     // serialize the pfx row using only path IDs
-    if ((s = bgpview_io_serialize_pfx_row(ptr, len, it, NULL, cb, cb_user,
-                                          1)) == -1) {
+    if (sets != NULL) {
+      s = bgpview_io_serialize_pfx_set_row(ptr, len, it, sets, NULL, cb,
+                                           cb_user, 1);
+    } else {
+      s = bgpview_io_serialize_pfx_row(ptr, len, it, NULL, cb, cb_user, 1,
+                                       encoding);
+    }
+    if (s == -1) {
       goto err;
     }
     if (s == 0) /* prefix has no peers so skip it */
@@ -176,9 +207,11 @@ static int send_pfxs(void *dest, bgpview_iter_t *it, bgpview_io_filter_cb_t *cb,
     goto err;
   }
 
+  bgpview_io_peersets_destroy(sets);
   return 0;
 
 err:
+  bgpview_io_peersets_destroy(sets);
   return -1;
 }
 
@@ -195,10 +228,15 @@ static int recv_pfxs(void *src, bgpview_iter_t *it,
   zmq_msg_t msg;
   uint8_t *buf;
   size_t len;
-  int read;
+
+  /* paths are sent as indexes unless there is no path map */
+  int use_pathid = pathid_map_cnt >= 0 ? 1 : 0;
 
   int pfx_rx = 0;
 
+  /* created when the first set of the dictionary is received */
+  bgpview_io_peersets_t *sets = NULL;
+
   ASSERT_MORE;
 
   /* foreach pfx, recv pfx.ip, pfx.len, [peers_cnt, peer_info] */
@@ -215,15 +253,40 @@ static int recv_pfxs(void *src, bgpview_iter_t *it,
       /* end of pfxs */
       break;
     }
+
+    if (buf[0] == PEERSET_HDR) {
+      /* the dictionary comes before all the rows */
+      if (pfx_rx != 0 ||
+          (sets == NULL && (sets = bgpview_io_peersets_create()) == NULL) ||
+          bgpview_io_deserialize_peerset(buf + 1, len - 1, sets, peerid_map,
+                                         peerid_map_cnt) != len - 1) {
+        fprintf(stderr, "ERROR: Malformed peer set received\n");
+        zmq_msg_close(&msg);
+        goto err;
+      }
+      zmq_msg_close(&msg);
+      continue;
+    }
     pfx_rx++;
 
-    if ((read = bgpview_io_deserialize_pfx_row(
-           buf, len, it, pfx_cb, pfx_peer_cb, peerid_map, peerid_map_cnt,
-           pathid_map, pathid_map_cnt, BGPVIEW_FIELD_ACTIVE)) == -1) {
+    /* each frame holds exactly one row, which is checked as a whole before
+       it is decoded straight out of the frame */
+    if (bgpview_io_validate_pfx_row(buf, len, use_pathid, sets,
+                                    (it != NULL) ? peerid_map_cnt : -1,
+                                    (it != NULL) ? pathid_map_cnt : -1) !=
+        len) {
+      fprintf(stderr, "ERROR: Malformed prefix row received\n");
+      zmq_msg_close(&msg);
+      goto err;
+    }
+
+    if (bgpview_io_deserialize_valid_pfx_row(
+          buf, len, it, pfx_cb, pfx_peer_cb, peerid_map, peerid_map_cnt,
+          pathid_map, pathid_map_cnt, sets, BGPVIEW_FIELD_ACTIVE) == -1) {
+      zmq_msg_close(&msg);
       goto err;
     }
 
-    assert(read == len);
     zmq_msg_close(&msg);
   }
 
@@ -235,9 +298,11 @@ static int recv_pfxs(void *src, bgpview_iter_t *it,
   assert(pfx_rx == pfx_cnt);
   ASSERT_MORE; /* there will be an empty frame for end-of-pfxs */
 
+  bgpview_io_peersets_destroy(sets);
   return 0;
 
 err:
+  bgpview_io_peersets_destroy(sets);
   return -1;
 }
 
@@ -638,7 +703,7 @@ bgpview_io_zmq_msg_type_t bgpview_io_zmq_recv_type(void *src, int flags)
 }
 
 int bgpview_io_zmq_send(void *dest, bgpview_t *view, bgpview_io_filter_cb_t *cb,
-                        void *cb_user)
+                        void *cb_user, bgpview_io_row_encoding_t encoding)
 {
   uint32_t u32;
 
@@ -666,7 +731,7 @@ int bgpview_io_zmq_send(void *dest, bgpview_t *view, bgpview_io_filter_cb_t *cb,
     goto err;
   }
 
-  if (send_pfxs(dest, it, cb, cb_user) != 0) {
+  if (send_pfxs(dest, it, cb, cb_user, encoding) != 0) {
     goto err;
   }
 
@@ -103,7 +103,10 @@ static void usage()
     "       -s <server-uri>       0MQ-style URI to connect to server on\n"
     "                               (default: %s)\n"
     "       -S <server-sub-uri>   0MQ-style URI to subscribe to tables on\n"
-    "                               (default: %s)\n",
+    "                               (default: %s)\n"
+    "       -e <encoding>         Encoding of the prefix rows sent to the "
+    "server\n"
+    "                               (1, 2 or 3, default: 1)\n",
     BGPVIEW_IO_ZMQ_HEARTBEAT_INTERVAL_DEFAULT,
     BGPVIEW_IO_ZMQ_HEARTBEAT_LIVENESS_DEFAULT,
     BGPVIEW_IO_ZMQ_RECONNECT_INTERVAL_MIN,
@@ -120,8 +123,25 @@ static int parse_args(bgpview_io_zmq_client_t *client, int argc, char **argv)
   optind = 1;
 
   /* remember the argv strings DO NOT belong to us */
-  while ((opt = getopt(argc, argv, ":i:l:n:r:R:s:S:?")) >= 0) {
+  while ((opt = getopt(argc, argv, ":e:i:l:n:r:R:s:S:?")) >= 0) {
     switch (opt) {
+    case 'e':
+      if (atoi(optarg) == 3) {
+        bgpview_io_zmq_client_set_row_encoding(client,
+                                               BGPVIEW_IO_ROW_ENCODING_V3);
+      } else if (atoi(optarg) == 2) {
+        bgpview_io_zmq_client_set_row_encoding(client,
+                                               BGPVIEW_IO_ROW_ENCODING_V2);
+      } else if (atoi(optarg) == 1) {
+        bgpview_io_zmq_client_set_row_encoding(client,
+                                               BGPVIEW_IO_ROW_ENCODING_V1);
+      } else {
+        fprintf(stderr, "ERROR: Invalid row encoding '%s'\n", optarg);
+        usage();
+        return -1;
+      }
+      break;
+
     case 'i':
       bgpview_io_zmq_client_set_heartbeat_interval(client, atoi(optarg));
       break;
@@ -177,6 +197,8 @@ bgpview_io_zmq_client_t *bgpview_io_zmq_client_init(uint8_t intents)
 
   BCFG.intents = intents;
 
+  client->row_encoding = BGPVIEW_IO_ROW_ENCODING_V1;
+
   /* init czmq */
   if ((BCFG.ctx = zctx_new()) == NULL) {
     fprintf(stderr, "Failed to create 0MQ context\n");
@@ -270,7 +292,8 @@ int bgpview_io_zmq_client_send_view(bgpview_io_zmq_client_t *client,
   }
 
   /* now just transmit the view */
-  if (bgpview_io_zmq_send(client->broker_zocket, view, cb, cb_user) != 0) {
+  if (bgpview_io_zmq_send(client->broker_zocket, view, cb, cb_user,
+                          client->row_encoding) != 0) {
     goto err;
   }
 
@@ -482,6 +505,14 @@ void bgpview_io_zmq_client_set_request_retries(bgpview_io_zmq_client_t *client,
   BCFG.request_retries = retry_cnt;
 }
 
+void bgpview_io_zmq_client_set_row_encoding(
+  bgpview_io_zmq_client_t *client, bgpview_io_row_encoding_t encoding)
+{
+  assert(client != NULL);
+
+  client->row_encoding = encoding;
+}
+
 int bgpview_io_zmq_client_set_identity(bgpview_io_zmq_client_t *client,
                                        const char *identity)
 {
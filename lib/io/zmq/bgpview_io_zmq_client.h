@@ -257,6 +257,20 @@ void bgpview_io_zmq_client_set_request_timeout(bgpview_io_zmq_client_t *client,
 void bgpview_io_zmq_client_set_request_retries(bgpview_io_zmq_client_t *client,
                                                int retry_cnt);
 
+/** Set the encoding of the prefix rows of the views sent to the server
+ *
+ * @param client        pointer to a client instance to update
+ * @param encoding      encoding to use
+ *
+ * With BGPVIEW_IO_ROW_ENCODING_V3, the peer set dictionary of each view is
+ * sent (one set per frame) before its prefix rows.
+ *
+ * @note defaults to BGPVIEW_IO_ROW_ENCODING_V1, which servers that predate
+ * the v2 encoding also decode
+ */
+void bgpview_io_zmq_client_set_row_encoding(
+  bgpview_io_zmq_client_t *client, bgpview_io_row_encoding_t encoding);
+
 /** Set the identity string for this client
  *
  * @param client        pointer to a bgpview client instance to update
@@ -71,6 +71,9 @@ struct bgpview_io_zmq_client {
   /** Next request sequence number to use */
   seq_num_t seq_num;
 
+  /** Encoding of the prefix rows of the views sent to the server */
+  bgpview_io_row_encoding_t row_encoding;
+
   /** Indicates that the client has been signaled to shutdown */
   int shutdown;
 };
@@ -120,10 +120,11 @@ bgpview_io_zmq_msg_type_t bgpview_io_zmq_recv_type(void *src, int flags);
  * @param dest          socket to send the view to
  * @param view          pointer to the view to send
  * @param cb            callback function to use to filter entries (may be NULL)
+ * @param encoding      encoding of the prefix rows
  * @return 0 if the view was sent successfully, -1 otherwise
  */
 int bgpview_io_zmq_send(void *dest, bgpview_t *view, bgpview_io_filter_cb_t *cb,
-                        void *cb_user);
+                        void *cb_user, bgpview_io_row_encoding_t encoding);
 
 /** Receive a view from the given socket
  *
@@ -815,6 +815,13 @@ void bgpview_io_zmq_server_set_window_len(bgpview_io_zmq_server_t *server,
   server->store_window_len = window_len;
 }
 
+void bgpview_io_zmq_server_set_huge_pages(bgpview_io_zmq_server_t *server,
+                                          int huge_pages)
+{
+  assert(server != NULL);
+  server->store_huge_pages = huge_pages;
+}
+
 int bgpview_io_zmq_server_set_client_uri(bgpview_io_zmq_server_t *server,
                                          const char *uri)
 {
@@ -879,8 +886,10 @@ int bgpview_io_zmq_server_publish_view(bgpview_io_zmq_server_t *server,
   }
 #endif
 
-  /* NULL -> no peer filtering */
-  if (bgpview_io_zmq_send(server->client_pub_socket, view, NULL, NULL) != 0) {
+  /* NULL -> no peer filtering. Subscribers may predate the v2 row encoding,
+     so views are published using v1 */
+  if (bgpview_io_zmq_send(server->client_pub_socket, view, NULL, NULL,
+                          BGPVIEW_IO_ROW_ENCODING_V1) != 0) {
     return -1;
   }
 
@@ -140,6 +140,16 @@ void bgpview_io_zmq_server_free(bgpview_io_zmq_server_t *server);
 void bgpview_io_zmq_server_set_window_len(bgpview_io_zmq_server_t *server,
                                           int window_len);
 
+/** Set whether the views of the store are backed by huge pages
+ *
+ * @param server        pointer to a bgpview server instance to configure
+ * @param huge_pages    1 to back the views with huge pages, 0 otherwise
+ *
+ * @note defaults to 0, see bgpview_enable_huge_pages
+ */
+void bgpview_io_zmq_server_set_huge_pages(bgpview_io_zmq_server_t *server,
+                                          int huge_pages);
+
 /** Set the URI for the server to listen for client connections on
  *
  * @param server        pointer to a bgpview server instance to update
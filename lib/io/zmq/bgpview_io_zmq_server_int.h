@@ -141,6 +141,9 @@ struct bgpview_io_zmq_server {
 
   /** The number of views in the store */
   int store_window_len;
+
+  /** Are the views in the store backed by huge pages? */
+  int store_huge_pages;
 };
 
 /** @} */
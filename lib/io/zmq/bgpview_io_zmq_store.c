@@ -49,6 +49,10 @@
             metric_prefix, __VA_ARGS__, value, time);                          \
   } while (0)
 
+#define DUMP_MEM_METRIC(field, mem)                                            \
+  DUMP_METRIC(store->server->metric_prefix, (mem).field, SVIEW_TIME(sview),    \
+              "views.%d.mem.%s", sview->id, #field);
+
 #define VIEW_GET_SVIEW(store, viewp)                                           \
   (store->sviews[(store->sviews_first_idx +                                    \
                   ((bgpview_get_time(viewp) - store->sviews_first_time) /      \
@@ -201,6 +205,11 @@ store_view_t *store_view_create(bgpview_io_zmq_store_t *store, int id)
   /* please oh please we don't want user pointers */
   bgpview_disable_user_data(sview->view);
 
+  if (store->server->store_huge_pages != 0 &&
+      bgpview_enable_huge_pages(sview->view) != 0) {
+    goto err;
+  }
+
   return sview;
 
 err:
@@ -303,6 +312,7 @@ static int dispatcher_run(bgpview_io_zmq_store_t *store, store_view_t *sview,
   int dispatch = 0; /* should we dispatch this view? */
   int i;
   int states_cnt[STORE_VIEW_STATE_MAX + 1];
+  bgpview_mem_stats_t mem;
 
   /* @todo this logic could be simplified now that we don't have interests
      anymore */
@@ -386,6 +396,9 @@ static int dispatcher_run(bgpview_io_zmq_store_t *store, store_view_t *sview,
               (uint64_t)bgpview_get_time_created(sview->view),
               SVIEW_TIME(sview), "views.%d.%s", sview->id, "time_created");
 
+  bgpview_get_mem_stats(sview->view, &mem);
+  BGPVIEW_MEM_STATS_FIELDS(DUMP_MEM_METRIC, mem)
+
   /* now publish the view */
   if (bgpview_io_zmq_server_publish_view(store->server, sview->view) != 0) {
     return -1;
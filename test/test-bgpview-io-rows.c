@@ -0,0 +1,246 @@
+/*
+ * Copyright (C) 2014 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bgpview.h"
+#include "bgpview_io.h"
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Checks that bgpview_io_validate_pfx_row rejects truncated rows and rows
+   that refer to peers or paths outside of the maps they would be decoded
+   with, and that such rows are never applied to a view */
+
+#define TEST_COLLECTOR "TEST-COLLECTOR"
+#define TEST_PEER_CNT 2
+
+/* peer IDs of the test view start at 1 */
+#define TEST_PEERID_MAP_CNT (TEST_PEER_CNT + 1)
+
+#define CHECK(msg, check)                                                      \
+  do {                                                                         \
+    if (!(check)) {                                                            \
+      fprintf(stderr, "FAIL: %s (line %d)\n", msg, __LINE__);                  \
+      return -1;                                                               \
+    }                                                                          \
+  } while (0)
+
+static bgpstream_pfx_t test_pfx;
+
+/* build a view with one prefix observed by every peer, each with its own
+   path */
+static int populate_view(bgpview_t *view)
+{
+  bgpview_iter_t *it = NULL;
+  bgpstream_ip_addr_t peer_ip;
+  bgpstream_as_path_t *path = NULL;
+  bgpstream_as_path_seg_asn_t segs[2];
+  bgpstream_peer_id_t peer_id;
+  int i;
+
+  if ((it = bgpview_iter_create(view)) == NULL ||
+      (path = bgpstream_as_path_create()) == NULL) {
+    goto err;
+  }
+
+  memset(&peer_ip, 0, sizeof(peer_ip));
+  peer_ip.version = BGPSTREAM_ADDR_VERSION_IPV4;
+
+  for (i = 0; i < TEST_PEER_CNT; i++) {
+    peer_ip.bs_ipv4.addr.s_addr = htonl(0xc0000201 + i); /* 192.0.2.x */
+    if ((peer_id = bgpview_iter_add_peer(it, TEST_COLLECTOR, &peer_ip,
+                                         65001 + i)) == 0 ||
+        bgpview_iter_activate_peer(it) != 1) {
+      goto err;
+    }
+
+    segs[0].type = BGPSTREAM_AS_PATH_SEG_ASN;
+    segs[0].asn = 65001 + i;
+    segs[1].type = BGPSTREAM_AS_PATH_SEG_ASN;
+    segs[1].asn = 65100 + i;
+    bgpstream_as_path_populate_from_data_zc(path, (uint8_t *)segs,
+                                            sizeof(segs));
+
+    if (bgpview_iter_add_pfx_peer(it, &test_pfx, peer_id, path) != 0 ||
+        bgpview_iter_pfx_activate_peer(it) != 1) {
+      goto err;
+    }
+  }
+
+  bgpstream_as_path_destroy(path);
+  bgpview_iter_destroy(it);
+  return 0;
+
+err:
+  fprintf(stderr, "ERROR: Could not populate the test view\n");
+  if (path != NULL) {
+    bgpstream_as_path_destroy(path);
+  }
+  bgpview_iter_destroy(it);
+  return -1;
+}
+
+/* get the number of elements a path ID map needs for the paths of the test
+   prefix */
+static int get_pathid_map_cnt(bgpview_iter_t *it)
+{
+  bgpstream_as_path_store_path_t *spath;
+  int cnt = 0;
+  int idx;
+
+  for (bgpview_iter_pfx_first_peer(it, BGPVIEW_FIELD_ACTIVE);
+       bgpview_iter_pfx_has_more_peer(it); bgpview_iter_pfx_next_peer(it)) {
+    spath = bgpview_iter_pfx_peer_get_as_path_store_path(it);
+    idx = bgpstream_as_path_store_path_get_idx(spath);
+    if (idx >= cnt) {
+      cnt = idx + 1;
+    }
+  }
+
+  return cnt;
+}
+
+static int test_row(bgpview_iter_t *it, bgpview_io_row_encoding_t encoding,
+                    int use_pathid)
+{
+  uint8_t buf[1024];
+  int len;
+  int cnt;
+  int pathid_map_cnt;
+  int i;
+
+  bgpview_t *dst = NULL;
+  bgpview_iter_t *dst_it = NULL;
+  bgpstream_peer_id_t peerid_map[TEST_PEERID_MAP_CNT];
+  int ret = -1;
+
+  CHECK("seek test prefix",
+        bgpview_iter_seek_pfx(it, &test_pfx, BGPVIEW_FIELD_ACTIVE) == 1);
+  pathid_map_cnt = get_pathid_map_cnt(it);
+  CHECK("test paths have distinct indexes", pathid_map_cnt >= TEST_PEER_CNT);
+
+  len = bgpview_io_serialize_pfx_row(buf, sizeof(buf), it, &cnt, NULL, NULL,
+                                     use_pathid, encoding);
+  CHECK("serialize row", len > 0 && cnt == TEST_PEER_CNT);
+
+  CHECK("complete row is valid",
+        bgpview_io_validate_pfx_row(buf, len, use_pathid, NULL,
+                                    TEST_PEERID_MAP_CNT,
+                                    pathid_map_cnt) == len);
+  CHECK("unchecked maps",
+        bgpview_io_validate_pfx_row(buf, len, use_pathid, NULL, -1, -1) ==
+          len);
+
+  /* truncated rows */
+  for (i = 0; i < len; i++) {
+    CHECK("truncated row is invalid",
+          bgpview_io_validate_pfx_row(buf, i, use_pathid, NULL,
+                                      TEST_PEERID_MAP_CNT,
+                                      pathid_map_cnt) == -1);
+  }
+
+  /* out-of-range peer IDs (the last peer is not in the map) */
+  CHECK("out-of-range peer ID is invalid",
+        bgpview_io_validate_pfx_row(buf, len, use_pathid, NULL,
+                                    TEST_PEERID_MAP_CNT - 1,
+                                    pathid_map_cnt) == -1);
+  CHECK("empty peer ID map",
+        bgpview_io_validate_pfx_row(buf, len, use_pathid, NULL, 0,
+                                    pathid_map_cnt) == -1);
+
+  if (use_pathid == 1) {
+    /* out-of-range path indexes (the last path is not in the map) */
+    CHECK("out-of-range path index is invalid",
+          bgpview_io_validate_pfx_row(buf, len, use_pathid, NULL,
+                                      TEST_PEERID_MAP_CNT,
+                                      pathid_map_cnt - 1) == -1);
+    CHECK("empty path ID map",
+          bgpview_io_validate_pfx_row(buf, len, use_pathid, NULL,
+                                      TEST_PEERID_MAP_CNT, 0) == -1);
+  } else {
+    /* rows with full paths (e.g. from Kafka) need no path ID map */
+    CHECK("full paths need no path ID map",
+          bgpview_io_validate_pfx_row(buf, len, use_pathid, NULL,
+                                      TEST_PEERID_MAP_CNT, 0) == len);
+  }
+
+  /* a row that fails the validation is not applied to the view */
+  if (use_pathid == 0) {
+    if ((dst = bgpview_create(NULL, NULL, NULL, NULL)) == NULL ||
+        (dst_it = bgpview_iter_create(dst)) == NULL) {
+      fprintf(stderr, "ERROR: Could not create the destination view\n");
+      goto done;
+    }
+    for (i = 0; i < TEST_PEERID_MAP_CNT; i++) {
+      peerid_map[i] = i;
+    }
+    if (bgpview_io_deserialize_pfx_row(
+          buf, len, dst_it, NULL, NULL, peerid_map, TEST_PEERID_MAP_CNT - 1,
+          NULL, -1, NULL, BGPVIEW_FIELD_ACTIVE) != -1 ||
+        bgpview_pfx_cnt(dst, BGPVIEW_FIELD_ALL_VALID) != 0) {
+      fprintf(stderr, "FAIL: invalid row was applied (line %d)\n", __LINE__);
+      goto done;
+    }
+  }
+
+  ret = 0;
+
+done:
+  bgpview_iter_destroy(dst_it);
+  bgpview_destroy(dst);
+  return ret;
+}
+
+int main(void)
+{
+  bgpview_t *view = NULL;
+  bgpview_iter_t *it = NULL;
+  int ret = -1;
+
+  memset(&test_pfx, 0, sizeof(test_pfx));
+  test_pfx.address.version = BGPSTREAM_ADDR_VERSION_IPV4;
+  test_pfx.address.bs_ipv4.addr.s_addr = htonl(0x0a000000); /* 10.0.0.0 */
+  test_pfx.mask_len = 24;
+
+  if ((view = bgpview_create(NULL, NULL, NULL, NULL)) == NULL ||
+      populate_view(view) != 0 || (it = bgpview_iter_create(view)) == NULL) {
+    goto done;
+  }
+
+  if (test_row(it, BGPVIEW_IO_ROW_ENCODING_V1, 1) != 0 ||
+      test_row(it, BGPVIEW_IO_ROW_ENCODING_V1, 0) != 0 ||
+      test_row(it, BGPVIEW_IO_ROW_ENCODING_V2, 1) != 0 ||
+      test_row(it, BGPVIEW_IO_ROW_ENCODING_V2, 0) != 0) {
+    goto done;
+  }
+
+  ret = 0;
+
+done:
+  bgpview_iter_destroy(it);
+  bgpview_destroy(view);
+  return (ret == 0) ? 0 : 1;
+}
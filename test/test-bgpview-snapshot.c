@@ -0,0 +1,320 @@
+/*
+ * Copyright (C) 2014 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bgpview.h"
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Checks that the snapshots of a view keep returning the cells the view had
+   when they were taken while the view is changed, cleared and garbage
+   collected, and that the prefixes a clear hands over to the snapshots are
+   only freed once the last of them is destroyed */
+
+#define TEST_COLLECTOR "TEST-COLLECTOR"
+#define TEST_PEER_CNT 2
+#define TEST_PFX_CNT 3
+#define TEST_CELLS_MAX 16
+
+#define CHECK(msg, check)                                                      \
+  do {                                                                         \
+    if (!(check)) {                                                            \
+      fprintf(stderr, "FAIL: %s (line %d)\n", msg, __LINE__);                  \
+      goto err;                                                                \
+    }                                                                          \
+  } while (0)
+
+typedef struct test_cell {
+  bgpstream_pfx_t pfx;
+  bgpstream_peer_id_t peer_id;
+  bgpstream_as_path_store_path_t *spath;
+} test_cell_t;
+
+static bgpstream_peer_id_t peer_ids[TEST_PEER_CNT];
+
+/* the i-th test prefix is 10.0.i.0/24 */
+static void build_pfx(bgpstream_pfx_t *pfx, int i)
+{
+  memset(pfx, 0, sizeof(*pfx));
+  pfx->address.version = BGPSTREAM_ADDR_VERSION_IPV4;
+  pfx->address.bs_ipv4.addr.s_addr = htonl(0x0a000000 + (i << 8));
+  pfx->mask_len = 24;
+}
+
+/* the path of a peer (variants give the peer other paths) */
+static void build_path(bgpstream_as_path_t *path,
+                       bgpstream_as_path_seg_asn_t *segs, int peer,
+                       int variant)
+{
+  segs[0].type = BGPSTREAM_AS_PATH_SEG_ASN;
+  segs[0].asn = 65001 + peer;
+  segs[1].type = BGPSTREAM_AS_PATH_SEG_ASN;
+  segs[1].asn = 65100 + (variant * 10) + peer;
+  bgpstream_as_path_populate_from_data_zc(
+    path, (uint8_t *)segs, sizeof(bgpstream_as_path_seg_asn_t) * 2);
+}
+
+/* add an active cell for the given prefix and peer */
+static int add_cell(bgpview_iter_t *it, int pfx_idx, int peer, int variant)
+{
+  bgpstream_as_path_t *path;
+  bgpstream_as_path_seg_asn_t segs[2];
+  bgpstream_pfx_t pfx;
+  int rc = -1;
+
+  if ((path = bgpstream_as_path_create()) == NULL) {
+    return -1;
+  }
+  build_pfx(&pfx, pfx_idx);
+  build_path(path, segs, peer, variant);
+  if (bgpview_iter_add_pfx_peer(it, &pfx, peer_ids[peer], path) == 0 &&
+      bgpview_iter_pfx_activate_peer(it) >= 0) {
+    rc = 0;
+  }
+  bgpstream_as_path_destroy(path);
+  return rc;
+}
+
+/* change the path of the cell the iterator points at */
+static int set_cell_path(bgpview_iter_t *it, int peer, int variant)
+{
+  bgpstream_as_path_t *path;
+  bgpstream_as_path_seg_asn_t segs[2];
+  int rc;
+
+  if ((path = bgpstream_as_path_create()) == NULL) {
+    return -1;
+  }
+  build_path(path, segs, peer, variant);
+  rc = bgpview_iter_pfx_peer_set_as_path(it, path);
+  bgpstream_as_path_destroy(path);
+  return rc;
+}
+
+/* add every peer, and a cell for each of them to every test prefix */
+static int populate_view(bgpview_t *view)
+{
+  bgpview_iter_t *it;
+  bgpstream_ip_addr_t peer_ip;
+  int peer, i;
+
+  if ((it = bgpview_iter_create(view)) == NULL) {
+    return -1;
+  }
+
+  memset(&peer_ip, 0, sizeof(peer_ip));
+  peer_ip.version = BGPSTREAM_ADDR_VERSION_IPV4;
+  for (peer = 0; peer < TEST_PEER_CNT; peer++) {
+    peer_ip.bs_ipv4.addr.s_addr = htonl(0xc0000201 + peer); /* 192.0.2.x */
+    if ((peer_ids[peer] = bgpview_iter_add_peer(it, TEST_COLLECTOR, &peer_ip,
+                                                65001 + peer)) == 0 ||
+        bgpview_iter_activate_peer(it) < 0) {
+      goto err;
+    }
+    for (i = 0; i < TEST_PFX_CNT; i++) {
+      if (add_cell(it, i, peer, 0) != 0) {
+        goto err;
+      }
+    }
+  }
+
+  bgpview_iter_destroy(it);
+  return 0;
+
+err:
+  fprintf(stderr, "ERROR: Could not populate the test view\n");
+  bgpview_iter_destroy(it);
+  return -1;
+}
+
+/* get the active cells of a view (or snapshot) */
+static int collect_cells(bgpview_t *view, test_cell_t *cells)
+{
+  bgpview_iter_t *it;
+  int cnt = 0;
+
+  if ((it = bgpview_iter_create(view)) == NULL) {
+    return -1;
+  }
+
+  for (bgpview_iter_first_pfx(it, 0, BGPVIEW_FIELD_ACTIVE);
+       bgpview_iter_has_more_pfx(it); bgpview_iter_next_pfx(it)) {
+    for (bgpview_iter_pfx_first_peer(it, BGPVIEW_FIELD_ACTIVE);
+         bgpview_iter_pfx_has_more_peer(it); bgpview_iter_pfx_next_peer(it)) {
+      if (cnt == TEST_CELLS_MAX) {
+        bgpview_iter_destroy(it);
+        return -1;
+      }
+      bgpstream_pfx_copy(&cells[cnt].pfx, bgpview_iter_pfx_get_pfx(it));
+      cells[cnt].peer_id = bgpview_iter_peer_get_peer_id(it);
+      cells[cnt].spath = bgpview_iter_pfx_peer_get_as_path_store_path(it);
+      cnt++;
+    }
+  }
+
+  bgpview_iter_destroy(it);
+  return cnt;
+}
+
+/* check that a view (or snapshot) has exactly the given cells (in any
+   order) */
+static int has_cells(bgpview_t *view, test_cell_t *exp, int exp_cnt)
+{
+  test_cell_t cells[TEST_CELLS_MAX];
+  int cnt;
+  int i, j;
+
+  if ((cnt = collect_cells(view, cells)) != exp_cnt) {
+    return 0;
+  }
+  for (i = 0; i < cnt; i++) {
+    for (j = 0; j < exp_cnt; j++) {
+      if (bgpstream_pfx_equal(&cells[i].pfx, &exp[j].pfx) &&
+          cells[i].peer_id == exp[j].peer_id &&
+          cells[i].spath == exp[j].spath) {
+        break;
+      }
+    }
+    if (j == exp_cnt) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static uint64_t get_pfx_infos_mem(bgpview_t *view)
+{
+  bgpview_mem_stats_t stats;
+
+  bgpview_get_mem_stats(view, &stats);
+  return stats.pfx_infos;
+}
+
+static int test_layout(bgpview_cell_layout_t layout)
+{
+  bgpview_t *view = NULL;
+  bgpview_t *snap1 = NULL;
+  bgpview_t *snap2 = NULL;
+  bgpview_iter_t *it = NULL;
+  test_cell_t orig[TEST_CELLS_MAX];
+  int orig_cnt;
+  bgpstream_pfx_t pfx;
+  uint64_t retired_mem;
+
+  if ((view = bgpview_create(NULL, NULL, NULL, NULL)) == NULL) {
+    goto err;
+  }
+  bgpview_set_cell_layout(view, layout);
+
+  CHECK("populate view", populate_view(view) == 0);
+  orig_cnt = collect_cells(view, orig);
+  CHECK("view has every cell", orig_cnt == TEST_PEER_CNT * TEST_PFX_CNT);
+
+  CHECK("create snapshots", (snap1 = bgpview_snapshot_create(view)) != NULL &&
+                              (snap2 = bgpview_snapshot_create(view)) != NULL);
+  CHECK("snapshot has the cells of the view",
+        has_cells(snap1, orig, orig_cnt) && has_cells(snap2, orig, orig_cnt));
+
+  /* change the path of a cell, remove another one and add a prefix */
+  CHECK("create iterator", (it = bgpview_iter_create(view)) != NULL);
+  build_pfx(&pfx, 0);
+  CHECK("change path", bgpview_iter_seek_pfx_peer(it, &pfx, peer_ids[0],
+                                                  BGPVIEW_FIELD_ACTIVE,
+                                                  BGPVIEW_FIELD_ACTIVE) == 1 &&
+                         set_cell_path(it, 0, 1) == 0);
+  build_pfx(&pfx, 1);
+  CHECK("remove cell", bgpview_iter_seek_pfx_peer(it, &pfx, peer_ids[1],
+                                                  BGPVIEW_FIELD_ACTIVE,
+                                                  BGPVIEW_FIELD_ACTIVE) == 1 &&
+                         bgpview_iter_pfx_remove_peer(it) == 0);
+  CHECK("add prefix", add_cell(it, TEST_PFX_CNT, 0, 0) == 0);
+  bgpview_iter_destroy(it);
+  it = NULL;
+  CHECK("view changed", !has_cells(view, orig, orig_cnt));
+  CHECK("snapshot kept the changed cells",
+        has_cells(snap1, orig, orig_cnt) && has_cells(snap2, orig, orig_cnt));
+
+  /* the cleared (and collected) prefixes are handed over to the snapshots */
+  bgpview_clear(view);
+  CHECK("view is empty", bgpview_pfx_cnt(view, BGPVIEW_FIELD_ALL_VALID) == 0);
+  CHECK("snapshot kept the cleared cells",
+        has_cells(snap1, orig, orig_cnt) && has_cells(snap2, orig, orig_cnt));
+  bgpview_gc(view);
+  CHECK("snapshot kept the collected cells",
+        has_cells(snap1, orig, orig_cnt) && has_cells(snap2, orig, orig_cnt));
+  retired_mem = get_pfx_infos_mem(view);
+  CHECK("retired prefixes are kept", retired_mem > 0);
+
+  /* and only freed once the last snapshot is gone */
+  bgpview_destroy(snap1);
+  snap1 = NULL;
+  CHECK("snapshot outlives another one", has_cells(snap2, orig, orig_cnt));
+  CHECK("retired prefixes are kept for the last snapshot",
+        get_pfx_infos_mem(view) == retired_mem);
+  bgpview_destroy(snap2);
+  snap2 = NULL;
+  CHECK("retired prefixes are freed with the last snapshot",
+        get_pfx_infos_mem(view) == 0);
+
+  /* with the sorted layout, a clear releases all prefixes at once, unless a
+     snapshot still shares them */
+  CHECK("repopulate view", populate_view(view) == 0);
+  orig_cnt = collect_cells(view, orig);
+  CHECK("view has every cell again",
+        orig_cnt == TEST_PEER_CNT * TEST_PFX_CNT);
+  CHECK("create snapshot", (snap1 = bgpview_snapshot_create(view)) != NULL);
+  bgpview_clear(view);
+  CHECK("snapshot survives a clear", has_cells(snap1, orig, orig_cnt));
+  bgpview_destroy(snap1);
+  snap1 = NULL;
+
+  CHECK("repopulate view", populate_view(view) == 0);
+  bgpview_clear(view);
+  CHECK("view is empty", bgpview_pfx_cnt(view, BGPVIEW_FIELD_ALL_VALID) == 0);
+  if (layout == BGPVIEW_CELL_LAYOUT_SORTED) {
+    CHECK("prefixes are released by the clear",
+          get_pfx_infos_mem(view) == 0);
+  }
+
+  bgpview_destroy(view);
+  return 0;
+
+err:
+  bgpview_iter_destroy(it);
+  bgpview_destroy(snap1);
+  bgpview_destroy(snap2);
+  bgpview_destroy(view);
+  return -1;
+}
+
+int main(void)
+{
+  if (test_layout(BGPVIEW_CELL_LAYOUT_HASH) != 0 ||
+      test_layout(BGPVIEW_CELL_LAYOUT_SORTED) != 0) {
+    return 1;
+  }
+  return 0;
+}
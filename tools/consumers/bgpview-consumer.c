@@ -44,8 +44,10 @@
 #include "bgpview_io.h"
 #include "bgpview_consumer_manager.h"
 #include "config.h"
+#include "parse_cmd.h"
 #include "utils.h"
 #include <assert.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -88,7 +90,13 @@ static int pfx_peer_filters_cnt = 0;
 static bgpview_t *view = NULL;
 
 #ifdef WITH_BGPVIEW_IO_FILE
-static io_t *file_handle = NULL;
+static bgpview_io_file_reader_t *file_reader = NULL;
+static bgpview_io_file_image_t *image_handle = NULL;
+/* only views in [file_start, file_end] are read from the file */
+static uint32_t file_start = 0;
+static uint32_t file_end = UINT32_MAX;
+/* set once no more views of the file are in range */
+static int file_done = 0;
 #endif
 #ifdef WITH_BGPVIEW_IO_KAFKA
 static bgpview_io_kafka_t *kafka_client = NULL;
@@ -356,7 +364,8 @@ static void usage(const char *name)
           "       -i\"<module> <opts>\"     IO module to use for obtaining views.\n"
           "                               Available modules:\n");
 #ifdef WITH_BGPVIEW_IO_FILE
-  fprintf(stderr, "                                - file\n");
+  fprintf(stderr, "                                - file "
+                  "([-s <time>] [-e <time>] <filename>)\n");
 #endif
 #ifdef WITH_BGPVIEW_IO_TEST
   fprintf(stderr, "                                - test\n");
@@ -379,7 +388,10 @@ static void usage(const char *name)
   fprintf(stderr,
           "       -m <prefix>           Metric prefix (default: %s)\n"
           "       -N <num-views>        Maximum number of views to process\n"
-          "                               (default: infinite)\n",
+          "                               (default: infinite)\n"
+          "       -H                    Back the view with huge pages (falls\n"
+          "                               back to normal pages if none are\n"
+          "                               available)\n",
           BGPVIEW_METRIC_PREFIX_DEFAULT);
 
   /* Consumers config */
@@ -393,6 +405,163 @@ static void usage(const char *name)
   filter_usage();
 }
 
+#ifdef WITH_BGPVIEW_IO_FILE
+static void file_usage(void)
+{
+  fprintf(stderr,
+          "file IO module options: [-s <time>] [-e <time>] <filename>\n"
+          "       -s <time>     read views at or after the given time\n"
+          "       -e <time>     read views at or before the given time\n"
+          "                       files with an index (written by the archiver"
+          " with -i)\n"
+          "                       are not read up to the start time\n");
+}
+
+/* move to the first view at or after the start time, if the file is indexed
+   (other files are simply read from their start) */
+static int seek_file(const char *filename)
+{
+  char idxfile_name[1024];
+  io_t *idxfile = NULL;
+  int ret;
+
+  snprintf(idxfile_name, sizeof(idxfile_name), "%s%s", filename,
+           BGPVIEW_IO_FILE_INDEX_SUFFIX);
+  if (access(idxfile_name, R_OK) != 0) {
+    return 1;
+  }
+
+  if ((idxfile = wandio_create(idxfile_name)) == NULL) {
+    fprintf(stderr, "ERROR: Could not open index file '%s'\n", idxfile_name);
+    return -1;
+  }
+  ret = bgpview_io_file_reader_seek(file_reader, idxfile, file_start);
+  wandio_destroy(idxfile);
+
+  return ret;
+}
+
+static int configure_file(const char *io_options)
+{
+#define MAXOPTS 1024
+  char *local_args = NULL;
+  char *process_argv[MAXOPTS];
+  int process_argc = 0;
+  char *filename;
+  int opt, prevoptind;
+  int ret;
+
+  if (io_options == NULL || strlen(io_options) == 0) {
+    fprintf(stderr,
+            "ERROR: filename must be provided when using the file module\n");
+    goto err;
+  }
+
+  /* parse the option string ready for getopt */
+  if ((local_args = strdup(io_options)) == NULL) {
+    goto err;
+  }
+  parse_cmd(local_args, &process_argc, process_argv, MAXOPTS, "file");
+
+  /* NB: remember to reset optind to 1 before using getopt! */
+  optind = 1;
+  while (prevoptind = optind,
+         (opt = getopt(process_argc, process_argv, ":s:e:?")) >= 0) {
+    if (optind == prevoptind + 2 && *optarg == '-') {
+      opt = ':';
+      --optind;
+    }
+    switch (opt) {
+    case 's':
+      file_start = strtoul(optarg, NULL, 10);
+      break;
+
+    case 'e':
+      file_end = strtoul(optarg, NULL, 10);
+      break;
+
+    case ':':
+      fprintf(stderr, "ERROR: Missing option argument for -%c\n", optopt);
+      file_usage();
+      goto err;
+
+    case '?':
+    default:
+      file_usage();
+      goto err;
+    }
+  }
+  if (optind != process_argc - 1) {
+    fprintf(stderr,
+            "ERROR: filename must be provided when using the file module\n");
+    file_usage();
+    goto err;
+  }
+  filename = process_argv[optind];
+
+  /* files of frozen view images are mapped rather than read */
+  if (strcmp(filename, "-") != 0 &&
+      bgpview_io_file_image_check(filename) != 0) {
+    if ((image_handle = bgpview_io_file_image_open(filename)) == NULL) {
+      fprintf(stderr, "ERROR: Could not open BGPView image file '%s'\n",
+              filename);
+      goto err;
+    }
+  } else {
+    if ((file_reader = bgpview_io_file_reader_open(filename)) == NULL) {
+      fprintf(stderr, "ERROR: Could not open BGPView file '%s'\n", filename);
+      goto err;
+    }
+    if (file_start > 0 && strcmp(filename, "-") != 0) {
+      if ((ret = seek_file(filename)) < 0) {
+        goto err;
+      }
+      /* no view of the file is in the range */
+      file_done = (ret == 0);
+    }
+  }
+
+  free(local_args);
+  return 0;
+
+err:
+  free(local_args);
+  return -1;
+}
+
+/* read the next view of the file that is in range, returns 0 if a view was
+   read, -1 otherwise (like the other IO modules) */
+static int recv_file_view(void)
+{
+  int ret;
+
+  while (file_done == 0) {
+    bgpview_clear(view);
+    if (image_handle != NULL) {
+      ret = bgpview_io_file_image_read_view(
+        image_handle, view, (peer_filters_cnt != 0) ? filter_peer : NULL,
+        (pfx_filters_cnt != 0) ? filter_pfx : NULL,
+        (pfx_peer_filters_cnt != 0) ? filter_pfx_peer : NULL);
+    } else {
+      ret = bgpview_io_file_reader_read(
+        file_reader, view, (peer_filters_cnt != 0) ? filter_peer : NULL,
+        (pfx_filters_cnt != 0) ? filter_pfx : NULL,
+        (pfx_peer_filters_cnt != 0) ? filter_pfx_peer : NULL);
+    }
+    if (ret <= 0 || bgpview_get_time(view) > file_end) {
+      /* views are in time order, so the rest of the file is out of range */
+      file_done = 1;
+      break;
+    }
+    if (bgpview_get_time(view) >= file_start) {
+      return 0;
+    }
+  }
+
+  return -1;
+}
+#endif
+
 static int configure_io(char *io_module)
 {
   char *io_options = NULL;
@@ -413,13 +582,7 @@ static int configure_io(char *io_module)
   }
 #ifdef WITH_BGPVIEW_IO_FILE
   else if (strcmp(io_module, "file") == 0) {
-    if (io_options == NULL || strlen(io_options) == 0) {
-      fprintf(stderr,
-              "ERROR: filename must be provided when using the file module\n");
-      goto err;
-    }
-    if ((file_handle = wandio_create(io_options)) == NULL) {
-      fprintf(stderr, "ERROR: Could not open BGPView file '%s'\n", io_options);
+    if (configure_file(io_options) != 0) {
       goto err;
     }
   }
@@ -487,9 +650,11 @@ err:
 static void shutdown_io(void)
 {
 #ifdef WITH_BGPVIEW_IO_FILE
-  if (file_handle != NULL) {
-    wandio_destroy(file_handle);
-    file_handle = NULL;
+  bgpview_io_file_reader_destroy(file_reader);
+  file_reader = NULL;
+  if (image_handle != NULL) {
+    bgpview_io_file_image_close(image_handle);
+    image_handle = NULL;
   }
 #endif
 #ifdef WITH_BGPVIEW_IO_KAFKA
@@ -525,11 +690,7 @@ static int recv_view(char *io_module)
   }
 #ifdef WITH_BGPVIEW_IO_FILE
   else if (strcmp(io_module, "file") == 0) {
-    bgpview_clear(view);
-    return bgpview_io_file_read(
-      file_handle, view, (peer_filters_cnt != 0) ? filter_peer : NULL,
-      (pfx_filters_cnt != 0) ? filter_pfx : NULL,
-      (pfx_peer_filters_cnt != 0) ? filter_pfx_peer : NULL);
+    return recv_file_view();
   }
 #endif
 #ifdef WITH_BGPVIEW_IO_KAFKA
@@ -586,6 +747,7 @@ int main(int argc, char **argv)
   int processed_view_limit = -1;
   int processed_view = 0;
   int view_is_borrowed = 0;
+  int huge_pages = 0;
 
   char *io_module = NULL;
 
@@ -606,7 +768,7 @@ int main(int argc, char **argv)
   }
 
   while (prevoptind = optind,
-         (opt = getopt(argc, argv, "f:i:m:N:b:c:v?")) >= 0) {
+         (opt = getopt(argc, argv, "f:i:m:N:b:c:Hv?")) >= 0) {
     if (optind == prevoptind + 2 && (optarg && *optarg == '-')) {
       fprintf(stderr, "ERROR: argument for %s looks like an option "
           "(remove the space after %s to force the argument)\n",
@@ -637,6 +799,10 @@ int main(int argc, char **argv)
       processed_view_limit = atoi(optarg);
       break;
 
+    case 'H':
+      huge_pages = 1;
+      break;
+
     case 'b':
       backends[backends_cnt++] = optarg;
       break;
@@ -744,6 +910,10 @@ int main(int argc, char **argv)
       // TODO: convert -f options to bgpstream_add_filter(bsrt->stream, ...)
       goto err;
     }
+    if (huge_pages != 0) {
+      fprintf(stderr, "WARN: -H option is not supported by the bsrt io "
+          "module\n");
+    }
   }
 #endif
   else {
@@ -754,6 +924,11 @@ int main(int argc, char **argv)
     }
     /* disable per-pfx-per-peer user pointer */
     bgpview_disable_user_data(view);
+    /* use compact sorted arrays for pfx-peer cells */
+    bgpview_set_cell_layout(view, BGPVIEW_CELL_LAYOUT_SORTED);
+    if (huge_pages != 0 && bgpview_enable_huge_pages(view) != 0) {
+      goto err;
+    }
   }
 
   while (recv_view(io_module) == 0) {
@@ -762,6 +937,9 @@ int main(int argc, char **argv)
               bgpview_get_time(view));
       goto err;
     }
+    /* start recording the changes for the next view (if the view has a
+       journal) */
+    bgpview_journal_checkpoint(view);
 
     processed_view++;
 
@@ -75,7 +75,9 @@ static void usage(const char *name)
     "       -l <beats>         Number of heartbeats that can go by before \n"
     "                          a client is declared dead (default: %d)\n"
     "       -w <window-len>    Number of views in the window (default: %d)\n"
-    "       -m <prefix>        Metric prefix (default: %s)\n",
+    "       -m <prefix>        Metric prefix (default: %s)\n"
+    "       -H                 Back the views with huge pages (falls back\n"
+    "                          to normal pages if none are available)\n",
     name, BGPVIEW_IO_ZMQ_CLIENT_URI_DEFAULT,
     BGPVIEW_IO_ZMQ_CLIENT_PUB_URI_DEFAULT,
     BGPVIEW_IO_ZMQ_HEARTBEAT_INTERVAL_DEFAULT,
@@ -101,10 +103,12 @@ int main(int argc, char **argv)
 
   int window_len = BGPVIEW_IO_ZMQ_SERVER_WINDOW_LEN;
 
+  int huge_pages = 0;
+
   signal(SIGINT, catch_sigint);
 
   while (prevoptind = optind,
-         (opt = getopt(argc, argv, ":c:C:i:l:w:m:v?")) >= 0) {
+         (opt = getopt(argc, argv, ":c:C:i:l:w:m:Hv?")) >= 0) {
     if (optind == prevoptind + 2 && *optarg == '-') {
       opt = ':';
       --optind;
@@ -140,6 +144,10 @@ int main(int argc, char **argv)
       strcpy(metric_prefix, optarg);
       break;
 
+    case 'H':
+      huge_pages = 1;
+      break;
+
     case '?':
     case 'v':
       fprintf(stderr, "bgpview version %d.%d.%d\n", BGPVIEW_MAJOR_VERSION,
@@ -179,6 +187,8 @@ int main(int argc, char **argv)
 
   bgpview_io_zmq_server_set_window_len(server, window_len);
 
+  bgpview_io_zmq_server_set_huge_pages(server, huge_pages);
+
   /* do work */
   /* this function will block until the server shuts down */
   bgpview_io_zmq_server_start(server);
@@ -28,23 +28,126 @@
 #include "bgpview_io_file.h"
 #include "config.h"
 #include "utils.h"
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include <wandio.h>
 
 static bgpview_t *view = NULL;
 static iow_t *wstdout = NULL;
 
+/* only views in [start, end] are output */
+static uint32_t start = 0;
+static uint32_t end = UINT32_MAX;
+
+static void usage(const char *name)
+{
+  fprintf(stderr,
+          "usage: %s [<options>] [<file> ...]\n"
+          "       -s <time>     output views at or after the given time\n"
+          "       -e <time>     output views at or before the given time\n"
+          "                       files with an index (written by the archiver"
+          " with -i)\n"
+          "                       are not read up to the start time\n",
+          name);
+}
+
+/* move to the first view at or after the start time, if the file is indexed
+   (other files are simply read from their start) */
+static int seek_file(bgpview_io_file_reader_t *reader, const char *file)
+{
+  char idxfile_name[1024];
+  io_t *idxfile = NULL;
+  int ret;
+
+  snprintf(idxfile_name, sizeof(idxfile_name), "%s%s", file,
+           BGPVIEW_IO_FILE_INDEX_SUFFIX);
+  if (access(idxfile_name, R_OK) != 0) {
+    return 1;
+  }
+
+  if ((idxfile = wandio_create(idxfile_name)) == NULL) {
+    return -1;
+  }
+  ret = bgpview_io_file_reader_seek(reader, idxfile, start);
+  wandio_destroy(idxfile);
+
+  return ret;
+}
+
+/* frozen view images are mapped rather than read */
+static int cat_image(const char *file)
+{
+  bgpview_io_file_image_t *image = NULL;
+  bgpview_frozen_t *frozen = NULL;
+  int ret;
+
+  if ((image = bgpview_io_file_image_open(file)) == NULL) {
+    goto err;
+  }
+
+  while ((ret = bgpview_io_file_image_read(image, &frozen)) > 0) {
+    if (bgpview_frozen_get_time(frozen) > end) {
+      bgpview_frozen_destroy(frozen);
+      break;
+    }
+    ret = 0;
+    if (bgpview_frozen_get_time(frozen) >= start) {
+      ret = bgpview_io_file_image_print(wstdout, frozen);
+    }
+    bgpview_frozen_destroy(frozen);
+    if (ret != 0) {
+      goto err;
+    }
+  }
+
+  if (ret < 0) {
+    goto err;
+  }
+
+  bgpview_io_file_image_close(image);
+  return 0;
+
+err:
+  bgpview_io_file_image_close(image);
+  return -1;
+}
+
 static int cat_file(const char *file)
 {
-  io_t *infile = NULL;
+  bgpview_io_file_reader_t *reader = NULL;
   int ret;
 
-  if ((infile = wandio_create(file)) == NULL) {
+  if (strcmp(file, "-") != 0 && bgpview_io_file_image_check(file) != 0) {
+    return cat_image(file);
+  }
+
+  if ((reader = bgpview_io_file_reader_open(file)) == NULL) {
     goto err;
   }
 
-  while ((ret = bgpview_io_file_read(infile, view, NULL, NULL, NULL)) > 0) {
-    if (bgpview_io_file_print(wstdout, view) != 0) {
+  if (start > 0 && strcmp(file, "-") != 0) {
+    if ((ret = seek_file(reader, file)) < 0) {
+      goto err;
+    }
+    if (ret == 0) {
+      /* no view of the file is in the range */
+      bgpview_io_file_reader_destroy(reader);
+      return 0;
+    }
+  }
+
+  while ((ret = bgpview_io_file_reader_read(reader, view, NULL, NULL, NULL)) >
+         0) {
+    if (bgpview_get_time(view) > end) {
+      /* views are in time order, so the rest of the file is out of range */
+      bgpview_clear(view);
+      break;
+    }
+    if (bgpview_get_time(view) >= start &&
+        bgpview_io_file_print(wstdout, view) != 0) {
       goto err;
     }
     bgpview_clear(view);
@@ -54,22 +157,37 @@ static int cat_file(const char *file)
     goto err;
   }
 
-  if (infile != NULL) {
-    wandio_destroy(infile);
-  }
+  bgpview_io_file_reader_destroy(reader);
   return 0;
 
 err:
-  if (infile != NULL) {
-    wandio_destroy(infile);
-  }
+  bgpview_io_file_reader_destroy(reader);
   return -1;
 }
 
 int main(int argc, char **argv)
 {
+  int opt;
   int i;
 
+  while ((opt = getopt(argc, argv, ":e:s:?")) >= 0) {
+    switch (opt) {
+    case 'e':
+      end = strtoul(optarg, NULL, 10);
+      break;
+
+    case 's':
+      start = strtoul(optarg, NULL, 10);
+      break;
+
+    case '?':
+    case ':':
+    default:
+      usage(argv[0]);
+      return -1;
+    }
+  }
+
   if ((view = bgpview_create(NULL, NULL, NULL, NULL)) == NULL) {
     goto err;
   }
@@ -78,12 +196,12 @@ int main(int argc, char **argv)
     goto err;
   }
 
-  if (argc == 1) {
+  if (optind == argc) {
     if (cat_file("-") != 0) {
       goto err;
     }
   } else {
-    for (i = 1; i < argc; i++) {
+    for (i = optind; i < argc; i++) {
       if (cat_file(argv[i]) != 0) {
         goto err;
       }